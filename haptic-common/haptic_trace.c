@@ -0,0 +1,169 @@
+#include "haptic_trace.h"
+
+#include <stdbool.h>
+#include "freertos/FreeRTOS.h"
+#include "esp_cpu.h"
+#include "esp_timer.h"
+#include "haptic_protocol.h"
+
+#if CONFIG_HAPTIC_TRACE
+
+#define TRACE_DEPTH         CONFIG_HAPTIC_TRACE_DEPTH
+#define TRACE_MASK          (TRACE_DEPTH - 1)
+// Cycles between SYNC events; well inside the 32-bit counter, so the signed
+// difference to the last SYNC is always exact
+#define TRACE_SYNC_CYCLES   (1u << 30)
+
+_Static_assert((TRACE_DEPTH & TRACE_MASK) == 0, "CONFIG_HAPTIC_TRACE_DEPTH must be a power of two");
+
+/*
+ * Slots are reserved with an atomic increment of `head`, so tasks that
+ * preempt each other (or a task that migrated) never share a slot. A slot's
+ * `seq` is cleared while it is written and then set to its position + 1;
+ * the dump only takes slots whose `seq` matches before and after copying.
+ */
+typedef struct {
+    uint32_t seq;
+    haptic_trace_event_t event;
+} trace_slot_t;
+
+typedef struct {
+    uint32_t head;                  // slots reserved, atomic
+    uint32_t tail;                  // next slot to dump, dump side only
+    uint32_t lost;                  // overwritten before they were dumped, dump side only
+    uint32_t sync_cycles;           // cycle count of the last SYNC
+    bool synced;
+    trace_slot_t slots[TRACE_DEPTH];
+} trace_ring_t;
+
+static trace_ring_t s_rings[portNUM_PROCESSORS];
+static uint16_t s_tag;
+
+static void ring_put(trace_ring_t *ring, uint32_t cycles, uint8_t stage, uint16_t tag, uint8_t index, uint32_t arg)
+{
+    uint32_t pos = __atomic_fetch_add(&ring->head, 1, __ATOMIC_RELAXED);
+    trace_slot_t *slot = &ring->slots[pos & TRACE_MASK];
+
+    __atomic_store_n(&slot->seq, 0, __ATOMIC_RELAXED);
+    __atomic_thread_fence(__ATOMIC_RELEASE);
+    slot->event.cycles = cycles;
+    slot->event.arg = arg;
+    slot->event.tag = tag;
+    slot->event.index = index;
+    slot->event.stage = stage;
+    __atomic_store_n(&slot->seq, pos + 1, __ATOMIC_RELEASE);
+}
+
+void haptic_trace(haptic_trace_stage_t stage, uint16_t tag, uint8_t index, uint32_t arg)
+{
+    int core;
+    uint32_t cycles;
+
+    // the cycle count must come from the core whose ring gets the event
+    do {
+        core = esp_cpu_get_core_id();
+        cycles = esp_cpu_get_cycle_count();
+    } while (core != esp_cpu_get_core_id());
+
+    trace_ring_t *ring = &s_rings[core];
+    if (!ring->synced || cycles - ring->sync_cycles >= TRACE_SYNC_CYCLES) {
+        ring->synced = true;
+        ring->sync_cycles = cycles;
+        ring_put(ring, cycles, HAPTIC_TRACE_SYNC, 0, HAPTIC_TRACE_PACKET, (uint32_t)esp_timer_get_time());
+    }
+    ring_put(ring, cycles, stage, tag, index, arg);
+}
+
+uint16_t haptic_trace_tag(void)
+{
+    uint16_t tag;
+
+    do {
+        tag = __atomic_add_fetch(&s_tag, 1, __ATOMIC_RELAXED);
+    } while (tag == 0);
+    return tag;
+}
+
+// Copy up to `max` pending events of `ring`; stops at a slot still being written
+static size_t ring_take(trace_ring_t *ring, haptic_trace_event_t *out, size_t max)
+{
+    uint32_t head = __atomic_load_n(&ring->head, __ATOMIC_ACQUIRE);
+    size_t count = 0;
+
+    if (head - ring->tail > TRACE_DEPTH) {
+        ring->lost += head - ring->tail - TRACE_DEPTH;
+        ring->tail = head - TRACE_DEPTH;
+    }
+    while (count < max && ring->tail != head) {
+        trace_slot_t *slot = &ring->slots[ring->tail & TRACE_MASK];
+        uint32_t seq = __atomic_load_n(&slot->seq, __ATOMIC_ACQUIRE);
+
+        if (seq == 0 || (int32_t)(seq - 1 - ring->tail) < 0) {
+            // reserved but not written yet; take it with the next dump
+            break;
+        }
+        haptic_trace_event_t event = slot->event;
+        __atomic_thread_fence(__ATOMIC_ACQUIRE);
+        if (seq - 1 != ring->tail || __atomic_load_n(&slot->seq, __ATOMIC_RELAXED) != seq) {
+            // overwritten by a newer event while we were behind
+            ring->lost++;
+        } else {
+            out[count++] = event;
+        }
+        ring->tail++;
+    }
+    return count;
+}
+
+#endif
+
+size_t haptic_trace_dump(uint8_t *buf, uint8_t seq, size_t max_payload, size_t *events)
+{
+    uint8_t header[HP_TRACE_HEADER_SIZE] = {
+        [4] = (uint8_t)(CONFIG_ESP_DEFAULT_CPU_FREQ_MHZ & 0xFF),
+        [5] = (uint8_t)(CONFIG_ESP_DEFAULT_CPU_FREQ_MHZ >> 8),
+    };
+    size_t count = 0;
+
+    if (max_payload > HP_MAX_PAYLOAD) {
+        max_payload = HP_MAX_PAYLOAD;
+    }
+    hp_packet_begin(buf, HP_PKT_TRACE, seq, 0);
+
+#if CONFIG_HAPTIC_TRACE
+    haptic_trace_event_t taken[(HP_MAX_PAYLOAD - HP_TRACE_HEADER_SIZE) / HP_TRACE_EVENT_SIZE];
+    size_t max = (max_payload - HP_TRACE_HEADER_SIZE) / HP_TRACE_EVENT_SIZE;
+
+    for (int core = 0; core < portNUM_PROCESSORS && count == 0; core++) {
+        trace_ring_t *ring = &s_rings[core];
+        uint32_t lost;
+
+        count = ring_take(ring, taken, max);
+        lost = ring->lost > 0xFFFF ? 0xFFFF : ring->lost;
+        if (count == 0) {
+            continue;
+        }
+        ring->lost -= lost;
+        header[0] = (uint8_t)core;
+        header[2] = (uint8_t)(lost & 0xFF);
+        header[3] = (uint8_t)(lost >> 8);
+    }
+    header[1] = (uint8_t)count;
+    hp_packet_append(buf, header, sizeof(header), max_payload);
+
+    for (size_t i = 0; i < count; i++) {
+        const haptic_trace_event_t *e = &taken[i];
+        const uint8_t raw[HP_TRACE_EVENT_SIZE] = {
+            (uint8_t)e->cycles, (uint8_t)(e->cycles >> 8), (uint8_t)(e->cycles >> 16), (uint8_t)(e->cycles >> 24),
+            (uint8_t)e->arg, (uint8_t)(e->arg >> 8), (uint8_t)(e->arg >> 16), (uint8_t)(e->arg >> 24),
+            (uint8_t)e->tag, (uint8_t)(e->tag >> 8), e->index, e->stage,
+        };
+        hp_packet_append(buf, raw, sizeof(raw), max_payload);
+    }
+#else
+    hp_packet_append(buf, header, sizeof(header), max_payload);
+#endif
+
+    *events = count;
+    return hp_packet_end(buf);
+}
@@ -0,0 +1,155 @@
+#pragma once
+
+#include <stdbool.h>
+#include <stdint.h>
+#include "freertos/FreeRTOS.h"
+#include "freertos/task.h"
+#include "esp_attr.h"
+#include "esp_err.h"
+#include "esp_timer.h"
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+/* -------------------------------------------------------------------------- */
+/*  Scheduled playback alarm                                                  */
+/*                                                                            */
+/*  Wakes the player task at an absolute esp_timer time. esp_timer alarms     */
+/*  come from the SYSTIMER hardware comparator, the same clock the host       */
+/*  synchronises to (haptic_protocol.h, TIME packets); with ISR dispatch      */
+/*  enabled the callback notifies the task straight from the interrupt.       */
+/*                                                                            */
+/*  Every cancel starts a new generation. Work stamped with the generation    */
+/*  current when it was queued is cancelled by a later cancel even if the     */
+/*  task had already taken it but not started waiting yet.                    */
+/* -------------------------------------------------------------------------- */
+
+#define HAPTIC_ALARM_BIT_FIRE    0x01
+#define HAPTIC_ALARM_BIT_CANCEL  0x02
+
+typedef enum {
+    HAPTIC_ALARM_FIRED     = 0,     ///< Woken at the target time
+    HAPTIC_ALARM_LATE      = 1,     ///< Target time had already passed
+    HAPTIC_ALARM_CANCELLED = 2,     ///< ::haptic_alarm_cancel was called while waiting, or since the expected generation
+} haptic_alarm_result_t;
+
+/**
+ * @brief Alarm owned by one waiting task.
+ */
+typedef struct {
+    esp_timer_handle_t timer;
+    TaskHandle_t task;              /*!< Task notified by the alarm */
+    volatile uint32_t generation;   /*!< Bumped by every cancel, never 0 */
+    uint32_t expected;              /*!< Generation the waits belong to, 0 = any */
+} haptic_alarm_t;
+
+static void IRAM_ATTR haptic_alarm_cb(void *arg)
+{
+    haptic_alarm_t *alarm = (haptic_alarm_t *)arg;
+#if CONFIG_ESP_TIMER_SUPPORTS_ISR_DISPATCH_METHOD
+    BaseType_t woken = pdFALSE;
+    xTaskNotifyFromISR(alarm->task, HAPTIC_ALARM_BIT_FIRE, eSetBits, &woken);
+    portYIELD_FROM_ISR(woken);
+#else
+    xTaskNotify(alarm->task, HAPTIC_ALARM_BIT_FIRE, eSetBits);
+#endif
+}
+
+/**
+ * @brief Create the alarm for the calling task.
+ */
+static inline esp_err_t haptic_alarm_init(haptic_alarm_t *alarm)
+{
+    const esp_timer_create_args_t timer_args = {
+        .callback = haptic_alarm_cb,
+        .arg = alarm,
+#if CONFIG_ESP_TIMER_SUPPORTS_ISR_DISPATCH_METHOD
+        .dispatch_method = ESP_TIMER_ISR,
+#else
+        .dispatch_method = ESP_TIMER_TASK,
+#endif
+        .name = "haptic_alarm",
+    };
+
+    alarm->task = xTaskGetCurrentTaskHandle();
+    alarm->generation = 1;
+    alarm->expected = 0;
+    return esp_timer_create(&timer_args, &alarm->timer);
+}
+
+/**
+ * @brief Current generation, to stamp work queued for the owning task with.
+ */
+static inline uint32_t haptic_alarm_generation(const haptic_alarm_t *alarm)
+{
+    return __atomic_load_n(&alarm->generation, __ATOMIC_ACQUIRE);
+}
+
+/**
+ * @brief Tie the following waits to work stamped with @p generation; 0 ties
+ *        them to nothing, so only a cancel during the wait aborts it.
+ */
+static inline void haptic_alarm_expect(haptic_alarm_t *alarm, uint32_t generation)
+{
+    alarm->expected = generation;
+}
+
+/**
+ * @brief Whether the expected generation has been cancelled.
+ */
+static inline bool haptic_alarm_stale(const haptic_alarm_t *alarm)
+{
+    return alarm->expected && alarm->expected != haptic_alarm_generation(alarm);
+}
+
+/**
+ * @brief Block the owning task until @p at_us (esp_timer_get_time() time).
+ */
+static inline haptic_alarm_result_t haptic_alarm_wait_until(haptic_alarm_t *alarm, int64_t at_us)
+{
+    int64_t delay;
+    uint32_t bits = 0;
+
+    // drop a cancel that arrived while nothing was waiting; one meant for the
+    // expected work has bumped the generation before notifying
+    xTaskNotifyWait(0, HAPTIC_ALARM_BIT_FIRE | HAPTIC_ALARM_BIT_CANCEL, NULL, 0);
+    if (haptic_alarm_stale(alarm)) {
+        return HAPTIC_ALARM_CANCELLED;
+    }
+    delay = at_us - esp_timer_get_time();
+    if (delay <= 0) {
+        return HAPTIC_ALARM_LATE;
+    }
+
+    esp_timer_start_once(alarm->timer, (uint64_t)delay);
+    while (!(bits & (HAPTIC_ALARM_BIT_FIRE | HAPTIC_ALARM_BIT_CANCEL))) {
+        uint32_t received = 0;
+        xTaskNotifyWait(0, HAPTIC_ALARM_BIT_FIRE | HAPTIC_ALARM_BIT_CANCEL, &received, portMAX_DELAY);
+        bits |= received;
+    }
+
+    if (!(bits & HAPTIC_ALARM_BIT_FIRE)) {
+        esp_timer_stop(alarm->timer);
+        return HAPTIC_ALARM_CANCELLED;
+    }
+    return HAPTIC_ALARM_FIRED;
+}
+
+/**
+ * @brief Abort a wait in progress and the waits of all work stamped so far,
+ *        from any task.
+ */
+static inline void haptic_alarm_cancel(haptic_alarm_t *alarm)
+{
+    if (__atomic_add_fetch(&alarm->generation, 1, __ATOMIC_RELEASE) == 0) {
+        __atomic_add_fetch(&alarm->generation, 1, __ATOMIC_RELEASE);
+    }
+    if (alarm->timer) {
+        xTaskNotify(alarm->task, HAPTIC_ALARM_BIT_CANCEL, eSetBits);
+    }
+}
+
+#ifdef __cplusplus
+}
+#endif
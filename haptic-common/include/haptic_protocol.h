@@ -0,0 +1,834 @@
+#pragma once
+
+#include <stdbool.h>
+#include <stddef.h>
+#include <stdint.h>
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+/* -------------------------------------------------------------------------- */
+/*  Haptic command protocol, version 1                                        */
+/*                                                                            */
+/*  Shared by the speaker (I2S) and LRA (DRV2605) firmware. The plugin        */
+/*  codec in haptic-mouse-plugin/protocol.js mirrors this header.             */
+/*                                                                            */
+/*  Packet layout, all multi-byte fields little endian:                       */
+/*                                                                            */
+/*  | byte    | field                                            |           */
+/*  |---------|--------------------------------------------------|           */
+/*  | 0       | magic (HP_MAGIC)                                 |           */
+/*  | 1       | protocol version (HP_VERSION)                    |           */
+/*  | 2       | packet type (::hp_packet_type_t)                 |           */
+/*  | 3       | sequence number, echoed in replies               |           */
+/*  | 4       | payload length in bytes                          |           */
+/*  | 5       | packet flags (HP_PKT_FLAG_*)                     |           */
+/*  | 6 ...   | payload                                          |           */
+/*  | last 2  | CRC-16/CCITT-FALSE over header and payload       |           */
+/*                                                                            */
+/*  A COMMANDS payload is a batch of 8-byte records:                          */
+/*                                                                            */
+/*  | byte | field                                               |           */
+/*  |------|-----------------------------------------------------|           */
+/*  | 0    | op (::hp_op_t)                                      |           */
+/*  | 1    | record flags (HP_REC_FLAG_*)                        |           */
+/*  | 2    | effect ID (DRV2605 library effect or clip ID)       |           */
+/*  | 3    | intensity, 0 – 255                                  |           */
+/*  | 4    | actuator index, HP_ACTUATOR_ALL for every actuator  |           */
+/*  | 5    | reserved, 0                                         |           */
+/*  | 6-7  | argument (pattern period in ms)                     |           */
+/*                                                                            */
+/*  Records of one packet are executed in order.                              */
+/*                                                                            */
+/*  Scheduled playback: with HP_PKT_FLAG_AT the payload starts with a 4-byte  */
+/*  target time, the low 32 bits of the device's esp_timer clock in µs, and   */
+/*  the records follow. PLAY and PATTERN_START records fire at that time from */
+/*  a hardware timer; other records run on arrival. The host maps its clock   */
+/*  to the device clock from TIME exchanges (offset and drift) and schedules  */
+/*  a fixed lead ahead, trading that delay for a constant one.                */
+/*                                                                            */
+/*  Tracing: TRACE packets drain the device's stage-timestamp ring            */
+/*  (haptic_trace.h). The payload is a HP_TRACE_HEADER_SIZE header (core,     */
+/*  event count, events lost, CPU MHz) followed by HP_TRACE_EVENT_SIZE        */
+/*  events; a packet without events means the ring is drained.                */
+/*                                                                            */
+/*  Clip upload (speaker, HP_CAP_UPLOAD): UPLOAD_BEGIN names the clip, its    */
+/*  size and CRC-32; the file follows in HP_UPLOAD_CHUNK_SIZE chunks, each    */
+/*  sent as UPLOAD_DATA packets and closed by UPLOAD_CHUNK with the chunk's   */
+/*  CRC-32. The device answers each step with UPLOAD_STATUS; a rejected       */
+/*  chunk is resent from the offset it reports. Up to two chunks may be       */
+/*  unacknowledged. The clip replaces the old one only after the last chunk   */
+/*  is on flash and the whole file checks out.                                */
+/*                                                                            */
+/*  Transports:                                                               */
+/*   - USB HID (LRA): one packet per output report HP_HID_REPORT_ID;          */
+/*     GET_REPORT(feature, HP_HID_CAPS_REPORT_ID) returns a CAPS packet,      */
+/*     GET_REPORT(feature, HP_HID_TIME_REPORT_ID) a TIME packet,              */
+/*     GET_REPORT(feature, HP_HID_TRACE_REPORT_ID) the next TRACE packet and  */
+/*     GET_REPORT(feature, HP_HID_EFFECTS_REPORT_ID) the next EFFECTS packet. */
+/*   - USB serial (speaker): packets back to back in the byte stream; the     */
+/*     device answers CAPS_QUERY with CAPS, TIME_QUERY with TIME, TRACE_QUERY */
+/*     with TRACE packets up to the empty one and, when HP_PKT_FLAG_ACK is    */
+/*     set or the packet is rejected, with a STATUS packet.                   */
+/*   - hapticd (host daemon, haptic-daemon/): clients send bare records, one  */
+/*     or more per WebSocket message or Unix-socket datagram, and receive     */
+/*     the device's CAPS and EFFECTS packets on connect. The daemon batches   */
+/*     and schedules the records and forwards them as COMMANDS packets.       */
+/* -------------------------------------------------------------------------- */
+
+#define HP_MAGIC        0xA5
+#define HP_VERSION      1
+
+#define HP_HEADER_SIZE  6
+#define HP_RECORD_SIZE  8
+#define HP_CRC_SIZE     2
+#define HP_MAX_PAYLOAD  248     ///< 31 records; the length field is one byte
+#define HP_MAX_PACKET   (HP_HEADER_SIZE + HP_MAX_PAYLOAD + HP_CRC_SIZE)
+
+#define HP_HID_REPORT_ID       0x20    ///< HID output report carrying one packet
+#define HP_HID_CAPS_REPORT_ID  0x21    ///< HID feature report returning a CAPS packet
+#define HP_HID_TIME_REPORT_ID  0x22    ///< HID feature report returning a TIME packet
+#define HP_HID_TRACE_REPORT_ID 0x23    ///< HID feature report returning the next TRACE packet
+#define HP_HID_EFFECTS_REPORT_ID 0x24  ///< HID feature report returning the next EFFECTS packet
+#define HP_HID_REPORT_SIZE     63      ///< Payload of every report (64-byte endpoint minus report ID)
+#define HP_HID_MAX_RECORDS     ((HP_HID_REPORT_SIZE - HP_HEADER_SIZE - HP_CRC_SIZE) / HP_RECORD_SIZE)
+
+#define HP_PACKET_SIZE(payload_len)  (HP_HEADER_SIZE + (payload_len) + HP_CRC_SIZE)
+
+typedef enum {
+    HP_PKT_COMMANDS      = 0x01,   ///< Host → device: batch of command records
+    HP_PKT_CAPS_QUERY    = 0x02,   ///< Host → device: request a CAPS packet
+    HP_PKT_CAPS          = 0x03,   ///< Device → host: ::hp_caps_t
+    HP_PKT_STATUS        = 0x04,   ///< Device → host: ::hp_status_report_t
+    HP_PKT_TIME_QUERY    = 0x05,   ///< Host → device: request a TIME packet
+    HP_PKT_TIME          = 0x06,   ///< Device → host: ::hp_time_t
+    HP_PKT_TRACE_QUERY   = 0x07,   ///< Host → device: drain the trace ring
+    HP_PKT_TRACE         = 0x08,   ///< Device → host: trace events of one core
+    HP_PKT_UPLOAD_BEGIN  = 0x09,   ///< Host → device: ::hp_upload_begin_t
+    HP_PKT_UPLOAD_DATA   = 0x0A,   ///< Host → device: offset (u32) and file bytes
+    HP_PKT_UPLOAD_CHUNK  = 0x0B,   ///< Host → device: chunk offset (u32) and CRC-32 (u32)
+    HP_PKT_UPLOAD_STATUS = 0x0C,   ///< Device → host: ::hp_upload_status_t
+    HP_PKT_EFFECTS       = 0x0D,   ///< Device → host: part of the effect catalog (::hp_effect_info_t)
+} hp_packet_type_t;
+
+#define HP_PKT_FLAG_ACK  0x01   ///< Answer with a STATUS packet (serial transport)
+#define HP_PKT_FLAG_AT   0x02   ///< Payload starts with a target time (HP_AT_SIZE bytes)
+
+#define HP_AT_SIZE                4
+#define HP_SCHEDULE_MAX_AHEAD_US  1000000   ///< Targets further ahead are treated as stale and run at once
+
+typedef enum {
+    HP_OP_NOP            = 0x00,
+    HP_OP_PLAY           = 0x01,   ///< Play an effect once
+    HP_OP_STOP           = 0x02,   ///< Stop playback and drop queued effects
+    HP_OP_PATTERN_START  = 0x03,   ///< Repeat an effect every `arg` ms
+    HP_OP_PATTERN_UPDATE = 0x04,   ///< Change period (`arg`, 0 = keep) and intensity
+    HP_OP_PATTERN_STOP   = 0x05,   ///< Stop the repeating effect
+} hp_op_t;
+
+#define HP_REC_FLAG_QUEUE  0x01    ///< PLAY after the current effect ends instead of interrupting it
+#define HP_REC_FLAG_RHYTHMIC 0x80  ///< hapticd link only: schedule at a constant lead on the device clock
+
+#define HP_ACTUATOR_ALL    0xFF
+
+typedef enum {
+    HP_STATUS_OK          = 0x00,
+    HP_STATUS_BAD_CRC     = 0x01,
+    HP_STATUS_BAD_VERSION = 0x02,
+    HP_STATUS_BAD_LENGTH  = 0x03,
+    HP_STATUS_BAD_TYPE    = 0x04,
+    HP_STATUS_UNSUPPORTED = 0x05,   ///< Some records used an op or actuator the device lacks
+    HP_STATUS_BUSY        = 0x06,   ///< Some records were dropped because the queue was full
+    HP_STATUS_STORAGE     = 0x07,   ///< Flash write or file system error
+    HP_STATUS_BAD_CLIP    = 0x08,   ///< Uploaded file fails its CRC-32 or is not a playable clip
+} hp_status_t;
+
+typedef enum {
+    HP_DEVICE_SPEAKER = 0x01,       ///< Effects are audio clips played over I2S
+    HP_DEVICE_LRA     = 0x02,       ///< Effects are DRV2605 library waveforms
+} hp_device_kind_t;
+
+/* Capability bits */
+#define HP_CAP_INTENSITY  0x0001    ///< Intensity is honoured
+#define HP_CAP_PATTERN    0x0002    ///< PATTERN_* ops are supported
+#define HP_CAP_QUEUE      0x0004    ///< HP_REC_FLAG_QUEUE is supported
+#define HP_CAP_ACK        0x0008    ///< HP_PKT_FLAG_ACK is answered
+#define HP_CAP_SCHEDULE   0x0010    ///< HP_PKT_FLAG_AT and TIME queries are supported
+#define HP_CAP_UPLOAD     0x0020    ///< UPLOAD_* packets replace clips at run time
+
+/**
+ * @brief Decoded header of a validated packet.
+ */
+typedef struct {
+    uint8_t type;                   /*!< ::hp_packet_type_t */
+    uint8_t seq;                    /*!< Sequence number */
+    uint8_t flags;                  /*!< HP_PKT_FLAG_* */
+    uint8_t payload_len;            /*!< Payload length in bytes */
+    const uint8_t *payload;         /*!< Points into the parsed buffer */
+} hp_packet_t;
+
+/**
+ * @brief One command record.
+ */
+typedef struct {
+    uint8_t op;                     /*!< ::hp_op_t */
+    uint8_t flags;                  /*!< HP_REC_FLAG_* */
+    uint8_t effect;                 /*!< Effect or clip ID */
+    uint8_t intensity;              /*!< 0 – 255 */
+    uint8_t actuator;               /*!< Actuator index or HP_ACTUATOR_ALL */
+    uint16_t arg;                   /*!< Op specific argument */
+} hp_record_t;
+
+/**
+ * @brief Device capabilities, payload of a CAPS packet (12 bytes).
+ */
+typedef struct {
+    uint8_t version_min;            /*!< Oldest protocol version understood */
+    uint8_t version_max;            /*!< Newest protocol version understood */
+    uint8_t device_kind;            /*!< ::hp_device_kind_t */
+    uint8_t actuator_count;         /*!< Number of actuators */
+    uint8_t max_records;            /*!< Records per packet on this transport (one less with HP_PKT_FLAG_AT on serial) */
+    uint8_t schedule_lead_ms;       /*!< Shortest lead between arrival and target time that is met */
+    uint16_t effect_count;          /*!< Valid effect IDs are 1 .. effect_count - 1 */
+    uint16_t features;              /*!< HP_CAP_* */
+    uint16_t min_period_ms;         /*!< Shortest pattern period */
+} hp_caps_t;
+
+#define HP_CAPS_SIZE 12
+
+/**
+ * @brief Payload of a STATUS packet (4 bytes).
+ */
+typedef struct {
+    uint8_t status;                 /*!< ::hp_status_t */
+    uint8_t accepted;               /*!< Records executed */
+    uint8_t rejected;               /*!< Records skipped */
+} hp_status_report_t;
+
+#define HP_STATUS_SIZE 4
+
+/**
+ * @brief Payload of a TIME packet (12 bytes).
+ *
+ * The counters let the host widen its scheduling lead when targets are
+ * missed.
+ */
+typedef struct {
+    uint64_t device_us;             /*!< esp_timer_get_time() when the query was served */
+    uint16_t scheduled;             /*!< Scheduled records executed (wraps) */
+    uint16_t late;                  /*!< ... of which arrived or became ready after their target (wraps) */
+} hp_time_t;
+
+#define HP_TIME_SIZE 12
+
+/*
+ * TRACE payload header: core (u8), event count (u8), events lost since the
+ * previous TRACE packet of that core (u16), CPU clock in MHz (u16), reserved
+ * (u8 x 2). Each event: cycle count (u32), argument (u32), tag (u16), record
+ * index (u8), stage (u8); see haptic_trace.h.
+ */
+#define HP_TRACE_HEADER_SIZE 8
+#define HP_TRACE_EVENT_SIZE  12
+
+#define HP_UPLOAD_CHUNK_SIZE  4096                      ///< Bytes per CRC-checked chunk (the last may be shorter)
+#define HP_UPLOAD_DATA_MAX    (HP_MAX_PAYLOAD - 4)      ///< File bytes per UPLOAD_DATA packet
+#define HP_UPLOAD_WINDOW      2                         ///< Chunks the host may send ahead of the acknowledgements
+
+/**
+ * @brief Payload of an UPLOAD_BEGIN packet (12 bytes).
+ *
+ * CRC-32 is the IEEE 802.3 / zlib one.
+ */
+typedef struct {
+    uint8_t clip;                   /*!< Clip ID, replaces /littlefs/<clip>.wav */
+    uint32_t size;                  /*!< File size in bytes */
+    uint32_t crc32;                 /*!< CRC-32 of the whole file */
+} hp_upload_begin_t;
+
+#define HP_UPLOAD_BEGIN_SIZE 12
+
+typedef enum {
+    HP_UPLOAD_BEGUN     = 0x00,     ///< Session open, send the first chunk
+    HP_UPLOAD_STORED    = 0x01,     ///< Chunks up to `offset` are on flash
+    HP_UPLOAD_COMMITTED = 0x02,     ///< Clip replaced and playable
+} hp_upload_phase_t;
+
+/**
+ * @brief Payload of an UPLOAD_STATUS packet (16 bytes).
+ *
+ * On an error status `offset` is where the host resumes (BAD_CRC,
+ * BAD_LENGTH); other errors end the session.
+ */
+typedef struct {
+    uint8_t status;                 /*!< ::hp_status_t */
+    uint8_t phase;                  /*!< ::hp_upload_phase_t */
+    uint8_t clip;                   /*!< Clip ID of the session */
+    uint32_t offset;                /*!< Bytes acknowledged */
+    uint32_t elapsed_us;            /*!< Since UPLOAD_BEGIN */
+    uint32_t flash_us;              /*!< Time spent writing flash so far */
+} hp_upload_status_t;
+
+#define HP_UPLOAD_STATUS_SIZE 16
+
+typedef enum {
+    HP_EFFECT_CLICK       = 0x00,   ///< Single click
+    HP_EFFECT_TICK        = 0x01,   ///< Short, light tick
+    HP_EFFECT_BUMP        = 0x02,   ///< Soft bump
+    HP_EFFECT_MULTI_CLICK = 0x03,   ///< Double / triple clicks and ticks
+    HP_EFFECT_BUZZ        = 0x04,   ///< Sustained buzz
+    HP_EFFECT_ALERT       = 0x05,   ///< Long alert
+    HP_EFFECT_PULSE       = 0x06,   ///< Pulsing
+    HP_EFFECT_HUM         = 0x07,   ///< Hum without kick or brake
+    HP_EFFECT_RAMP_UP     = 0x08,   ///< Rising ramp
+    HP_EFFECT_RAMP_DOWN   = 0x09,   ///< Falling ramp
+} hp_effect_category_t;
+
+/**
+ * @brief One effect of the catalog (4 bytes on the wire).
+ *
+ * EFFECTS payload: ID of the first entry (u8), entry count (u8), then the
+ * entries for consecutive IDs. An empty packet ends the catalog.
+ */
+typedef struct {
+    uint16_t duration_ms;           /*!< Nominal play time, kick and brake included */
+    uint8_t peak;                   /*!< Peak strength in % of full scale */
+    uint8_t category;               /*!< ::hp_effect_category_t */
+} hp_effect_info_t;
+
+#define HP_EFFECTS_HEADER_SIZE 2
+#define HP_EFFECT_INFO_SIZE    4
+#define HP_HID_MAX_EFFECTS     ((HP_HID_REPORT_SIZE - HP_HEADER_SIZE - HP_CRC_SIZE - HP_EFFECTS_HEADER_SIZE) / HP_EFFECT_INFO_SIZE)
+
+/* -------------------------------------------------------------------------- */
+/*  CRC                                                                       */
+/* -------------------------------------------------------------------------- */
+
+/**
+ * @brief CRC-16/CCITT-FALSE (poly 0x1021, init 0xFFFF, no reflection).
+ *
+ * Nibble table: 32 bytes of constants, two lookups per byte.
+ */
+static inline uint16_t hp_crc16(const uint8_t *data, size_t len)
+{
+    static const uint16_t table[16] = {
+        0x0000, 0x1021, 0x2042, 0x3063, 0x4084, 0x50A5, 0x60C6, 0x70E7,
+        0x8108, 0x9129, 0xA14A, 0xB16B, 0xC18C, 0xD1AD, 0xE1CE, 0xF1EF,
+    };
+    uint16_t crc = 0xFFFF;
+
+    for (size_t i = 0; i < len; i++) {
+        crc = (uint16_t)((crc << 4) ^ table[(crc >> 12) ^ (data[i] >> 4)]);
+        crc = (uint16_t)((crc << 4) ^ table[(crc >> 12) ^ (data[i] & 0x0F)]);
+    }
+    return crc;
+}
+
+/* -------------------------------------------------------------------------- */
+/*  Encoding                                                                  */
+/* -------------------------------------------------------------------------- */
+
+/**
+ * @brief Start a packet in @p buf (at least HP_MAX_PACKET bytes, or the
+ *        transport's report size).
+ */
+static inline void hp_packet_begin(uint8_t *buf, uint8_t type, uint8_t seq, uint8_t flags)
+{
+    buf[0] = HP_MAGIC;
+    buf[1] = HP_VERSION;
+    buf[2] = type;
+    buf[3] = seq;
+    buf[4] = 0;
+    buf[5] = flags;
+}
+
+/**
+ * @brief Append raw payload bytes.
+ *
+ * @return false if the payload would exceed @p max_payload
+ */
+static inline bool hp_packet_append(uint8_t *buf, const uint8_t *data, size_t len, size_t max_payload)
+{
+    size_t used = buf[4];
+
+    if (used + len > max_payload || used + len > HP_MAX_PAYLOAD) {
+        return false;
+    }
+    for (size_t i = 0; i < len; i++) {
+        buf[HP_HEADER_SIZE + used + i] = data[i];
+    }
+    buf[4] = (uint8_t)(used + len);
+    return true;
+}
+
+/**
+ * @brief Append one command record.
+ *
+ * @return false if the packet already holds @p max_records records
+ */
+static inline bool hp_packet_add_record(uint8_t *buf, const hp_record_t *rec, size_t max_records)
+{
+    const uint8_t raw[HP_RECORD_SIZE] = {
+        rec->op, rec->flags, rec->effect, rec->intensity, rec->actuator, 0,
+        (uint8_t)(rec->arg & 0xFF), (uint8_t)(rec->arg >> 8),
+    };
+    return hp_packet_append(buf, raw, sizeof(raw), max_records * HP_RECORD_SIZE);
+}
+
+/**
+ * @brief Append the CRC.
+ *
+ * @return Total packet length
+ */
+static inline size_t hp_packet_end(uint8_t *buf)
+{
+    size_t len = HP_HEADER_SIZE + buf[4];
+    uint16_t crc = hp_crc16(buf, len);
+
+    buf[len] = (uint8_t)(crc & 0xFF);
+    buf[len + 1] = (uint8_t)(crc >> 8);
+    return len + HP_CRC_SIZE;
+}
+
+static inline void hp_caps_encode(const hp_caps_t *caps, uint8_t out[HP_CAPS_SIZE])
+{
+    out[0] = caps->version_min;
+    out[1] = caps->version_max;
+    out[2] = caps->device_kind;
+    out[3] = caps->actuator_count;
+    out[4] = caps->max_records;
+    out[5] = caps->schedule_lead_ms;
+    out[6] = (uint8_t)(caps->effect_count & 0xFF);
+    out[7] = (uint8_t)(caps->effect_count >> 8);
+    out[8] = (uint8_t)(caps->features & 0xFF);
+    out[9] = (uint8_t)(caps->features >> 8);
+    out[10] = (uint8_t)(caps->min_period_ms & 0xFF);
+    out[11] = (uint8_t)(caps->min_period_ms >> 8);
+}
+
+/**
+ * @brief Build a complete CAPS packet.
+ *
+ * @return Packet length
+ */
+static inline size_t hp_build_caps(uint8_t *buf, uint8_t seq, const hp_caps_t *caps)
+{
+    uint8_t payload[HP_CAPS_SIZE];
+
+    hp_caps_encode(caps, payload);
+    hp_packet_begin(buf, HP_PKT_CAPS, seq, 0);
+    hp_packet_append(buf, payload, sizeof(payload), HP_MAX_PAYLOAD);
+    return hp_packet_end(buf);
+}
+
+/**
+ * @brief Build a complete STATUS packet.
+ *
+ * @return Packet length
+ */
+static inline size_t hp_build_status(uint8_t *buf, uint8_t seq, const hp_status_report_t *report)
+{
+    const uint8_t payload[HP_STATUS_SIZE] = { report->status, report->accepted, report->rejected, 0 };
+
+    hp_packet_begin(buf, HP_PKT_STATUS, seq, 0);
+    hp_packet_append(buf, payload, sizeof(payload), HP_MAX_PAYLOAD);
+    return hp_packet_end(buf);
+}
+
+/**
+ * @brief Build a complete TIME packet.
+ *
+ * @return Packet length
+ */
+static inline size_t hp_build_time(uint8_t *buf, uint8_t seq, const hp_time_t *time)
+{
+    uint8_t payload[HP_TIME_SIZE];
+
+    for (int i = 0; i < 8; i++) {
+        payload[i] = (uint8_t)(time->device_us >> (8 * i));
+    }
+    payload[8] = (uint8_t)(time->scheduled & 0xFF);
+    payload[9] = (uint8_t)(time->scheduled >> 8);
+    payload[10] = (uint8_t)(time->late & 0xFF);
+    payload[11] = (uint8_t)(time->late >> 8);
+    hp_packet_begin(buf, HP_PKT_TIME, seq, 0);
+    hp_packet_append(buf, payload, sizeof(payload), HP_MAX_PAYLOAD);
+    return hp_packet_end(buf);
+}
+
+/**
+ * @brief Make the packet started in @p buf a scheduled one. Call right after
+ *        ::hp_packet_begin, before adding records.
+ *
+ * @param[in] at_us  Target time, low 32 bits of the device clock in µs
+ */
+static inline bool hp_packet_set_at(uint8_t *buf, uint32_t at_us)
+{
+    const uint8_t raw[HP_AT_SIZE] = {
+        (uint8_t)at_us, (uint8_t)(at_us >> 8), (uint8_t)(at_us >> 16), (uint8_t)(at_us >> 24),
+    };
+
+    if (buf[4] != 0) {
+        return false;
+    }
+    buf[5] |= HP_PKT_FLAG_AT;
+    return hp_packet_append(buf, raw, sizeof(raw), HP_MAX_PAYLOAD);
+}
+
+/**
+ * @brief Build a complete UPLOAD_STATUS packet.
+ *
+ * @return Packet length
+ */
+static inline size_t hp_build_upload_status(uint8_t *buf, uint8_t seq, const hp_upload_status_t *st)
+{
+    const uint32_t words[3] = { st->offset, st->elapsed_us, st->flash_us };
+    uint8_t payload[HP_UPLOAD_STATUS_SIZE] = { st->status, st->phase, st->clip, 0 };
+
+    for (int w = 0; w < 3; w++) {
+        for (int i = 0; i < 4; i++) {
+            payload[4 + 4 * w + i] = (uint8_t)(words[w] >> (8 * i));
+        }
+    }
+    hp_packet_begin(buf, HP_PKT_UPLOAD_STATUS, seq, 0);
+    hp_packet_append(buf, payload, sizeof(payload), HP_MAX_PAYLOAD);
+    return hp_packet_end(buf);
+}
+
+/**
+ * @brief Build a complete EFFECTS packet for IDs @p first_id ..
+ *        @p first_id + @p count - 1; @p count 0 builds the end marker.
+ *
+ * @return Packet length, 0 when the entries do not fit @p max_payload
+ */
+static inline size_t hp_build_effects(uint8_t *buf, uint8_t seq, uint8_t first_id,
+                                      const hp_effect_info_t *info, size_t count, size_t max_payload)
+{
+    const uint8_t header[HP_EFFECTS_HEADER_SIZE] = { first_id, (uint8_t)count };
+
+    if (count > 0xFF || HP_EFFECTS_HEADER_SIZE + count * HP_EFFECT_INFO_SIZE > max_payload) {
+        return 0;
+    }
+    hp_packet_begin(buf, HP_PKT_EFFECTS, seq, 0);
+    hp_packet_append(buf, header, sizeof(header), max_payload);
+    for (size_t i = 0; i < count; i++) {
+        const uint8_t entry[HP_EFFECT_INFO_SIZE] = {
+            (uint8_t)(info[i].duration_ms & 0xFF), (uint8_t)(info[i].duration_ms >> 8),
+            info[i].peak, info[i].category,
+        };
+        hp_packet_append(buf, entry, sizeof(entry), max_payload);
+    }
+    return hp_packet_end(buf);
+}
+
+/* -------------------------------------------------------------------------- */
+/*  Decoding                                                                  */
+/* -------------------------------------------------------------------------- */
+
+static inline uint32_t hp_get_u32(const uint8_t *p)
+{
+    return (uint32_t)p[0] | ((uint32_t)p[1] << 8) | ((uint32_t)p[2] << 16) | ((uint32_t)p[3] << 24);
+}
+
+/**
+ * @brief Validate a packet at the start of @p buf.
+ *
+ * Trailing bytes after the packet (HID report padding) are ignored.
+ *
+ * @param[in]  buf  Received bytes
+ * @param[in]  len  Number of received bytes
+ * @param[out] out  Decoded header; payload points into @p buf
+ *
+ * @return HP_STATUS_OK or the reason the packet was rejected
+ */
+static inline hp_status_t hp_packet_parse(const uint8_t *buf, size_t len, hp_packet_t *out)
+{
+    if (len < (size_t)HP_PACKET_SIZE(0) || buf[0] != HP_MAGIC) {
+        return HP_STATUS_BAD_LENGTH;
+    }
+    if (len < (size_t)HP_PACKET_SIZE(buf[4]) || buf[4] > HP_MAX_PAYLOAD) {
+        return HP_STATUS_BAD_LENGTH;
+    }
+
+    size_t body = HP_HEADER_SIZE + buf[4];
+    uint16_t crc = (uint16_t)(buf[body] | (buf[body + 1] << 8));
+    if (crc != hp_crc16(buf, body)) {
+        return HP_STATUS_BAD_CRC;
+    }
+    if (buf[1] != HP_VERSION) {
+        return HP_STATUS_BAD_VERSION;
+    }
+
+    out->type = buf[2];
+    out->seq = buf[3];
+    out->payload_len = buf[4];
+    out->flags = buf[5];
+    out->payload = buf + HP_HEADER_SIZE;
+    return HP_STATUS_OK;
+}
+
+// Offset of the first record in the payload
+static inline size_t hp_records_offset(const hp_packet_t *pkt)
+{
+    return (pkt->flags & HP_PKT_FLAG_AT) ? HP_AT_SIZE : 0;
+}
+
+/**
+ * @brief Target time of a scheduled packet.
+ *
+ * @return false if the packet is not scheduled (or too short to be)
+ */
+static inline bool hp_packet_at(const hp_packet_t *pkt, uint32_t *at_us)
+{
+    const uint8_t *p = pkt->payload;
+
+    if (!(pkt->flags & HP_PKT_FLAG_AT) || pkt->payload_len < HP_AT_SIZE) {
+        return false;
+    }
+    *at_us = (uint32_t)p[0] | ((uint32_t)p[1] << 8) | ((uint32_t)p[2] << 16) | ((uint32_t)p[3] << 24);
+    return true;
+}
+
+/**
+ * @brief Expand a 32-bit target time to the 64-bit device clock.
+ *
+ * The low 32 bits wrap every ~71 minutes; the target is taken as the
+ * instant closest to @p now_us. Targets more than HP_SCHEDULE_MAX_AHEAD_US
+ * ahead come from a stale host clock estimate and resolve to @p now_us.
+ * Targets in the past are returned as is, so the caller can count them late.
+ */
+static inline int64_t hp_time_resolve(uint32_t at_us, int64_t now_us)
+{
+    int32_t delta = (int32_t)(at_us - (uint32_t)now_us);
+
+    return delta > HP_SCHEDULE_MAX_AHEAD_US ? now_us : now_us + delta;
+}
+
+/**
+ * @brief Number of records in a COMMANDS packet.
+ */
+static inline size_t hp_record_count(const hp_packet_t *pkt)
+{
+    size_t offset = hp_records_offset(pkt);
+
+    return pkt->payload_len < offset ? 0 : (pkt->payload_len - offset) / HP_RECORD_SIZE;
+}
+
+/**
+ * @brief Decode record @p index of a COMMANDS packet.
+ */
+static inline void hp_record_get(const hp_packet_t *pkt, size_t index, hp_record_t *rec)
+{
+    const uint8_t *raw = pkt->payload + hp_records_offset(pkt) + index * HP_RECORD_SIZE;
+
+    rec->op = raw[0];
+    rec->flags = raw[1];
+    rec->effect = raw[2];
+    rec->intensity = raw[3];
+    rec->actuator = raw[4];
+    rec->arg = (uint16_t)(raw[6] | (raw[7] << 8));
+}
+
+static inline bool hp_caps_decode(const hp_packet_t *pkt, hp_caps_t *caps)
+{
+    const uint8_t *p = pkt->payload;
+
+    if (pkt->type != HP_PKT_CAPS || pkt->payload_len < HP_CAPS_SIZE) {
+        return false;
+    }
+    caps->version_min = p[0];
+    caps->version_max = p[1];
+    caps->device_kind = p[2];
+    caps->actuator_count = p[3];
+    caps->max_records = p[4];
+    caps->schedule_lead_ms = p[5];
+    caps->effect_count = (uint16_t)(p[6] | (p[7] << 8));
+    caps->features = (uint16_t)(p[8] | (p[9] << 8));
+    caps->min_period_ms = (uint16_t)(p[10] | (p[11] << 8));
+    return true;
+}
+
+static inline bool hp_time_decode(const hp_packet_t *pkt, hp_time_t *time)
+{
+    const uint8_t *p = pkt->payload;
+
+    if (pkt->type != HP_PKT_TIME || pkt->payload_len < HP_TIME_SIZE) {
+        return false;
+    }
+    time->device_us = 0;
+    for (int i = 7; i >= 0; i--) {
+        time->device_us = (time->device_us << 8) | p[i];
+    }
+    time->scheduled = (uint16_t)(p[8] | (p[9] << 8));
+    time->late = (uint16_t)(p[10] | (p[11] << 8));
+    return true;
+}
+
+/**
+ * @brief Decode an EFFECTS packet.
+ *
+ * @param[out] first_id  ID of the first entry
+ * @param[out] info      Entries, up to @p max
+ *
+ * @return Number of entries decoded, 0 for the end marker
+ */
+static inline size_t hp_effects_decode(const hp_packet_t *pkt, uint8_t *first_id, hp_effect_info_t *info, size_t max)
+{
+    const uint8_t *p = pkt->payload;
+    size_t count;
+
+    if (pkt->type != HP_PKT_EFFECTS || pkt->payload_len < HP_EFFECTS_HEADER_SIZE) {
+        return 0;
+    }
+    *first_id = p[0];
+    count = p[1];
+    if (count > (size_t)(pkt->payload_len - HP_EFFECTS_HEADER_SIZE) / HP_EFFECT_INFO_SIZE) {
+        count = (size_t)(pkt->payload_len - HP_EFFECTS_HEADER_SIZE) / HP_EFFECT_INFO_SIZE;
+    }
+    if (count > max) {
+        count = max;
+    }
+    for (size_t i = 0; i < count; i++) {
+        const uint8_t *e = p + HP_EFFECTS_HEADER_SIZE + i * HP_EFFECT_INFO_SIZE;
+        info[i].duration_ms = (uint16_t)(e[0] | (e[1] << 8));
+        info[i].peak = e[2];
+        info[i].category = e[3];
+    }
+    return count;
+}
+
+static inline bool hp_upload_begin_decode(const hp_packet_t *pkt, hp_upload_begin_t *begin)
+{
+    if (pkt->type != HP_PKT_UPLOAD_BEGIN || pkt->payload_len < HP_UPLOAD_BEGIN_SIZE) {
+        return false;
+    }
+    begin->clip = pkt->payload[0];
+    begin->size = hp_get_u32(pkt->payload + 4);
+    begin->crc32 = hp_get_u32(pkt->payload + 8);
+    return true;
+}
+
+/**
+ * @brief File bytes of an UPLOAD_DATA packet.
+ *
+ * @param[out] offset  File offset of the first byte
+ * @param[out] data    Points into the packet
+ * @param[out] len     Number of bytes
+ */
+static inline bool hp_upload_data_decode(const hp_packet_t *pkt, uint32_t *offset, const uint8_t **data, size_t *len)
+{
+    if (pkt->type != HP_PKT_UPLOAD_DATA || pkt->payload_len < 4) {
+        return false;
+    }
+    *offset = hp_get_u32(pkt->payload);
+    *data = pkt->payload + 4;
+    *len = pkt->payload_len - 4;
+    return true;
+}
+
+static inline bool hp_upload_chunk_decode(const hp_packet_t *pkt, uint32_t *offset, uint32_t *crc32)
+{
+    if (pkt->type != HP_PKT_UPLOAD_CHUNK || pkt->payload_len < 8) {
+        return false;
+    }
+    *offset = hp_get_u32(pkt->payload);
+    *crc32 = hp_get_u32(pkt->payload + 4);
+    return true;
+}
+
+/* -------------------------------------------------------------------------- */
+/*  Byte stream framing (serial transport)                                    */
+/* -------------------------------------------------------------------------- */
+
+/**
+ * @brief Reassembles packets from a byte stream, resynchronising on the
+ *        next magic byte after garbage or a corrupted packet.
+ */
+typedef struct {
+    uint8_t buf[HP_MAX_PACKET];     /*!< Bytes not yet consumed */
+    size_t len;
+    uint8_t pkt[HP_MAX_PACKET];     /*!< Last packet returned, referenced by hp_packet_t */
+} hp_stream_t;
+
+typedef enum {
+    HP_STREAM_MORE   = 0,           ///< Need more bytes
+    HP_STREAM_PACKET = 1,           ///< A valid packet is available
+    HP_STREAM_ERROR  = 2,           ///< A corrupted packet was dropped
+} hp_stream_result_t;
+
+static inline void hp_stream_reset(hp_stream_t *s)
+{
+    s->len = 0;
+}
+
+// Drop the first n bytes
+static inline void hp_stream_consume(hp_stream_t *s, size_t n)
+{
+    for (size_t j = n; j < s->len; j++) {
+        s->buf[j - n] = s->buf[j];
+    }
+    s->len -= n;
+}
+
+// Drop the first byte and everything up to the next magic byte
+static inline void hp_stream_resync(hp_stream_t *s)
+{
+    size_t i = 1;
+
+    while (i < s->len && s->buf[i] != HP_MAGIC) {
+        i++;
+    }
+    hp_stream_consume(s, i);
+}
+
+/**
+ * @brief Look for a packet in the bytes already buffered.
+ *
+ * Call until it returns HP_STREAM_MORE after every HP_STREAM_PACKET or
+ * HP_STREAM_ERROR, since one chunk of input may hold several packets.
+ * On HP_STREAM_PACKET @p out is valid until the next packet is returned;
+ * on HP_STREAM_ERROR @p status holds the reason.
+ */
+static inline hp_stream_result_t hp_stream_poll(hp_stream_t *s, hp_packet_t *out, hp_status_t *status)
+{
+    if (s->len <= 4) {
+        return HP_STREAM_MORE;
+    }
+    if (s->buf[4] > HP_MAX_PAYLOAD) {
+        *status = HP_STATUS_BAD_LENGTH;
+        hp_stream_resync(s);
+        return HP_STREAM_ERROR;
+    }
+
+    size_t need = HP_PACKET_SIZE(s->buf[4]);
+    if (s->len < need) {
+        return HP_STREAM_MORE;
+    }
+
+    for (size_t i = 0; i < need; i++) {
+        s->pkt[i] = s->buf[i];
+    }
+    *status = hp_packet_parse(s->pkt, need, out);
+    if (*status != HP_STATUS_OK) {
+        hp_stream_resync(s);
+        return HP_STREAM_ERROR;
+    }
+    hp_stream_consume(s, need);
+    return HP_STREAM_PACKET;
+}
+
+/**
+ * @brief Feed one byte, then look for a packet (see ::hp_stream_poll).
+ */
+static inline hp_stream_result_t hp_stream_feed(hp_stream_t *s, uint8_t byte, hp_packet_t *out, hp_status_t *status)
+{
+    if (s->len == 0 && byte != HP_MAGIC) {
+        return HP_STREAM_MORE;
+    }
+    s->buf[s->len++] = byte;
+    return hp_stream_poll(s, out, status);
+}
+
+#ifdef __cplusplus
+}
+#endif
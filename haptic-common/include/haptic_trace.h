@@ -0,0 +1,101 @@
+#pragma once
+
+#include <stddef.h>
+#include <stdint.h>
+#include "sdkconfig.h"
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+/* -------------------------------------------------------------------------- */
+/*  Stage-timestamp trace                                                     */
+/*                                                                            */
+/*  Records when a command passes each stage of the firmware, as compact      */
+/*  binary events in one ring per CPU core. An event is the core's cycle      */
+/*  counter plus a few bytes of context, reserved with one atomic increment,  */
+/*  so recording costs well under a microsecond and never blocks; nothing is  */
+/*  formatted on the device. The rings are drained on request as TRACE        */
+/*  packets (haptic_protocol.h) and decoded on the host by                    */
+/*  tools/haptic_trace.py into per-stage latency histograms and a timeline.   */
+/*                                                                            */
+/*  Cycle counters are per core and wrap every few seconds, so each core      */
+/*  also records a SYNC event carrying esp_timer time whenever its last one   */
+/*  is 2^30 cycles old; every event can then be placed on the esp_timer       */
+/*  clock relative to the SYNC before it.                                     */
+/* -------------------------------------------------------------------------- */
+
+typedef enum {
+    HAPTIC_TRACE_SYNC    = 0,   ///< arg: low 32 bits of esp_timer_get_time()
+    HAPTIC_TRACE_USB_RX  = 1,   ///< Packet or report received; arg: bytes
+    HAPTIC_TRACE_PARSE   = 2,   ///< Packet validated; arg: hp_status_t
+    HAPTIC_TRACE_ENQUEUE = 3,   ///< Command posted to the player queue; arg: effect
+    HAPTIC_TRACE_DEQUEUE = 4,   ///< Command taken by the player; arg: effect
+    HAPTIC_TRACE_STORAGE = 5,   ///< Clip read from flash; arg: bytes
+    HAPTIC_TRACE_OUTPUT  = 6,   ///< I2S write or I2C GO issued; arg: effect or bytes
+    HAPTIC_TRACE_DONE    = 7,   ///< Output finished; arg: esp_err_t or bytes
+    HAPTIC_TRACE_DROP    = 8,   ///< Command discarded (queue full, cancelled, unsupported)
+} haptic_trace_stage_t;
+
+/** Index of events that belong to a whole packet rather than one record */
+#define HAPTIC_TRACE_PACKET  0xFF
+
+/**
+ * @brief One trace event (HP_TRACE_EVENT_SIZE bytes on the wire).
+ */
+typedef struct {
+    uint32_t cycles;                /*!< Cycle counter of the recording core */
+    uint32_t arg;                   /*!< Stage specific, see ::haptic_trace_stage_t */
+    uint16_t tag;                   /*!< Links the stages of one packet; 0 = untagged */
+    uint8_t index;                  /*!< Record within the packet or HAPTIC_TRACE_PACKET */
+    uint8_t stage;                  /*!< ::haptic_trace_stage_t */
+} haptic_trace_event_t;
+
+#if CONFIG_HAPTIC_TRACE
+
+/**
+ * @brief Record that @p tag / @p index reached @p stage. Safe from any task
+ *        on either core; not from ISRs.
+ */
+void haptic_trace(haptic_trace_stage_t stage, uint16_t tag, uint8_t index, uint32_t arg);
+
+/**
+ * @brief New tag for a received packet (never 0, wraps).
+ */
+uint16_t haptic_trace_tag(void);
+
+#else
+
+static inline void haptic_trace(haptic_trace_stage_t stage, uint16_t tag, uint8_t index, uint32_t arg)
+{
+    (void)stage;
+    (void)tag;
+    (void)index;
+    (void)arg;
+}
+
+static inline uint16_t haptic_trace_tag(void)
+{
+    return 0;
+}
+
+#endif
+
+/**
+ * @brief Drain the oldest pending events of one core into a TRACE packet.
+ *
+ * Events are removed from the ring once dumped. With tracing disabled, or
+ * once both rings are drained, the packet holds no events.
+ *
+ * @param[out] buf          Packet buffer, at least HP_PACKET_SIZE(max_payload) bytes
+ * @param[in]  seq          Sequence number of the packet
+ * @param[in]  max_payload  Payload limit of the transport
+ * @param[out] events       Number of events in the packet
+ *
+ * @return Packet length
+ */
+size_t haptic_trace_dump(uint8_t *buf, uint8_t seq, size_t max_payload, size_t *events);
+
+#ifdef __cplusplus
+}
+#endif
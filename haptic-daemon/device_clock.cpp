@@ -0,0 +1,99 @@
+#include "device_clock.h"
+
+#include <algorithm>
+#include <ctime>
+
+namespace hapticd {
+
+namespace {
+
+constexpr size_t CLOCK_WINDOW = 30;             // exchanges kept for the fit
+constexpr size_t CLOCK_MIN_SAMPLES = 4;         // exchanges before the estimate is used
+constexpr int64_t CLOCK_MIN_SPAN_US = 2000000;  // history before drift is estimated
+constexpr int64_t CLOCK_RTT_SLACK_US = 200;     // over the fastest round trip still trusted
+
+}  // namespace
+
+int64_t monotonic_us()
+{
+    timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return int64_t(ts.tv_sec) * 1000000 + ts.tv_nsec / 1000;
+}
+
+void DeviceClock::reset()
+{
+    samples_.clear();
+    base_us_ = 0;
+    offset_us_ = 0;
+    rate_ = 1.0;
+    rtt_us_ = 0;
+}
+
+void DeviceClock::add_sample(int64_t t0_us, int64_t t1_us, uint64_t device_us)
+{
+    samples_.push_back({ (t0_us + t1_us) / 2, device_us, t1_us - t0_us });
+    if (samples_.size() > CLOCK_WINDOW) {
+        samples_.pop_front();
+    }
+    fit();
+}
+
+void DeviceClock::fit()
+{
+    rtt_us_ = std::min_element(samples_.begin(), samples_.end(),
+                               [](const Sample &a, const Sample &b) { return a.rtt_us < b.rtt_us; })->rtt_us;
+
+    // least squares around the mean, relative to the first good sample so
+    // the large clock values keep their precision
+    const Sample *first = nullptr;
+    const Sample *last = nullptr;
+    double mh = 0;
+    double md = 0;
+    size_t n = 0;
+    for (const Sample &s : samples_) {
+        if (s.rtt_us > 2 * rtt_us_ + CLOCK_RTT_SLACK_US) {
+            continue;
+        }
+        if (!first) {
+            first = &s;
+        }
+        last = &s;
+        mh += double(s.host_us - first->host_us);
+        md += double(int64_t(s.device_us - first->device_us));
+        n++;
+    }
+    mh /= n;
+    md /= n;
+
+    double rate = 1.0;
+    if (last->host_us - first->host_us >= CLOCK_MIN_SPAN_US) {
+        double sxy = 0;
+        double sxx = 0;
+        for (const Sample &s : samples_) {
+            if (s.rtt_us > 2 * rtt_us_ + CLOCK_RTT_SLACK_US) {
+                continue;
+            }
+            double h = double(s.host_us - first->host_us) - mh;
+            double d = double(int64_t(s.device_us - first->device_us)) - md;
+            sxy += h * d;
+            sxx += h * h;
+        }
+        rate = sxy / sxx;
+    }
+    base_us_ = first->host_us + int64_t(mh);
+    offset_us_ = double(first->device_us) + md;
+    rate_ = rate;
+}
+
+bool DeviceClock::synced() const
+{
+    return samples_.size() >= CLOCK_MIN_SAMPLES;
+}
+
+int64_t DeviceClock::to_device(int64_t host_us) const
+{
+    return int64_t(offset_us_ + rate_ * double(host_us - base_us_));
+}
+
+}  // namespace hapticd
@@ -0,0 +1,43 @@
+#pragma once
+
+#include <cstddef>
+#include <cstdint>
+#include <deque>
+
+namespace hapticd {
+
+// CLOCK_MONOTONIC in µs
+int64_t monotonic_us();
+
+// Maps the host clock to the device's esp_timer clock, as DeviceClock in
+// haptic-mouse-plugin/clocksync.js: each exchange pairs the device time with
+// the midpoint of the host timestamps around it, exchanges with a slow round
+// trip are left out, and a line through the rest gives offset and drift.
+class DeviceClock {
+public:
+    void reset();
+    void add_sample(int64_t t0_us, int64_t t1_us, uint64_t device_us);
+    bool synced() const;
+    // Device time at host time `host_us`
+    int64_t to_device(int64_t host_us) const;
+    double drift_ppm() const { return (rate_ - 1.0) * 1e6; }
+    int64_t rtt_us() const { return rtt_us_; }
+    size_t samples() const { return samples_.size(); }
+
+private:
+    struct Sample {
+        int64_t host_us;
+        uint64_t device_us;
+        int64_t rtt_us;
+    };
+
+    void fit();
+
+    std::deque<Sample> samples_;
+    int64_t base_us_ = 0;       // host time of the fit's reference point
+    double offset_us_ = 0;      // device time at base_us_
+    double rate_ = 1.0;         // device µs per host µs
+    int64_t rtt_us_ = 0;        // fastest round trip in the window
+};
+
+}  // namespace hapticd
@@ -0,0 +1,366 @@
+#include "dispatcher.h"
+
+#include <algorithm>
+#include <cerrno>
+#include <cstring>
+#include <sys/eventfd.h>
+#include <unistd.h>
+
+#include "log.h"
+
+namespace hapticd {
+
+static const char *TAG = "dispatcher";
+
+namespace {
+
+constexpr int64_t SCHEDULE_GROUP_US = 1000;     // rhythmic records this close share a packet and a target
+constexpr int64_t SCHEDULE_MAX_LEAD_US = 50000; // upper bound when missed targets widen the lead
+constexpr int64_t SCHEDULE_WIDEN_US = 2000;     // lead added per exchange that saw missed targets
+constexpr unsigned CLOCK_BURST = 8;             // exchanges right after opening the device
+constexpr auto CLOCK_SYNC_INTERVAL = std::chrono::seconds(2);
+constexpr auto REOPEN_INTERVAL = std::chrono::seconds(1);
+
+bool timed_op(uint8_t op)
+{
+    return op == HP_OP_PLAY || op == HP_OP_PATTERN_START;
+}
+
+}  // namespace
+
+void LatencyHistogram::add(int64_t us)
+{
+    int b = 0;
+    while (b < BUCKETS - 1 && (int64_t(1) << b) < us) {
+        b++;
+    }
+    bucket[b]++;
+    count++;
+    sum_us += us;
+    max_us = std::max(max_us, us);
+}
+
+int64_t LatencyHistogram::percentile(double p) const
+{
+    uint64_t target = uint64_t(p / 100.0 * double(count));
+    uint64_t seen = 0;
+    for (int b = 0; b < BUCKETS; b++) {
+        seen += bucket[b];
+        if (seen > target) {
+            return int64_t(1) << b;
+        }
+    }
+    return max_us;
+}
+
+Dispatcher::Dispatcher(const Options &options)
+    : options_(options)
+{
+    event_fd_ = eventfd(0, EFD_NONBLOCK | EFD_CLOEXEC);
+}
+
+Dispatcher::~Dispatcher()
+{
+    stop();
+    if (event_fd_ >= 0) {
+        close(event_fd_);
+    }
+}
+
+void Dispatcher::start()
+{
+    running_ = true;
+    thread_ = std::thread(&Dispatcher::run, this);
+}
+
+void Dispatcher::stop()
+{
+    {
+        std::lock_guard<std::mutex> lock(mutex_);
+        running_ = false;
+    }
+    cv_.notify_all();
+    if (thread_.joinable()) {
+        thread_.join();
+    }
+}
+
+void Dispatcher::signal_event()
+{
+    uint64_t one = 1;
+    if (write(event_fd_, &one, sizeof(one)) < 0) {
+        HLOGW(TAG, "eventfd: %s", std::strerror(errno));
+    }
+}
+
+bool Dispatcher::ready() const
+{
+    std::lock_guard<std::mutex> lock(mutex_);
+    return ready_;
+}
+
+std::vector<Packet> Dispatcher::hello() const
+{
+    std::lock_guard<std::mutex> lock(mutex_);
+    return hello_;
+}
+
+DispatchStats Dispatcher::stats() const
+{
+    std::lock_guard<std::mutex> lock(mutex_);
+    return stats_;
+}
+
+void Dispatcher::print_stats(FILE *out) const
+{
+    DispatchStats s = stats();
+    const LatencyHistogram &h = s.immediate;
+
+    std::fprintf(out, "commands %llu, coalesced %llu, dropped %llu, packets %llu (%llu scheduled)\n",
+                 (unsigned long long)s.commands, (unsigned long long)s.coalesced, (unsigned long long)s.dropped,
+                 (unsigned long long)s.packets, (unsigned long long)s.scheduled);
+    if (h.count) {
+        std::fprintf(out, "issue to HID write: n %llu, mean %lld µs, p50 <= %lld µs, p99 <= %lld µs, max %lld µs\n",
+                     (unsigned long long)h.count, (long long)(h.sum_us / int64_t(h.count)),
+                     (long long)h.percentile(50), (long long)h.percentile(99), (long long)h.max_us);
+    }
+}
+
+void Dispatcher::submit(const Command *cmds, size_t n)
+{
+    {
+        std::lock_guard<std::mutex> lock(mutex_);
+        stats_.commands += n;
+        if (!ready_) {
+            stats_.dropped += n;
+            return;
+        }
+        for (size_t i = 0; i < n; i++) {
+            queue_locked(cmds[i]);
+        }
+    }
+    cv_.notify_one();
+}
+
+// Coalesce on the way in, so a burst costs as few records as it can
+void Dispatcher::queue_locked(const Command &cmd)
+{
+    const hp_record_t &rec = cmd.rec;
+    const bool rhythmic = rec.flags & HP_REC_FLAG_RHYTHMIC;
+
+    switch (rec.op) {
+    case HP_OP_PATTERN_UPDATE:
+        // a rate update only changes the pending start/update of the pattern
+        if (!queue_.empty() && (queue_.back().rec.op == HP_OP_PATTERN_START ||
+                                queue_.back().rec.op == HP_OP_PATTERN_UPDATE)) {
+            hp_record_t &last = queue_.back().rec;
+            last.arg = rec.arg ? rec.arg : last.arg;
+            last.intensity = rec.intensity;
+            stats_.coalesced++;
+            return;
+        }
+        break;
+    case HP_OP_STOP: {
+        // effects still waiting would be cut off right away
+        size_t before = queue_.size();
+        queue_.erase(std::remove_if(queue_.begin(), queue_.end(),
+                                    [](const Command &c) { return c.rec.op == HP_OP_PLAY; }),
+                     queue_.end());
+        stats_.coalesced += before - queue_.size();
+        break;
+    }
+    case HP_OP_PLAY:
+        // the same effect is already waiting: one play is enough, unless
+        // this one is queued to play after it
+        for (Command &pending : queue_) {
+            const hp_record_t &p = pending.rec;
+            if (!(rec.flags & HP_REC_FLAG_QUEUE) && p.op == HP_OP_PLAY && p.effect == rec.effect && p.actuator == rec.actuator &&
+                (p.flags & HP_REC_FLAG_RHYTHMIC) == (rec.flags & HP_REC_FLAG_RHYTHMIC) &&
+                (!rhythmic || cmd.t_us - pending.t_us <= SCHEDULE_GROUP_US)) {
+                pending.rec.intensity = std::max(p.intensity, rec.intensity);
+                stats_.coalesced++;
+                return;
+            }
+        }
+        // the same effect is still in its first half on the device
+        if (!rhythmic && !(rec.flags & HP_REC_FLAG_QUEUE) && rec.effect == last_play_.effect &&
+            rec.intensity <= last_play_.intensity &&
+            cmd.t_us - last_play_.sent_us < int64_t(link_.effect_duration_ms(rec.effect)) * 1000 / 2) {
+            stats_.coalesced++;
+            return;
+        }
+        break;
+    default:
+        break;
+    }
+    queue_.push_back(cmd);
+}
+
+// Take the records of the next packet. Timed records (PLAY, PATTERN_START)
+// either all carry one target time or none: a rhythmic record is not sent
+// with an immediate one, nor with one issued more than SCHEDULE_GROUP_US
+// apart. Untimed records go with either kind.
+size_t Dispatcher::take_batch_locked(std::vector<Command> &batch, int64_t *at_host_us)
+{
+    const bool scheduling = lead_us_ > 0 && clock_.synced();
+    const size_t max_records = std::max<size_t>(1, std::min<size_t>(link_.caps().max_records, HP_HID_MAX_RECORDS));
+    const Command *first = nullptr;
+    size_t n = 0;
+
+    for (; n < queue_.size() && n < max_records; n++) {
+        const Command &cmd = queue_[n];
+        if (!timed_op(cmd.rec.op)) {
+            continue;
+        }
+        bool timed = scheduling && (cmd.rec.flags & HP_REC_FLAG_RHYTHMIC);
+        if (!first) {
+            first = &cmd;
+        } else if (timed != (scheduling && (first->rec.flags & HP_REC_FLAG_RHYTHMIC)) ||
+                   (timed && cmd.t_us - first->t_us > SCHEDULE_GROUP_US)) {
+            break;
+        }
+    }
+    *at_host_us = first && scheduling && (first->rec.flags & HP_REC_FLAG_RHYTHMIC) ? first->t_us + lead_us_ : 0;
+    batch.assign(queue_.begin(), queue_.begin() + n);
+    queue_.erase(queue_.begin(), queue_.begin() + n);
+    return n;
+}
+
+bool Dispatcher::connect()
+{
+    std::string path = options_.hidraw.empty() ? HidLink::find() : options_.hidraw;
+    if (path.empty() || !link_.open(path)) {
+        return false;
+    }
+    clock_.reset();
+    unsigned burst = (link_.caps().features & HP_CAP_SCHEDULE) ? CLOCK_BURST : 0;
+    for (unsigned i = 0; i < burst; i++) {
+        if (!sync_clock()) {
+            disconnect();
+            return false;
+        }
+    }
+    lead_us_ = clock_.synced() ? (int64_t(link_.caps().schedule_lead_ms) + options_.lead_margin_ms) * 1000 : 0;
+    if (lead_us_) {
+        HLOGI(TAG, "device clock synced: rtt %lld µs, lead %lld ms", (long long)clock_.rtt_us(),
+              (long long)lead_us_ / 1000);
+    }
+    return true;
+}
+
+void Dispatcher::disconnect()
+{
+    HLOGW(TAG, "%s: device lost (%s)", link_.path().c_str(), std::strerror(errno));
+    link_.close();
+}
+
+// One clock exchange; runs on the writer thread between packets. Returns
+// false if the device is gone.
+bool Dispatcher::sync_clock()
+{
+    hp_time_t time;
+    int64_t t0;
+    int64_t t1;
+
+    next_sync_ = std::chrono::steady_clock::now() + CLOCK_SYNC_INTERVAL;
+    if (!link_.read_time(&time, &t0, &t1)) {
+        return errno != ENODEV && errno != EIO;
+    }
+    clock_.add_sample(t0, t1, time.device_us);
+
+    // targets were missed since the last exchange: this host needs more lead
+    std::lock_guard<std::mutex> lock(mutex_);
+    if (last_late_ >= 0 && last_late_ != time.late && lead_us_) {
+        lead_us_ = std::min(SCHEDULE_MAX_LEAD_US, lead_us_ + SCHEDULE_WIDEN_US);
+        HLOGW(TAG, "device missed targets, lead now %lld ms", (long long)lead_us_ / 1000);
+    }
+    last_late_ = time.late;
+    return true;
+}
+
+void Dispatcher::run()
+{
+    std::vector<Command> batch;
+    uint8_t packet[HP_HID_REPORT_SIZE];
+    std::unique_lock<std::mutex> lock(mutex_);
+
+    while (running_) {
+        if (!ready_) {
+            lock.unlock();
+            bool ok = connect();
+            lock.lock();
+            if (!ok) {
+                cv_.wait_for(lock, REOPEN_INTERVAL, [this] { return !running_; });
+                continue;
+            }
+            ready_ = true;
+            hello_ = link_.hello();
+            last_late_ = -1;
+            signal_event();
+            continue;
+        }
+
+        auto now = std::chrono::steady_clock::now();
+        if (lead_us_ && now >= next_sync_ && (queue_.empty() || now >= next_sync_ + CLOCK_SYNC_INTERVAL)) {
+            // idle, or busy for long enough that the estimate would go stale
+            lock.unlock();
+            bool alive = sync_clock();
+            lock.lock();
+            if (!alive) {
+                disconnect();
+            }
+        } else if (queue_.empty()) {
+            auto until = lead_us_ ? next_sync_ : now + std::chrono::hours(1);
+            cv_.wait_until(lock, until, [this] { return !running_ || !queue_.empty(); });
+            continue;
+        } else {
+            int64_t at_host_us;
+            size_t n = take_batch_locked(batch, &at_host_us);
+
+            hp_packet_begin(packet, HP_PKT_COMMANDS, seq_++, 0);
+            if (at_host_us) {
+                hp_packet_set_at(packet, uint32_t(clock_.to_device(at_host_us)));
+            }
+            // take_batch_locked() sized the batch to the report, target time included
+            for (size_t i = 0; i < n; i++) {
+                hp_record_t rec = batch[i].rec;
+                rec.flags &= uint8_t(~HP_REC_FLAG_RHYTHMIC);
+                hp_packet_add_record(packet, &rec, HP_MAX_PAYLOAD / HP_RECORD_SIZE);
+                // set before the write, so a repeat arriving during it is coalesced
+                if (rec.op == HP_OP_PLAY) {
+                    last_play_ = { rec.effect, rec.intensity, monotonic_us() };
+                }
+            }
+            size_t len = hp_packet_end(packet);
+            lock.unlock();
+
+            int64_t start_us = monotonic_us();
+            bool sent = link_.send(packet, len);
+
+            lock.lock();
+            if (!sent) {
+                disconnect();
+            }
+            stats_.packets++;
+            stats_.scheduled += at_host_us != 0;
+            for (size_t i = 0; i < n; i++) {
+                const hp_record_t &rec = batch[i].rec;
+                if (!(rec.flags & HP_REC_FLAG_RHYTHMIC) || !at_host_us) {
+                    stats_.immediate.add(start_us - batch[i].t_us);
+                }
+            }
+        }
+
+        if (!link_.is_open()) {
+            ready_ = false;
+            stats_.dropped += queue_.size();
+            queue_.clear();
+            hello_.clear();
+            lead_us_ = 0;
+            signal_event();
+        }
+    }
+    link_.close();
+}
+
+}  // namespace hapticd
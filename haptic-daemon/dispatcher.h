@@ -0,0 +1,111 @@
+#pragma once
+
+#include <chrono>
+#include <condition_variable>
+#include <cstdint>
+#include <cstdio>
+#include <deque>
+#include <mutex>
+#include <string>
+#include <thread>
+#include <vector>
+
+#include "device_clock.h"
+#include "hid_link.h"
+
+namespace hapticd {
+
+// One command record from a client or an input device
+struct Command {
+    hp_record_t rec;
+    int64_t t_us;                   // host time it was issued (input event time for evdev)
+};
+
+// Latency from issue to the start of the HID write, log2 buckets in µs
+struct LatencyHistogram {
+    static constexpr int BUCKETS = 24;
+    uint64_t count = 0;
+    int64_t sum_us = 0;
+    int64_t max_us = 0;
+    uint64_t bucket[BUCKETS] = {};
+
+    void add(int64_t us);
+    int64_t percentile(double p) const;     // upper edge of the bucket holding it
+};
+
+struct DispatchStats {
+    uint64_t commands = 0;          // records accepted from clients and inputs
+    uint64_t coalesced = 0;         // ... merged into or dropped for another record
+    uint64_t dropped = 0;           // ... lost because no device was open
+    uint64_t packets = 0;           // HID writes
+    uint64_t scheduled = 0;         // packets with a target time
+    LatencyHistogram immediate;     // unscheduled records
+};
+
+// Owns the device: (re)opens it, keeps its clock in sync, and turns the
+// records submitted from any thread into COMMANDS packets. Records queued
+// while a write is in flight go out together in the next packet, the same
+// batching the content script does over WebHID; rhythmic records
+// (HP_REC_FLAG_RHYTHMIC) are scheduled a constant lead ahead on the device
+// clock, everything else is sent at once.
+class Dispatcher {
+public:
+    struct Options {
+        std::string hidraw;         // device node, empty = first protocol device found
+        int lead_margin_ms = 3;     // transport jitter absorbed on top of the device's own lead
+    };
+
+    explicit Dispatcher(const Options &options);
+    Dispatcher(const Dispatcher &) = delete;
+    Dispatcher &operator=(const Dispatcher &) = delete;
+    ~Dispatcher();
+
+    void start();
+    void stop();
+
+    // Queue records; dropped while no device is open
+    void submit(const Command *cmds, size_t n);
+
+    // Readable (eventfd) whenever the device is opened or lost
+    int event_fd() const { return event_fd_; }
+    bool ready() const;
+    // CAPS and EFFECTS packets of the open device
+    std::vector<Packet> hello() const;
+
+    DispatchStats stats() const;
+    void print_stats(FILE *out) const;
+
+private:
+    void run();
+    bool connect();
+    void disconnect();
+    bool sync_clock();
+    void queue_locked(const Command &cmd);
+    size_t take_batch_locked(std::vector<Command> &batch, int64_t *at_host_us);
+    void signal_event();
+
+    Options options_;
+    HidLink link_;                  // opened and closed by the writer thread under mutex_ once ready_
+    DeviceClock clock_;             // writer thread only
+    int event_fd_ = -1;
+    std::thread thread_;
+
+    mutable std::mutex mutex_;
+    std::condition_variable cv_;
+    bool running_ = false;
+    bool ready_ = false;
+    std::vector<Packet> hello_;
+    std::deque<Command> queue_;
+    DispatchStats stats_;
+    uint8_t seq_ = 0;
+    int64_t lead_us_ = 0;           // 0 = not scheduling
+    int last_late_ = -1;            // device's missed-target counter at the last exchange
+    std::chrono::steady_clock::time_point next_sync_;
+    struct {
+        uint8_t effect = 0;
+        uint8_t intensity = 0;
+        int64_t sent_us = 0;
+    } last_play_;
+};
+
+}  // namespace hapticd
@@ -0,0 +1,191 @@
+#include "evdev_input.h"
+
+#include <cerrno>
+#include <climits>
+#include <cstring>
+#include <dirent.h>
+#include <fcntl.h>
+#include <linux/input.h>
+#include <sys/ioctl.h>
+#include <unistd.h>
+
+#include "log.h"
+
+namespace hapticd {
+
+static const char *TAG = "evdev";
+
+namespace {
+
+constexpr int HI_RES_PER_DETENT = 120;
+
+bool test_bit(const unsigned long *bits, int bit)
+{
+    constexpr int BITS = sizeof(unsigned long) * CHAR_BIT;
+    return bits[bit / BITS] & (1UL << (bit % BITS));
+}
+
+}  // namespace
+
+EvdevInput::EvdevInput(const Options &options, Dispatcher &dispatcher)
+    : options_(options), dispatcher_(dispatcher)
+{
+}
+
+EvdevInput::~EvdevInput()
+{
+    for (const Device &dev : devices_) {
+        ::close(dev.fd);
+    }
+}
+
+bool EvdevInput::open_device(const std::string &path, bool quiet)
+{
+    int fd = ::open(path.c_str(), O_RDONLY | O_NONBLOCK | O_CLOEXEC);
+    if (fd < 0) {
+        if (!quiet) {
+            HLOGE(TAG, "%s: %s", path.c_str(), std::strerror(errno));
+        }
+        return false;
+    }
+
+    unsigned long rel[(REL_MAX + 1 + 8 * sizeof(long) - 1) / (8 * sizeof(long))] = {};
+    unsigned long key[(KEY_MAX + 1 + 8 * sizeof(long) - 1) / (8 * sizeof(long))] = {};
+    ioctl(fd, EVIOCGBIT(EV_REL, sizeof(rel)), rel);
+    ioctl(fd, EVIOCGBIT(EV_KEY, sizeof(key)), key);
+    if (!test_bit(rel, REL_WHEEL) || !test_bit(key, BTN_LEFT)) {
+        if (!quiet) {
+            HLOGE(TAG, "%s: not a pointer with a wheel", path.c_str());
+        }
+        ::close(fd);
+        return false;
+    }
+
+    // event times on the clock the dispatcher measures latency with
+    int clock = CLOCK_MONOTONIC;
+    if (ioctl(fd, EVIOCSCLOCKID, &clock) < 0) {
+        HLOGW(TAG, "%s: monotonic timestamps unavailable, latency includes clock offset", path.c_str());
+    }
+
+    char name[128] = "?";
+    ioctl(fd, EVIOCGNAME(sizeof(name)), name);
+    const bool hi_res = test_bit(rel, REL_WHEEL_HI_RES);
+    devices_.push_back({ fd, path, hi_res });
+    HLOGI(TAG, "%s: %s%s", path.c_str(), name, hi_res ? " (high-resolution wheel)" : "");
+    return true;
+}
+
+bool EvdevInput::open()
+{
+    for (const std::string &path : options_.paths) {
+        if (path != "auto") {
+            if (!open_device(path, false)) {
+                return false;
+            }
+            continue;
+        }
+        DIR *dir = opendir("/dev/input");
+        if (!dir) {
+            HLOGE(TAG, "/dev/input: %s", std::strerror(errno));
+            return false;
+        }
+        size_t before = devices_.size();
+        while (dirent *entry = readdir(dir)) {
+            if (std::strncmp(entry->d_name, "event", 5) == 0) {
+                open_device(std::string("/dev/input/") + entry->d_name, true);
+            }
+        }
+        closedir(dir);
+        if (devices_.size() == before) {
+            HLOGW(TAG, "no pointer with a wheel found (permissions?)");
+        }
+    }
+    return true;
+}
+
+std::vector<int> EvdevInput::fds() const
+{
+    std::vector<int> fds;
+    for (const Device &dev : devices_) {
+        fds.push_back(dev.fd);
+    }
+    return fds;
+}
+
+void EvdevInput::play(uint8_t effect, int64_t t_us)
+{
+    if (!effect) {
+        return;
+    }
+    Command cmd = {};
+    cmd.rec.op = HP_OP_PLAY;
+    cmd.rec.effect = effect;
+    cmd.rec.intensity = options_.intensity;
+    cmd.rec.actuator = HP_ACTUATOR_ALL;
+    cmd.t_us = t_us;
+    dispatcher_.submit(&cmd, 1);
+}
+
+bool EvdevInput::on_readable(int fd)
+{
+    Device *dev = nullptr;
+    for (Device &d : devices_) {
+        if (d.fd == fd) {
+            dev = &d;
+        }
+    }
+    if (!dev) {
+        return false;
+    }
+
+    input_event events[64];
+    for (;;) {
+        ssize_t n = read(fd, events, sizeof(events));
+        if (n < 0 && errno == EINTR) {
+            continue;
+        }
+        if (n < 0 && errno == EAGAIN) {
+            return true;
+        }
+        if (n <= 0) {
+            HLOGW(TAG, "%s: gone", dev->path.c_str());
+            ::close(fd);
+            devices_.erase(devices_.begin() + (dev - devices_.data()));
+            return false;
+        }
+
+        for (size_t i = 0; i < size_t(n) / sizeof(input_event); i++) {
+            const input_event &ev = events[i];
+            const int64_t t_us = int64_t(ev.input_event_sec) * 1000000 + ev.input_event_usec;
+
+            if (ev.type == EV_REL) {
+                int detents = 0;
+                if (dev->hi_res && (ev.code == REL_WHEEL_HI_RES || ev.code == REL_HWHEEL_HI_RES)) {
+                    int &acc = ev.code == REL_WHEEL_HI_RES ? dev->hi_res_v : dev->hi_res_h;
+                    // a direction change restarts the detent
+                    if ((acc > 0 && ev.value < 0) || (acc < 0 && ev.value > 0)) {
+                        acc = 0;
+                    }
+                    acc += ev.value;
+                    detents = acc / HI_RES_PER_DETENT;
+                    acc %= HI_RES_PER_DETENT;
+                } else if (!dev->hi_res && (ev.code == REL_WHEEL || ev.code == REL_HWHEEL)) {
+                    detents = ev.value;
+                }
+                // one tick however far the wheel moved within one report
+                if (detents) {
+                    play(options_.wheel_effect, t_us);
+                }
+            } else if (ev.type == EV_KEY && ev.code >= BTN_LEFT && ev.code <= BTN_MIDDLE) {
+                // value 2 is autorepeat
+                if (ev.value == 1) {
+                    play(options_.press_effect, t_us);
+                } else if (ev.value == 0) {
+                    play(options_.release_effect, t_us);
+                }
+            }
+        }
+    }
+}
+
+}  // namespace hapticd
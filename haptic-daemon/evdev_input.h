@@ -0,0 +1,52 @@
+#pragma once
+
+#include <cstdint>
+#include <string>
+#include <vector>
+
+#include "dispatcher.h"
+
+namespace hapticd {
+
+// Pointer input read straight from evdev: wheel detents and button presses
+// become PLAY records, stamped with the kernel's event time so the latency
+// statistics cover the daemon end to end.
+class EvdevInput {
+public:
+    struct Options {
+        std::vector<std::string> paths;     // event nodes; "auto" = every device with a wheel and a left button
+        uint8_t wheel_effect = 24;          // Sharp Tick 1
+        uint8_t press_effect = 1;           // Strong Click
+        uint8_t release_effect = 0;         // 0 = none
+        uint8_t intensity = 0xFF;
+    };
+
+    EvdevInput(const Options &options, Dispatcher &dispatcher);
+    EvdevInput(const EvdevInput &) = delete;
+    EvdevInput &operator=(const EvdevInput &) = delete;
+    ~EvdevInput();
+
+    // Open the devices; false if one named explicitly cannot be used
+    bool open();
+    std::vector<int> fds() const;
+    // Handle the events of one device; false once it is gone (closed)
+    bool on_readable(int fd);
+
+private:
+    struct Device {
+        int fd;
+        std::string path;
+        bool hi_res;                // REL_WHEEL_HI_RES reported, plain detents ignored
+        int hi_res_v = 0;           // accumulated 1/120 detents
+        int hi_res_h = 0;
+    };
+
+    bool open_device(const std::string &path, bool quiet);
+    void play(uint8_t effect, int64_t t_us);
+
+    Options options_;
+    Dispatcher &dispatcher_;
+    std::vector<Device> devices_;
+};
+
+}  // namespace hapticd
@@ -0,0 +1,317 @@
+// hapticd-fake: uhid stand-in for the LRA firmware's command protocol
+//
+// Creates a virtual HID device with the firmware's vendor collection,
+// answers the CAPS, TIME and EFFECTS feature reports the way the firmware
+// does and logs every record it receives with the lead its target time
+// leaves, so hapticd and the content script's WebHID path can be exercised
+// on Linux without hardware. Needs access to /dev/uhid (root, or a udev rule).
+
+#include <cerrno>
+#include <csignal>
+#include <cstdarg>
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include <fcntl.h>
+#include <getopt.h>
+#include <linux/uhid.h>
+#include <poll.h>
+#include <sys/signalfd.h>
+#include <time.h>
+#include <unistd.h>
+
+#include "drv2605_effects.h"
+#include "haptic_protocol.h"
+
+namespace {
+
+const char NAME[] = "Haptic Mouse (hapticd-fake)";
+
+// Vendor page collection of hid_report_descriptor in tusb_hid_main.c
+const uint8_t REPORT_DESCRIPTOR[] = {
+    0x06, 0x00, 0xFF,   // Usage Page (Vendor 0xFF00)
+    0x09, 0x01,         // Usage (1)
+    0xA1, 0x01,         // Collection (Application)
+    0x85, 0x10, 0x15, 0x00, 0x25, 0xFF, 0x09, 0x01, 0x19, 0x01, 0x29, 0x01,
+    0x75, 0x08, 0x95, 0x01, 0x91, 0x02,                         // legacy effect
+    0x85, 0x11, 0x15, 0x00, 0x25, 0xFF, 0x09, 0x01, 0x75, 0x08, 0x95, 0x05, 0x91, 0x02,     // legacy pattern
+    0x85, HP_HID_REPORT_ID, 0x15, 0x00, 0x25, 0xFF, 0x09, 0x01, 0x75, 0x08, 0x95, HP_HID_REPORT_SIZE, 0x91, 0x02,
+    0x85, HP_HID_CAPS_REPORT_ID, 0x15, 0x00, 0x25, 0xFF, 0x09, 0x01, 0x75, 0x08, 0x95, HP_HID_REPORT_SIZE, 0xB1, 0x02,
+    0x85, HP_HID_TIME_REPORT_ID, 0x15, 0x00, 0x25, 0xFF, 0x09, 0x01, 0x75, 0x08, 0x95, HP_HID_REPORT_SIZE, 0xB1, 0x02,
+    0x85, HP_HID_TRACE_REPORT_ID, 0x15, 0x00, 0x25, 0xFF, 0x09, 0x01, 0x75, 0x08, 0x95, HP_HID_REPORT_SIZE, 0xB1, 0x02,
+    0x85, HP_HID_EFFECTS_REPORT_ID, 0x15, 0x00, 0x25, 0xFF, 0x09, 0x01, 0x75, 0x08, 0x95, HP_HID_REPORT_SIZE, 0xB1, 0x02,
+    0xC0,               // End Collection
+};
+
+// s_caps of the firmware
+const hp_caps_t CAPS = {
+    HP_VERSION, HP_VERSION, HP_DEVICE_LRA, 1, HP_HID_MAX_RECORDS, 3, DRV2605_EFFECT_COUNT,
+    HP_CAP_INTENSITY | HP_CAP_PATTERN | HP_CAP_QUEUE | HP_CAP_SCHEDULE, 10,
+};
+
+const char *const OP_NAMES[] = { "nop", "play", "stop", "pattern start", "pattern update", "pattern stop" };
+
+struct Fake {
+    int64_t start_us;
+    double drift_ppm;
+    uint16_t scheduled = 0;
+    uint16_t late = 0;
+    uint8_t effects_next = 1;
+
+    // The device's esp_timer clock: starts at 0 and runs off by drift_ppm
+    int64_t device_us() const
+    {
+        timespec ts;
+        clock_gettime(CLOCK_MONOTONIC, &ts);
+        int64_t host = int64_t(ts.tv_sec) * 1000000 + ts.tv_nsec / 1000 - start_us;
+        return host + int64_t(double(host) * drift_ppm / 1e6);
+    }
+};
+
+void log_line(const Fake &fake, const char *fmt, ...) __attribute__((format(printf, 2, 3)));
+
+void log_line(const Fake &fake, const char *fmt, ...)
+{
+    va_list args;
+    va_start(args, fmt);
+    std::printf("%10.1f ms  ", double(fake.device_us()) / 1000.0);
+    std::vprintf(fmt, args);
+    std::printf("\n");
+    std::fflush(stdout);
+    va_end(args);
+}
+
+const char *effect_name(uint8_t id)
+{
+    const drv2605_effect_t *effect = drv2605_effect(id);
+    return effect ? effect->name : "-";
+}
+
+// Feature report `id` into `buf` (report ID first), 0 if there is none
+size_t get_feature(Fake &fake, uint8_t id, uint8_t *buf)
+{
+    uint8_t *packet = buf + 1;
+
+    std::memset(buf, 0, 1 + HP_HID_REPORT_SIZE);
+    buf[0] = id;
+    if (id == HP_HID_CAPS_REPORT_ID) {
+        hp_build_caps(packet, 0, &CAPS);
+        fake.effects_next = 1;
+    } else if (id == HP_HID_TIME_REPORT_ID) {
+        const hp_time_t now = { uint64_t(fake.device_us()), fake.scheduled, fake.late };
+        hp_build_time(packet, 0, &now);
+    } else if (id == HP_HID_EFFECTS_REPORT_ID) {
+        // as build_effects_report(): an empty packet after the last entries
+        hp_effect_info_t info[HP_HID_MAX_EFFECTS];
+        uint8_t first = fake.effects_next;
+        size_t count = 0;
+        while (count < HP_HID_MAX_EFFECTS && first + count < DRV2605_EFFECT_COUNT) {
+            const drv2605_effect_t *effect = drv2605_effect(uint8_t(first + count));
+            info[count] = { effect->duration_ms, effect->peak, effect->category };
+            count++;
+        }
+        fake.effects_next = count ? uint8_t(first + count) : 1;
+        hp_build_effects(packet, 0, count ? first : 0, info, count, HP_HID_REPORT_SIZE - HP_HEADER_SIZE - HP_CRC_SIZE);
+    } else {
+        return 0;
+    }
+    return 1 + HP_HID_REPORT_SIZE;
+}
+
+void on_packet(Fake &fake, const uint8_t *buf, size_t len)
+{
+    hp_packet_t pkt;
+    hp_status_t status = hp_packet_parse(buf, len, &pkt);
+    if (status == HP_STATUS_OK && pkt.type != HP_PKT_COMMANDS) {
+        status = HP_STATUS_BAD_TYPE;
+    }
+    if (status != HP_STATUS_OK) {
+        log_line(fake, "rejected packet: status %d", status);
+        return;
+    }
+
+    const int64_t now = fake.device_us();
+    uint32_t at;
+    bool scheduled = hp_packet_at(&pkt, &at);
+    int64_t target = scheduled ? hp_time_resolve(at, now) : 0;
+
+    for (size_t i = 0; i < hp_record_count(&pkt); i++) {
+        hp_record_t rec;
+        hp_record_get(&pkt, i, &rec);
+        const char *op = rec.op < sizeof(OP_NAMES) / sizeof(OP_NAMES[0]) ? OP_NAMES[rec.op] : "?";
+        char when[48] = "now";
+        char period[24] = "";
+
+        if (scheduled && (rec.op == HP_OP_PLAY || rec.op == HP_OP_PATTERN_START)) {
+            fake.scheduled++;
+            if (target < now) {
+                fake.late++;
+            }
+            std::snprintf(when, sizeof(when), "at %+.2f ms%s", double(target - now) / 1000.0,
+                          target < now ? " LATE" : "");
+        }
+        if (rec.op == HP_OP_PATTERN_START) {
+            std::snprintf(period, sizeof(period), " every %u ms", rec.arg);
+        }
+        if (rec.op == HP_OP_PLAY || rec.op == HP_OP_PATTERN_START) {
+            log_line(fake, "seq %3u  %-14s %3u %-34s intensity %3u%s%s  %s", pkt.seq, op, rec.effect,
+                     effect_name(rec.effect), rec.intensity, rec.flags & HP_REC_FLAG_QUEUE ? " queued" : "",
+                     period, when);
+        } else {
+            log_line(fake, "seq %3u  %s", pkt.seq, op);
+        }
+    }
+}
+
+void on_output(Fake &fake, const uint8_t *data, size_t len)
+{
+    if (!len) {
+        return;
+    }
+    if (data[0] == HP_HID_REPORT_ID) {
+        on_packet(fake, data + 1, len - 1);
+    } else if (data[0] == 0x10 && len >= 2) {
+        log_line(fake, "legacy   play           %3u %s", data[1], effect_name(data[1]));
+    } else if (data[0] == 0x11) {
+        log_line(fake, "legacy   pattern report (%zu bytes)", len - 1);
+    } else {
+        log_line(fake, "ignored output report 0x%02x", data[0]);
+    }
+}
+
+bool write_event(int fd, const uhid_event &ev)
+{
+    if (write(fd, &ev, sizeof(ev)) != ssize_t(sizeof(ev))) {
+        std::fprintf(stderr, "uhid write: %s\n", std::strerror(errno));
+        return false;
+    }
+    return true;
+}
+
+void usage(const char *argv0)
+{
+    std::fprintf(stderr,
+                 "usage: %s [--uhid PATH] [--drift-ppm PPM] [--vid ID] [--pid ID]\n"
+                 "  --drift-ppm PPM   run the device clock fast (or slow, negative) against the host\n",
+                 argv0);
+}
+
+}  // namespace
+
+int main(int argc, char **argv)
+{
+    static const option long_options[] = {
+        { "uhid", required_argument, nullptr, 'u' },
+        { "drift-ppm", required_argument, nullptr, 'd' },
+        { "vid", required_argument, nullptr, 'v' },
+        { "pid", required_argument, nullptr, 'p' },
+        { "help", no_argument, nullptr, 'h' },
+        {},
+    };
+    const char *uhid_path = "/dev/uhid";
+    double drift_ppm = 0;
+    unsigned vid = 0x303A, pid = 0x4004;
+
+    int opt;
+    while ((opt = getopt_long(argc, argv, "h", long_options, nullptr)) != -1) {
+        switch (opt) {
+        case 'u':
+            uhid_path = optarg;
+            break;
+        case 'd':
+            drift_ppm = std::atof(optarg);
+            break;
+        case 'v':
+            vid = unsigned(std::strtoul(optarg, nullptr, 0));
+            break;
+        case 'p':
+            pid = unsigned(std::strtoul(optarg, nullptr, 0));
+            break;
+        default:
+            usage(argv[0]);
+            return opt == 'h' ? 0 : 2;
+        }
+    }
+
+    int fd = open(uhid_path, O_RDWR | O_CLOEXEC);
+    if (fd < 0) {
+        std::fprintf(stderr, "%s: %s\n", uhid_path, std::strerror(errno));
+        return 1;
+    }
+
+    sigset_t mask;
+    sigemptyset(&mask);
+    sigaddset(&mask, SIGINT);
+    sigaddset(&mask, SIGTERM);
+    sigprocmask(SIG_BLOCK, &mask, nullptr);
+    int signal_fd = signalfd(-1, &mask, SFD_CLOEXEC);
+
+    timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    Fake fake = { int64_t(ts.tv_sec) * 1000000 + ts.tv_nsec / 1000, drift_ppm };
+
+    uhid_event ev = {};
+    ev.type = UHID_CREATE2;
+    std::snprintf(reinterpret_cast<char *>(ev.u.create2.name), sizeof(ev.u.create2.name), "%s", NAME);
+    ev.u.create2.rd_size = sizeof(REPORT_DESCRIPTOR);
+    ev.u.create2.bus = BUS_USB;
+    ev.u.create2.vendor = vid;
+    ev.u.create2.product = pid;
+    std::memcpy(ev.u.create2.rd_data, REPORT_DESCRIPTOR, sizeof(REPORT_DESCRIPTOR));
+    if (!write_event(fd, ev)) {
+        return 1;
+    }
+
+    pollfd fds[2] = { { fd, POLLIN, 0 }, { signal_fd, POLLIN, 0 } };
+    for (;;) {
+        if (poll(fds, 2, -1) < 0 && errno != EINTR) {
+            break;
+        }
+        if (fds[1].revents) {
+            break;
+        }
+        if (!(fds[0].revents & POLLIN)) {
+            continue;
+        }
+        if (read(fd, &ev, sizeof(ev)) <= 0) {
+            break;
+        }
+
+        switch (ev.type) {
+        case UHID_START:
+            log_line(fake, "started, clock drift %+.0f ppm", drift_ppm);
+            break;
+        case UHID_OUTPUT:
+            on_output(fake, ev.u.output.data, ev.u.output.size);
+            break;
+        case UHID_GET_REPORT: {
+            uhid_event reply = {};
+            reply.type = UHID_GET_REPORT_REPLY;
+            reply.u.get_report_reply.id = ev.u.get_report.id;
+            size_t size = ev.u.get_report.rtype == UHID_FEATURE_REPORT
+                          ? get_feature(fake, ev.u.get_report.rnum, reply.u.get_report_reply.data) : 0;
+            reply.u.get_report_reply.err = size ? 0 : EIO;
+            reply.u.get_report_reply.size = uint16_t(size);
+            write_event(fd, reply);
+            break;
+        }
+        case UHID_SET_REPORT: {
+            uhid_event reply = {};
+            reply.type = UHID_SET_REPORT_REPLY;
+            reply.u.set_report_reply.id = ev.u.set_report.id;
+            reply.u.set_report_reply.err = EIO;
+            write_event(fd, reply);
+            break;
+        }
+        default:
+            break;
+        }
+    }
+
+    std::printf("scheduled %u, late %u\n", fake.scheduled, fake.late);
+    ev = {};
+    ev.type = UHID_DESTROY;
+    write_event(fd, ev);
+    close(fd);
+    return 0;
+}
@@ -0,0 +1,160 @@
+#include "hid_link.h"
+
+#include <algorithm>
+#include <cerrno>
+#include <cstring>
+#include <dirent.h>
+#include <fcntl.h>
+#include <fstream>
+#include <iterator>
+#include <linux/hidraw.h>
+#include <sys/ioctl.h>
+#include <unistd.h>
+
+#include "device_clock.h"
+#include "log.h"
+
+namespace hapticd {
+
+static const char *TAG = "hid-link";
+
+HidLink::~HidLink()
+{
+    close();
+}
+
+std::string HidLink::find()
+{
+    // Report ID items of the command packet and CAPS reports
+    static const uint8_t packet_id[] = { 0x85, HP_HID_REPORT_ID };
+    static const uint8_t caps_id[] = { 0x85, HP_HID_CAPS_REPORT_ID };
+    std::vector<std::string> nodes;
+
+    if (DIR *dir = opendir("/sys/class/hidraw")) {
+        while (dirent *entry = readdir(dir)) {
+            if (std::strncmp(entry->d_name, "hidraw", 6) == 0) {
+                nodes.push_back(entry->d_name);
+            }
+        }
+        closedir(dir);
+    }
+    std::sort(nodes.begin(), nodes.end());
+
+    for (const std::string &node : nodes) {
+        std::ifstream f("/sys/class/hidraw/" + node + "/device/report_descriptor", std::ios::binary);
+        std::vector<uint8_t> desc((std::istreambuf_iterator<char>(f)), std::istreambuf_iterator<char>());
+        auto has = [&desc](const uint8_t *item) {
+            return std::search(desc.begin(), desc.end(), item, item + 2) != desc.end();
+        };
+        if (has(packet_id) && has(caps_id)) {
+            return "/dev/" + node;
+        }
+    }
+    return "";
+}
+
+bool HidLink::get_packet(uint8_t report_id, uint8_t type, uint8_t *report, hp_packet_t *pkt)
+{
+    std::memset(report, 0, 1 + HP_HID_REPORT_SIZE);
+    report[0] = report_id;
+    int len = ioctl(fd_, HIDIOCGFEATURE(1 + HP_HID_REPORT_SIZE), report);
+    if (len < 1) {
+        return false;
+    }
+    // the report ID comes first unless the device has none
+    const uint8_t *data = report[0] == report_id && report[1] == HP_MAGIC ? report + 1 : report;
+    size_t avail = size_t(len) - (data - report);
+    return hp_packet_parse(data, avail, pkt) == HP_STATUS_OK && pkt->type == type;
+}
+
+bool HidLink::open(const std::string &path)
+{
+    close();
+    fd_ = ::open(path.c_str(), O_RDWR | O_CLOEXEC);
+    if (fd_ < 0) {
+        HLOGE(TAG, "%s: %s", path.c_str(), std::strerror(errno));
+        return false;
+    }
+    path_ = path;
+
+    uint8_t report[1 + HP_HID_REPORT_SIZE];
+    hp_packet_t pkt;
+    if (!get_packet(HP_HID_CAPS_REPORT_ID, HP_PKT_CAPS, report, &pkt) || !hp_caps_decode(&pkt, &caps_) ||
+        caps_.version_min > HP_VERSION || caps_.version_max < HP_VERSION) {
+        HLOGE(TAG, "%s: no CAPS report, not a haptic protocol device", path.c_str());
+        close();
+        return false;
+    }
+    hello_.emplace_back(pkt.payload - HP_HEADER_SIZE, pkt.payload + pkt.payload_len + HP_CRC_SIZE);
+
+    // catalog, one EFFECTS packet per read; older firmware has none. The
+    // CAPS read rewound it, but another reader (a browser tab) may move the
+    // device's cursor meanwhile: read on past the empty packet that starts
+    // it over until every effect came by, for at most two rounds
+    durations_.assign(caps_.effect_count, 0);
+    std::vector<bool> seen(caps_.effect_count);
+    size_t missing = caps_.effect_count > 1 ? caps_.effect_count - 1u : 0u;
+    const unsigned round = (caps_.effect_count + HP_HID_MAX_EFFECTS - 1) / HP_HID_MAX_EFFECTS + 1;
+    for (unsigned i = 0; i < 2 * round && missing; i++) {
+        hp_effect_info_t info[HP_HID_MAX_EFFECTS];
+        uint8_t first = 0;
+        if (!get_packet(HP_HID_EFFECTS_REPORT_ID, HP_PKT_EFFECTS, report, &pkt)) {
+            break;
+        }
+        hello_.emplace_back(pkt.payload - HP_HEADER_SIZE, pkt.payload + pkt.payload_len + HP_CRC_SIZE);
+        size_t count = hp_effects_decode(&pkt, &first, info, HP_HID_MAX_EFFECTS);
+        for (size_t j = 0; j < count; j++) {
+            size_t id = first + j;
+            if (id > 0 && id < durations_.size() && !seen[id]) {
+                seen[id] = true;
+                durations_[id] = info[j].duration_ms;
+                missing--;
+            }
+        }
+    }
+
+    HLOGI(TAG, "%s: protocol v%u, kind %u, %u effects, lead %u ms, features 0x%04x", path.c_str(), HP_VERSION,
+          caps_.device_kind, caps_.effect_count, caps_.schedule_lead_ms, caps_.features);
+    return true;
+}
+
+void HidLink::close()
+{
+    if (fd_ >= 0) {
+        ::close(fd_);
+    }
+    fd_ = -1;
+    caps_ = {};
+    durations_.clear();
+    hello_.clear();
+}
+
+uint16_t HidLink::effect_duration_ms(uint8_t effect) const
+{
+    return effect < durations_.size() ? durations_[effect] : 0;
+}
+
+bool HidLink::send(const uint8_t *packet, size_t len)
+{
+    uint8_t report[1 + HP_HID_REPORT_SIZE] = { HP_HID_REPORT_ID };
+
+    if (len > HP_HID_REPORT_SIZE) {
+        errno = EMSGSIZE;
+        return false;
+    }
+    std::memcpy(report + 1, packet, len);
+    return write(fd_, report, sizeof(report)) == ssize_t(sizeof(report));
+}
+
+bool HidLink::read_time(hp_time_t *time, int64_t *t0_us, int64_t *t1_us)
+{
+    uint8_t report[1 + HP_HID_REPORT_SIZE];
+    hp_packet_t pkt;
+
+    *t0_us = monotonic_us();
+    bool ok = get_packet(HP_HID_TIME_REPORT_ID, HP_PKT_TIME, report, &pkt);
+    *t1_us = monotonic_us();
+    return ok && hp_time_decode(&pkt, time);
+}
+
+}  // namespace hapticd
@@ -0,0 +1,58 @@
+#pragma once
+
+#include <cstdint>
+#include <string>
+#include <vector>
+
+#include "haptic_protocol.h"
+
+namespace hapticd {
+
+using Packet = std::vector<uint8_t>;
+
+// The LRA firmware's command protocol over a hidraw node: COMMANDS packets
+// go out as output report HP_HID_REPORT_ID, CAPS, TIME and EFFECTS packets
+// come back as feature reports (haptic_protocol.h).
+class HidLink {
+public:
+    HidLink() = default;
+    HidLink(const HidLink &) = delete;
+    HidLink &operator=(const HidLink &) = delete;
+    ~HidLink();
+
+    // First hidraw node whose report descriptor has the command protocol
+    // reports, empty if there is none
+    static std::string find();
+
+    // Open the node and read the capabilities and effect catalog; false if
+    // it is not a protocol device
+    bool open(const std::string &path);
+    void close();
+    bool is_open() const { return fd_ >= 0; }
+    const std::string &path() const { return path_; }
+
+    const hp_caps_t &caps() const { return caps_; }
+    // Nominal play time of a library effect, 0 if unknown
+    uint16_t effect_duration_ms(uint8_t effect) const;
+    // CAPS packet followed by the EFFECTS packets up to the empty one, as
+    // read from the device; forwarded to clients on connect
+    const std::vector<Packet> &hello() const { return hello_; }
+
+    // Send one packet; false (errno set) if the device is gone
+    bool send(const uint8_t *packet, size_t len);
+    // Read the device clock; t0_us and t1_us are the host clock around the exchange
+    bool read_time(hp_time_t *time, int64_t *t0_us, int64_t *t1_us);
+
+private:
+    // Read a feature report holding one packet into `report`; the packet
+    // starts after the report ID
+    bool get_packet(uint8_t report_id, uint8_t type, uint8_t *report, hp_packet_t *pkt);
+
+    int fd_ = -1;
+    std::string path_;
+    hp_caps_t caps_ = {};
+    std::vector<uint16_t> durations_;
+    std::vector<Packet> hello_;
+};
+
+}  // namespace hapticd
@@ -0,0 +1,30 @@
+#pragma once
+
+#include <cstdio>
+#include <ctime>
+
+// ESP_LOG style logging to stderr: level, milliseconds since start, tag
+namespace hapticd {
+
+extern bool g_verbose;
+
+inline long log_ms()
+{
+    static timespec start = [] {
+        timespec ts;
+        clock_gettime(CLOCK_MONOTONIC, &ts);
+        return ts;
+    }();
+    timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return (ts.tv_sec - start.tv_sec) * 1000 + (ts.tv_nsec - start.tv_nsec) / 1000000;
+}
+
+}  // namespace hapticd
+
+#define HLOG(level, tag, fmt, ...) \
+    std::fprintf(stderr, level " (%ld) %s: " fmt "\n", hapticd::log_ms(), tag, ##__VA_ARGS__)
+#define HLOGE(tag, fmt, ...) HLOG("E", tag, fmt, ##__VA_ARGS__)
+#define HLOGW(tag, fmt, ...) HLOG("W", tag, fmt, ##__VA_ARGS__)
+#define HLOGI(tag, fmt, ...) HLOG("I", tag, fmt, ##__VA_ARGS__)
+#define HLOGD(tag, fmt, ...) do { if (hapticd::g_verbose) HLOG("D", tag, fmt, ##__VA_ARGS__); } while (0)
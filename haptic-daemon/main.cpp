@@ -0,0 +1,153 @@
+// hapticd: host-side haptics daemon for the LRA firmware
+//
+// Opens the device through hidraw and owns its clock sync, batching and
+// coalescing; browsers (content.js over WebSocket) and desktop apps (Unix
+// socket) send it bare command records, and pointer input can drive it
+// directly from evdev.
+
+#include <getopt.h>
+#include <csignal>
+#include <cstdio>
+#include <cstdlib>
+#include <string>
+
+#include "dispatcher.h"
+#include "evdev_input.h"
+#include "log.h"
+#include "server.h"
+
+namespace hapticd {
+bool g_verbose = false;
+}
+
+using namespace hapticd;
+
+static const char *TAG = "hapticd";
+
+static void usage(const char *argv0)
+{
+    std::fprintf(stderr,
+                 "usage: %s [options]\n"
+                 "  --hidraw PATH          device node (default: first command protocol device)\n"
+                 "  --socket PATH          Unix socket (default: %s, \"\" = none)\n"
+                 "  --ws-port PORT         WebSocket port on 127.0.0.1 (default 8765, 0 = none)\n"
+                 "  --ws-origin ORIGIN     accepted Origin header, repeatable, * = any\n"
+                 "                         (default: chrome-extension:// origins)\n"
+                 "  --input PATH|auto      evdev pointer to react to, repeatable\n"
+                 "  --wheel-effect ID      effect per wheel detent (default 24, 0 = none)\n"
+                 "  --press-effect ID      effect per button press (default 1, 0 = none)\n"
+                 "  --release-effect ID    effect per button release (default 0 = none)\n"
+                 "  --input-intensity N    intensity of input effects, 0-255 (default 255)\n"
+                 "  --lead MS              margin on top of the device's schedule lead (default 3)\n"
+                 "  --verbose              log every client and packet\n",
+                 argv0, Server::default_socket_path().c_str());
+}
+
+static bool parse_u8(const char *arg, uint8_t *out)
+{
+    char *end;
+    long v = std::strtol(arg, &end, 0);
+    if (*end || v < 0 || v > 255) {
+        return false;
+    }
+    *out = uint8_t(v);
+    return true;
+}
+
+int main(int argc, char **argv)
+{
+    enum { OPT_HIDRAW = 256, OPT_SOCKET, OPT_WS_PORT, OPT_WS_ORIGIN, OPT_INPUT, OPT_WHEEL, OPT_PRESS,
+           OPT_RELEASE, OPT_INTENSITY, OPT_LEAD, OPT_VERBOSE };
+    static const option long_options[] = {
+        { "hidraw", required_argument, nullptr, OPT_HIDRAW },
+        { "socket", required_argument, nullptr, OPT_SOCKET },
+        { "ws-port", required_argument, nullptr, OPT_WS_PORT },
+        { "ws-origin", required_argument, nullptr, OPT_WS_ORIGIN },
+        { "input", required_argument, nullptr, OPT_INPUT },
+        { "wheel-effect", required_argument, nullptr, OPT_WHEEL },
+        { "press-effect", required_argument, nullptr, OPT_PRESS },
+        { "release-effect", required_argument, nullptr, OPT_RELEASE },
+        { "input-intensity", required_argument, nullptr, OPT_INTENSITY },
+        { "lead", required_argument, nullptr, OPT_LEAD },
+        { "verbose", no_argument, nullptr, OPT_VERBOSE },
+        { "help", no_argument, nullptr, 'h' },
+        {},
+    };
+
+    Dispatcher::Options dispatch_options;
+    Server::Options server_options;
+    EvdevInput::Options input_options;
+    server_options.socket_path = Server::default_socket_path();
+
+    int opt;
+    while ((opt = getopt_long(argc, argv, "h", long_options, nullptr)) != -1) {
+        bool ok = true;
+        switch (opt) {
+        case OPT_HIDRAW:
+            dispatch_options.hidraw = optarg;
+            break;
+        case OPT_SOCKET:
+            server_options.socket_path = optarg;
+            break;
+        case OPT_WS_PORT:
+            server_options.ws_port = std::atoi(optarg);
+            ok = server_options.ws_port >= 0 && server_options.ws_port <= 65535;
+            break;
+        case OPT_WS_ORIGIN:
+            server_options.ws_origins.push_back(optarg);
+            break;
+        case OPT_INPUT:
+            input_options.paths.push_back(optarg);
+            break;
+        case OPT_WHEEL:
+            ok = parse_u8(optarg, &input_options.wheel_effect);
+            break;
+        case OPT_PRESS:
+            ok = parse_u8(optarg, &input_options.press_effect);
+            break;
+        case OPT_RELEASE:
+            ok = parse_u8(optarg, &input_options.release_effect);
+            break;
+        case OPT_INTENSITY:
+            ok = parse_u8(optarg, &input_options.intensity);
+            break;
+        case OPT_LEAD:
+            dispatch_options.lead_margin_ms = std::atoi(optarg);
+            ok = dispatch_options.lead_margin_ms >= 0 && dispatch_options.lead_margin_ms <= 50;
+            break;
+        case OPT_VERBOSE:
+            g_verbose = true;
+            break;
+        default:
+            usage(argv[0]);
+            return opt == 'h' ? 0 : 2;
+        }
+        if (!ok) {
+            std::fprintf(stderr, "%s: bad value \"%s\"\n", argv[0], optarg);
+            return 2;
+        }
+    }
+
+    // the server takes the signals through a signalfd; block them before
+    // the writer thread exists so it never receives one
+    sigset_t mask;
+    sigemptyset(&mask);
+    sigaddset(&mask, SIGINT);
+    sigaddset(&mask, SIGTERM);
+    sigaddset(&mask, SIGUSR1);
+    pthread_sigmask(SIG_BLOCK, &mask, nullptr);
+
+    Dispatcher dispatcher(dispatch_options);
+    EvdevInput input(input_options, dispatcher);
+    Server server(server_options, dispatcher, input);
+
+    if (!input.open()) {
+        return 1;
+    }
+    dispatcher.start();
+    bool ok = server.run();
+    dispatcher.stop();
+    dispatcher.print_stats(stderr);
+    HLOGI(TAG, "stopped");
+    return ok ? 0 : 1;
+}
@@ -0,0 +1,305 @@
+#include "server.h"
+
+#include <arpa/inet.h>
+#include <cerrno>
+#include <csignal>
+#include <cstdlib>
+#include <cstring>
+#include <netinet/in.h>
+#include <netinet/tcp.h>
+#include <sys/epoll.h>
+#include <sys/signalfd.h>
+#include <sys/socket.h>
+#include <sys/un.h>
+#include <unistd.h>
+
+#include "log.h"
+
+namespace hapticd {
+
+static const char *TAG = "server";
+
+namespace {
+
+constexpr int MAX_CLIENTS = 32;
+
+hp_record_t decode_record(const uint8_t *raw)
+{
+    hp_record_t rec;
+    rec.op = raw[0];
+    rec.flags = raw[1];
+    rec.effect = raw[2];
+    rec.intensity = raw[3];
+    rec.actuator = raw[4];
+    rec.arg = uint16_t(raw[6] | raw[7] << 8);
+    return rec;
+}
+
+}  // namespace
+
+std::string Server::default_socket_path()
+{
+    const char *runtime = std::getenv("XDG_RUNTIME_DIR");
+    return std::string(runtime && *runtime ? runtime : "/tmp") + "/hapticd.sock";
+}
+
+Server::Server(const Options &options, Dispatcher &dispatcher, EvdevInput &input)
+    : options_(options), dispatcher_(dispatcher), input_(input)
+{
+}
+
+Server::~Server()
+{
+    close_all_clients();
+    for (int fd : { unix_fd_, tcp_fd_, signal_fd_, epoll_fd_ }) {
+        if (fd >= 0) {
+            ::close(fd);
+        }
+    }
+    if (unix_fd_ >= 0) {
+        unlink(options_.socket_path.c_str());
+    }
+}
+
+void Server::watch(int fd)
+{
+    epoll_event ev = {};
+    ev.events = EPOLLIN;
+    ev.data.fd = fd;
+    epoll_ctl(epoll_fd_, EPOLL_CTL_ADD, fd, &ev);
+}
+
+bool Server::listen_unix()
+{
+    sockaddr_un addr = {};
+    addr.sun_family = AF_UNIX;
+    if (options_.socket_path.size() >= sizeof(addr.sun_path)) {
+        HLOGE(TAG, "socket path too long: %s", options_.socket_path.c_str());
+        return false;
+    }
+    std::strcpy(addr.sun_path, options_.socket_path.c_str());
+
+    // message boundaries are kept, so a datagram is a whole batch of records
+    unix_fd_ = socket(AF_UNIX, SOCK_SEQPACKET | SOCK_NONBLOCK | SOCK_CLOEXEC, 0);
+    if (unix_fd_ < 0) {
+        HLOGE(TAG, "socket: %s", std::strerror(errno));
+        return false;
+    }
+    unlink(addr.sun_path);
+    if (bind(unix_fd_, reinterpret_cast<sockaddr *>(&addr), sizeof(addr)) < 0 || listen(unix_fd_, 8) < 0) {
+        HLOGE(TAG, "%s: %s", addr.sun_path, std::strerror(errno));
+        ::close(unix_fd_);
+        unix_fd_ = -1;
+        return false;
+    }
+    watch(unix_fd_);
+    HLOGI(TAG, "listening on %s", addr.sun_path);
+    return true;
+}
+
+bool Server::listen_tcp()
+{
+    sockaddr_in addr = {};
+    addr.sin_family = AF_INET;
+    addr.sin_port = htons(uint16_t(options_.ws_port));
+    addr.sin_addr.s_addr = htonl(INADDR_LOOPBACK);
+
+    tcp_fd_ = socket(AF_INET, SOCK_STREAM | SOCK_NONBLOCK | SOCK_CLOEXEC, 0);
+    if (tcp_fd_ < 0) {
+        HLOGE(TAG, "socket: %s", std::strerror(errno));
+        return false;
+    }
+    int one = 1;
+    setsockopt(tcp_fd_, SOL_SOCKET, SO_REUSEADDR, &one, sizeof(one));
+    if (bind(tcp_fd_, reinterpret_cast<sockaddr *>(&addr), sizeof(addr)) < 0 || listen(tcp_fd_, 8) < 0) {
+        HLOGE(TAG, "127.0.0.1:%d: %s", options_.ws_port, std::strerror(errno));
+        ::close(tcp_fd_);
+        tcp_fd_ = -1;
+        return false;
+    }
+    watch(tcp_fd_);
+    HLOGI(TAG, "WebSocket on ws://127.0.0.1:%d/", options_.ws_port);
+    return true;
+}
+
+void Server::accept_client(int listener, bool websocket)
+{
+    int fd = accept4(listener, nullptr, nullptr, SOCK_NONBLOCK | SOCK_CLOEXEC);
+    if (fd < 0) {
+        return;
+    }
+    // without a device there is nothing to offer; clients retry
+    if (!dispatcher_.ready() || clients_.size() >= MAX_CLIENTS) {
+        ::close(fd);
+        return;
+    }
+    Client client;
+    if (websocket) {
+        int one = 1;
+        setsockopt(fd, IPPROTO_TCP, TCP_NODELAY, &one, sizeof(one));
+        client.ws = std::make_unique<WebSocket>(fd, &options_.ws_origins);
+    }
+    // Unix clients are greeted at once, WebSocket clients after the upgrade
+    if (!websocket && !greet(fd, client)) {
+        ::close(fd);
+        return;
+    }
+    watch(fd);
+    clients_.emplace(fd, std::move(client));
+    HLOGD(TAG, "client %d connected (%s)", fd, websocket ? "websocket" : "unix");
+}
+
+bool Server::greet(int fd, Client &client)
+{
+    for (const Packet &pkt : dispatcher_.hello()) {
+        bool ok = client.ws ? client.ws->send_binary(pkt.data(), pkt.size())
+                            : send(fd, pkt.data(), pkt.size(), MSG_NOSIGNAL) == ssize_t(pkt.size());
+        if (!ok) {
+            return false;
+        }
+    }
+    client.greeted = true;
+    return true;
+}
+
+void Server::close_client(int fd)
+{
+    epoll_ctl(epoll_fd_, EPOLL_CTL_DEL, fd, nullptr);
+    ::close(fd);
+    clients_.erase(fd);
+    HLOGD(TAG, "client %d closed", fd);
+}
+
+void Server::close_all_clients()
+{
+    while (!clients_.empty()) {
+        close_client(clients_.begin()->first);
+    }
+}
+
+void Server::on_records(const uint8_t *data, size_t len)
+{
+    Command cmds[HP_HID_MAX_RECORDS * 8];
+    const int64_t now_us = monotonic_us();
+    size_t n = 0;
+
+    // a partial record at the end is a client bug; it is ignored
+    for (size_t pos = 0; pos + HP_RECORD_SIZE <= len; pos += HP_RECORD_SIZE) {
+        cmds[n].rec = decode_record(data + pos);
+        cmds[n].t_us = now_us;
+        if (++n == sizeof(cmds) / sizeof(cmds[0])) {
+            dispatcher_.submit(cmds, n);
+            n = 0;
+        }
+    }
+    if (n) {
+        dispatcher_.submit(cmds, n);
+    }
+}
+
+void Server::on_client(int fd)
+{
+    Client &client = clients_.at(fd);
+
+    if (client.ws) {
+        bool open = client.ws->on_readable([this](const uint8_t *data, size_t len) { on_records(data, len); });
+        if (open && !client.greeted && client.ws->is_open()) {
+            open = greet(fd, client);
+        }
+        if (!open) {
+            close_client(fd);
+        }
+        return;
+    }
+
+    uint8_t buf[4096];
+    for (;;) {
+        ssize_t n = recv(fd, buf, sizeof(buf), 0);
+        if (n < 0 && errno == EINTR) {
+            continue;
+        }
+        if (n < 0 && (errno == EAGAIN || errno == EWOULDBLOCK)) {
+            return;
+        }
+        if (n <= 0) {
+            close_client(fd);
+            return;
+        }
+        on_records(buf, size_t(n));
+    }
+}
+
+bool Server::run()
+{
+    epoll_fd_ = epoll_create1(EPOLL_CLOEXEC);
+    if (epoll_fd_ < 0) {
+        HLOGE(TAG, "epoll: %s", std::strerror(errno));
+        return false;
+    }
+
+    sigset_t mask;
+    sigemptyset(&mask);
+    sigaddset(&mask, SIGINT);
+    sigaddset(&mask, SIGTERM);
+    sigaddset(&mask, SIGUSR1);
+    pthread_sigmask(SIG_BLOCK, &mask, nullptr);
+    signal_fd_ = signalfd(-1, &mask, SFD_NONBLOCK | SFD_CLOEXEC);
+    watch(signal_fd_);
+    watch(dispatcher_.event_fd());
+    for (int fd : input_.fds()) {
+        watch(fd);
+    }
+
+    if (!options_.socket_path.empty() && !listen_unix()) {
+        return false;
+    }
+    if (options_.ws_port && !listen_tcp()) {
+        return false;
+    }
+
+    bool device_ready = dispatcher_.ready();
+    for (;;) {
+        epoll_event events[16];
+        int n = epoll_wait(epoll_fd_, events, 16, -1);
+        if (n < 0 && errno == EINTR) {
+            continue;
+        }
+        if (n < 0) {
+            HLOGE(TAG, "epoll_wait: %s", std::strerror(errno));
+            return false;
+        }
+        for (int i = 0; i < n; i++) {
+            const int fd = events[i].data.fd;
+
+            if (fd == signal_fd_) {
+                signalfd_siginfo si;
+                while (read(signal_fd_, &si, sizeof(si)) == sizeof(si)) {
+                    if (si.ssi_signo == SIGUSR1) {
+                        dispatcher_.print_stats(stderr);
+                    } else {
+                        HLOGI(TAG, "exiting on signal %u", si.ssi_signo);
+                        return true;
+                    }
+                }
+            } else if (fd == dispatcher_.event_fd()) {
+                uint64_t count;
+                while (read(fd, &count, sizeof(count)) == sizeof(count)) {
+                }
+                // the device was lost, maybe reopened since: clients hold the
+                // old catalog and reconnect for the new one
+                if (device_ready) {
+                    close_all_clients();
+                }
+                device_ready = dispatcher_.ready();
+            } else if (fd == unix_fd_ || fd == tcp_fd_) {
+                accept_client(fd, fd == tcp_fd_);
+            } else if (clients_.count(fd)) {
+                on_client(fd);
+            } else if (!input_.on_readable(fd)) {
+                epoll_ctl(epoll_fd_, EPOLL_CTL_DEL, fd, nullptr);
+            }
+        }
+    }
+}
+
+}  // namespace hapticd
@@ -0,0 +1,64 @@
+#pragma once
+
+#include <cstdint>
+#include <map>
+#include <memory>
+#include <string>
+#include <vector>
+
+#include "dispatcher.h"
+#include "evdev_input.h"
+#include "websocket.h"
+
+namespace hapticd {
+
+// Client side of the daemon, all on one epoll loop: the Unix socket and the
+// WebSocket listener, their clients, the input devices and the signals.
+// Clients receive the device's CAPS and EFFECTS packets on connect and send
+// bare 8-byte command records; they are dropped whenever the device goes
+// away and refused while there is none.
+class Server {
+public:
+    struct Options {
+        std::string socket_path;                // Unix SOCK_SEQPACKET socket, empty = none
+        int ws_port = 8765;                     // 127.0.0.1 WebSocket port, 0 = none
+        std::vector<std::string> ws_origins;    // accepted Origin headers, "*" = any, empty = extensions
+    };
+
+    Server(const Options &options, Dispatcher &dispatcher, EvdevInput &input);
+    Server(const Server &) = delete;
+    Server &operator=(const Server &) = delete;
+    ~Server();
+
+    // Run until SIGINT or SIGTERM; false if a listener could not be set up
+    bool run();
+
+    static std::string default_socket_path();
+
+private:
+    struct Client {
+        std::unique_ptr<WebSocket> ws;          // null on the Unix socket
+        bool greeted = false;
+    };
+
+    bool listen_unix();
+    bool listen_tcp();
+    void watch(int fd);
+    void accept_client(int listener, bool websocket);
+    void close_client(int fd);
+    void close_all_clients();
+    bool greet(int fd, Client &client);
+    void on_client(int fd);
+    void on_records(const uint8_t *data, size_t len);
+
+    Options options_;
+    Dispatcher &dispatcher_;
+    EvdevInput &input_;
+    int epoll_fd_ = -1;
+    int unix_fd_ = -1;
+    int tcp_fd_ = -1;
+    int signal_fd_ = -1;
+    std::map<int, Client> clients_;
+};
+
+}  // namespace hapticd
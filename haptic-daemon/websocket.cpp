@@ -0,0 +1,339 @@
+#include "websocket.h"
+
+#include <algorithm>
+#include <cctype>
+#include <cerrno>
+#include <cstring>
+#include <sys/socket.h>
+#include <unistd.h>
+
+#include "log.h"
+
+namespace hapticd {
+
+static const char *TAG = "websocket";
+
+namespace {
+
+constexpr size_t MAX_HANDSHAKE = 4096;
+constexpr size_t MAX_MESSAGE = 4096;    // records are 8 bytes; anything larger is not a client of ours
+constexpr char EXTENSION_ORIGIN[] = "chrome-extension://";
+
+enum : uint8_t {
+    OP_CONTINUATION = 0x0,
+    OP_TEXT = 0x1,
+    OP_BINARY = 0x2,
+    OP_CLOSE = 0x8,
+    OP_PING = 0x9,
+    OP_PONG = 0xA,
+};
+
+uint32_t rol(uint32_t v, int n)
+{
+    return (v << n) | (v >> (32 - n));
+}
+
+// SHA-1, only for the handshake
+void sha1(const std::string &msg, uint8_t out[20])
+{
+    uint32_t h[5] = { 0x67452301, 0xEFCDAB89, 0x98BADCFE, 0x10325476, 0xC3D2E1F0 };
+    std::vector<uint8_t> data(msg.begin(), msg.end());
+    uint64_t bits = uint64_t(data.size()) * 8;
+
+    data.push_back(0x80);
+    while (data.size() % 64 != 56) {
+        data.push_back(0);
+    }
+    for (int i = 7; i >= 0; i--) {
+        data.push_back(uint8_t(bits >> (8 * i)));
+    }
+
+    for (size_t chunk = 0; chunk < data.size(); chunk += 64) {
+        uint32_t w[80];
+        for (int i = 0; i < 16; i++) {
+            const uint8_t *p = &data[chunk + 4 * i];
+            w[i] = uint32_t(p[0]) << 24 | uint32_t(p[1]) << 16 | uint32_t(p[2]) << 8 | p[3];
+        }
+        for (int i = 16; i < 80; i++) {
+            w[i] = rol(w[i - 3] ^ w[i - 8] ^ w[i - 14] ^ w[i - 16], 1);
+        }
+        uint32_t a = h[0], b = h[1], c = h[2], d = h[3], e = h[4];
+        for (int i = 0; i < 80; i++) {
+            uint32_t f, k;
+            if (i < 20) {
+                f = (b & c) | (~b & d);
+                k = 0x5A827999;
+            } else if (i < 40) {
+                f = b ^ c ^ d;
+                k = 0x6ED9EBA1;
+            } else if (i < 60) {
+                f = (b & c) | (b & d) | (c & d);
+                k = 0x8F1BBCDC;
+            } else {
+                f = b ^ c ^ d;
+                k = 0xCA62C1D6;
+            }
+            uint32_t t = rol(a, 5) + f + e + k + w[i];
+            e = d;
+            d = c;
+            c = rol(b, 30);
+            b = a;
+            a = t;
+        }
+        h[0] += a;
+        h[1] += b;
+        h[2] += c;
+        h[3] += d;
+        h[4] += e;
+    }
+    for (int i = 0; i < 20; i++) {
+        out[i] = uint8_t(h[i / 4] >> (24 - 8 * (i % 4)));
+    }
+}
+
+std::string base64(const uint8_t *data, size_t len)
+{
+    static const char table[] = "ABCDEFGHIJKLMNOPQRSTUVWXYZabcdefghijklmnopqrstuvwxyz0123456789+/";
+    std::string out;
+
+    for (size_t i = 0; i < len; i += 3) {
+        uint32_t v = uint32_t(data[i]) << 16;
+        if (i + 1 < len) {
+            v |= uint32_t(data[i + 1]) << 8;
+        }
+        if (i + 2 < len) {
+            v |= data[i + 2];
+        }
+        out += table[(v >> 18) & 63];
+        out += table[(v >> 12) & 63];
+        out += i + 1 < len ? table[(v >> 6) & 63] : '=';
+        out += i + 2 < len ? table[v & 63] : '=';
+    }
+    return out;
+}
+
+// Value of an HTTP header, case-insensitive name, empty if absent
+std::string header(const std::string &request, const char *name)
+{
+    std::string lower(request);
+    std::string key = std::string("\r\n") + name + ":";
+    std::transform(lower.begin(), lower.end(), lower.begin(), [](unsigned char c) { return std::tolower(c); });
+    std::transform(key.begin(), key.end(), key.begin(), [](unsigned char c) { return std::tolower(c); });
+
+    size_t pos = lower.find(key);
+    if (pos == std::string::npos) {
+        return "";
+    }
+    size_t start = request.find_first_not_of(" \t", pos + key.size());
+    size_t end = request.find("\r\n", start);
+    return request.substr(start, end - start);
+}
+
+}  // namespace
+
+std::string WebSocket::accept_key(const std::string &key)
+{
+    uint8_t digest[20];
+    sha1(key + "258EAFA5-E914-47DA-95CA-C5AB0DC85B11", digest);
+    return base64(digest, sizeof(digest));
+}
+
+WebSocket::WebSocket(int fd, const std::vector<std::string> *origins)
+    : fd_(fd), origins_(origins)
+{
+}
+
+bool WebSocket::send_all(const uint8_t *data, size_t len)
+{
+    while (len) {
+        ssize_t n = send(fd_, data, len, MSG_NOSIGNAL);
+        if (n < 0 && errno == EINTR) {
+            continue;
+        }
+        if (n <= 0) {
+            // a client that cannot keep up with a few bytes is dropped
+            return false;
+        }
+        data += n;
+        len -= size_t(n);
+    }
+    return true;
+}
+
+bool WebSocket::origin_allowed(const std::string &origin) const
+{
+    if (origins_->empty()) {
+        return origin.compare(0, sizeof(EXTENSION_ORIGIN) - 1, EXTENSION_ORIGIN) == 0 &&
+               origin.size() > sizeof(EXTENSION_ORIGIN) - 1;
+    }
+    return std::find(origins_->begin(), origins_->end(), origin) != origins_->end() ||
+           std::find(origins_->begin(), origins_->end(), "*") != origins_->end();
+}
+
+bool WebSocket::handshake()
+{
+    std::string request(in_.begin(), in_.end());
+    size_t end = request.find("\r\n\r\n");
+    if (end == std::string::npos) {
+        return in_.size() < MAX_HANDSHAKE;
+    }
+    request.resize(end + 2);
+    in_.erase(in_.begin(), in_.begin() + end + 4);
+
+    std::string key = header(request, "Sec-WebSocket-Key");
+    std::string upgrade = header(request, "Upgrade");
+    std::string origin = header(request, "Origin");
+    std::transform(upgrade.begin(), upgrade.end(), upgrade.begin(), [](unsigned char c) { return std::tolower(c); });
+
+    const char *error = nullptr;
+    if (request.compare(0, 4, "GET ") != 0 || upgrade != "websocket" || key.empty()) {
+        error = "400 Bad Request";
+    } else if (!origin_allowed(origin)) {
+        HLOGW(TAG, "refused origin \"%s\"", origin.c_str());
+        error = "403 Forbidden";
+    }
+    if (error) {
+        std::string reply = std::string("HTTP/1.1 ") + error + "\r\nConnection: close\r\nContent-Length: 0\r\n\r\n";
+        send_all(reinterpret_cast<const uint8_t *>(reply.data()), reply.size());
+        return false;
+    }
+
+    std::string reply = "HTTP/1.1 101 Switching Protocols\r\n"
+                        "Upgrade: websocket\r\n"
+                        "Connection: Upgrade\r\n"
+                        "Sec-WebSocket-Accept: " + accept_key(key) + "\r\n\r\n";
+    if (!send_all(reinterpret_cast<const uint8_t *>(reply.data()), reply.size())) {
+        return false;
+    }
+    HLOGD(TAG, "fd %d: open, origin \"%s\"", fd_, origin.c_str());
+    state_ = State::OPEN;
+    return true;
+}
+
+bool WebSocket::parse_frames(const MessageHandler &on_message)
+{
+    for (;;) {
+        if (in_.size() < 2) {
+            return true;
+        }
+        const bool fin = in_[0] & 0x80;
+        const uint8_t opcode = in_[0] & 0x0F;
+        const bool masked = in_[1] & 0x80;
+        uint64_t len = in_[1] & 0x7F;
+        size_t pos = 2;
+
+        if (len == 126) {
+            if (in_.size() < 4) {
+                return true;
+            }
+            len = uint64_t(in_[2]) << 8 | in_[3];
+            pos = 4;
+        } else if (len == 127) {
+            if (in_.size() < 10) {
+                return true;
+            }
+            len = 0;
+            for (int i = 0; i < 8; i++) {
+                len = len << 8 | in_[2 + i];
+            }
+            pos = 10;
+        }
+        // clients must mask; oversized frames are not from our clients
+        if (!masked || len > MAX_MESSAGE) {
+            send_frame(OP_CLOSE, reinterpret_cast<const uint8_t *>("\x03\xea"), 2);     // 1002 protocol error
+            return false;
+        }
+        if (in_.size() < pos + 4 + len) {
+            return true;
+        }
+
+        const uint8_t *mask = &in_[pos];
+        uint8_t *payload = &in_[pos + 4];
+        for (uint64_t i = 0; i < len; i++) {
+            payload[i] ^= mask[i % 4];
+        }
+
+        switch (opcode) {
+        case OP_BINARY:
+        case OP_TEXT:
+        case OP_CONTINUATION:
+            if (opcode != OP_CONTINUATION) {
+                message_.clear();
+                message_.push_back(opcode);
+            }
+            if (message_.empty() || message_.size() + len > MAX_MESSAGE) {
+                return false;
+            }
+            message_.insert(message_.end(), payload, payload + len);
+            if (fin) {
+                if (message_[0] == OP_BINARY) {
+                    on_message(message_.data() + 1, message_.size() - 1);
+                }
+                message_.clear();
+            }
+            break;
+        case OP_PING:
+            send_frame(OP_PONG, payload, size_t(len));
+            break;
+        case OP_CLOSE:
+            send_frame(OP_CLOSE, payload, std::min<size_t>(size_t(len), 2));
+            return false;
+        default:
+            break;
+        }
+        in_.erase(in_.begin(), in_.begin() + pos + 4 + len);
+    }
+}
+
+bool WebSocket::on_readable(const MessageHandler &on_message)
+{
+    uint8_t buf[4096];
+
+    for (;;) {
+        ssize_t n = recv(fd_, buf, sizeof(buf), 0);
+        if (n < 0 && errno == EINTR) {
+            continue;
+        }
+        if (n < 0 && (errno == EAGAIN || errno == EWOULDBLOCK)) {
+            return true;
+        }
+        if (n <= 0) {
+            return false;
+        }
+        in_.insert(in_.end(), buf, buf + n);
+        if (state_ == State::HANDSHAKE && !handshake()) {
+            return false;
+        }
+        if (state_ == State::OPEN && !parse_frames(on_message)) {
+            state_ = State::CLOSED;
+            return false;
+        }
+    }
+}
+
+bool WebSocket::send_frame(uint8_t opcode, const uint8_t *data, size_t len)
+{
+    uint8_t frame[10 + MAX_MESSAGE];
+    size_t pos = 0;
+
+    if (len > MAX_MESSAGE) {
+        return false;
+    }
+    frame[pos++] = uint8_t(0x80 | opcode);
+    if (len < 126) {
+        frame[pos++] = uint8_t(len);
+    } else {
+        frame[pos++] = 126;
+        frame[pos++] = uint8_t(len >> 8);
+        frame[pos++] = uint8_t(len);
+    }
+    std::memcpy(frame + pos, data, len);
+    return send_all(frame, pos + len);
+}
+
+bool WebSocket::send_binary(const uint8_t *data, size_t len)
+{
+    return state_ == State::OPEN && send_frame(OP_BINARY, data, len);
+}
+
+}  // namespace hapticd
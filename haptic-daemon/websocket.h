@@ -0,0 +1,47 @@
+#pragma once
+
+#include <cstdint>
+#include <functional>
+#include <string>
+#include <vector>
+
+namespace hapticd {
+
+// Server side of one RFC 6455 WebSocket connection on a non-blocking
+// socket: the HTTP upgrade, then binary messages. Text messages are
+// ignored, pings answered; fragmented messages are reassembled.
+class WebSocket {
+public:
+    using MessageHandler = std::function<void(const uint8_t *data, size_t len)>;
+
+    // `origins`: accepted Origin headers, "*" = any; empty = browser
+    // extensions only (chrome-extension://), since any web page can open a
+    // WebSocket to 127.0.0.1 as well
+    WebSocket(int fd, const std::vector<std::string> *origins);
+
+    // Consume what is readable; false once the connection is to be closed
+    bool on_readable(const MessageHandler &on_message);
+    bool is_open() const { return state_ == State::OPEN; }
+    // Send one binary message; false if the socket cannot take it
+    bool send_binary(const uint8_t *data, size_t len);
+
+    // Sec-WebSocket-Accept for a Sec-WebSocket-Key
+    static std::string accept_key(const std::string &key);
+
+private:
+    enum class State { HANDSHAKE, OPEN, CLOSED };
+
+    bool handshake();
+    bool origin_allowed(const std::string &origin) const;
+    bool parse_frames(const MessageHandler &on_message);
+    bool send_frame(uint8_t opcode, const uint8_t *data, size_t len);
+    bool send_all(const uint8_t *data, size_t len);
+
+    int fd_;
+    const std::vector<std::string> *origins_;
+    State state_ = State::HANDSHAKE;
+    std::vector<uint8_t> in_;
+    std::vector<uint8_t> message_;      // fragments of the message being reassembled
+};
+
+}  // namespace hapticd
@@ -1,131 +1,157 @@
 #include "drv2605_effects.h"
 
-/* DRV2605 Library Effects Name Table
- * Index i  (1-123)  →  Name shown in TI datasheet
+/*
+ * DRV2605 library effects as listed in the TI datasheet:
+ * X(id, duration ms, peak %, category, name)
+ *
+ * Durations are the nominal length of each waveform on a typical 170 -
+ * 240 Hz LRA, rounded to 5 ms; peak is the strength the datasheet gives in
+ * the name (the higher end for ramps). The player's scheduler uses them to
+ * tell a running effect from a finished one without polling the GO bit.
  */
-const char *const drv2605_effect_names[124] = {
-    [0]   = "",
-    [1]   = "Strong Click - 100%",
-    [2]   = "Strong Click - 60%",
-    [3]   = "Strong Click - 30%",
-    [4]   = "Sharp Click - 100%",
-    [5]   = "Sharp Click - 60%",
-    [6]   = "Sharp Click - 30%",
-    [7]   = "Soft Bump - 100%",
-    [8]   = "Soft Bump - 60%",
-    [9]   = "Soft Bump - 30%",
-    [10]  = "Double Click - 100%",
-    [11]  = "Double Click - 60%",
-    [12]  = "Triple Click - 100%",
-    [13]  = "Soft Fuzz - 60%",
-    [14]  = "Strong Buzz - 100%",
-    [15]  = "750 ms Alert - 100%",
-    [16]  = "1000 ms Alert - 100%",
-    [17]  = "Strong Click 1 - 100%",
-    [18]  = "Strong Click 2 - 80%",
-    [19]  = "Strong Click 3 - 60%",
-    [20]  = "Strong Click 4 - 30%",
-    [21]  = "Medium Click 1 - 100%",
-    [22]  = "Medium Click 2 - 80%",
-    [23]  = "Medium Click 3 - 60%",
-    [24]  = "Sharp Tick 1 - 100%",
-    [25]  = "Sharp Tick 2 - 80%",
-    [26]  = "Sharp Tick 3 - 60%",
-    [27]  = "Short Double Click Strong 1 - 100%",
-    [28]  = "Short Double Click Strong 2 - 80%",
-    [29]  = "Short Double Click Strong 3 - 60%",
-    [30]  = "Short Double Click Strong 4 - 30%",
-    [31]  = "Short Double Click Medium 1 - 100%",
-    [32]  = "Short Double Click Medium 2 - 80%",
-    [33]  = "Short Double Click Medium 3 - 60%",
-    [34]  = "Short Double Sharp Tick 1 - 100%",
-    [35]  = "Short Double Sharp Tick 2 - 80%",
-    [36]  = "Short Double Sharp Tick 3 - 60%",
-    [37]  = "Long Double Sharp Click Strong 1 - 100%",
-    [38]  = "Long Double Sharp Click Strong 2 - 80%",
-    [39]  = "Long Double Sharp Click Strong 3 - 60%",
-    [40]  = "Long Double Sharp Click Strong 4 - 30%",
-    [41]  = "Long Double Sharp Click Medium 1 - 100%",
-    [42]  = "Long Double Sharp Click Medium 2 - 80%",
-    [43]  = "Long Double Sharp Click Medium 3 - 60%",
-    [44]  = "Long Double Sharp Tick 1 - 100%",
-    [45]  = "Long Double Sharp Tick 2 - 80%",
-    [46]  = "Long Double Sharp Tick 3 - 60%",
-    [47]  = "Buzz 1 - 100%",
-    [48]  = "Buzz 2 - 80%",
-    [49]  = "Buzz 3 - 60%",
-    [50]  = "Buzz 4 - 40%",
-    [51]  = "Buzz 5 - 20%",
-    [52]  = "Pulsing Strong 1 - 100%",
-    [53]  = "Pulsing Strong 2 - 60%",
-    [54]  = "Pulsing Medium 1 - 100%",
-    [55]  = "Pulsing Medium 2 - 60%",
-    [56]  = "Pulsing Sharp 1 - 100%",
-    [57]  = "Pulsing Sharp 2 - 60%",
-    [58]  = "Transition Click 1 - 100%",
-    [59]  = "Transition Click 2 - 80%",
-    [60]  = "Transition Click 3 - 60%",
-    [61]  = "Transition Click 4 - 40%",
-    [62]  = "Transition Click 5 - 20%",
-    [63]  = "Transition Click 6 - 10%",
-    [64]  = "Transition Hum 1 - 100%",
-    [65]  = "Transition Hum 2 - 80%",
-    [66]  = "Transition Hum 3 - 60%",
-    [67]  = "Transition Hum 4 - 40%",
-    [68]  = "Transition Hum 5 - 20%",
-    [69]  = "Transition Hum 6 - 10%",
-    [70]  = "Transition Ramp Down Long Smooth 1 - 100→0%",
-    [71]  = "Transition Ramp Down Long Smooth 2 - 100→0%",
-    [72]  = "Transition Ramp Down Medium Smooth 1 - 100→0%",
-    [73]  = "Transition Ramp Down Medium Smooth 2 - 100→0%",
-    [74]  = "Transition Ramp Down Short Smooth 1 - 100→0%",
-    [75]  = "Transition Ramp Down Short Smooth 2 - 100→0%",
-    [76]  = "Transition Ramp Down Long Sharp 1 - 100→0%",
-    [77]  = "Transition Ramp Down Long Sharp 2 - 100→0%",
-    [78]  = "Transition Ramp Down Medium Sharp 1 - 100→0%",
-    [79]  = "Transition Ramp Down Medium Sharp 2 - 100→0%",
-    [80]  = "Transition Ramp Down Short Sharp 1 - 100→0%",
-    [81]  = "Transition Ramp Down Short Sharp 2 - 100→0%",
-    [82]  = "Transition Ramp Up Long Smooth 1 - 0→100%",
-    [83]  = "Transition Ramp Up Long Smooth 2 - 0→100%",
-    [84]  = "Transition Ramp Up Medium Smooth 1 - 0→100%",
-    [85]  = "Transition Ramp Up Medium Smooth 2 - 0→100%",
-    [86]  = "Transition Ramp Up Short Smooth 1 - 0→100%",
-    [87]  = "Transition Ramp Up Short Smooth 2 - 0→100%",
-    [88]  = "Transition Ramp Up Long Sharp 1 - 0→100%",
-    [89]  = "Transition Ramp Up Long Sharp 2 - 0→100%",
-    [90]  = "Transition Ramp Up Medium Sharp 1 - 0→100%",
-    [91]  = "Transition Ramp Up Medium Sharp 2 - 0→100%",
-    [92]  = "Transition Ramp Up Short Sharp 1 - 0→100%",
-    [93]  = "Transition Ramp Up Short Sharp 2 - 0→100%",
-    [94]  = "Transition Ramp Down Long Smooth 1 - 50→0%",
-    [95]  = "Transition Ramp Down Long Smooth 2 - 50→0%",
-    [96]  = "Transition Ramp Down Medium Smooth 1 - 50→0%",
-    [97]  = "Transition Ramp Down Medium Smooth 2 - 50→0%",
-    [98]  = "Transition Ramp Down Short Smooth 1 - 50→0%",
-    [99]  = "Transition Ramp Down Short Smooth 2 - 50→0%",
-    [100] = "Transition Ramp Down Long Sharp 1 - 50→0%",
-    [101] = "Transition Ramp Down Long Sharp 2 - 50→0%",
-    [102] = "Transition Ramp Down Medium Sharp 1 - 50→0%",
-    [103] = "Transition Ramp Down Medium Sharp 2 - 50→0%",
-    [104] = "Transition Ramp Down Short Sharp 1 - 50→0%",
-    [105] = "Transition Ramp Down Short Sharp 2 - 50→0%",
-    [106] = "Transition Ramp Up Long Smooth 1 - 0→50%",
-    [107] = "Transition Ramp Up Long Smooth 2 - 0→50%",
-    [108] = "Transition Ramp Up Medium Smooth 1 - 0→50%",
-    [109] = "Transition Ramp Up Medium Smooth 2 - 0→50%",
-    [110] = "Transition Ramp Up Short Smooth 1 - 0→50%",
-    [111] = "Transition Ramp Up Short Smooth 2 - 0→50%",
-    [112] = "Transition Ramp Up Long Sharp 1 - 0→50%",
-    [113] = "Transition Ramp Up Long Sharp 2 - 0→50%",
-    [114] = "Transition Ramp Up Medium Sharp 1 - 0→50%",
-    [115] = "Transition Ramp Up Medium Sharp 2 - 0→50%",
-    [116] = "Transition Ramp Up Short Sharp 1 - 0→50%",
-    [117] = "Transition Ramp Up Short Sharp 2 - 0→50%",
-    [118] = "Long Buzz for Programmatic Stopping - 100%",
-    [119] = "Smooth Hum 1 (No kick or brake pulse) - 50%",
-    [120] = "Smooth Hum 2 (No kick or brake pulse) - 40%",
-    [121] = "Smooth Hum 3 (No kick or brake pulse) - 30%",
-    [122] = "Smooth Hum 4 (No kick or brake pulse) - 20%",
-    [123] = "Smooth Hum 5 (No kick or brake pulse) - 10%"
+#define DRV2605_EFFECT_LIST(X) \
+    X(  1,   60, 100, CLICK,       "Strong Click - 100%") \
+    X(  2,   60,  60, CLICK,       "Strong Click - 60%") \
+    X(  3,   60,  30, CLICK,       "Strong Click - 30%") \
+    X(  4,   45, 100, CLICK,       "Sharp Click - 100%") \
+    X(  5,   45,  60, CLICK,       "Sharp Click - 60%") \
+    X(  6,   45,  30, CLICK,       "Sharp Click - 30%") \
+    X(  7,  100, 100, BUMP,        "Soft Bump - 100%") \
+    X(  8,  100,  60, BUMP,        "Soft Bump - 60%") \
+    X(  9,  100,  30, BUMP,        "Soft Bump - 30%") \
+    X( 10,  160, 100, MULTI_CLICK, "Double Click - 100%") \
+    X( 11,  160,  60, MULTI_CLICK, "Double Click - 60%") \
+    X( 12,  250, 100, MULTI_CLICK, "Triple Click - 100%") \
+    X( 13,  260,  60, BUZZ,        "Soft Fuzz - 60%") \
+    X( 14,  250, 100, BUZZ,        "Strong Buzz - 100%") \
+    X( 15,  750, 100, ALERT,       "750 ms Alert - 100%") \
+    X( 16, 1000, 100, ALERT,       "1000 ms Alert - 100%") \
+    X( 17,   60, 100, CLICK,       "Strong Click 1 - 100%") \
+    X( 18,   60,  80, CLICK,       "Strong Click 2 - 80%") \
+    X( 19,   60,  60, CLICK,       "Strong Click 3 - 60%") \
+    X( 20,   60,  30, CLICK,       "Strong Click 4 - 30%") \
+    X( 21,   50, 100, CLICK,       "Medium Click 1 - 100%") \
+    X( 22,   50,  80, CLICK,       "Medium Click 2 - 80%") \
+    X( 23,   50,  60, CLICK,       "Medium Click 3 - 60%") \
+    X( 24,   30, 100, TICK,        "Sharp Tick 1 - 100%") \
+    X( 25,   30,  80, TICK,        "Sharp Tick 2 - 80%") \
+    X( 26,   30,  60, TICK,        "Sharp Tick 3 - 60%") \
+    X( 27,  130, 100, MULTI_CLICK, "Short Double Click Strong 1 - 100%") \
+    X( 28,  130,  80, MULTI_CLICK, "Short Double Click Strong 2 - 80%") \
+    X( 29,  130,  60, MULTI_CLICK, "Short Double Click Strong 3 - 60%") \
+    X( 30,  130,  30, MULTI_CLICK, "Short Double Click Strong 4 - 30%") \
+    X( 31,  120, 100, MULTI_CLICK, "Short Double Click Medium 1 - 100%") \
+    X( 32,  120,  80, MULTI_CLICK, "Short Double Click Medium 2 - 80%") \
+    X( 33,  120,  60, MULTI_CLICK, "Short Double Click Medium 3 - 60%") \
+    X( 34,  100, 100, MULTI_CLICK, "Short Double Sharp Tick 1 - 100%") \
+    X( 35,  100,  80, MULTI_CLICK, "Short Double Sharp Tick 2 - 80%") \
+    X( 36,  100,  60, MULTI_CLICK, "Short Double Sharp Tick 3 - 60%") \
+    X( 37,  200, 100, MULTI_CLICK, "Long Double Sharp Click Strong 1 - 100%") \
+    X( 38,  200,  80, MULTI_CLICK, "Long Double Sharp Click Strong 2 - 80%") \
+    X( 39,  200,  60, MULTI_CLICK, "Long Double Sharp Click Strong 3 - 60%") \
+    X( 40,  200,  30, MULTI_CLICK, "Long Double Sharp Click Strong 4 - 30%") \
+    X( 41,  190, 100, MULTI_CLICK, "Long Double Sharp Click Medium 1 - 100%") \
+    X( 42,  190,  80, MULTI_CLICK, "Long Double Sharp Click Medium 2 - 80%") \
+    X( 43,  190,  60, MULTI_CLICK, "Long Double Sharp Click Medium 3 - 60%") \
+    X( 44,  170, 100, MULTI_CLICK, "Long Double Sharp Tick 1 - 100%") \
+    X( 45,  170,  80, MULTI_CLICK, "Long Double Sharp Tick 2 - 80%") \
+    X( 46,  170,  60, MULTI_CLICK, "Long Double Sharp Tick 3 - 60%") \
+    X( 47,  400, 100, BUZZ,        "Buzz 1 - 100%") \
+    X( 48,  400,  80, BUZZ,        "Buzz 2 - 80%") \
+    X( 49,  400,  60, BUZZ,        "Buzz 3 - 60%") \
+    X( 50,  400,  40, BUZZ,        "Buzz 4 - 40%") \
+    X( 51,  400,  20, BUZZ,        "Buzz 5 - 20%") \
+    X( 52, 1000, 100, PULSE,       "Pulsing Strong 1 - 100%") \
+    X( 53, 1000,  60, PULSE,       "Pulsing Strong 2 - 60%") \
+    X( 54,  900, 100, PULSE,       "Pulsing Medium 1 - 100%") \
+    X( 55,  900,  60, PULSE,       "Pulsing Medium 2 - 60%") \
+    X( 56,  800, 100, PULSE,       "Pulsing Sharp 1 - 100%") \
+    X( 57,  800,  60, PULSE,       "Pulsing Sharp 2 - 60%") \
+    X( 58,   40, 100, CLICK,       "Transition Click 1 - 100%") \
+    X( 59,   40,  80, CLICK,       "Transition Click 2 - 80%") \
+    X( 60,   40,  60, CLICK,       "Transition Click 3 - 60%") \
+    X( 61,   40,  40, CLICK,       "Transition Click 4 - 40%") \
+    X( 62,   40,  20, CLICK,       "Transition Click 5 - 20%") \
+    X( 63,   40,  10, CLICK,       "Transition Click 6 - 10%") \
+    X( 64,  250, 100, HUM,         "Transition Hum 1 - 100%") \
+    X( 65,  250,  80, HUM,         "Transition Hum 2 - 80%") \
+    X( 66,  250,  60, HUM,         "Transition Hum 3 - 60%") \
+    X( 67,  250,  40, HUM,         "Transition Hum 4 - 40%") \
+    X( 68,  250,  20, HUM,         "Transition Hum 5 - 20%") \
+    X( 69,  250,  10, HUM,         "Transition Hum 6 - 10%") \
+    X( 70, 1000, 100, RAMP_DOWN,   "Transition Ramp Down Long Smooth 1 - 100→0%") \
+    X( 71, 1000, 100, RAMP_DOWN,   "Transition Ramp Down Long Smooth 2 - 100→0%") \
+    X( 72,  500, 100, RAMP_DOWN,   "Transition Ramp Down Medium Smooth 1 - 100→0%") \
+    X( 73,  500, 100, RAMP_DOWN,   "Transition Ramp Down Medium Smooth 2 - 100→0%") \
+    X( 74,  250, 100, RAMP_DOWN,   "Transition Ramp Down Short Smooth 1 - 100→0%") \
+    X( 75,  250, 100, RAMP_DOWN,   "Transition Ramp Down Short Smooth 2 - 100→0%") \
+    X( 76, 1000, 100, RAMP_DOWN,   "Transition Ramp Down Long Sharp 1 - 100→0%") \
+    X( 77, 1000, 100, RAMP_DOWN,   "Transition Ramp Down Long Sharp 2 - 100→0%") \
+    X( 78,  500, 100, RAMP_DOWN,   "Transition Ramp Down Medium Sharp 1 - 100→0%") \
+    X( 79,  500, 100, RAMP_DOWN,   "Transition Ramp Down Medium Sharp 2 - 100→0%") \
+    X( 80,  250, 100, RAMP_DOWN,   "Transition Ramp Down Short Sharp 1 - 100→0%") \
+    X( 81,  250, 100, RAMP_DOWN,   "Transition Ramp Down Short Sharp 2 - 100→0%") \
+    X( 82, 1000, 100, RAMP_UP,     "Transition Ramp Up Long Smooth 1 - 0→100%") \
+    X( 83, 1000, 100, RAMP_UP,     "Transition Ramp Up Long Smooth 2 - 0→100%") \
+    X( 84,  500, 100, RAMP_UP,     "Transition Ramp Up Medium Smooth 1 - 0→100%") \
+    X( 85,  500, 100, RAMP_UP,     "Transition Ramp Up Medium Smooth 2 - 0→100%") \
+    X( 86,  250, 100, RAMP_UP,     "Transition Ramp Up Short Smooth 1 - 0→100%") \
+    X( 87,  250, 100, RAMP_UP,     "Transition Ramp Up Short Smooth 2 - 0→100%") \
+    X( 88, 1000, 100, RAMP_UP,     "Transition Ramp Up Long Sharp 1 - 0→100%") \
+    X( 89, 1000, 100, RAMP_UP,     "Transition Ramp Up Long Sharp 2 - 0→100%") \
+    X( 90,  500, 100, RAMP_UP,     "Transition Ramp Up Medium Sharp 1 - 0→100%") \
+    X( 91,  500, 100, RAMP_UP,     "Transition Ramp Up Medium Sharp 2 - 0→100%") \
+    X( 92,  250, 100, RAMP_UP,     "Transition Ramp Up Short Sharp 1 - 0→100%") \
+    X( 93,  250, 100, RAMP_UP,     "Transition Ramp Up Short Sharp 2 - 0→100%") \
+    X( 94, 1000,  50, RAMP_DOWN,   "Transition Ramp Down Long Smooth 1 - 50→0%") \
+    X( 95, 1000,  50, RAMP_DOWN,   "Transition Ramp Down Long Smooth 2 - 50→0%") \
+    X( 96,  500,  50, RAMP_DOWN,   "Transition Ramp Down Medium Smooth 1 - 50→0%") \
+    X( 97,  500,  50, RAMP_DOWN,   "Transition Ramp Down Medium Smooth 2 - 50→0%") \
+    X( 98,  250,  50, RAMP_DOWN,   "Transition Ramp Down Short Smooth 1 - 50→0%") \
+    X( 99,  250,  50, RAMP_DOWN,   "Transition Ramp Down Short Smooth 2 - 50→0%") \
+    X(100, 1000,  50, RAMP_DOWN,   "Transition Ramp Down Long Sharp 1 - 50→0%") \
+    X(101, 1000,  50, RAMP_DOWN,   "Transition Ramp Down Long Sharp 2 - 50→0%") \
+    X(102,  500,  50, RAMP_DOWN,   "Transition Ramp Down Medium Sharp 1 - 50→0%") \
+    X(103,  500,  50, RAMP_DOWN,   "Transition Ramp Down Medium Sharp 2 - 50→0%") \
+    X(104,  250,  50, RAMP_DOWN,   "Transition Ramp Down Short Sharp 1 - 50→0%") \
+    X(105,  250,  50, RAMP_DOWN,   "Transition Ramp Down Short Sharp 2 - 50→0%") \
+    X(106, 1000,  50, RAMP_UP,     "Transition Ramp Up Long Smooth 1 - 0→50%") \
+    X(107, 1000,  50, RAMP_UP,     "Transition Ramp Up Long Smooth 2 - 0→50%") \
+    X(108,  500,  50, RAMP_UP,     "Transition Ramp Up Medium Smooth 1 - 0→50%") \
+    X(109,  500,  50, RAMP_UP,     "Transition Ramp Up Medium Smooth 2 - 0→50%") \
+    X(110,  250,  50, RAMP_UP,     "Transition Ramp Up Short Smooth 1 - 0→50%") \
+    X(111,  250,  50, RAMP_UP,     "Transition Ramp Up Short Smooth 2 - 0→50%") \
+    X(112, 1000,  50, RAMP_UP,     "Transition Ramp Up Long Sharp 1 - 0→50%") \
+    X(113, 1000,  50, RAMP_UP,     "Transition Ramp Up Long Sharp 2 - 0→50%") \
+    X(114,  500,  50, RAMP_UP,     "Transition Ramp Up Medium Sharp 1 - 0→50%") \
+    X(115,  500,  50, RAMP_UP,     "Transition Ramp Up Medium Sharp 2 - 0→50%") \
+    X(116,  250,  50, RAMP_UP,     "Transition Ramp Up Short Sharp 1 - 0→50%") \
+    X(117,  250,  50, RAMP_UP,     "Transition Ramp Up Short Sharp 2 - 0→50%") \
+    X(118, 1000, 100, BUZZ,        "Long Buzz for Programmatic Stopping - 100%") \
+    X(119,  400,  50, HUM,         "Smooth Hum 1 (No kick or brake pulse) - 50%") \
+    X(120,  400,  40, HUM,         "Smooth Hum 2 (No kick or brake pulse) - 40%") \
+    X(121,  400,  30, HUM,         "Smooth Hum 3 (No kick or brake pulse) - 30%") \
+    X(122,  400,  20, HUM,         "Smooth Hum 4 (No kick or brake pulse) - 20%") \
+    X(123,  400,  10, HUM,         "Smooth Hum 5 (No kick or brake pulse) - 10%")
+
+#define DRV2605_EFFECT_ENTRY(id, ms, pct, cat, label) \
+    [id] = { .duration_ms = (ms), .peak = (pct), .category = HP_EFFECT_##cat, .name = (label) },
+
+const drv2605_effect_t drv2605_effects[DRV2605_EFFECT_COUNT] = {
+    [0] = { .name = "" },
+    DRV2605_EFFECT_LIST(DRV2605_EFFECT_ENTRY)
 };
+
+/* The list must name every library effect once, in ID order, with a duration
+ * and a peak in range. Each entry gets an enumerator numbered by its position
+ * in the list, which must equal its ID; a repeated ID repeats the name. */
+#define DRV2605_EFFECT_POS(id, ...)                 DRV2605_EFFECT_POS_##id,
+#define DRV2605_EFFECT_AT(id, ...)                  && DRV2605_EFFECT_POS_##id == (id)
+#define DRV2605_EFFECT_VALID(id, ms, pct, cat, ...) && (ms) > 0 && (ms) <= 0xFFFF && (pct) > 0 && (pct) <= 100
+
+enum { DRV2605_EFFECT_POS_NONE, DRV2605_EFFECT_LIST(DRV2605_EFFECT_POS) DRV2605_EFFECT_POS_END };
+
+_Static_assert(DRV2605_EFFECT_POS_END == DRV2605_EFFECT_COUNT,
+               "catalog must list effects 1 .. DRV2605_EFFECT_COUNT - 1");
+_Static_assert(1 DRV2605_EFFECT_LIST(DRV2605_EFFECT_AT), "catalog IDs must be listed in order");
+_Static_assert(1 DRV2605_EFFECT_LIST(DRV2605_EFFECT_VALID), "catalog duration or peak out of range");
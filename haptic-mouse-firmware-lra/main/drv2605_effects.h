@@ -1,10 +1,37 @@
 #pragma once
+
+#include <stdint.h>
+#include "haptic_protocol.h"
+
 #ifdef __cplusplus
 extern "C" {
 #endif
 
-extern const char *const drv2605_effect_names[124];
+#define DRV2605_EFFECT_COUNT 124    ///< Library effects are 1 .. 123, 0 ends a sequence
+
+/**
+ * @brief Catalog entry of a library effect.
+ *
+ * Durations are nominal: the LRA waveforms follow the actuator's resonance
+ * in closed loop, so the real play time varies by a few percent.
+ */
+typedef struct {
+    uint16_t duration_ms;           /*!< Kick to end of brake */
+    uint8_t peak;                   /*!< Peak strength in % of full scale */
+    uint8_t category;               /*!< ::hp_effect_category_t */
+    const char *name;               /*!< Name in the TI datasheet */
+} drv2605_effect_t;
+
+extern const drv2605_effect_t drv2605_effects[DRV2605_EFFECT_COUNT];
+
+/**
+ * @brief Catalog entry of @p id, NULL for 0 and IDs out of range.
+ */
+static inline const drv2605_effect_t *drv2605_effect(uint8_t id)
+{
+    return (id > 0 && id < DRV2605_EFFECT_COUNT) ? &drv2605_effects[id] : NULL;
+}
 
 #ifdef __cplusplus
 }
-#endif
\ No newline at end of file
+#endif
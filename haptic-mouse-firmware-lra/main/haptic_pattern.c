@@ -0,0 +1,167 @@
+#include "haptic_pattern.h"
+
+#include "esp_log.h"
+#include "esp_check.h"
+#include "esp_timer.h"
+#include "haptic_trace.h"
+
+static const char *TAG = "haptic-pattern";
+
+static QueueHandle_t s_play_queue;
+static esp_timer_handle_t s_timer;
+
+/* Pattern state, written from the TinyUSB task and read from the esp_timer task */
+static portMUX_TYPE s_lock = portMUX_INITIALIZER_UNLOCKED;
+static haptic_play_t s_play;
+static uint32_t s_period_ms;
+static int64_t s_last_host_us;
+static bool s_running;
+static bool s_delayed_start;    // armed once for a scheduled START; goes periodic on the first repetition
+
+static void pattern_timer_cb(void *arg)
+{
+    haptic_play_t play;
+    bool running;
+    bool expired;
+    bool delayed_start;
+    uint32_t period_ms;
+
+    taskENTER_CRITICAL(&s_lock);
+    play = s_play;
+    running = s_running;
+    expired = (esp_timer_get_time() - s_last_host_us) > (int64_t)HAPTIC_PATTERN_TIMEOUT_MS * 1000;
+    delayed_start = s_delayed_start;
+    s_delayed_start = false;
+    period_ms = s_period_ms;
+    taskEXIT_CRITICAL(&s_lock);
+
+    if (!running) {
+        return;
+    }
+    if (delayed_start) {
+        esp_timer_start_periodic(s_timer, (uint64_t)period_ms * 1000);
+    }
+    if (expired) {
+        // the host went away without sending STOP
+        ESP_LOGW(TAG, "pattern timed out");
+        haptic_pattern_stop();
+        return;
+    }
+
+    // if the player is still busy, skip this repetition rather than queueing up
+    play.trace_tag = haptic_trace_tag();
+    play.trace_index = 0;
+    haptic_trace(HAPTIC_TRACE_ENQUEUE, play.trace_tag, 0, play.effect);
+    if (xQueueSend(s_play_queue, &play, 0) != pdTRUE) {
+        haptic_trace(HAPTIC_TRACE_DROP, play.trace_tag, 0, play.effect);
+    }
+}
+
+esp_err_t haptic_pattern_init(QueueHandle_t play_queue)
+{
+    ESP_RETURN_ON_FALSE(play_queue, ESP_ERR_INVALID_ARG, TAG, "null queue");
+    s_play_queue = play_queue;
+
+    const esp_timer_create_args_t timer_args = {
+        .callback = pattern_timer_cb,
+        .dispatch_method = ESP_TIMER_TASK,
+        .name = "haptic_pattern",
+        .skip_unhandled_events = true,
+    };
+    return esp_timer_create(&timer_args, &s_timer);
+}
+
+static void pattern_start(uint8_t effect, uint32_t period_ms, uint8_t intensity, int64_t at_us)
+{
+    int64_t delay = at_us - esp_timer_get_time();
+
+    esp_timer_stop(s_timer);
+
+    taskENTER_CRITICAL(&s_lock);
+    s_play.effect = effect;
+    s_play.intensity = intensity;
+    s_period_ms = period_ms;
+    s_last_host_us = esp_timer_get_time();
+    s_running = true;
+    s_delayed_start = delay > 0;
+    taskEXIT_CRITICAL(&s_lock);
+
+    if (delay > 0) {
+        // scheduled: the timer plays the first repetition and then goes periodic
+        esp_timer_start_once(s_timer, (uint64_t)delay);
+        return;
+    }
+
+    // first repetition right away, then on every period
+    haptic_play_t play = { .effect = effect, .intensity = intensity, .trace_tag = haptic_trace_tag() };
+    haptic_trace(HAPTIC_TRACE_ENQUEUE, play.trace_tag, 0, effect);
+    xQueueSend(s_play_queue, &play, 0);
+    esp_timer_start_periodic(s_timer, (uint64_t)period_ms * 1000);
+}
+
+static void pattern_update(uint32_t period_ms, uint8_t intensity)
+{
+    bool restart;
+
+    taskENTER_CRITICAL(&s_lock);
+    if (!s_running) {
+        taskEXIT_CRITICAL(&s_lock);
+        return;
+    }
+    s_play.intensity = intensity;
+    s_last_host_us = esp_timer_get_time();
+    restart = period_ms && period_ms != s_period_ms;
+    if (restart) {
+        s_period_ms = period_ms;
+        // a scheduled START picks up the new period when it fires
+        restart = !s_delayed_start;
+    }
+    taskEXIT_CRITICAL(&s_lock);
+
+    if (restart) {
+        esp_timer_restart(s_timer, (uint64_t)period_ms * 1000);
+    }
+}
+
+void haptic_pattern_stop(void)
+{
+    if (s_timer) {
+        esp_timer_stop(s_timer);
+    }
+    taskENTER_CRITICAL(&s_lock);
+    s_running = false;
+    s_delayed_start = false;
+    taskEXIT_CRITICAL(&s_lock);
+}
+
+esp_err_t haptic_pattern_command(haptic_pattern_op_t op, uint8_t effect, uint32_t period_ms, uint8_t intensity, int64_t at_us)
+{
+    if (period_ms && period_ms < HAPTIC_PATTERN_MIN_PERIOD) {
+        period_ms = HAPTIC_PATTERN_MIN_PERIOD;
+    }
+
+    switch (op) {
+    case HAPTIC_PATTERN_START:
+        if (effect == 0 || period_ms == 0) {
+            haptic_pattern_stop();
+        } else {
+            pattern_start(effect, period_ms, intensity, at_us);
+        }
+        return ESP_OK;
+    case HAPTIC_PATTERN_UPDATE:
+        pattern_update(period_ms, intensity);
+        return ESP_OK;
+    case HAPTIC_PATTERN_STOP:
+        haptic_pattern_stop();
+        return ESP_OK;
+    default:
+        return ESP_ERR_INVALID_ARG;
+    }
+}
+
+esp_err_t haptic_pattern_handle_report(const uint8_t *report, uint16_t len)
+{
+    ESP_RETURN_ON_FALSE(report && len >= 5, ESP_ERR_INVALID_SIZE, TAG, "short pattern report");
+
+    return haptic_pattern_command(report[0], report[1], report[2] | (report[3] << 8), report[4], 0);
+}
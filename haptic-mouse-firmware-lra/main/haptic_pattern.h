@@ -0,0 +1,101 @@
+#pragma once
+
+#include <stdint.h>
+#include "freertos/FreeRTOS.h"
+#include "freertos/queue.h"
+#include "esp_err.h"
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+/* -------------------------------------------------------------------------- */
+/*  Continuous pattern generator                                              */
+/*                                                                            */
+/*  Repeats one library effect at a fixed period from a local timer, so the   */
+/*  host sends one start report, optional updates and one stop report instead */
+/*  of one report per repetition.                                             */
+/* -------------------------------------------------------------------------- */
+
+#define HAPTIC_PATTERN_REPORT_ID   0x11    ///< HID output report carrying pattern commands
+#define HAPTIC_PATTERN_MIN_PERIOD  10      ///< Shortest repeat period (ms)
+#define HAPTIC_PATTERN_TIMEOUT_MS  2000    ///< Pattern stops if the host sends nothing for this long
+
+typedef enum {
+    HAPTIC_PATTERN_STOP   = 0x00,          ///< Stop the running pattern
+    HAPTIC_PATTERN_START  = 0x01,          ///< Start (or replace) a pattern
+    HAPTIC_PATTERN_UPDATE = 0x02,          ///< Change rate / intensity of the running pattern
+} haptic_pattern_op_t;
+
+/**
+ * @brief One effect to play, as posted to the player queue.
+ */
+typedef struct {
+    uint8_t effect;                        /*!< DRV2605 library effect ID (0 = stop playback) */
+    uint8_t intensity;                     /*!< 0 – 255, 255 = full scale */
+    uint8_t flags;                         /*!< HP_REC_FLAG_* from haptic_protocol.h */
+    int64_t at_us;                         /*!< esp_timer time to fire at, 0 = as soon as possible */
+    uint8_t repeat;                        /*!< Repetitions the player posts after this one */
+    uint16_t period_ms;                    /*!< Spacing of the repetitions, 0 = back to back */
+    uint32_t generation;                   /*!< Player alarm generation when posted, 0 = outlives flushes */
+    uint16_t trace_tag;                    /*!< haptic_trace.h tag, 0 = untraced */
+    uint8_t trace_index;                   /*!< Record index for haptic_trace() */
+} haptic_play_t;
+
+/**
+ * @brief Create the pattern timer.
+ *
+ * @param[in] play_queue  Queue of ::haptic_play_t consumed by the player loop.
+ *                        Every repetition of a running pattern is posted here.
+ *
+ * @return ESP_OK on success or an error code from esp_timer
+ */
+esp_err_t haptic_pattern_init(QueueHandle_t play_queue);
+
+/**
+ * @brief Handle a pattern report from the host.
+ *
+ * Report layout (after the report ID):
+ *
+ * | byte | field                               |
+ * |------|-------------------------------------|
+ * | 0    | op (::haptic_pattern_op_t)          |
+ * | 1    | effect ID (ignored by UPDATE/STOP)  |
+ * | 2-3  | period in ms, little endian         |
+ * | 4    | intensity (0 – 255)                 |
+ *
+ * START plays the first repetition immediately. UPDATE with a period of 0
+ * keeps the current period.
+ *
+ * @param[in] report  Report payload (without the report ID)
+ * @param[in] len     Payload length
+ *
+ * @return
+ *  - ESP_OK on success
+ *  - ESP_ERR_INVALID_SIZE if the payload is too short
+ *  - ESP_ERR_INVALID_ARG for an unknown op
+ */
+esp_err_t haptic_pattern_handle_report(const uint8_t *report, uint16_t len);
+
+/**
+ * @brief Execute one pattern command.
+ *
+ * Shared by the legacy pattern report and the PATTERN_* ops of the command
+ * protocol; arguments as in ::haptic_pattern_handle_report. A START with a
+ * future @p at_us (esp_timer time) plays its first repetition at that time
+ * and keeps the phase from there; other ops ignore it.
+ *
+ * @return
+ *  - ESP_OK on success
+ *  - ESP_ERR_INVALID_ARG for an unknown op
+ */
+esp_err_t haptic_pattern_command(haptic_pattern_op_t op, uint8_t effect, uint32_t period_ms, uint8_t intensity, int64_t at_us);
+
+/**
+ * @brief Stop the running pattern, if any.
+ */
+void haptic_pattern_stop(void);
+
+#ifdef __cplusplus
+}
+#endif
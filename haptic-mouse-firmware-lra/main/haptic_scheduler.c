@@ -0,0 +1,126 @@
+#include "haptic_scheduler.h"
+
+#include <string.h>
+#include "haptic_protocol.h"
+#include "drv2605_effects.h"
+
+void haptic_sched_init(haptic_sched_t *sched, drv2605_handle_t drv)
+{
+    memset(sched, 0, sizeof(*sched));
+    sched->drv = drv;
+}
+
+haptic_sched_action_t haptic_sched_decide(const haptic_sched_t *sched, uint8_t effect, uint8_t intensity,
+                                          uint8_t flags, int64_t now_us)
+{
+    const drv2605_effect_t *next = drv2605_effect(effect);
+    int64_t left_us = sched->end_us - now_us;
+
+    if (sched->count == 0 || sched->end_us == 0 || left_us <= 0 || sched->resyncs != sched->drv->stats.resyncs) {
+        return HAPTIC_SCHED_START;
+    }
+
+    if (!(flags & HP_REC_FLAG_QUEUE)) {
+        const drv2605_effect_t *running = drv2605_effect(sched->slots[sched->count - 1]);
+        // the last effect of the sequence is the one still playing near its end;
+        // compare strengths after intensity scaling
+        if (running && next && running->category == next->category &&
+            (uint32_t)running->peak * sched->intensity >= (uint32_t)next->peak * intensity &&
+            left_us >= (int64_t)next->duration_ms * 500) {
+            return HAPTIC_SCHED_DROP;
+        }
+        return HAPTIC_SCHED_PREEMPT;
+    }
+
+    if (sched->count < HAPTIC_SCHED_SLOTS && intensity == sched->intensity && left_us > HAPTIC_SCHED_APPEND_GUARD) {
+        return HAPTIC_SCHED_APPEND;
+    }
+    return HAPTIC_SCHED_WAIT;
+}
+
+esp_err_t haptic_sched_load(haptic_sched_t *sched, uint8_t effect, uint8_t intensity)
+{
+    static const uint8_t stop = 0;
+    const uint8_t seq[2] = { effect, 0 };
+    esp_err_t err = drv2605_queue_write(sched->drv, DRV2605_REG_GO, &stop, 1);
+
+    sched->count = 0;
+    sched->end_us = 0;
+    if (err == ESP_OK) {
+        err = drv2605_queue_write(sched->drv, DRV2605_REG_WAVESEQ1, seq, sizeof(seq));
+    }
+    if (err == ESP_OK) {
+        err = drv2605_flush(sched->drv);
+    }
+    if (err == ESP_OK) {
+        sched->slots[0] = effect;
+        sched->count = 1;
+        sched->intensity = intensity;
+        sched->resyncs = sched->drv->stats.resyncs;
+    }
+    return err;
+}
+
+esp_err_t haptic_sched_go(haptic_sched_t *sched, int64_t now_us)
+{
+    esp_err_t err = drv2605_go(sched->drv);
+    int64_t duration_us = 0;
+
+    if (err != ESP_OK) {
+        sched->end_us = 0;
+        return err;
+    }
+    for (uint8_t i = 0; i < sched->count; i++) {
+        const drv2605_effect_t *info = drv2605_effect(sched->slots[i]);
+        duration_us += info ? (int64_t)info->duration_ms * 1000 : 0;
+    }
+    sched->end_us = now_us + duration_us;
+    return ESP_OK;
+}
+
+esp_err_t haptic_sched_append(haptic_sched_t *sched, uint8_t effect, int64_t now_us)
+{
+    const drv2605_effect_t *info = drv2605_effect(effect);
+    uint8_t slot = sched->count;
+    uint8_t go = 0;
+    esp_err_t err = ESP_OK;
+
+    if (slot >= HAPTIC_SCHED_SLOTS || info == NULL) {
+        return ESP_ERR_INVALID_ARG;
+    }
+    // terminate behind the new slot first: the sequencer must never run
+    // into a slot that still holds an older effect. The batch keeps the order.
+    if (slot + 1 < HAPTIC_SCHED_SLOTS) {
+        static const uint8_t end = 0;
+        err = drv2605_queue_write(sched->drv, DRV2605_REG_WAVESEQ1 + slot + 1, &end, 1);
+    }
+    if (err == ESP_OK) {
+        err = drv2605_queue_write(sched->drv, DRV2605_REG_WAVESEQ1 + slot, &effect, 1);
+    }
+    if (err == ESP_OK) {
+        err = drv2605_queue_read(sched->drv, DRV2605_REG_GO, &go, 1);
+    }
+    if (err == ESP_OK) {
+        err = drv2605_flush(sched->drv);
+    }
+    if (err != ESP_OK) {
+        sched->end_us = 0;
+        return err;
+    }
+    sched->slots[slot] = effect;
+    sched->count++;
+    if (!(go & 0x01)) {
+        // the sequencer had already passed the old terminator
+        sched->end_us = 0;
+        return ESP_ERR_INVALID_STATE;
+    }
+    sched->end_us = (sched->end_us > now_us ? sched->end_us : now_us) + (int64_t)info->duration_ms * 1000;
+    return ESP_OK;
+}
+
+esp_err_t haptic_sched_stop(haptic_sched_t *sched)
+{
+    sched->count = 0;
+    sched->end_us = 0;
+    return drv2605_stop(sched->drv);
+}
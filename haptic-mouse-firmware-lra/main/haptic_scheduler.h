@@ -0,0 +1,88 @@
+#pragma once
+
+#include <stdint.h>
+#include "esp_err.h"
+#include "i2c_drv2605.h"
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+/* -------------------------------------------------------------------------- */
+/*  Duration-aware effect scheduler                                           */
+/*                                                                            */
+/*  Tracks what the DRV2605 sequencer (WAVESEQ1..8) holds and, from the       */
+/*  effect catalog (drv2605_effects.h), until when it plays. A new effect     */
+/*  then either starts on an idle actuator, preempts the running one, is      */
+/*  appended to the running sequence, waits for it, or is dropped because the */
+/*  running effect already covers it.                                         */
+/* -------------------------------------------------------------------------- */
+
+#define HAPTIC_SCHED_SLOTS          8       ///< WAVESEQ registers
+#define HAPTIC_SCHED_APPEND_GUARD   3000    ///< µs; closer to the end an append may miss the sequencer
+
+typedef enum {
+    HAPTIC_SCHED_START   = 0,       ///< Actuator idle: load and play
+    HAPTIC_SCHED_PREEMPT = 1,       ///< Stop the running sequence and play
+    HAPTIC_SCHED_APPEND  = 2,       ///< Queue into the next free WAVESEQ slot of the running sequence
+    HAPTIC_SCHED_WAIT    = 3,       ///< Queued effect that cannot be appended: play when the sequence ends
+    HAPTIC_SCHED_DROP    = 4,       ///< Redundant with the running effect
+} haptic_sched_action_t;
+
+/**
+ * @brief Sequencer state, owned by the player task.
+ */
+typedef struct {
+    drv2605_handle_t drv;
+    uint8_t slots[HAPTIC_SCHED_SLOTS];  /*!< Effects loaded into WAVESEQ1.. */
+    uint8_t count;                      /*!< Slots in use */
+    uint8_t intensity;                  /*!< Intensity the sequence plays at */
+    int64_t end_us;                     /*!< Expected end of the sequence, 0 = not started */
+    uint32_t resyncs;                   /*!< drv->stats.resyncs when the sequence was loaded */
+} haptic_sched_t;
+
+void haptic_sched_init(haptic_sched_t *sched, drv2605_handle_t drv);
+
+/**
+ * @brief Decide what to do with @p effect (a valid library effect).
+ *
+ * A non-queued effect is dropped when the running effect has the same
+ * category, at least its strength and at least half its duration left;
+ * otherwise it preempts. A queued effect (HP_REC_FLAG_QUEUE) is appended
+ * when a slot is free, the intensity matches and the sequence does not end
+ * within HAPTIC_SCHED_APPEND_GUARD; otherwise it waits. After the driver
+ * re-applied its register setup the sequencer no longer holds the
+ * sequence, and every effect starts afresh.
+ */
+haptic_sched_action_t haptic_sched_decide(const haptic_sched_t *sched, uint8_t effect, uint8_t intensity,
+                                          uint8_t flags, int64_t now_us);
+
+/**
+ * @brief Stop the sequencer and load @p effect alone; ::haptic_sched_go plays it.
+ *
+ * The stop and the two WAVESEQ writes go out as one driver batch.
+ */
+esp_err_t haptic_sched_load(haptic_sched_t *sched, uint8_t effect, uint8_t intensity);
+
+/**
+ * @brief Write GO for the loaded sequence.
+ */
+esp_err_t haptic_sched_go(haptic_sched_t *sched, int64_t now_us);
+
+/**
+ * @brief Append @p effect to the running sequence.
+ *
+ * @return ESP_OK when the sequencer will play it, ESP_ERR_INVALID_STATE
+ *         when the sequence ended before the append (load and play it
+ *         instead), or an I2C error
+ */
+esp_err_t haptic_sched_append(haptic_sched_t *sched, uint8_t effect, int64_t now_us);
+
+/**
+ * @brief Stop playback and forget the sequence.
+ */
+esp_err_t haptic_sched_stop(haptic_sched_t *sched);
+
+#ifdef __cplusplus
+}
+#endif
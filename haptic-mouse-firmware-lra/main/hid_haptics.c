@@ -0,0 +1,131 @@
+#include "hid_haptics.h"
+
+#include <string.h>
+#include "esp_check.h"
+#include "drv2605_effects.h"
+#include "haptic_pattern.h"
+
+static const char *TAG = "hid-haptics";
+
+/*
+ * Waveform list, in ordinal order from HID_HAPTICS_ORDINAL_FIRST. Each
+ * standard waveform plays the library effect closest to its description;
+ * the continuous ones repeat the effect on the pattern timer, so their
+ * duration list entry is 0 as the spec requires.
+ */
+typedef struct {
+    uint16_t waveform;
+    uint8_t effect;
+    bool continuous;
+} hid_haptics_waveform_t;
+
+static const hid_haptics_waveform_t s_waveforms[HID_HAPTICS_WAVEFORM_COUNT] = {
+    { HID_HAPTICS_WAVEFORM_CLICK,             1,   false },    // Strong Click 100%
+    { HID_HAPTICS_WAVEFORM_BUZZ_CONTINUOUS,   47,  true  },    // Buzz 1 100%
+    { HID_HAPTICS_WAVEFORM_RUMBLE_CONTINUOUS, 119, true  },    // Smooth Hum 1 50%
+    { HID_HAPTICS_WAVEFORM_PRESS,             4,   false },    // Sharp Click 100%
+    { HID_HAPTICS_WAVEFORM_RELEASE,           5,   false },    // Sharp Click 60%
+    { HID_HAPTICS_WAVEFORM_HOVER,             26,  false },    // Sharp Tick 3 60%
+    { HID_HAPTICS_WAVEFORM_SUCCESS,           27,  false },    // Short Double Click Strong 1 100%
+    { HID_HAPTICS_WAVEFORM_ERROR,             14,  false },    // Strong Buzz 100%
+};
+
+static uint16_t s_auto_trigger = HID_HAPTICS_ORDINAL_NONE;
+
+static inline void put_le16(uint8_t *p, uint16_t v)
+{
+    p[0] = (uint8_t)v;
+    p[1] = (uint8_t)(v >> 8);
+}
+
+static inline uint16_t get_le16(const uint8_t *p)
+{
+    return (uint16_t)(p[0] | (p[1] << 8));
+}
+
+uint16_t hid_haptics_get_feature(uint8_t *buf, uint16_t len)
+{
+    if (len < HID_HAPTICS_FEATURE_SIZE) {
+        return 0;
+    }
+    memset(buf, 0, HID_HAPTICS_FEATURE_SIZE);
+    for (int i = 0; i < HID_HAPTICS_WAVEFORM_COUNT; i++) {
+        const hid_haptics_waveform_t *w = &s_waveforms[i];
+        put_le16(buf + 2 * i, w->waveform);
+        put_le16(buf + 2 * (HID_HAPTICS_WAVEFORM_COUNT + i), w->continuous ? 0 : drv2605_effect(w->effect)->duration_ms);
+    }
+    uint8_t *p = buf + 4 * HID_HAPTICS_WAVEFORM_COUNT;
+    put_le16(p, s_auto_trigger);
+    // p[2..5]: auto trigger associated control, none
+    put_le16(p + 6, HAPTIC_PATTERN_TIMEOUT_MS);
+    return HID_HAPTICS_FEATURE_SIZE;
+}
+
+esp_err_t hid_haptics_set_feature(const uint8_t *buf, uint16_t len)
+{
+    ESP_RETURN_ON_FALSE(buf && len >= HID_HAPTICS_FEATURE_SIZE, ESP_ERR_INVALID_SIZE, TAG, "short feature report");
+
+    uint16_t ordinal = get_le16(buf + 4 * HID_HAPTICS_WAVEFORM_COUNT);
+    ESP_RETURN_ON_FALSE(ordinal >= HID_HAPTICS_ORDINAL_NONE && ordinal <= HID_HAPTICS_ORDINAL_MAX,
+                        ESP_ERR_INVALID_ARG, TAG, "auto trigger %u out of range", ordinal);
+    s_auto_trigger = ordinal;
+    return ESP_OK;
+}
+
+// Ordinal of a waveform usage, 0 if unknown
+static uint16_t waveform_ordinal(uint16_t waveform)
+{
+    if (waveform == HID_HAPTICS_WAVEFORM_NONE) {
+        return HID_HAPTICS_ORDINAL_NONE;
+    }
+    if (waveform == HID_HAPTICS_WAVEFORM_STOP) {
+        return HID_HAPTICS_ORDINAL_STOP;
+    }
+    for (int i = 0; i < HID_HAPTICS_WAVEFORM_COUNT; i++) {
+        if (s_waveforms[i].waveform == waveform) {
+            return (uint16_t)(HID_HAPTICS_ORDINAL_FIRST + i);
+        }
+    }
+    return 0;
+}
+
+esp_err_t hid_haptics_decode_output(const uint8_t *buf, uint16_t len, hid_haptics_trigger_t *trigger)
+{
+    ESP_RETURN_ON_FALSE(buf && len >= HID_HAPTICS_OUTPUT_SIZE, ESP_ERR_INVALID_SIZE, TAG, "short output report");
+
+    uint16_t ordinal = get_le16(buf);
+    uint8_t percent = buf[2] > 100 ? 100 : buf[2];
+
+    memset(trigger, 0, sizeof(*trigger));
+    if (ordinal >= HID_HAPTICS_WAVEFORM_NONE) {
+        ordinal = waveform_ordinal(ordinal);
+    }
+    if (ordinal == HID_HAPTICS_ORDINAL_STOP) {
+        trigger->action = HID_HAPTICS_STOP;
+        return ESP_OK;
+    }
+    if (ordinal == HID_HAPTICS_ORDINAL_NONE) {
+        return ESP_OK;
+    }
+    if (ordinal < HID_HAPTICS_ORDINAL_FIRST || ordinal > HID_HAPTICS_ORDINAL_MAX) {
+        return ESP_ERR_NOT_FOUND;
+    }
+    if (percent == 0) {
+        return ESP_OK;
+    }
+
+    const hid_haptics_waveform_t *w = &s_waveforms[ordinal - HID_HAPTICS_ORDINAL_FIRST];
+    trigger->effect = w->effect;
+    trigger->intensity = (uint8_t)((percent * 0xFF + 50) / 100);
+    trigger->period_ms = get_le16(buf + 4);
+    if (w->continuous) {
+        trigger->action = HID_HAPTICS_CONTINUOUS;
+        if (trigger->period_ms == 0) {
+            trigger->period_ms = drv2605_effect(w->effect)->duration_ms;
+        }
+    } else {
+        trigger->action = HID_HAPTICS_PLAY;
+        trigger->repeat = buf[3];
+    }
+    return ESP_OK;
+}
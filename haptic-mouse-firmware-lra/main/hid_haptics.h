@@ -0,0 +1,201 @@
+#pragma once
+
+#include <stdint.h>
+#include <stdbool.h>
+#include "esp_err.h"
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+/* -------------------------------------------------------------------------- */
+/*  Standard HID Haptics page (0x0E) interface                                */
+/*                                                                            */
+/*  A Simple Haptic Controller collection that OS haptic stacks and hidraw    */
+/*  clients drive without the command protocol: a feature report lists the   */
+/*  standard waveforms the device supports with their durations, an output   */
+/*  report triggers one by ordinal. Waveforms map onto DRV2605 library        */
+/*  effects; continuous ones repeat on the pattern timer until STOP or the    */
+/*  waveform cutoff time.                                                     */
+/* -------------------------------------------------------------------------- */
+
+#define HID_HAPTICS_FEATURE_REPORT_ID  0x30    ///< Waveform list, duration list, auto trigger, cutoff time
+#define HID_HAPTICS_OUTPUT_REPORT_ID   0x31    ///< Manual trigger, intensity, repeat count, retrigger period
+
+/* Haptics page usages (HUTRR63) */
+#define HID_USAGE_PAGE_HAPTICS                 0x0E
+#define HID_USAGE_PAGE_ORDINAL                 0x0A
+#define HID_HAPTICS_SIMPLE_CONTROLLER          0x01
+#define HID_HAPTICS_WAVEFORM_LIST              0x10
+#define HID_HAPTICS_DURATION_LIST              0x11
+#define HID_HAPTICS_AUTO_TRIGGER               0x20
+#define HID_HAPTICS_MANUAL_TRIGGER             0x21
+#define HID_HAPTICS_AUTO_TRIGGER_CONTROL       0x22
+#define HID_HAPTICS_INTENSITY                  0x23
+#define HID_HAPTICS_REPEAT_COUNT               0x24
+#define HID_HAPTICS_RETRIGGER_PERIOD           0x25
+#define HID_HAPTICS_WAVEFORM_CUTOFF_TIME       0x28
+
+#define HID_HAPTICS_WAVEFORM_NONE              0x1001
+#define HID_HAPTICS_WAVEFORM_STOP              0x1002
+#define HID_HAPTICS_WAVEFORM_CLICK             0x1003
+#define HID_HAPTICS_WAVEFORM_BUZZ_CONTINUOUS   0x1004
+#define HID_HAPTICS_WAVEFORM_RUMBLE_CONTINUOUS 0x1005
+#define HID_HAPTICS_WAVEFORM_PRESS             0x1006
+#define HID_HAPTICS_WAVEFORM_RELEASE           0x1007
+#define HID_HAPTICS_WAVEFORM_HOVER             0x1008
+#define HID_HAPTICS_WAVEFORM_SUCCESS           0x1009
+#define HID_HAPTICS_WAVEFORM_ERROR             0x100A
+
+/* Ordinals 1 and 2 are WAVEFORM_NONE and WAVEFORM_STOP by definition; the
+ * waveform list describes ordinals 3 .. HID_HAPTICS_ORDINAL_MAX */
+#define HID_HAPTICS_ORDINAL_NONE       1
+#define HID_HAPTICS_ORDINAL_STOP       2
+#define HID_HAPTICS_ORDINAL_FIRST      3
+#define HID_HAPTICS_WAVEFORM_COUNT     8
+#define HID_HAPTICS_ORDINAL_MAX        (HID_HAPTICS_ORDINAL_FIRST + HID_HAPTICS_WAVEFORM_COUNT - 1)
+
+/* Report sizes without the report ID */
+#define HID_HAPTICS_FEATURE_SIZE       (4 * HID_HAPTICS_WAVEFORM_COUNT + 8)
+#define HID_HAPTICS_OUTPUT_SIZE        6
+
+/**
+ * @brief Report descriptor of the Simple Haptic Controller, a top-level
+ *        collection of its own. Field order matches the reports below.
+ *
+ * Feature report: waveform usage (u16) per ordinal, duration in ms (u16)
+ * per ordinal, auto trigger ordinal (u16), auto trigger associated control
+ * (u32, 0: this device has no controls), waveform cutoff time in ms (u16).
+ *
+ * Output report: manual trigger ordinal (u16), intensity in % (u8), repeat
+ * count (u8), retrigger period in ms (u16). The manual trigger also takes
+ * a waveform usage (0x1001 and up) in place of its ordinal, for clients
+ * that skip the waveform list.
+ */
+#define HID_HAPTICS_REPORT_DESCRIPTOR \
+    HID_USAGE_PAGE(HID_USAGE_PAGE_HAPTICS), \
+    HID_USAGE(HID_HAPTICS_SIMPLE_CONTROLLER), \
+    HID_COLLECTION(HID_COLLECTION_APPLICATION), \
+        HID_REPORT_ID(HID_HAPTICS_FEATURE_REPORT_ID) \
+        HID_USAGE(HID_HAPTICS_WAVEFORM_LIST), \
+        HID_COLLECTION(HID_COLLECTION_LOGICAL), \
+            HID_USAGE_PAGE(HID_USAGE_PAGE_ORDINAL), \
+            HID_USAGE_MIN(HID_HAPTICS_ORDINAL_FIRST), \
+            HID_USAGE_MAX(HID_HAPTICS_ORDINAL_MAX), \
+            HID_LOGICAL_MIN_N(HID_HAPTICS_WAVEFORM_NONE, 2), \
+            HID_LOGICAL_MAX_N(0x2FFF, 2), \
+            HID_REPORT_SIZE(16), \
+            HID_REPORT_COUNT(HID_HAPTICS_WAVEFORM_COUNT), \
+            HID_FEATURE( HID_DATA | HID_VARIABLE | HID_ABSOLUTE ), \
+        HID_COLLECTION_END, \
+        HID_USAGE_PAGE(HID_USAGE_PAGE_HAPTICS), \
+        HID_USAGE(HID_HAPTICS_DURATION_LIST), \
+        HID_COLLECTION(HID_COLLECTION_LOGICAL), \
+            HID_USAGE_PAGE(HID_USAGE_PAGE_ORDINAL), \
+            HID_USAGE_MIN(HID_HAPTICS_ORDINAL_FIRST), \
+            HID_USAGE_MAX(HID_HAPTICS_ORDINAL_MAX), \
+            HID_LOGICAL_MIN(0), \
+            HID_LOGICAL_MAX_N(0x7FFF, 2), \
+            HID_UNIT_N(0x1001, 2),          /* SI linear, seconds */ \
+            HID_UNIT_EXPONENT(0x0D),        /* 10^-3: ms */ \
+            HID_REPORT_SIZE(16), \
+            HID_REPORT_COUNT(HID_HAPTICS_WAVEFORM_COUNT), \
+            HID_FEATURE( HID_DATA | HID_VARIABLE | HID_ABSOLUTE ), \
+        HID_COLLECTION_END, \
+        HID_USAGE_PAGE(HID_USAGE_PAGE_HAPTICS), \
+        HID_USAGE(HID_HAPTICS_AUTO_TRIGGER), \
+        HID_LOGICAL_MIN(HID_HAPTICS_ORDINAL_NONE), \
+        HID_LOGICAL_MAX(HID_HAPTICS_ORDINAL_MAX), \
+        HID_UNIT(0), \
+        HID_UNIT_EXPONENT(0), \
+        HID_REPORT_SIZE(16), \
+        HID_REPORT_COUNT(1), \
+        HID_FEATURE( HID_DATA | HID_VARIABLE | HID_ABSOLUTE ), \
+        HID_USAGE(HID_HAPTICS_AUTO_TRIGGER_CONTROL), \
+        HID_LOGICAL_MIN(0), \
+        HID_LOGICAL_MAX_N(0x7FFFFFFF, 3), \
+        HID_REPORT_SIZE(32), \
+        HID_FEATURE( HID_CONSTANT | HID_VARIABLE | HID_ABSOLUTE ), \
+        HID_USAGE(HID_HAPTICS_WAVEFORM_CUTOFF_TIME), \
+        HID_LOGICAL_MAX_N(0x7FFF, 2), \
+        HID_UNIT_N(0x1001, 2), \
+        HID_UNIT_EXPONENT(0x0D), \
+        HID_REPORT_SIZE(16), \
+        HID_FEATURE( HID_CONSTANT | HID_VARIABLE | HID_ABSOLUTE ), \
+        HID_REPORT_ID(HID_HAPTICS_OUTPUT_REPORT_ID) \
+        HID_USAGE(HID_HAPTICS_MANUAL_TRIGGER), \
+        HID_LOGICAL_MIN(HID_HAPTICS_ORDINAL_NONE), \
+        HID_LOGICAL_MAX(HID_HAPTICS_ORDINAL_MAX), \
+        HID_UNIT(0), \
+        HID_UNIT_EXPONENT(0), \
+        HID_REPORT_SIZE(16), \
+        HID_OUTPUT( HID_DATA | HID_VARIABLE | HID_ABSOLUTE ), \
+        HID_USAGE(HID_HAPTICS_INTENSITY), \
+        HID_LOGICAL_MIN(0), \
+        HID_LOGICAL_MAX(100), \
+        HID_REPORT_SIZE(8), \
+        HID_OUTPUT( HID_DATA | HID_VARIABLE | HID_ABSOLUTE ), \
+        HID_USAGE(HID_HAPTICS_REPEAT_COUNT), \
+        HID_LOGICAL_MAX_N(0xFF, 2), \
+        HID_OUTPUT( HID_DATA | HID_VARIABLE | HID_ABSOLUTE ), \
+        HID_USAGE(HID_HAPTICS_RETRIGGER_PERIOD), \
+        HID_LOGICAL_MAX_N(0x7FFF, 2), \
+        HID_UNIT_N(0x1001, 2), \
+        HID_UNIT_EXPONENT(0x0D), \
+        HID_REPORT_SIZE(16), \
+        HID_OUTPUT( HID_DATA | HID_VARIABLE | HID_ABSOLUTE ), \
+    HID_COLLECTION_END
+
+typedef enum {
+    HID_HAPTICS_NOTHING,                ///< WAVEFORM_NONE, zero intensity or an unknown waveform
+    HID_HAPTICS_STOP,                   ///< Stop whatever plays
+    HID_HAPTICS_PLAY,                   ///< Play `effect` 1 + `repeat` times
+    HID_HAPTICS_CONTINUOUS,             ///< Repeat `effect` every `period_ms` until stopped
+} hid_haptics_action_t;
+
+/**
+ * @brief A decoded manual trigger.
+ */
+typedef struct {
+    hid_haptics_action_t action;
+    uint8_t effect;                     /*!< DRV2605 library effect */
+    uint8_t intensity;                  /*!< 0 – 255 */
+    uint8_t repeat;                     /*!< Extra plays after the first (PLAY) */
+    uint16_t period_ms;                 /*!< Start to start of repeats; 0 = back to back */
+} hid_haptics_trigger_t;
+
+/**
+ * @brief Fill the feature report (without report ID).
+ *
+ * @return Report length, 0 if @p len is too small
+ */
+uint16_t hid_haptics_get_feature(uint8_t *buf, uint16_t len);
+
+/**
+ * @brief Apply a feature report written by the host; only the auto
+ *        trigger is writable. It is stored and reported back but never
+ *        fires, since the device has no control to associate it with.
+ *
+ * @return
+ *  - ESP_OK on success
+ *  - ESP_ERR_INVALID_SIZE if the report is too short
+ *  - ESP_ERR_INVALID_ARG if the auto trigger is not a listed ordinal
+ */
+esp_err_t hid_haptics_set_feature(const uint8_t *buf, uint16_t len);
+
+/**
+ * @brief Decode an output report into what the player should do.
+ *
+ * Continuous waveforms repeat every retrigger period, or back to back when
+ * it is 0; other waveforms play once plus the repeat count.
+ *
+ * @return
+ *  - ESP_OK on success
+ *  - ESP_ERR_INVALID_SIZE if the report is too short
+ *  - ESP_ERR_NOT_FOUND if the waveform is not in the waveform list
+ */
+esp_err_t hid_haptics_decode_output(const uint8_t *buf, uint16_t len, hid_haptics_trigger_t *trigger);
+
+#ifdef __cplusplus
+}
+#endif
@@ -8,16 +8,303 @@
 #include "esp_check.h"
 #include "driver/i2c_master.h"
 #include "esp_check.h"
+#include "esp_attr.h"
+#include "esp_timer.h"
 #include "freertos/FreeRTOS.h"
 #include "freertos/task.h"
+#include "freertos/semphr.h"
 
-#define DRV2605_I2C_TIMEOUT_MS  100
+#define DRV2605_I2C_TIMEOUT_MS  10      // per transaction on a bus without callbacks
 
 static const char *TAG = "i2c-drv2605";
 
 /* Null-pointer guard macro (short form) */
 #define CHECK_HANDLE(h) ESP_RETURN_ON_FALSE((h) != NULL, ESP_ERR_INVALID_ARG, TAG, "null handle")
 
+/*---------------------------------------------------------------------------
+ *  Transaction queue
+ *-------------------------------------------------------------------------*/
+
+// Bus ISR: transactions of a device complete in the order they were queued
+static bool IRAM_ATTR drv2605_on_trans_done(i2c_master_dev_handle_t i2c_dev, const i2c_master_event_data_t *evt_data,
+                                            void *arg)
+{
+    drv2605_handle_t handle = (drv2605_handle_t)arg;
+    BaseType_t woken = pdFALSE;
+    uint8_t done = handle->done;
+
+    // completions of an attempt abandoned by a bus reset are not counted
+    if (done < handle->submitted) {
+        handle->xfers[handle->pending[done]].event = (uint8_t)evt_data->event;
+        handle->done = ++done;
+        if (done == handle->submitted) {
+            xSemaphoreGiveFromISR(handle->done_sem, &woken);
+        }
+    }
+    return woken == pdTRUE;
+}
+
+// Batch deadline: wake the flushing task, which then finds the batch late
+static void IRAM_ATTR drv2605_on_deadline(void *arg)
+{
+    drv2605_handle_t handle = (drv2605_handle_t)arg;
+#if CONFIG_ESP_TIMER_SUPPORTS_ISR_DISPATCH_METHOD
+    BaseType_t woken = pdFALSE;
+    xSemaphoreGiveFromISR(handle->done_sem, &woken);
+    portYIELD_FROM_ISR(woken);
+#else
+    xSemaphoreGive(handle->done_sem);
+#endif
+}
+
+static esp_err_t drv2605_xfer_start(drv2605_handle_t handle, drv2605_xfer_t *xfer, int timeout_ms)
+{
+    if (xfer->rx_len) {
+        return i2c_master_transmit_receive(handle->i2c_dev, xfer->tx, xfer->tx_len, xfer->rx, xfer->rx_len, timeout_ms);
+    }
+    return i2c_master_transmit(handle->i2c_dev, xfer->tx, xfer->tx_len, timeout_ms);
+}
+
+// Send xfers[from..count) once. ESP_FAIL leaves the first transaction that
+// was not acknowledged in *failed; ESP_ERR_TIMEOUT means the bus is stuck.
+// The bus goes on with the queued transactions after a NACK, so a retry
+// skips those that already completed: a trailing GO must not run twice.
+static esp_err_t drv2605_attempt(drv2605_handle_t handle, uint8_t from, uint8_t *failed)
+{
+    if (!handle->async) {
+        for (uint8_t i = from; i < handle->count; i++) {
+            esp_err_t err = drv2605_xfer_start(handle, &handle->xfers[i], DRV2605_I2C_TIMEOUT_MS);
+            if (err == ESP_ERR_TIMEOUT) {
+                handle->stats.timeouts++;
+                return err;
+            }
+            if (err != ESP_OK) {
+                handle->stats.nacks++;
+                *failed = i;
+                return ESP_FAIL;
+            }
+        }
+        return ESP_OK;
+    }
+
+    // wire time: address byte(s) plus data, 9 clocks a byte
+    uint32_t bytes = 0;
+    uint8_t sends = 0;
+    for (uint8_t i = from; i < handle->count; i++) {
+        if (handle->xfers[i].event != I2C_EVENT_DONE) {
+            handle->pending[sends++] = i;
+            bytes += 1u + handle->xfers[i].tx_len + (handle->xfers[i].rx_len ? 1u + handle->xfers[i].rx_len : 0u);
+        }
+    }
+    const int64_t deadline = esp_timer_get_time() + (int64_t)bytes * 9 * 1000000 / handle->scl_speed_hz +
+                             DRV2605_SLACK_US;
+
+    xSemaphoreTake(handle->done_sem, 0);
+    handle->done = 0;
+    handle->submitted = 0;
+    for (uint8_t k = 0; k < sends; k++) {
+        drv2605_xfer_t *xfer = &handle->xfers[handle->pending[k]];
+        xfer->event = I2C_EVENT_ALIVE;
+        handle->submitted = k + 1;
+        if (drv2605_xfer_start(handle, xfer, 0) != ESP_OK) {
+            // the bus driver still holds transactions from before
+            handle->submitted = k;
+            break;
+        }
+    }
+    while (handle->done < handle->submitted) {
+        int64_t left_us = deadline - esp_timer_get_time();
+        if (left_us <= 0) {
+            handle->stats.timeouts++;
+            return ESP_ERR_TIMEOUT;
+        }
+        // a tick is 10 ms: the deadline alarm wakes the wait on time, the
+        // tick timeout only backs it up
+        esp_timer_start_once(handle->deadline_timer, (uint64_t)left_us);
+        xSemaphoreTake(handle->done_sem, pdMS_TO_TICKS((left_us + 999) / 1000) + 1);
+        esp_timer_stop(handle->deadline_timer);
+    }
+    for (uint8_t k = 0; k < handle->submitted; k++) {
+        uint8_t event = handle->xfers[handle->pending[k]].event;
+        if (event == I2C_EVENT_DONE) {
+            continue;
+        }
+        if (event == I2C_EVENT_NACK) {
+            handle->stats.nacks++;
+            *failed = handle->pending[k];
+            return ESP_FAIL;
+        }
+        handle->stats.timeouts++;
+        return ESP_ERR_TIMEOUT;
+    }
+    if (handle->submitted < sends) {
+        handle->stats.timeouts++;
+        return ESP_ERR_TIMEOUT;
+    }
+    return ESP_OK;
+}
+
+// Drop what the bus driver still holds of an abandoned attempt, so that no
+// late completion lands in a caller's receive buffer or counts against the
+// next batch, then clock SCL until the slave lets go of SDA and issue a STOP
+static esp_err_t drv2605_bus_reset(drv2605_handle_t handle)
+{
+    handle->submitted = 0;
+    handle->done = 0;
+    if (handle->async) {
+        i2c_master_bus_wait_all_done(handle->bus, DRV2605_I2C_TIMEOUT_MS);
+    }
+    return i2c_master_bus_reset(handle->bus);
+}
+
+// Free a stuck bus and bring the chip back to the setup; it may have reset
+// (brown-out, EN glitch) which is a common reason for holding SDA.
+static esp_err_t drv2605_recover(drv2605_handle_t handle)
+{
+    drv2605_xfer_t batch[DRV2605_QUEUE_DEPTH];
+    const uint8_t count = handle->count;
+    esp_err_t err;
+
+    handle->stats.recoveries++;
+    err = drv2605_bus_reset(handle);
+    if (err != ESP_OK) {
+        ESP_LOGE(TAG, "bus reset failed: %s", esp_err_to_name(err));
+        return err;
+    }
+    if (handle->init == NULL) {
+        return ESP_OK;
+    }
+
+    // the setup goes through the queue too, ahead of the interrupted batch
+    memcpy(batch, handle->xfers, count * sizeof(batch[0]));
+    handle->count = 0;
+    handle->recovering = true;
+    handle->stats.resyncs++;
+    err = drv2605_write_blocks(handle, handle->init, handle->init_count);
+    handle->recovering = false;
+    memcpy(handle->xfers, batch, count * sizeof(batch[0]));
+    handle->count = count;
+    if (err != ESP_OK) {
+        ESP_LOGE(TAG, "bus reset, register setup failed: %s", esp_err_to_name(err));
+    } else {
+        ESP_LOGW(TAG, "bus reset, register setup re-applied");
+    }
+    return err;
+}
+
+static void drv2605_record_latency(drv2605_stats_t *stats, uint32_t us)
+{
+    unsigned bucket = 0;
+
+    while (bucket < DRV2605_LATENCY_BUCKETS - 1 && us >= ((uint32_t)DRV2605_LATENCY_BUCKET0_US << bucket)) {
+        bucket++;
+    }
+    stats->latency[bucket]++;
+    if (us > stats->max_us) {
+        stats->max_us = us;
+    }
+}
+
+static esp_err_t drv2605_queue(drv2605_handle_t handle, uint8_t reg, const uint8_t *vals, uint8_t *rx, size_t len)
+{
+    ESP_RETURN_ON_FALSE(handle && handle->i2c_dev, ESP_ERR_INVALID_ARG, TAG, "null handle");
+    ESP_RETURN_ON_FALSE((vals || rx) && len > 0 && len <= DRV2605_BLOCK_MAX, ESP_ERR_INVALID_ARG, TAG, "bad length");
+
+    if (handle->count == DRV2605_QUEUE_DEPTH) {
+        ESP_RETURN_ON_ERROR(drv2605_flush(handle), TAG, "flush of a full batch failed");
+    }
+    drv2605_xfer_t *xfer = &handle->xfers[handle->count++];
+    xfer->event = I2C_EVENT_ALIVE;
+    xfer->tx[0] = reg;
+    if (vals) {
+        memcpy(xfer->tx + 1, vals, len);
+        xfer->tx_len = (uint8_t)(1 + len);
+        xfer->rx = NULL;
+        xfer->rx_len = 0;
+    } else {
+        xfer->tx_len = 1;
+        xfer->rx = rx;
+        xfer->rx_len = (uint8_t)len;
+    }
+    return ESP_OK;
+}
+
+esp_err_t drv2605_queue_write(drv2605_handle_t handle, uint8_t reg, const uint8_t *vals, size_t len)
+{
+    return drv2605_queue(handle, reg, vals, NULL, len);
+}
+
+esp_err_t drv2605_queue_read(drv2605_handle_t handle, uint8_t reg, uint8_t *vals, size_t len)
+{
+    return drv2605_queue(handle, reg, NULL, vals, len);
+}
+
+esp_err_t drv2605_flush(drv2605_handle_t handle)
+{
+    CHECK_HANDLE(handle);
+
+    if (handle->count == 0) {
+        return ESP_OK;
+    }
+
+    const int64_t start = esp_timer_get_time();
+    bool recovered = handle->recovering;
+    uint8_t from = 0;
+    esp_err_t err;
+
+    for (int attempt = 0;; attempt++) {
+        err = drv2605_attempt(handle, from, &from);
+        if (err == ESP_OK || attempt == DRV2605_RETRIES) {
+            break;
+        }
+        if (err == ESP_ERR_TIMEOUT) {
+            if (recovered) {
+                break;
+            }
+            recovered = true;
+            drv2605_recover(handle);
+            // the chip may have reset: the whole batch goes again
+            for (uint8_t i = 0; i < handle->count; i++) {
+                handle->xfers[i].event = I2C_EVENT_ALIVE;
+            }
+            from = 0;
+        }
+        handle->stats.retries++;
+    }
+    if (err == ESP_ERR_TIMEOUT && handle->async) {
+        // giving up: the batch's receive buffers are about to go out of scope
+        drv2605_bus_reset(handle);
+    }
+    handle->count = 0;
+    handle->stats.batches++;
+    drv2605_record_latency(&handle->stats, (uint32_t)(esp_timer_get_time() - start));
+    if (err != ESP_OK) {
+        handle->stats.failures++;
+        ESP_LOGW(TAG, "batch failed: %s", esp_err_to_name(err));
+    }
+    return err;
+}
+
+uint32_t drv2605_latency_percentile(const drv2605_stats_t *stats, unsigned percent)
+{
+    uint64_t total = 0;
+    uint64_t seen = 0;
+
+    for (unsigned i = 0; i < DRV2605_LATENCY_BUCKETS; i++) {
+        total += stats->latency[i];
+    }
+    if (total == 0) {
+        return 0;
+    }
+    for (unsigned i = 0; i < DRV2605_LATENCY_BUCKETS - 1; i++) {
+        seen += stats->latency[i];
+        if (seen * 100 >= total * percent) {
+            return (uint32_t)DRV2605_LATENCY_BUCKET0_US << i;
+        }
+    }
+    return UINT32_MAX;
+}
+
 /*---------------------------------------------------------------------------
  *  Public API implementation
  *-------------------------------------------------------------------------*/
@@ -42,33 +329,41 @@ esp_err_t drv2605_init(i2c_master_bus_handle_t bus_handle, const drv2605_config_
     if (out_handle->i2c_dev == NULL) {
         ESP_GOTO_ON_ERROR(i2c_master_bus_add_device(bus_handle, &i2c_dev_conf, &out_handle->i2c_dev), err, TAG, "i2c new bus failed");
     }
+    out_handle->bus = bus_handle;
+    out_handle->scl_speed_hz = i2c_dev_conf.scl_speed_hz;
+    out_handle->init = drv2605_config->init;
+    out_handle->init_count = drv2605_config->init_count;
+    out_handle->done_sem = xSemaphoreCreateBinaryStatic(&out_handle->done_sem_buf);
+
+    // callbacks are only accepted on a bus created with a transaction queue
+    const i2c_master_event_callbacks_t cbs = {
+        .on_trans_done = drv2605_on_trans_done,
+    };
+    out_handle->async = i2c_master_register_event_callbacks(out_handle->i2c_dev, &cbs, out_handle) == ESP_OK;
+    if (out_handle->async) {
+        const esp_timer_create_args_t timer_args = {
+            .callback = drv2605_on_deadline,
+            .arg = out_handle,
+#if CONFIG_ESP_TIMER_SUPPORTS_ISR_DISPATCH_METHOD
+            .dispatch_method = ESP_TIMER_ISR,
+#else
+            .dispatch_method = ESP_TIMER_TASK,
+#endif
+            .name = "drv2605_deadline",
+        };
+        ESP_GOTO_ON_ERROR(esp_timer_create(&timer_args, &out_handle->deadline_timer), err, TAG, "no deadline timer");
+    }
+
+    // identify the chip; this is also the first transaction it has to answer
+    uint8_t status;
+    ESP_GOTO_ON_ERROR(drv2605_read_reg8(out_handle, DRV2605_REG_STATUS, &status), err, TAG, "no response");
+    out_handle->device_id = DRV2605_STATUS_DEVICE_ID(status);
+    ESP_LOGI(TAG, "device ID %u, status 0x%02x", out_handle->device_id, status);
 
-    // set default values
-    #define W(reg, val)  ESP_GOTO_ON_ERROR(drv2605_write_reg8(out_handle, (reg), (val)), err, TAG, "init reg write failed")
-    #define R(reg, p)    ESP_GOTO_ON_ERROR(drv2605_read_reg8 (out_handle, (reg), (p)),  err, TAG, "init reg read failed")
-
-    W(DRV2605_REG_MODE, 0x00); // out of standby
-
-    W(DRV2605_REG_RTPIN, 0x00); // no real-time-playback
-  
-    W(DRV2605_REG_WAVESEQ1, 1); // strong click
-    W(DRV2605_REG_WAVESEQ2, 0); // end sequence
-  
-    W(DRV2605_REG_OVERDRIVE, 0); // no overdrive
-  
-    W(DRV2605_REG_SUSTAINPOS, 0);
-    W(DRV2605_REG_SUSTAINNEG, 0); 
-    W(DRV2605_REG_BREAK, 0); 
-    W(DRV2605_REG_AUDIOMAX, 0x64);
-  
-    // ERM open loop
-    uint8_t v;
-    // turn off N_ERM_LRA
-    R(DRV2605_REG_FEEDBACK, &v);
-    W(DRV2605_REG_FEEDBACK, v & 0x7F);   /* clear LRA_EN (bit-7) */
-    // turn on ERM_OPEN_LOOP    
-    R(DRV2605_REG_CONTROL3, &v);
-    W(DRV2605_REG_CONTROL3,  v | 0x20);     /* set ERM_OPEN_LOOP (bit-5) */
+    if (drv2605_config->init != NULL) {
+        ESP_GOTO_ON_ERROR(drv2605_write_blocks(out_handle, drv2605_config->init, drv2605_config->init_count),
+                          err, TAG, "register setup failed");
+    }
 
     // return handle
     *drv2605_handle = out_handle;
@@ -76,6 +371,9 @@ esp_err_t drv2605_init(i2c_master_bus_handle_t bus_handle, const drv2605_config_
 
     // Failure cleanup
 err:
+    if (out_handle && out_handle->deadline_timer) {
+        esp_timer_delete(out_handle->deadline_timer);
+    }
     if (out_handle && out_handle->i2c_dev) {
         i2c_master_bus_rm_device(out_handle->i2c_dev);
     }
@@ -87,9 +385,8 @@ esp_err_t drv2605_write_reg8(drv2605_handle_t handle, uint8_t reg, uint8_t val)
 {
     ESP_RETURN_ON_FALSE(handle && handle->i2c_dev,ESP_ERR_INVALID_ARG, TAG, "null handle");
 
-    uint8_t buf[2] = { reg, val };
-
-    return i2c_master_transmit(handle->i2c_dev, buf, sizeof(buf), DRV2605_I2C_TIMEOUT_MS);
+    ESP_RETURN_ON_ERROR(drv2605_queue_write(handle, reg, &val, 1), TAG, "queue failed");
+    return drv2605_flush(handle);
 }
 
 esp_err_t drv2605_read_reg8(drv2605_handle_t handle, uint8_t reg, uint8_t *out_val)
@@ -97,10 +394,66 @@ esp_err_t drv2605_read_reg8(drv2605_handle_t handle, uint8_t reg, uint8_t *out_v
     ESP_RETURN_ON_FALSE(handle && handle->i2c_dev,ESP_ERR_INVALID_ARG, TAG, "null handle");
     ESP_RETURN_ON_FALSE(out_val, ESP_ERR_INVALID_ARG, TAG, "null out_val pointer");
 
-    return i2c_master_transmit_receive(handle->i2c_dev,
-                                        &reg,   1,          /* tx buffer & length */
-                                        out_val, 1,         /* rx buffer & length */
-                                        DRV2605_I2C_TIMEOUT_MS);
+    ESP_RETURN_ON_ERROR(drv2605_queue_read(handle, reg, out_val, 1), TAG, "queue failed");
+    return drv2605_flush(handle);
+}
+
+esp_err_t drv2605_write_regs(drv2605_handle_t handle, uint8_t reg, const uint8_t *vals, size_t len)
+{
+    ESP_RETURN_ON_FALSE(handle && handle->i2c_dev, ESP_ERR_INVALID_ARG, TAG, "null handle");
+    ESP_RETURN_ON_ERROR(drv2605_queue_write(handle, reg, vals, len), TAG, "queue failed");
+    return drv2605_flush(handle);
+}
+
+esp_err_t drv2605_read_regs(drv2605_handle_t handle, uint8_t reg, uint8_t *vals, size_t len)
+{
+    ESP_RETURN_ON_FALSE(handle && handle->i2c_dev, ESP_ERR_INVALID_ARG, TAG, "null handle");
+    ESP_RETURN_ON_ERROR(drv2605_queue_read(handle, reg, vals, len), TAG, "queue failed");
+    return drv2605_flush(handle);
+}
+
+esp_err_t drv2605_write_blocks(drv2605_handle_t handle, const drv2605_reg_block_t *blocks, size_t count)
+{
+    ESP_RETURN_ON_FALSE(handle && handle->i2c_dev, ESP_ERR_INVALID_ARG, TAG, "null handle");
+
+    for (size_t b = 0; b < count; b++) {
+        const drv2605_reg_block_t *block = &blocks[b];
+        uint8_t want[DRV2605_BLOCK_MAX];
+        uint8_t got[DRV2605_BLOCK_MAX];
+        bool keeps = false;
+
+        ESP_RETURN_ON_FALSE(block->len > 0 && block->len <= DRV2605_BLOCK_MAX, ESP_ERR_INVALID_ARG, TAG,
+                            "block 0x%02x: bad length", block->reg);
+        for (size_t i = 0; i < block->len; i++) {
+            keeps |= block->keep[i] != 0;
+        }
+        // read-modify-write the whole run at once
+        if (keeps) {
+            ESP_RETURN_ON_ERROR(drv2605_read_regs(handle, block->reg, got, block->len), TAG,
+                                "block 0x%02x: read failed", block->reg);
+        }
+        for (size_t i = 0; i < block->len; i++) {
+            want[i] = (uint8_t)((keeps ? (got[i] & block->keep[i]) : 0) | block->set[i]);
+        }
+
+        for (int attempt = 0;; attempt++) {
+            // write and read back in one batch
+            ESP_RETURN_ON_ERROR(drv2605_queue_write(handle, block->reg, want, block->len), TAG, "queue failed");
+            ESP_RETURN_ON_ERROR(drv2605_queue_read(handle, block->reg, got, block->len), TAG, "queue failed");
+            ESP_RETURN_ON_ERROR(drv2605_flush(handle), TAG, "block 0x%02x: write failed", block->reg);
+            if (memcmp(want, got, block->len) == 0) {
+                break;
+            }
+            for (size_t i = 0; i < block->len; i++) {
+                if (want[i] != got[i]) {
+                    ESP_LOGW(TAG, "reg 0x%02x reads 0x%02x, wrote 0x%02x", (unsigned)(block->reg + i), got[i], want[i]);
+                }
+            }
+            ESP_RETURN_ON_FALSE(attempt == 0, ESP_ERR_INVALID_RESPONSE, TAG, "block 0x%02x: verify failed",
+                                block->reg);
+        }
+    }
+    return ESP_OK;
 }
 
 esp_err_t drv2605_set_waveform(drv2605_handle_t handle, uint8_t slot, uint8_t waveform_id)
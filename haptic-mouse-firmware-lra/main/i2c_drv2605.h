@@ -1,8 +1,13 @@
 #pragma once
 
+#include <stdbool.h>
+#include <stddef.h>
 #include <stdint.h>
 #include "driver/i2c_master.h"
 #include "esp_err.h"
+#include "esp_timer.h"
+#include "freertos/FreeRTOS.h"
+#include "freertos/semphr.h"
 
 #ifdef __cplusplus
 extern "C" {
@@ -11,6 +16,11 @@ extern "C" {
 #define DRV2605_ADDR 0x5A ///< Device I2C address
 
 #define DRV2605_REG_STATUS 0x00       ///< Status register
+#define DRV2605_STATUS_DEVICE_ID(s) ((s) >> 5) ///< DEVICE_ID field of the status register
+#define DRV2605_DEVICE_ID_DRV2605 3   ///< DRV2605 (with licensed library)
+#define DRV2605_DEVICE_ID_DRV2604 4   ///< DRV2604 (RAM, no library)
+#define DRV2605_DEVICE_ID_DRV2604L 6  ///< DRV2604L (RAM, no library)
+#define DRV2605_DEVICE_ID_DRV2605L 7  ///< DRV2605L (with licensed library)
 #define DRV2605_REG_MODE 0x01         ///< Mode register
 #define DRV2605_MODE_INTTRIG 0x00     ///< Internal trigger mode
 #define DRV2605_MODE_EXTTRIGEDGE 0x01 ///< External edge trigger mode
@@ -54,15 +64,87 @@ extern "C" {
 #define DRV2605_REG_VBAT 0x21        ///< Vbat voltage-monitor register
 #define DRV2605_REG_LRARESON 0x22    ///< LRA resonance-period register
 
+#define DRV2605_WAKE_US 250           ///< EN high to the first I²C transaction
+#define DRV2605_BLOCK_MAX 24          ///< Registers in one ::drv2605_reg_block_t
+
+#define DRV2605_QUEUE_DEPTH 8         ///< Transactions in one batch; also the bus trans_queue_depth to use
+#define DRV2605_RETRIES 2             ///< Batch attempts after the first, see ::drv2605_flush
+#define DRV2605_SLACK_US 1000         ///< Time a batch may take beyond its wire time before the bus counts as stuck
+#define DRV2605_LATENCY_BUCKETS 12    ///< Buckets of ::drv2605_stats_t.latency
+#define DRV2605_LATENCY_BUCKET0_US 32 ///< Upper bound of the first latency bucket; each next one doubles it
+
 /* -------------------------------------------------------------------------- */
 /*  Configuration and Handle Structures                                       */
 /* -------------------------------------------------------------------------- */
+
+/**
+ * @brief A run of consecutive registers set in one burst.
+ *
+ * The DRV2605 increments the register address after every byte, so the run
+ * goes out as a single I²C write. Register @c reg + i becomes
+ * (current & keep[i]) | set[i]; a block whose keep bytes are all zero is
+ * written without being read first.
+ */
+typedef struct {
+    uint8_t reg;                          /*!< First register */
+    uint8_t len;                          /*!< Registers in the run, up to DRV2605_BLOCK_MAX */
+    uint8_t set[DRV2605_BLOCK_MAX];       /*!< Bits to set */
+    uint8_t keep[DRV2605_BLOCK_MAX];      /*!< Bits to keep from the current value */
+} drv2605_reg_block_t;
+
 typedef struct {
     i2c_device_config_t drv2605_device;  /*!< Configuration for eeprom device */
+    const drv2605_reg_block_t *init;     /*!< Register setup applied by ::drv2605_init, NULL = none */
+    size_t init_count;                   /*!< Blocks in @c init */
 } drv2605_config_t;
 
+/**
+ * @brief One queued transaction: a write, or a register address write followed by a read.
+ *
+ * The bytes live here rather than with the caller because the bus driver
+ * sends them after the queueing call has returned.
+ */
+typedef struct {
+    uint8_t tx[1 + DRV2605_BLOCK_MAX];    /*!< Register address, then the data of a write */
+    uint8_t tx_len;                       /*!< Bytes in @c tx */
+    uint8_t rx_len;                       /*!< Bytes to read into @c rx, 0 for a write */
+    uint8_t *rx;                          /*!< Caller buffer, filled by ::drv2605_flush */
+    volatile uint8_t event;               /*!< i2c_master_event_t of the completion, I2C_EVENT_ALIVE while pending; retries skip I2C_EVENT_DONE */
+} drv2605_xfer_t;
+
+/**
+ * @brief Transport counters, updated by ::drv2605_flush.
+ */
+typedef struct {
+    uint32_t batches;                     /*!< Flushed batches */
+    uint32_t nacks;                       /*!< Transactions the chip did not acknowledge */
+    uint32_t timeouts;                    /*!< Attempts that did not complete in time */
+    uint32_t retries;                     /*!< Attempts after the first */
+    uint32_t recoveries;                  /*!< Bus resets after a stuck bus */
+    uint32_t resyncs;                     /*!< Register setup re-applied after a bus reset */
+    uint32_t failures;                    /*!< Batches given up on */
+    uint32_t max_us;                      /*!< Longest flush */
+    uint32_t latency[DRV2605_LATENCY_BUCKETS]; /*!< Flushes by duration; bucket i ends at DRV2605_LATENCY_BUCKET0_US << i, the last is open */
+} drv2605_stats_t;
+
 struct drv2605_t {
     i2c_master_dev_handle_t i2c_dev;      /*!< I2C device handle */
+    i2c_master_bus_handle_t bus;          /*!< Bus the device is on, reset when stuck */
+    uint8_t device_id;                    /*!< DEVICE_ID read at init (DRV2605_DEVICE_ID_*) */
+    uint32_t scl_speed_hz;                /*!< Bus clock, for the batch deadline */
+    const drv2605_reg_block_t *init;      /*!< Register setup, re-applied after a bus reset */
+    size_t init_count;                    /*!< Blocks in @c init */
+    bool async;                           /*!< Transactions complete through the bus callback */
+    bool recovering;                      /*!< Re-applying the setup; no nested recovery */
+    drv2605_xfer_t xfers[DRV2605_QUEUE_DEPTH]; /*!< Current batch */
+    uint8_t count;                        /*!< Transactions queued in the batch */
+    uint8_t pending[DRV2605_QUEUE_DEPTH]; /*!< Indices into @c xfers of the transactions sent by the current attempt */
+    volatile uint8_t submitted;           /*!< Entries of @c pending handed to the bus */
+    volatile uint8_t done;                /*!< Entries of @c pending completed */
+    SemaphoreHandle_t done_sem;           /*!< Given when the last submitted transaction completes */
+    StaticSemaphore_t done_sem_buf;       /*!< Storage of @c done_sem */
+    esp_timer_handle_t deadline_timer;    /*!< Gives @c done_sem at the batch deadline, finer than the tick */
+    drv2605_stats_t stats;                /*!< Transport counters */
 };
 
 typedef struct drv2605_t *drv2605_handle_t;
@@ -74,6 +156,12 @@ typedef struct drv2605_t *drv2605_handle_t;
 /**
  * @brief  Create and initialize a DRV2605 device on an existing I²C bus.
  *
+ * Reads the status register to identify the chip, then applies and verifies
+ * the register setup in @c cfg->init with ::drv2605_write_blocks. On a bus
+ * created with a trans_queue_depth of at least DRV2605_QUEUE_DEPTH the
+ * transactions of a batch go out back to back without the task waiting on
+ * each one; on other buses they are sent one by one.
+ *
  * @param[in]  bus_handle  I²C master bus handle (from i2c_master_bus_create)
  * @param[in]  cfg         Device configuration
  * @param[out] v_handle    Returned driver handle
@@ -82,11 +170,64 @@ typedef struct drv2605_t *drv2605_handle_t;
  */
 esp_err_t drv2605_init(i2c_master_bus_handle_t bus_handle, const drv2605_config_t *drv2605_config, drv2605_handle_t *drv2605_handle);
 
+/**
+ * @brief Queue a write of @p len consecutive registers starting at @p reg.
+ *
+ * Nothing is sent until ::drv2605_flush; a full batch is flushed first.
+ *
+ * @return
+ *  - ESP_OK when queued
+ *  - ESP_ERR_INVALID_ARG if @p handle is NULL or @p len is 0 or above DRV2605_BLOCK_MAX
+ *  - The error of flushing a full batch
+ */
+esp_err_t drv2605_queue_write(drv2605_handle_t handle, uint8_t reg, const uint8_t *vals, size_t len);
+
+/**
+ * @brief Queue a read of @p len consecutive registers starting at @p reg.
+ *
+ * @p vals is filled by the ::drv2605_flush that sends the batch and must
+ * stay valid until then.
+ *
+ * @return as ::drv2605_queue_write
+ */
+esp_err_t drv2605_queue_read(drv2605_handle_t handle, uint8_t reg, uint8_t *vals, size_t len);
+
+/**
+ * @brief Send the queued batch in order and wait for it.
+ *
+ * An attempt gets the wire time of the batch plus DRV2605_SLACK_US, timed
+ * with an esp_timer alarm rather than the scheduler tick. A
+ * transaction the chip does not acknowledge is sent again together with
+ * everything queued behind it, up to DRV2605_RETRIES times. An attempt that
+ * does not complete in time means a stuck bus: the bus is reset, which
+ * clocks SCL until the slave releases SDA, and the register setup given to
+ * ::drv2605_init is re-applied (counted in @c stats.resyncs, so callers
+ * caching register state can tell) before the whole batch is sent again.
+ * This happens at most once per flush, which bounds its duration.
+ *
+ * @return
+ *  - ESP_OK when every transaction of the batch completed
+ *  - ESP_ERR_INVALID_ARG if @p handle is NULL
+ *  - ESP_FAIL when the chip kept not acknowledging
+ *  - ESP_ERR_TIMEOUT when the bus stayed stuck; the bus is reset before
+ *    returning, so no transaction of the batch is left in flight
+ */
+esp_err_t drv2605_flush(drv2605_handle_t handle);
+
+/**
+ * @brief Upper bound of the flush latency below which @p percent of the flushes completed.
+ *
+ * @return microseconds, UINT32_MAX when they fall into the open last bucket,
+ *         0 before the first flush
+ */
+uint32_t drv2605_latency_percentile(const drv2605_stats_t *stats, unsigned percent);
+
 /**
  * @brief Write an 8-bit value to a DRV2605 register.
  *
  * Sends a two-byte I²C transaction—register address followed by data—using the
- * device handle returned by ::drv2605_init.
+ * device handle returned by ::drv2605_init. Like every call below it queues
+ * the transaction and flushes, so anything queued before goes out first.
  *
  * @param[in] handle  Driver handle obtained from ::drv2605_init.
  * @param[in] reg     Register address (0x00 – 0x7F) to be written.
@@ -117,6 +258,41 @@ esp_err_t drv2605_write_reg8(drv2605_handle_t handle, uint8_t reg, uint8_t val);
  */
 esp_err_t drv2605_read_reg8(drv2605_handle_t handle, uint8_t reg, uint8_t *out_val);
 
+/**
+ * @brief Write @p len consecutive registers starting at @p reg in one transaction.
+ *
+ * @return
+ *  - ESP_OK on success
+ *  - ESP_ERR_INVALID_ARG if @p handle is NULL or @p len is 0 or above DRV2605_BLOCK_MAX
+ *  - Propagated I²C errors (e.g., ESP_ERR_TIMEOUT, ESP_FAIL)
+ */
+esp_err_t drv2605_write_regs(drv2605_handle_t handle, uint8_t reg, const uint8_t *vals, size_t len);
+
+/**
+ * @brief Read @p len consecutive registers starting at @p reg in one transaction.
+ *
+ * @return
+ *  - ESP_OK on success
+ *  - ESP_ERR_INVALID_ARG if @p handle or @p vals is NULL or @p len is 0 or above DRV2605_BLOCK_MAX
+ *  - Propagated I²C errors (e.g., ESP_ERR_TIMEOUT, ESP_FAIL)
+ */
+esp_err_t drv2605_read_regs(drv2605_handle_t handle, uint8_t reg, uint8_t *vals, size_t len);
+
+/**
+ * @brief Apply register blocks and read them back.
+ *
+ * Each block costs one burst write, plus one burst read before it when it
+ * keeps bits, plus one burst read to verify. A block that does not read
+ * back as written is written once more.
+ *
+ * @return
+ *  - ESP_OK when every block reads back as written
+ *  - ESP_ERR_INVALID_ARG if @p handle is NULL or a block is longer than DRV2605_BLOCK_MAX
+ *  - ESP_ERR_INVALID_RESPONSE if a block still differs after the second write
+ *  - Propagated I²C errors
+ */
+esp_err_t drv2605_write_blocks(drv2605_handle_t handle, const drv2605_reg_block_t *blocks, size_t count);
+
 /**
  * @brief Assign a vibration waveform to one of the DRV2605’s eight sequence slots.
  *
@@ -15,20 +15,92 @@
 #include "class/hid/hid_device.h"
 #include "driver/i2c_master.h"
 #include "driver/gpio.h"
+#include "esp_rom_sys.h"
 
 #include "i2c_drv2605.h"
 #include "drv2605_effects.h"
+#include "haptic_pattern.h"
+#include "haptic_scheduler.h"
+#include "haptic_protocol.h"
+#include "haptic_alarm.h"
+#include "haptic_trace.h"
+#include "hid_haptics.h"
 
 #define I2C_SCL_GPIO 5
 #define I2C_SDA_GPIO 6
 #define DRV_EN_GPIO  7
 #define MASTER_FREQUENCY 400000
 
+// Scheduled effects load the sequencer this long before their target time
+// and only write GO at the target
+#define DRV2605_ARM_US   1000
+
 static const char *TAG = "app_main";
 
 // the queue handle
 static QueueHandle_t hid_evt_queue = NULL;
 
+// wakes the player loop for scheduled effects
+static haptic_alarm_t s_alarm;
+static volatile uint16_t s_scheduled;
+static volatile uint16_t s_late;
+
+// Boot phases; USB enumerates while the actuator is set up
+typedef enum {
+    BOOT_APP_MAIN,          // app_main entered (bootloader and IDF startup before it)
+    BOOT_USB_STARTED,       // TinyUSB installed, enumeration running
+    BOOT_DRV_READY,         // DRV2605 registers written and verified
+    BOOT_USB_MOUNTED,       // host set the configuration
+    BOOT_PHASE_COUNT,
+} boot_phase_t;
+
+// esp_timer time each phase was reached, 0 = not yet
+static volatile int64_t s_boot_us[BOOT_PHASE_COUNT];
+
+static void boot_mark(boot_phase_t phase)
+{
+    if (s_boot_us[phase] == 0) {
+        s_boot_us[phase] = esp_timer_get_time();
+    }
+}
+
+// DRV2605 register setup, two bursts instead of a transaction per
+// register: out of standby in internal-trigger mode with LRA library 1 and a
+// strong click loaded for the boot confirmation, then no time offsets, the
+// audio-to-vibe ceiling and LRA feedback, keeping the calibration results
+#define DRV_OFS(reg) ((reg) - DRV2605_REG_OVERDRIVE)
+static const drv2605_reg_block_t s_drv_setup[] = {
+    {
+        .reg = DRV2605_REG_MODE,
+        .len = DRV2605_REG_WAVESEQ2 - DRV2605_REG_MODE + 1,
+        // MODE, RTPIN, LIBRARY, WAVESEQ1 (strong click), WAVESEQ2 (end)
+        .set = { DRV2605_MODE_INTTRIG, 0x00, 0x01, 1, 0 },
+    },
+    {
+        .reg = DRV2605_REG_OVERDRIVE,
+        .len = DRV2605_REG_CONTROL3 - DRV2605_REG_OVERDRIVE + 1,
+        .set = {
+            [DRV_OFS(DRV2605_REG_AUDIOMAX)] = 0x64,
+            [DRV_OFS(DRV2605_REG_FEEDBACK)] = 0x80,     // N_ERM_LRA: LRA
+            [DRV_OFS(DRV2605_REG_CONTROL3)] = 0x20,     // ERM_OPEN_LOOP
+        },
+        .keep = {
+            [DRV_OFS(DRV2605_REG_AUDIOCTRL)] = 0xFF,
+            [DRV_OFS(DRV2605_REG_AUDIOLVL)] = 0xFF,
+            [DRV_OFS(DRV2605_REG_AUDIOOUTMIN)] = 0xFF,
+            [DRV_OFS(DRV2605_REG_AUDIOOUTMAX)] = 0xFF,
+            [DRV_OFS(DRV2605_REG_RATEDV)] = 0xFF,
+            [DRV_OFS(DRV2605_REG_CLAMPV)] = 0xFF,
+            [DRV_OFS(DRV2605_REG_AUTOCALCOMP)] = 0xFF,
+            [DRV_OFS(DRV2605_REG_AUTOCALEMP)] = 0xFF,
+            [DRV_OFS(DRV2605_REG_FEEDBACK)] = 0x7F,
+            [DRV_OFS(DRV2605_REG_CONTROL1)] = 0xFF,
+            [DRV_OFS(DRV2605_REG_CONTROL2)] = 0xFF,
+            [DRV_OFS(DRV2605_REG_CONTROL3)] = (uint8_t)~0x20,
+        },
+    },
+};
+
 /************* TinyUSB descriptors ****************/
 
 #define TUSB_DESC_TOTAL_LEN      (TUD_CONFIG_DESC_LEN + CFG_TUD_HID * TUD_HID_DESC_LEN)
@@ -37,8 +109,8 @@ static QueueHandle_t hid_evt_queue = NULL;
  * @brief HID report descriptor
  */
 const uint8_t hid_report_descriptor[] = {
-    HID_USAGE_PAGE(0x0E), // Haptics page
-    HID_USAGE(0x01), // Simple Haptic Controller
+    HID_USAGE_PAGE_N(0xFF00, 2), // Vendor page: legacy reports and the command protocol
+    HID_USAGE(0x01),
     HID_COLLECTION(HID_COLLECTION_APPLICATION), // Application
         HID_REPORT_ID(0x10) // Haptic report ID
         HID_LOGICAL_MIN(0x00),
@@ -49,7 +121,50 @@ const uint8_t hid_report_descriptor[] = {
         HID_REPORT_SIZE(0x08),
         HID_REPORT_COUNT(0x01),
         HID_OUTPUT( HID_DATA | HID_VARIABLE | HID_ABSOLUTE ), // Output (Data,Var,Abs)
-    HID_COLLECTION_END
+        HID_REPORT_ID(HAPTIC_PATTERN_REPORT_ID) // Continuous pattern report ID
+        HID_LOGICAL_MIN(0x00),
+        HID_LOGICAL_MAX(0xFF),
+        HID_USAGE(0x01),
+        HID_REPORT_SIZE(0x08),
+        HID_REPORT_COUNT(0x05), // op, effect, period (2 bytes), intensity
+        HID_OUTPUT( HID_DATA | HID_VARIABLE | HID_ABSOLUTE ),
+        HID_REPORT_ID(HP_HID_REPORT_ID) // Command protocol packet (haptic_protocol.h)
+        HID_LOGICAL_MIN(0x00),
+        HID_LOGICAL_MAX(0xFF),
+        HID_USAGE(0x01),
+        HID_REPORT_SIZE(0x08),
+        HID_REPORT_COUNT(HP_HID_REPORT_SIZE),
+        HID_OUTPUT( HID_DATA | HID_VARIABLE | HID_ABSOLUTE ),
+        HID_REPORT_ID(HP_HID_CAPS_REPORT_ID) // Capabilities (CAPS packet)
+        HID_LOGICAL_MIN(0x00),
+        HID_LOGICAL_MAX(0xFF),
+        HID_USAGE(0x01),
+        HID_REPORT_SIZE(0x08),
+        HID_REPORT_COUNT(HP_HID_REPORT_SIZE),
+        HID_FEATURE( HID_DATA | HID_VARIABLE | HID_ABSOLUTE ),
+        HID_REPORT_ID(HP_HID_TIME_REPORT_ID) // Device clock (TIME packet)
+        HID_LOGICAL_MIN(0x00),
+        HID_LOGICAL_MAX(0xFF),
+        HID_USAGE(0x01),
+        HID_REPORT_SIZE(0x08),
+        HID_REPORT_COUNT(HP_HID_REPORT_SIZE),
+        HID_FEATURE( HID_DATA | HID_VARIABLE | HID_ABSOLUTE ),
+        HID_REPORT_ID(HP_HID_TRACE_REPORT_ID) // Trace dump (TRACE packet)
+        HID_LOGICAL_MIN(0x00),
+        HID_LOGICAL_MAX(0xFF),
+        HID_USAGE(0x01),
+        HID_REPORT_SIZE(0x08),
+        HID_REPORT_COUNT(HP_HID_REPORT_SIZE),
+        HID_FEATURE( HID_DATA | HID_VARIABLE | HID_ABSOLUTE ),
+        HID_REPORT_ID(HP_HID_EFFECTS_REPORT_ID) // Effect catalog (EFFECTS packet)
+        HID_LOGICAL_MIN(0x00),
+        HID_LOGICAL_MAX(0xFF),
+        HID_USAGE(0x01),
+        HID_REPORT_SIZE(0x08),
+        HID_REPORT_COUNT(HP_HID_REPORT_SIZE),
+        HID_FEATURE( HID_DATA | HID_VARIABLE | HID_ABSOLUTE ),
+    HID_COLLECTION_END,
+    HID_HAPTICS_REPORT_DESCRIPTOR, // Standard Simple Haptic Controller (hid_haptics.h)
 };
 
 /**
@@ -87,98 +202,491 @@ uint8_t const *tud_hid_descriptor_report_cb(uint8_t instance)
     return hid_report_descriptor;
 }
 
+// Capabilities reported to the host
+static const hp_caps_t s_caps = {
+    .version_min = HP_VERSION,
+    .version_max = HP_VERSION,
+    .device_kind = HP_DEVICE_LRA,
+    .actuator_count = 1,
+    .max_records = HP_HID_MAX_RECORDS,
+    .schedule_lead_ms = 3,
+    .effect_count = DRV2605_EFFECT_COUNT,
+    .features = HP_CAP_INTENSITY | HP_CAP_PATTERN | HP_CAP_QUEUE | HP_CAP_SCHEDULE,
+    .min_period_ms = HAPTIC_PATTERN_MIN_PERIOD,
+};
+
+// Next catalog entry returned by the effects feature report
+static uint8_t s_effects_next = 1;
+
+// One EFFECTS packet per request; after the last entries comes an empty
+// packet and the next request starts over at effect 1. Reading CAPS rewinds
+// the catalog too, so a reader that reads CAPS first starts at effect 1
+// unless another one reads the catalog at the same time.
+static void build_effects_report(uint8_t *buffer)
+{
+    hp_effect_info_t info[HP_HID_MAX_EFFECTS];
+    uint8_t first = s_effects_next;
+    size_t count = 0;
+
+    while (count < HP_HID_MAX_EFFECTS && first + count < DRV2605_EFFECT_COUNT) {
+        const drv2605_effect_t *effect = drv2605_effect((uint8_t)(first + count));
+        info[count].duration_ms = effect->duration_ms;
+        info[count].peak = effect->peak;
+        info[count].category = effect->category;
+        count++;
+    }
+    s_effects_next = count ? (uint8_t)(first + count) : 1;
+    hp_build_effects(buffer, 0, count ? first : 0, info, count, HP_HID_REPORT_SIZE - HP_HEADER_SIZE - HP_CRC_SIZE);
+}
+
+// Invoked when the host has set the configuration
+void tud_mount_cb(void)
+{
+    boot_mark(BOOT_USB_MOUNTED);
+}
+
 // Invoked when received GET_REPORT control request
 // Application must fill buffer report's content and return its length.
 // Return zero will cause the stack to STALL request
 uint16_t tud_hid_get_report_cb(uint8_t instance, uint8_t report_id, hid_report_type_t report_type, uint8_t* buffer, uint16_t reqlen)
 {
     (void) instance;
-    (void) report_id;
-    (void) report_type;
-    (void) buffer;
-    (void) reqlen;
+
+    if (report_type == HID_REPORT_TYPE_FEATURE && report_id == HP_HID_CAPS_REPORT_ID && reqlen >= HP_HID_REPORT_SIZE) {
+        memset(buffer, 0, HP_HID_REPORT_SIZE);
+        hp_build_caps(buffer, 0, &s_caps);
+        s_effects_next = 1;
+        return HP_HID_REPORT_SIZE;
+    }
+    if (report_type == HID_REPORT_TYPE_FEATURE && report_id == HP_HID_TIME_REPORT_ID && reqlen >= HP_HID_REPORT_SIZE) {
+        // sampled as late as possible; the host takes the midpoint of its request
+        const hp_time_t now = {
+            .device_us = (uint64_t)esp_timer_get_time(),
+            .scheduled = s_scheduled,
+            .late = s_late,
+        };
+        memset(buffer, 0, HP_HID_REPORT_SIZE);
+        hp_build_time(buffer, 0, &now);
+        return HP_HID_REPORT_SIZE;
+    }
+    if (report_type == HID_REPORT_TYPE_FEATURE && report_id == HP_HID_TRACE_REPORT_ID && reqlen >= HP_HID_REPORT_SIZE) {
+        // one chunk per request; the host reads until a chunk has no events
+        size_t events;
+        memset(buffer, 0, HP_HID_REPORT_SIZE);
+        haptic_trace_dump(buffer, 0, HP_HID_REPORT_SIZE - HP_HEADER_SIZE - HP_CRC_SIZE, &events);
+        return HP_HID_REPORT_SIZE;
+    }
+    if (report_type == HID_REPORT_TYPE_FEATURE && report_id == HP_HID_EFFECTS_REPORT_ID && reqlen >= HP_HID_REPORT_SIZE) {
+        memset(buffer, 0, HP_HID_REPORT_SIZE);
+        build_effects_report(buffer);
+        return HP_HID_REPORT_SIZE;
+    }
+    if (report_type == HID_REPORT_TYPE_FEATURE && report_id == HID_HAPTICS_FEATURE_REPORT_ID) {
+        return hid_haptics_get_feature(buffer, reqlen);
+    }
 
     return 0;
 }
 
+// Post one effect to the player queue, stamped so that a later flush drops
+// it even once the player has taken it
+static void post_play(const haptic_play_t *play)
+{
+    haptic_play_t stamped = *play;
+
+    if (!stamped.generation) {
+        stamped.generation = haptic_alarm_generation(&s_alarm);
+    }
+    haptic_trace(HAPTIC_TRACE_ENQUEUE, play->trace_tag, play->trace_index, play->effect);
+    if (xQueueSend(hid_evt_queue, &stamped, 0) != pdTRUE) {
+        haptic_trace(HAPTIC_TRACE_DROP, play->trace_tag, play->trace_index, play->effect);
+    }
+}
+
+// Forget queued and scheduled effects, ahead of a stop
+static void flush_playback(void)
+{
+    xQueueReset(hid_evt_queue);
+    haptic_alarm_cancel(&s_alarm);
+}
+
+// Execute a command protocol packet. Records run in order; PLAY and STOP go
+// through the player queue, pattern ops are applied directly. In a scheduled
+// packet PLAY and PATTERN_START fire at the target time.
+static void handle_protocol_packet(const uint8_t *buffer, uint16_t bufsize, uint16_t tag)
+{
+    hp_packet_t pkt;
+    hp_status_t status = hp_packet_parse(buffer, bufsize, &pkt);
+    int64_t at_us = 0;
+    uint32_t at;
+
+    if (status == HP_STATUS_OK && pkt.type != HP_PKT_COMMANDS) {
+        status = HP_STATUS_BAD_TYPE;
+    }
+    haptic_trace(HAPTIC_TRACE_PARSE, tag, HAPTIC_TRACE_PACKET, status);
+    if (status != HP_STATUS_OK) {
+        return;
+    }
+    if (hp_packet_at(&pkt, &at)) {
+        at_us = hp_time_resolve(at, esp_timer_get_time());
+    }
+
+    for (size_t i = 0; i < hp_record_count(&pkt); i++) {
+        hp_record_t rec;
+        hp_record_get(&pkt, i, &rec);
+        if (rec.actuator != 0 && rec.actuator != HP_ACTUATOR_ALL) {
+            continue;
+        }
+
+        switch (rec.op) {
+        case HP_OP_PLAY:
+        case HP_OP_STOP: {
+            haptic_play_t play = {
+                .effect = rec.op == HP_OP_PLAY ? rec.effect : 0,
+                .intensity = rec.intensity,
+                .flags = rec.flags,
+                .at_us = rec.op == HP_OP_PLAY ? at_us : 0,
+                .trace_tag = tag,
+                .trace_index = (uint8_t)i,
+            };
+            if (rec.op == HP_OP_STOP) {
+                flush_playback();
+            }
+            post_play(&play);
+            break;
+        }
+        case HP_OP_PATTERN_START:
+            haptic_pattern_command(HAPTIC_PATTERN_START, rec.effect, rec.arg, rec.intensity, at_us);
+            break;
+        case HP_OP_PATTERN_UPDATE:
+            haptic_pattern_command(HAPTIC_PATTERN_UPDATE, 0, rec.arg, rec.intensity, 0);
+            break;
+        case HP_OP_PATTERN_STOP:
+            haptic_pattern_command(HAPTIC_PATTERN_STOP, 0, 0, 0, 0);
+            break;
+        default:
+            break;
+        }
+    }
+}
+
+// Execute a manual trigger of the standard haptics collection. A trigger
+// replaces whatever plays: repeats of a one-shot waveform are queued back to
+// back or scheduled a retrigger period apart, continuous waveforms run on the
+// pattern timer until STOP or the waveform cutoff time. Only the first play
+// is queued here; the player posts each repetition as it takes the previous
+// one, so all 255 repeats fit the queue.
+static void handle_haptics_output(const uint8_t *buffer, uint16_t bufsize, uint16_t tag)
+{
+    hid_haptics_trigger_t trigger;
+    esp_err_t err = hid_haptics_decode_output(buffer, bufsize, &trigger);
+
+    haptic_trace(HAPTIC_TRACE_PARSE, tag, HAPTIC_TRACE_PACKET,
+                 err == ESP_OK ? HP_STATUS_OK : err == ESP_ERR_NOT_FOUND ? HP_STATUS_UNSUPPORTED : HP_STATUS_BAD_LENGTH);
+    if (err != ESP_OK || trigger.action == HID_HAPTICS_NOTHING) {
+        return;
+    }
+
+    haptic_pattern_stop();
+    flush_playback();
+    if (trigger.action == HID_HAPTICS_STOP) {
+        haptic_play_t stop = { .trace_tag = tag };
+        post_play(&stop);
+    } else if (trigger.action == HID_HAPTICS_CONTINUOUS) {
+        haptic_pattern_command(HAPTIC_PATTERN_START, trigger.effect, trigger.period_ms, trigger.intensity, 0);
+    } else {
+        haptic_play_t play = {
+            .effect = trigger.effect,
+            .intensity = trigger.intensity,
+            .repeat = (uint8_t)trigger.repeat,
+            .period_ms = (uint16_t)trigger.period_ms,
+            .trace_tag = tag,
+        };
+        post_play(&play);
+    }
+}
+
 // Invoked when received SET_REPORT control request or
 // received data on OUT endpoint ( Report ID = 0, Type = 0 )
 void tud_hid_set_report_cb(uint8_t instance, uint8_t report_id, hid_report_type_t report_type, uint8_t const* buffer, uint16_t bufsize)
 {
-    if (report_type == HID_REPORT_TYPE_OUTPUT && report_id == 0x10 && bufsize >= 1) {
-        // send the effect to the queue for procession
-        uint8_t effect = buffer[0];
-        if (hid_evt_queue) {
-            xQueueSendFromISR(hid_evt_queue, &effect, NULL);
+    if (report_type == HID_REPORT_TYPE_FEATURE && report_id == HID_HAPTICS_FEATURE_REPORT_ID) {
+        hid_haptics_set_feature(buffer, bufsize);
+        return;
+    }
+    if (report_type != HID_REPORT_TYPE_OUTPUT || hid_evt_queue == NULL) {
+        return;
+    }
+
+    uint16_t tag = haptic_trace_tag();
+    haptic_trace(HAPTIC_TRACE_USB_RX, tag, HAPTIC_TRACE_PACKET, bufsize);
+
+    if (report_id == HP_HID_REPORT_ID) {
+        handle_protocol_packet(buffer, bufsize, tag);
+    } else if (report_id == 0x10 && bufsize >= 1) {
+        // legacy single effect report
+        haptic_play_t play = {
+            .effect = buffer[0],
+            .intensity = 0xFF,
+            .generation = haptic_alarm_generation(&s_alarm),
+            .trace_tag = tag,
+        };
+        haptic_trace(HAPTIC_TRACE_ENQUEUE, tag, 0, play.effect);
+        xQueueSendFromISR(hid_evt_queue, &play, NULL);
+    } else if (report_id == HID_HAPTICS_OUTPUT_REPORT_ID) {
+        handle_haptics_output(buffer, bufsize, tag);
+    } else if (report_id == HAPTIC_PATTERN_REPORT_ID) {
+        esp_err_t err = haptic_pattern_handle_report(buffer, bufsize);
+        haptic_trace(HAPTIC_TRACE_PARSE, tag, HAPTIC_TRACE_PACKET, err == ESP_OK ? HP_STATUS_OK : HP_STATUS_BAD_LENGTH);
+    }
+}
+
+// Wait for the running waveform to finish (GO bit clears). Queued effects
+// that cannot be appended wait for the catalog duration first, so this only
+// covers an actuator running a little longer than nominal.
+static void drv2605_wait_idle(drv2605_handle_t handle)
+{
+    for (int i = 0; i < 100; i++) {
+        uint8_t go = 0;
+        if (drv2605_read_reg8(handle, DRV2605_REG_GO, &go) != ESP_OK || !(go & 0x01)) {
+            return;
         }
+        vTaskDelay(pdMS_TO_TICKS(10));
+    }
+}
+
+// Scale the library waveforms by adjusting the rated voltage, which is the
+// full-scale reference in closed-loop LRA mode. The setup block keeps
+// RATEDV, so a driver resync leaves whatever the chip holds: the scaled
+// value, or the power-on default if it reset. The cached intensity only
+// holds until the next resync, and the next load writes RATEDV again.
+static esp_err_t drv2605_apply_intensity(drv2605_handle_t handle, uint8_t rated_full, uint8_t intensity)
+{
+    static uint8_t current = 0xFF;
+    static uint32_t resyncs;
+
+    if (intensity == current && resyncs == handle->stats.resyncs) {
+        return ESP_OK;
+    }
+    esp_err_t err = drv2605_write_reg8(handle, DRV2605_REG_RATEDV, (uint8_t)((rated_full * intensity) / 0xFF));
+    if (err == ESP_OK) {
+        current = intensity;
+        resyncs = handle->stats.resyncs;
+    }
+    return err;
+}
+
+// Set the intensity and load the effect for the next GO
+static esp_err_t player_load(haptic_sched_t *sched, uint8_t rated_full, uint8_t effect, uint8_t intensity)
+{
+    esp_err_t err = drv2605_apply_intensity(sched->drv, rated_full, intensity);
+
+    if (err == ESP_OK) {
+        err = haptic_sched_load(sched, effect, intensity);
+    }
+    return err;
+}
+
+// Console report of the I2C transport, when something went wrong since the
+// last one: counters and flush latency
+static void i2c_report(drv2605_handle_t handle)
+{
+    static uint32_t reported;
+    const drv2605_stats_t *stats = &handle->stats;
+
+    if (stats->retries + stats->failures == reported) {
+        return;
+    }
+    reported = stats->retries + stats->failures;
+    ESP_LOGW(TAG, "I2C: %lu batches, %lu NACKs, %lu timeouts, %lu retries, %lu bus resets, %lu resyncs, %lu failed",
+             (unsigned long)stats->batches, (unsigned long)stats->nacks, (unsigned long)stats->timeouts,
+             (unsigned long)stats->retries, (unsigned long)stats->recoveries, (unsigned long)stats->resyncs,
+             (unsigned long)stats->failures);
+    ESP_LOGW(TAG, "I2C latency: p50 < %lu us, p99 < %lu us, max %lu us",
+             (unsigned long)drv2605_latency_percentile(stats, 50), (unsigned long)drv2605_latency_percentile(stats, 99),
+             (unsigned long)stats->max_us);
+}
+
+// Console report of the boot phases, once USB is mounted and the actuator
+// is ready; the first effect can play from the later of the two
+static void boot_report(void)
+{
+    static const char *const names[BOOT_PHASE_COUNT] = {
+        [BOOT_APP_MAIN] = "app_main",
+        [BOOT_USB_STARTED] = "USB started",
+        [BOOT_DRV_READY] = "DRV2605 ready",
+        [BOOT_USB_MOUNTED] = "USB mounted",
+    };
+    const int64_t mounted = s_boot_us[BOOT_USB_MOUNTED];
+    const int64_t ready = s_boot_us[BOOT_DRV_READY];
+
+    ESP_LOGI(TAG, "Boot phases (ms since startup):");
+    for (int i = 0; i < BOOT_PHASE_COUNT; i++) {
+        ESP_LOGI(TAG, "  %-14s %8.2f", names[i], s_boot_us[i] / 1000.0);
     }
+    ESP_LOGI(TAG, "  %-14s %8.2f", "first effect", (mounted > ready ? mounted : ready) / 1000.0);
 }
 
 void app_main(void)
 {
-    ESP_LOGI(TAG, "ENABLE DRV2605");
+    boot_mark(BOOT_APP_MAIN);
+
+    // the DRV2605 wakes while USB starts
     gpio_reset_pin(DRV_EN_GPIO);
     gpio_set_direction(DRV_EN_GPIO, GPIO_MODE_OUTPUT);
     gpio_set_level(DRV_EN_GPIO, 1);
+    const int64_t drv_enabled_us = esp_timer_get_time();
+
+    // the player queue must exist before the first report arrives; it holds
+    // at least one full protocol packet. Effects requested before the
+    // actuator is set up wait in it.
+    hid_evt_queue = xQueueCreate(2 * HP_HID_MAX_RECORDS, sizeof(haptic_play_t));
+    ESP_ERROR_CHECK(haptic_pattern_init(hid_evt_queue));
+    ESP_ERROR_CHECK(haptic_alarm_init(&s_alarm));
+
+    // enumeration runs in the TinyUSB task from here on; the capability,
+    // clock and catalog reports do not need the actuator
+    const tinyusb_config_t tusb_cfg = {
+        .device_descriptor = NULL,
+        .string_descriptor = hid_string_descriptor,
+        .string_descriptor_count = sizeof(hid_string_descriptor) / sizeof(hid_string_descriptor[0]),
+        .external_phy = false,
+        .configuration_descriptor = hid_configuration_descriptor,
+    };
+    ESP_ERROR_CHECK(tinyusb_driver_install(&tusb_cfg));
+    boot_mark(BOOT_USB_STARTED);
 
-    ESP_LOGI(TAG, "DRV2605 initialization");
     //set i2c pins
     i2c_master_bus_config_t i2c_bus_config = {
         .clk_source = I2C_CLK_SRC_DEFAULT,
         .i2c_port = I2C_NUM_0,
         .scl_io_num = I2C_SCL_GPIO,
         .sda_io_num = I2C_SDA_GPIO,
+        .trans_queue_depth = DRV2605_QUEUE_DEPTH,
         .flags.enable_internal_pullup = true,
     };
     i2c_master_bus_handle_t bus_handle;
     ESP_ERROR_CHECK(i2c_new_master_bus(&i2c_bus_config, &bus_handle));
 
     drv2605_config_t drv2605_config = {
-        .drv2605_device.scl_speed_hz = 400000,
+        .drv2605_device.scl_speed_hz = MASTER_FREQUENCY,
         .drv2605_device.device_address = DRV2605_ADDR,
+        .init = s_drv_setup,
+        .init_count = sizeof(s_drv_setup) / sizeof(s_drv_setup[0]),
     };
     // DRV2605 handle
     drv2605_handle_t drv2605_handle;
 
+    int64_t awake_in = drv_enabled_us + DRV2605_WAKE_US - esp_timer_get_time();
+    if (awake_in > 0) {
+        esp_rom_delay_us((uint32_t)awake_in);
+    }
     ESP_ERROR_CHECK(drv2605_init(bus_handle, &drv2605_config, &drv2605_handle));
-    ESP_LOGI(TAG, "DRV2605 initialization DONE");
-
-    ESP_LOGI(TAG, "DRV2605 configuration");
-    // use LRA mode
-    drv2605_use_lra(drv2605_handle);
-
-    // set waveform library
-    drv2605_select_library(drv2605_handle, 1);
-    drv2605_set_mode(drv2605_handle, DRV2605_MODE_INTTRIG);
-    drv2605_go(drv2605_handle);
-    ESP_LOGI(TAG, "DRV2605 configuration DONE");
-
-    ESP_LOGI(TAG, "USB initialization");
-    const tinyusb_config_t tusb_cfg = {
-        .device_descriptor = NULL,
-        .string_descriptor = hid_string_descriptor,
-        .string_descriptor_count = sizeof(hid_string_descriptor) / sizeof(hid_string_descriptor[0]),
-        .external_phy = false,
-        .configuration_descriptor = hid_configuration_descriptor,
-    };
-
-    ESP_ERROR_CHECK(tinyusb_driver_install(&tusb_cfg));
-    ESP_LOGI(TAG, "USB initialization DONE");
+    // full-scale reference for intensity scaling
+    uint8_t rated_full = 0;
+    ESP_ERROR_CHECK(drv2605_read_reg8(drv2605_handle, DRV2605_REG_RATEDV, &rated_full));
+    boot_mark(BOOT_DRV_READY);
+    // boot confirmation: the strong click loaded by the setup
+    if (drv2605_go(drv2605_handle) != ESP_OK) {
+        ESP_LOGW(TAG, "boot click failed");
+    }
 
-    hid_evt_queue = xQueueCreate(10, sizeof(uint8_t));
+    haptic_sched_t sched;
+    haptic_sched_init(&sched, drv2605_handle);
+    bool boot_reported = false;
 
     while (1) {
-        uint8_t effect;
-        if (xQueueReceive(hid_evt_queue, &effect, pdMS_TO_TICKS(100))) {
-            ESP_LOGI("drv2605", "Play %s", drv2605_effect_names[effect]);
-            // set the effect to play
-            drv2605_stop(drv2605_handle);
-            // set the waveform 
-            drv2605_set_waveform(drv2605_handle, 0, effect);
-            // end waveform
-            drv2605_set_waveform(drv2605_handle, 1, 0);
+        haptic_play_t play;
+        if (!boot_reported && s_boot_us[BOOT_USB_MOUNTED]) {
+            boot_report();
+            boot_reported = true;
+        }
+        if (!xQueueReceive(hid_evt_queue, &play, pdMS_TO_TICKS(100))) {
+            i2c_report(drv2605_handle);
+        } else {
+            uint8_t effect = play.effect;
+            haptic_trace(HAPTIC_TRACE_DEQUEUE, play.trace_tag, play.trace_index, effect);
+            // flushed after the player took it; the alarm waits below check
+            // again, so a flush before the target time still drops it
+            haptic_alarm_expect(&s_alarm, play.generation);
+            if (haptic_alarm_stale(&s_alarm)) {
+                haptic_trace(HAPTIC_TRACE_DROP, play.trace_tag, play.trace_index, effect);
+                continue;
+            }
+            if (effect == 0) {
+                esp_err_t err = haptic_sched_stop(&sched);
+                haptic_trace(HAPTIC_TRACE_DONE, play.trace_tag, play.trace_index, err);
+                continue;
+            }
+            if (drv2605_effect(effect) == NULL) {
+                haptic_trace(HAPTIC_TRACE_DROP, play.trace_tag, play.trace_index, effect);
+                continue;
+            }
+            if (play.repeat) {
+                // the next repetition, a retrigger period after this one or
+                // right behind it; it keeps this play's generation, so a
+                // flush since still drops it
+                haptic_play_t next = play;
+                int64_t base = play.at_us ? play.at_us : esp_timer_get_time();
+                next.repeat--;
+                next.flags = play.period_ms ? 0 : HP_REC_FLAG_QUEUE;
+                next.at_us = play.period_ms ? base + (int64_t)play.period_ms * 1000 : 0;
+                next.trace_index++;
+                post_play(&next);
+            }
+            if (play.at_us) {
+                // scheduled: leave the running effect alone until shortly before the target
+                if (haptic_alarm_wait_until(&s_alarm, play.at_us - DRV2605_ARM_US) == HAPTIC_ALARM_CANCELLED) {
+                    haptic_trace(HAPTIC_TRACE_DROP, play.trace_tag, play.trace_index, effect);
+                    continue;
+                }
+                esp_err_t err = player_load(&sched, rated_full, effect, play.intensity);
+                if (err != ESP_OK) {
+                    haptic_trace(HAPTIC_TRACE_DONE, play.trace_tag, play.trace_index, err);
+                    continue;
+                }
+                haptic_alarm_result_t result = haptic_alarm_wait_until(&s_alarm, play.at_us);
+                if (result == HAPTIC_ALARM_CANCELLED) {
+                    haptic_trace(HAPTIC_TRACE_DROP, play.trace_tag, play.trace_index, effect);
+                    continue;
+                }
+                s_scheduled++;
+                if (result == HAPTIC_ALARM_LATE) {
+                    s_late++;
+                }
+            } else {
+                haptic_sched_action_t action = haptic_sched_decide(&sched, effect, play.intensity, play.flags,
+                                                                   esp_timer_get_time());
+                if (action == HAPTIC_SCHED_DROP) {
+                    haptic_trace(HAPTIC_TRACE_DROP, play.trace_tag, play.trace_index, effect);
+                    continue;
+                }
+                if (action == HAPTIC_SCHED_APPEND) {
+                    esp_err_t err = haptic_sched_append(&sched, effect, esp_timer_get_time());
+                    if (err != ESP_ERR_INVALID_STATE) {
+                        haptic_trace(HAPTIC_TRACE_OUTPUT, play.trace_tag, play.trace_index, effect);
+                        haptic_trace(HAPTIC_TRACE_DONE, play.trace_tag, play.trace_index, err);
+                        continue;
+                    }
+                    // the sequence ended just before the append: start afresh
+                }
+                if (action == HAPTIC_SCHED_WAIT) {
+                    if (haptic_alarm_wait_until(&s_alarm, sched.end_us) == HAPTIC_ALARM_CANCELLED) {
+                        haptic_trace(HAPTIC_TRACE_DROP, play.trace_tag, play.trace_index, effect);
+                        continue;
+                    }
+                    drv2605_wait_idle(drv2605_handle);
+                }
+                esp_err_t err = player_load(&sched, rated_full, effect, play.intensity);
+                if (err != ESP_OK) {
+                    haptic_trace(HAPTIC_TRACE_DONE, play.trace_tag, play.trace_index, err);
+                    continue;
+                }
+            }
             // play the effect!
-            drv2605_go(drv2605_handle);
+            haptic_trace(HAPTIC_TRACE_OUTPUT, play.trace_tag, play.trace_index, effect);
+            esp_err_t err = haptic_sched_go(&sched, esp_timer_get_time());
+            haptic_trace(HAPTIC_TRACE_DONE, play.trace_tag, play.trace_index, err);
         }
     }
 }
@@ -0,0 +1,503 @@
+#include "haptic_mouse.h"
+
+#include <dirent.h>
+#include <inttypes.h>
+#include <stdlib.h>
+#include <string.h>
+#include "freertos/semphr.h"
+#include "esp_attr.h"
+#include "esp_rom_crc.h"
+#include "esp_timer.h"
+
+#define TAG "clip_store"
+
+#define CLIP_DIR                    "/littlefs"
+#define CLIP_COUNT                  256
+#define UPLOAD_TMP_PATH             CLIP_DIR "/upload.tmp"
+#define UPLOAD_TASK_PRIORITY        5       // below the command and I2S tasks
+#define UPLOAD_BUFFER_WAIT_MS       1000
+#define UPLOAD_JOB_QUEUE_LEN        (HP_UPLOAD_WINDOW + 2)
+#define CLIP_BUFFER_SIZE            (CONFIG_AUDIO_CLIP_BUFFER_KB * 1024)
+#define CLIP_MIN_RATE               4000    // sample rates the resampler takes
+#define CLIP_MAX_RATE               48000
+
+#define CCCC(c1, c2, c3, c4)    ((c4 << 24) | (c3 << 16) | (c2 << 8) | c1)
+
+// Where the PCM data of /littlefs/<id>.wav lives. Built once at boot, so a
+// play seeks straight to the samples; an upload swaps its entry together
+// with the file under s_lock, so playback never reads a half-replaced clip.
+typedef struct {
+    uint32_t data_offset;
+    uint32_t data_size;     // 0 = no clip
+    clip_format_t format;
+} clip_entry_t;
+
+static clip_entry_t s_index[CLIP_COUNT];
+static SemaphoreHandle_t s_lock;
+static StaticSemaphore_t s_lock_buf;
+
+// Clips are loaded into this one buffer for playback; clips that do not fit
+// are not indexed and not accepted by an upload
+EXT_RAM_BSS_ATTR static uint8_t s_clip_buf[CLIP_BUFFER_SIZE];
+
+/*
+ * Upload. The command task checks each chunk's CRC and hands the buffer to
+ * the upload task, which writes it to a temporary file while the next chunk
+ * arrives in the other buffer. After the last chunk the file is checked and
+ * renamed over the clip, which LittleFS does atomically.
+ */
+typedef enum {
+    UPLOAD_JOB_BEGIN,
+    UPLOAD_JOB_WRITE,
+    UPLOAD_JOB_ABORT,
+} upload_job_type_t;
+
+typedef struct {
+    upload_job_type_t type;
+    uint8_t seq;
+    hp_upload_begin_t begin;        // BEGIN
+    uint8_t *buf;                   // WRITE: chunk, returned to s_free once written
+    uint32_t offset;
+    uint32_t len;
+    uint32_t crc32;                 // WRITE: CRC-32 of the file up to the end of this chunk
+} upload_job_t;
+
+static uint8_t s_buffers[HP_UPLOAD_WINDOW][HP_UPLOAD_CHUNK_SIZE];
+static QueueHandle_t s_free;        // buffers not holding a chunk
+static QueueHandle_t s_jobs;
+static StaticQueue_t s_free_buf;
+static StaticQueue_t s_jobs_buf;
+static uint8_t s_free_storage[HP_UPLOAD_WINDOW * sizeof(uint8_t *)];
+static uint8_t s_jobs_storage[UPLOAD_JOB_QUEUE_LEN * sizeof(upload_job_t)];
+
+TaskHandle_t xUploadTask;
+static StaticTask_t s_upload_tcb;
+static StackType_t s_upload_stack[UPLOAD_TASK_STACK_SIZE];
+
+// Receiving side, command task only
+static struct {
+    bool active;
+    bool bad;                       // data of the current chunk was lost or out of order
+    bool resync;                    // chunk rejected; waiting for the host to resend it
+    uint8_t seq;
+    hp_upload_begin_t begin;
+    uint32_t chunk_start;
+    uint32_t received;              // bytes of the current chunk in buf
+    uint32_t file_crc;              // CRC-32 of the chunks accepted so far
+    int64_t start_us;
+    uint8_t *buf;
+} s_rx;
+
+static char *clip_path(char *path, size_t len, uint8_t id)
+{
+    snprintf(path, len, CLIP_DIR "/%d.wav", id);
+    return path;
+}
+
+// WAVE_FORMAT_PCM, or WAVE_FORMAT_EXTENSIBLE with a PCM sub-format
+static bool clip_parse_fmt(const uint8_t *fmt, uint32_t len, clip_format_t *format)
+{
+    uint16_t tag = fmt[0] | (fmt[1] << 8);
+    uint16_t channels = fmt[2] | (fmt[3] << 8);
+    uint16_t bits = fmt[14] | (fmt[15] << 8);
+
+    if (tag == 0xFFFE && len >= 26) {
+        tag = fmt[24] | (fmt[25] << 8);
+    }
+    format->sample_rate = hp_get_u32(fmt + 4);
+    format->channels = (uint8_t)channels;
+    return tag == 1 && bits == 16 && (channels == 1 || channels == 2) &&
+           format->sample_rate >= CLIP_MIN_RATE && format->sample_rate <= CLIP_MAX_RATE;
+}
+
+// Locate the data chunk of a RIFF/WAVE file and read its format
+static bool clip_parse(FILE *f, clip_entry_t *entry)
+{
+    uint32_t riff[3];
+    uint32_t chunk[2];
+    uint8_t fmt[26];
+    bool have_fmt = false;
+    long file_size;
+
+    if (fseek(f, 0, SEEK_END) != 0 || (file_size = ftell(f)) < 0 || fseek(f, 0, SEEK_SET) != 0) {
+        return false;
+    }
+    if (fread(riff, sizeof(riff), 1, f) != 1 ||
+        riff[0] != CCCC('R', 'I', 'F', 'F') || riff[2] != CCCC('W', 'A', 'V', 'E')) {
+        return false;
+    }
+    while (fread(chunk, sizeof(chunk), 1, f) == 1) {
+        // chunks are padded to an even size
+        uint32_t skip = (chunk[1] + 1) & ~1u;
+
+        if (chunk[0] == CCCC('f', 'm', 't', ' ') && chunk[1] >= 16) {
+            size_t len = chunk[1] < sizeof(fmt) ? chunk[1] : sizeof(fmt);
+            if (fread(fmt, 1, len, f) != len || !clip_parse_fmt(fmt, chunk[1], &entry->format)) {
+                return false;
+            }
+            have_fmt = true;
+            skip -= len;
+        } else if (chunk[0] == CCCC('d', 'a', 't', 'a')) {
+            long offset = ftell(f);
+            uint32_t frame = 2u * entry->format.channels;
+            if (!have_fmt) {
+                return false;
+            }
+            entry->data_offset = (uint32_t)offset;
+            // some encoders leave the size of a truncated file
+            entry->data_size = chunk[1] < (uint32_t)(file_size - offset) ? chunk[1] : (uint32_t)(file_size - offset);
+            entry->data_size -= entry->data_size % frame;
+            return entry->data_size > 0 && entry->data_size <= CLIP_BUFFER_SIZE;
+        }
+        if (fseek(f, (long)skip, SEEK_CUR) != 0) {
+            return false;
+        }
+    }
+    return false;
+}
+
+static bool clip_parse_file(const char *path, clip_entry_t *entry)
+{
+    FILE *f = fopen(path, "rb");
+    bool ok;
+
+    if (f == NULL) {
+        return false;
+    }
+    ok = clip_parse(f, entry);
+    fclose(f);
+    return ok;
+}
+
+uint8_t *clip_store_load(uint8_t id, size_t *size, clip_format_t *format)
+{
+    char path[24];
+    uint8_t *data = NULL;
+
+    *size = 0;
+    if (s_lock == NULL) {
+        return NULL;
+    }
+
+    xSemaphoreTake(s_lock, portMAX_DELAY);
+    clip_entry_t entry = s_index[id];
+    FILE *f = entry.data_size ? fopen(clip_path(path, sizeof(path), id), "rb") : NULL;
+    if (f != NULL) {
+        if (fseek(f, entry.data_offset, SEEK_SET) == 0 && fread(s_clip_buf, 1, entry.data_size, f) == entry.data_size) {
+            data = s_clip_buf;
+        }
+        fclose(f);
+    }
+    xSemaphoreGive(s_lock);
+
+    if (data) {
+        *size = entry.data_size;
+        *format = entry.format;
+    }
+    return data;
+}
+
+static void send_status(uint8_t seq, const hp_upload_status_t *st)
+{
+    uint8_t buf[HP_PACKET_SIZE(HP_UPLOAD_STATUS_SIZE)];
+
+    cmd_serial_write(buf, hp_build_upload_status(buf, seq, st));
+}
+
+// Check the uploaded file and put it in place of the clip
+static hp_status_t upload_commit(const hp_upload_begin_t *begin, uint32_t crc32)
+{
+    char path[24];
+    clip_entry_t entry;
+
+    if (crc32 != begin->crc32 || !clip_parse_file(UPLOAD_TMP_PATH, &entry)) {
+        remove(UPLOAD_TMP_PATH);
+        return HP_STATUS_BAD_CLIP;
+    }
+
+    xSemaphoreTake(s_lock, portMAX_DELAY);
+    bool ok = rename(UPLOAD_TMP_PATH, clip_path(path, sizeof(path), begin->clip)) == 0;
+    if (ok) {
+        s_index[begin->clip] = entry;
+    }
+    xSemaphoreGive(s_lock);
+
+    if (!ok) {
+        remove(UPLOAD_TMP_PATH);
+        return HP_STATUS_STORAGE;
+    }
+    ESP_LOGI(TAG, "Clip %d replaced, %" PRIu32 " bytes of audio, %" PRIu32 " Hz %s", begin->clip, entry.data_size,
+             entry.format.sample_rate, entry.format.channels == 1 ? "mono" : "stereo");
+    return HP_STATUS_OK;
+}
+
+static void upload_task(void *arg)
+{
+    hp_upload_begin_t begin = { 0 };
+    FILE *f = NULL;
+    int64_t start_us = 0;
+    uint32_t flash_us = 0;
+    upload_job_t job;
+
+    while (1) {
+        xQueueReceive(s_jobs, &job, portMAX_DELAY);
+        hp_upload_status_t st = { .status = HP_STATUS_OK, .clip = begin.clip };
+
+        if (job.type == UPLOAD_JOB_ABORT) {
+            if (f) {
+                fclose(f);
+                f = NULL;
+                remove(UPLOAD_TMP_PATH);
+            }
+            continue;
+        }
+
+        if (job.type == UPLOAD_JOB_BEGIN) {
+            if (f) {
+                fclose(f);
+            }
+            begin = job.begin;
+            start_us = esp_timer_get_time();
+            flash_us = 0;
+            f = fopen(UPLOAD_TMP_PATH, "wb");
+            if (f) {
+                // chunks are written whole; skip the stdio copy
+                setvbuf(f, NULL, _IONBF, 0);
+            }
+            st.clip = begin.clip;
+            st.phase = HP_UPLOAD_BEGUN;
+            st.status = f ? HP_STATUS_OK : HP_STATUS_STORAGE;
+        } else {
+            int64_t t0 = esp_timer_get_time();
+            bool ok = f && fwrite(job.buf, 1, job.len, f) == job.len;
+            bool last = job.offset + job.len == begin.size;
+
+            xQueueSend(s_free, &job.buf, 0);
+            if (f == NULL) {
+                continue;       // the session already failed and said so
+            }
+            if (last) {
+                ok = (fclose(f) == 0) && ok;
+                f = NULL;
+            }
+            flash_us += (uint32_t)(esp_timer_get_time() - t0);
+
+            st.phase = last ? HP_UPLOAD_COMMITTED : HP_UPLOAD_STORED;
+            st.offset = job.offset + job.len;
+            if (!ok) {
+                if (f) {
+                    fclose(f);
+                    f = NULL;
+                }
+                remove(UPLOAD_TMP_PATH);
+                st.status = HP_STATUS_STORAGE;
+            } else if (last) {
+                st.status = upload_commit(&begin, job.crc32);
+            }
+        }
+
+        st.elapsed_us = (uint32_t)(esp_timer_get_time() - start_us);
+        st.flash_us = flash_us;
+        send_status(job.seq, &st);
+    }
+}
+
+esp_err_t clip_store_init(void)
+{
+    char path[24];
+    int count = 0;
+
+    s_lock = xSemaphoreCreateMutexStatic(&s_lock_buf);
+    s_free = xQueueCreateStatic(HP_UPLOAD_WINDOW, sizeof(uint8_t *), s_free_storage, &s_free_buf);
+    s_jobs = xQueueCreateStatic(UPLOAD_JOB_QUEUE_LEN, sizeof(upload_job_t), s_jobs_storage, &s_jobs_buf);
+    for (int i = 0; i < HP_UPLOAD_WINDOW; i++) {
+        uint8_t *buf = s_buffers[i];
+        xQueueSend(s_free, &buf, 0);
+    }
+
+    // left behind by an upload that was cut off
+    remove(UPLOAD_TMP_PATH);
+
+    DIR *dir = opendir(CLIP_DIR);
+    ESP_RETURN_ON_FALSE(dir, ESP_ERR_NOT_FOUND, TAG, "cannot open " CLIP_DIR);
+    struct dirent *de;
+    while ((de = readdir(dir)) != NULL) {
+        char *end;
+        long id = strtol(de->d_name, &end, 10);
+        if (end == de->d_name || strcmp(end, ".wav") != 0 || id < 0 || id >= CLIP_COUNT) {
+            continue;
+        }
+        clip_entry_t entry;
+        if (clip_parse_file(clip_path(path, sizeof(path), (uint8_t)id), &entry)) {
+            s_index[id] = entry;
+            count++;
+        } else {
+            ESP_LOGW(TAG, "%s: not a playable clip", path);
+        }
+    }
+    closedir(dir);
+    ESP_LOGI(TAG, "%d clips indexed", count);
+
+    // flash writes stay on the USB core, away from the output
+    xUploadTask = xTaskCreateStaticPinnedToCore(upload_task, "upload_task", UPLOAD_TASK_STACK_SIZE, NULL, UPLOAD_TASK_PRIORITY,
+                                                s_upload_stack, &s_upload_tcb, HAPTIC_USB_CORE);
+    return ESP_OK;
+}
+
+/* ---------------------------- command task side ---------------------------- */
+
+static void upload_release_buffer(void)
+{
+    if (s_rx.buf) {
+        xQueueSend(s_free, &s_rx.buf, 0);
+        s_rx.buf = NULL;
+    }
+}
+
+// Reject the current chunk; the host resends it from chunk_start
+static void upload_reject(uint8_t seq, hp_status_t status)
+{
+    const hp_upload_status_t st = {
+        .status = status,
+        .phase = HP_UPLOAD_STORED,
+        .clip = s_rx.begin.clip,
+        .offset = s_rx.chunk_start,
+        .elapsed_us = (uint32_t)(esp_timer_get_time() - s_rx.start_us),
+    };
+
+    s_rx.received = 0;
+    s_rx.bad = false;
+    s_rx.resync = true;
+    send_status(seq, &st);
+}
+
+static void upload_begin(const hp_packet_t *pkt)
+{
+    hp_upload_begin_t begin;
+    hp_upload_status_t st = { .status = HP_STATUS_BUSY, .phase = HP_UPLOAD_BEGUN };
+
+    if (s_jobs == NULL || !hp_upload_begin_decode(pkt, &begin) || begin.size == 0) {
+        if (s_jobs) {
+            st.status = HP_STATUS_BAD_LENGTH;
+        }
+        send_status(pkt->seq, &st);
+        return;
+    }
+
+    if (s_rx.active) {
+        // a new BEGIN abandons the unfinished upload
+        const upload_job_t abort = { .type = UPLOAD_JOB_ABORT };
+        xQueueSend(s_jobs, &abort, portMAX_DELAY);
+        upload_release_buffer();
+    }
+
+    memset(&s_rx, 0, sizeof(s_rx));
+    s_rx.active = true;
+    s_rx.seq = pkt->seq;
+    s_rx.begin = begin;
+    s_rx.start_us = esp_timer_get_time();
+
+    const upload_job_t job = { .type = UPLOAD_JOB_BEGIN, .seq = pkt->seq, .begin = begin };
+    xQueueSend(s_jobs, &job, portMAX_DELAY);
+}
+
+static void upload_data(const hp_packet_t *pkt)
+{
+    uint32_t offset;
+    const uint8_t *data;
+    size_t len;
+
+    if (!s_rx.active || !hp_upload_data_decode(pkt, &offset, &data, &len)) {
+        return;
+    }
+    if (offset == s_rx.chunk_start) {
+        // first packet of a chunk, possibly resent
+        s_rx.received = 0;
+        s_rx.bad = false;
+        s_rx.resync = false;
+    }
+    if (s_rx.resync || s_rx.bad) {
+        return;
+    }
+
+    uint32_t chunk_len = s_rx.begin.size - s_rx.chunk_start;
+    if (chunk_len > HP_UPLOAD_CHUNK_SIZE) {
+        chunk_len = HP_UPLOAD_CHUNK_SIZE;
+    }
+    if (offset != s_rx.chunk_start + s_rx.received || s_rx.received + len > chunk_len) {
+        s_rx.bad = true;
+        return;
+    }
+    // both buffers may still be on their way to flash
+    if (s_rx.buf == NULL && xQueueReceive(s_free, &s_rx.buf, pdMS_TO_TICKS(UPLOAD_BUFFER_WAIT_MS)) != pdTRUE) {
+        s_rx.bad = true;
+        return;
+    }
+    memcpy(s_rx.buf + s_rx.received, data, len);
+    s_rx.received += len;
+}
+
+static void upload_chunk(const hp_packet_t *pkt)
+{
+    uint32_t offset;
+    uint32_t crc32;
+
+    if (!s_rx.active || !hp_upload_chunk_decode(pkt, &offset, &crc32)) {
+        return;
+    }
+    if (offset < s_rx.chunk_start || (offset > s_rx.chunk_start && !s_rx.resync)) {
+        // the host is behind (an acknowledgement got lost) or skipped data;
+        // tell it where to continue. Chunks it sent ahead of a rejected one
+        // are dropped quietly, it rewinds anyway.
+        upload_reject(pkt->seq, HP_STATUS_BAD_LENGTH);
+        return;
+    }
+    if (offset != s_rx.chunk_start) {
+        return;
+    }
+
+    uint32_t chunk_len = s_rx.begin.size - s_rx.chunk_start;
+    if (chunk_len > HP_UPLOAD_CHUNK_SIZE) {
+        chunk_len = HP_UPLOAD_CHUNK_SIZE;
+    }
+    if (s_rx.resync || s_rx.bad || s_rx.received != chunk_len) {
+        upload_reject(pkt->seq, HP_STATUS_BAD_LENGTH);
+        return;
+    }
+    if (esp_rom_crc32_le(0, s_rx.buf, chunk_len) != crc32) {
+        upload_reject(pkt->seq, HP_STATUS_BAD_CRC);
+        return;
+    }
+
+    s_rx.file_crc = esp_rom_crc32_le(s_rx.file_crc, s_rx.buf, chunk_len);
+    const upload_job_t job = {
+        .type = UPLOAD_JOB_WRITE,
+        .seq = pkt->seq,
+        .buf = s_rx.buf,
+        .offset = s_rx.chunk_start,
+        .len = chunk_len,
+        .crc32 = s_rx.file_crc,
+    };
+    s_rx.buf = NULL;
+    s_rx.chunk_start += chunk_len;
+    s_rx.received = 0;
+    s_rx.active = s_rx.chunk_start < s_rx.begin.size;
+    xQueueSend(s_jobs, &job, portMAX_DELAY);
+}
+
+void clip_upload_packet(const hp_packet_t *pkt)
+{
+    switch (pkt->type) {
+    case HP_PKT_UPLOAD_BEGIN:
+        upload_begin(pkt);
+        break;
+    case HP_PKT_UPLOAD_DATA:
+        upload_data(pkt);
+        break;
+    case HP_PKT_UPLOAD_CHUNK:
+        upload_chunk(pkt);
+        break;
+    default:
+        break;
+    }
+}
@@ -1,8 +1,19 @@
 #include "haptic_mouse.h"
 
+#include "esp_timer.h"
+#include "freertos/semphr.h"
+#include "haptic_protocol.h"
+#include "haptic_trace.h"
+#if CONFIG_HAPTIC_USB_COMPOSITE
+#include "tusb_cdc_acm.h"
+#else
 #include "driver/usb_serial_jtag.h"
+#endif
 
-#define BUF_SIZE (128)
+#define BUF_SIZE (HP_MAX_PACKET)
+// Room for a whole upload chunk while the previous one is handed to flash
+#define RX_BUF_SIZE (HP_UPLOAD_CHUNK_SIZE)
+#define SERIAL_WRITE_TIMEOUT_MS 20
 
 #define CMD_START 0xAA
 #define CMD_STOP 0x55
@@ -12,41 +23,125 @@
 bool parse_command(uint8_t *data, int len, audio_command_t *cmd);
 bool validate_command(uint8_t *data, int len);
 uint8_t calculate_checksum(uint8_t *data, int len);
+static void handle_stream(const uint8_t *data, int len, uint16_t tag);
 
-void cmd_task(void *arg)
+// Capabilities reported for CAPS_QUERY
+static const hp_caps_t s_caps = {
+    .version_min = HP_VERSION,
+    .version_max = HP_VERSION,
+    .device_kind = HP_DEVICE_SPEAKER,
+    .actuator_count = 1,
+    .max_records = HP_MAX_PAYLOAD / HP_RECORD_SIZE,
+    .schedule_lead_ms = 25,     // clip load from LittleFS plus two DMA descriptors
+    .effect_count = 256,    // clip IDs, /littlefs/<id>.wav
+    .features = HP_CAP_INTENSITY | HP_CAP_QUEUE | HP_CAP_ACK | HP_CAP_SCHEDULE | HP_CAP_UPLOAD,
+    .min_period_ms = 0,
+};
+
+static hp_stream_t s_stream;
+
+#if CONFIG_HAPTIC_USB_COMPOSITE
+// the command task and the upload writer both answer on the CDC port
+static SemaphoreHandle_t s_serial_lock;
+static StaticSemaphore_t s_serial_lock_buf;
+
+static void serial_init(void)
+{
+    s_serial_lock = xSemaphoreCreateMutexStatic(&s_serial_lock_buf);
+    ESP_ERROR_CHECK(usb_composite_init(xTaskGetCurrentTaskHandle()));
+    ESP_LOGI(TAG, "USB HID + CDC init done");
+}
+
+// Whatever the CDC port holds; sleeps until the receive callback notifies
+// the task when it holds nothing
+static int serial_read(uint8_t *buf, size_t size)
+{
+    size_t len = 0;
+
+    if (tinyusb_cdcacm_read(TINYUSB_CDC_ACM_0, buf, size, &len) != ESP_OK || len == 0) {
+        ulTaskNotifyTake(pdTRUE, portMAX_DELAY);
+        return 0;
+    }
+    return (int)len;
+}
+
+void cmd_serial_write(const void *buf, size_t len)
+{
+    const uint8_t *p = (const uint8_t *)buf;
+
+    xSemaphoreTake(s_serial_lock, portMAX_DELAY);
+    while (len) {
+        size_t queued = tinyusb_cdcacm_write_queue(TINYUSB_CDC_ACM_0, p, len);
+        p += queued;
+        len -= queued;
+        // nothing moves without a host reading the port
+        if (tinyusb_cdcacm_write_flush(TINYUSB_CDC_ACM_0, pdMS_TO_TICKS(SERIAL_WRITE_TIMEOUT_MS)) != ESP_OK &&
+            queued == 0) {
+            break;
+        }
+    }
+    xSemaphoreGive(s_serial_lock);
+}
+#else
+static void serial_init(void)
 {
     // Configure USB SERIAL JTAG
     usb_serial_jtag_driver_config_t usb_serial_jtag_config = {
-        .rx_buffer_size = BUF_SIZE,
+        .rx_buffer_size = RX_BUF_SIZE,
         .tx_buffer_size = BUF_SIZE,
     };
 
     ESP_ERROR_CHECK(usb_serial_jtag_driver_install(&usb_serial_jtag_config));
     ESP_LOGI(TAG, "USB_SERIAL_JTAG init done");
+}
+
+static int serial_read(uint8_t *buf, size_t size)
+{
+    return usb_serial_jtag_read_bytes(buf, size, 20 / portTICK_PERIOD_MS);
+}
+
+void cmd_serial_write(const void *buf, size_t len)
+{
+    usb_serial_jtag_write_bytes(buf, len, SERIAL_WRITE_TIMEOUT_MS / portTICK_PERIOD_MS);
+}
+#endif
+
+void cmd_task(void *arg)
+{
+    serial_init();
 
     // Configure a temporary buffer for the incoming data
-    uint8_t *data = (uint8_t *) malloc(BUF_SIZE);
-    if (data == NULL) {
-        ESP_LOGE(TAG, "no memory for data");
-        return;
-    }
+    static uint8_t data[BUF_SIZE];
 
-    audio_command_t cmd;
+    audio_command_t cmd = {0};
 
     while (1) {
-        int len = usb_serial_jtag_read_bytes(data, (BUF_SIZE - 1), 20 / portTICK_PERIOD_MS);
+        int len = serial_read(data, BUF_SIZE - 1);
+        uint16_t tag = 0;
 
         if (len) {
-            if (!parse_command(data, len, &cmd)) {
+            tag = haptic_trace_tag();
+            haptic_trace(HAPTIC_TRACE_USB_RX, tag, HAPTIC_TRACE_PACKET, len);
+        }
+
+        if (len && (s_stream.len || data[0] != CMD_START)) {
+            handle_stream(data, len, tag);
+        } else if (len) {
+            // legacy frame (AA cmd id checksum 55)
+            bool valid = parse_command(data, len, &cmd);
+            haptic_trace(HAPTIC_TRACE_PARSE, tag, HAPTIC_TRACE_PACKET, valid ? HP_STATUS_OK : HP_STATUS_BAD_CRC);
+            if (!valid) {
                 ESP_LOGE(TAG, "Invalid command");
-                // Write Invalid command(FF FF FF FF FF) back to the USB SERIAL JTAG
-                usb_serial_jtag_write_bytes("\xFF\xFF\xFF\xFF\xFF", 5, 20 / portTICK_PERIOD_MS);
+                // Write Invalid command(FF FF FF FF FF) back to the serial channel
+                cmd_serial_write("\xFF\xFF\xFF\xFF\xFF", 5);
                 continue;
             } else {
+                cmd.trace_tag = tag;
+                cmd.trace_index = 0;
+                haptic_trace(HAPTIC_TRACE_ENQUEUE, tag, 0, (uint8_t)cmd.audio_id);
                 xQueueSend(xAudioCommandQueue, &cmd, 0);
-                // Write data back to the USB SERIAL JTAG
-                usb_serial_jtag_write_bytes((const char *) data, len, 20 / portTICK_PERIOD_MS);
-                ESP_LOGI(TAG, "Received command: %d, %d", cmd.cmd, cmd.audio_id);
+                // Write data back to the serial channel
+                cmd_serial_write(data, len);
             }
         }
     }
@@ -64,6 +159,9 @@ bool parse_command(uint8_t *data, int len, audio_command_t *cmd)
 
     cmd->cmd = data[1];
     cmd->audio_id = data[2];
+    cmd->intensity = 0xFF;
+    cmd->at_us = 0;
+    cmd->generation = 0;
 
     return true;
 }
@@ -94,3 +192,146 @@ uint8_t calculate_checksum(uint8_t *data, int len)
     }
     return checksum;
 }
+
+static void write_packet(const uint8_t *buf, size_t len)
+{
+    cmd_serial_write(buf, len);
+}
+
+// Drop the clips waiting to play as soon as possible. Scheduled clips and
+// stream wake-ups go back to the end of the queue in their order; the I2S
+// task may take entries meanwhile, which only leaves fewer to sort.
+static void drop_unscheduled(void)
+{
+    UBaseType_t waiting = uxQueueMessagesWaiting(xAudioCommandQueue);
+    audio_command_t cmd;
+
+    while (waiting-- && xQueueReceive(xAudioCommandQueue, &cmd, 0) == pdTRUE) {
+        if (cmd.at_us || cmd.cmd == AUDIO_CMD_STREAM) {
+            xQueueSend(xAudioCommandQueue, &cmd, 0);
+        } else if (cmd.trace_tag) {
+            haptic_trace(HAPTIC_TRACE_DROP, cmd.trace_tag, cmd.trace_index, (uint8_t)cmd.audio_id);
+        }
+    }
+}
+
+// Execute the records of a COMMANDS packet in order
+hp_status_t cmd_run_commands(const hp_packet_t *pkt, uint16_t tag, hp_status_report_t *report)
+{
+    hp_status_t status = HP_STATUS_OK;
+    int64_t at_us = 0;
+    uint32_t at;
+
+    if (hp_packet_at(pkt, &at)) {
+        at_us = hp_time_resolve(at, esp_timer_get_time());
+    }
+
+    for (size_t i = 0; i < hp_record_count(pkt); i++) {
+        hp_record_t rec;
+        hp_record_get(pkt, i, &rec);
+
+        if ((rec.actuator != 0 && rec.actuator != HP_ACTUATOR_ALL) ||
+            (rec.op != HP_OP_PLAY && rec.op != HP_OP_STOP && rec.op != HP_OP_NOP)) {
+            // patterns are not supported by the speaker
+            haptic_trace(HAPTIC_TRACE_DROP, tag, (uint8_t)i, rec.op);
+            report->rejected++;
+            status = HP_STATUS_UNSUPPORTED;
+            continue;
+        }
+
+        if (rec.op == HP_OP_STOP) {
+            xQueueReset(xAudioCommandQueue);
+            i2s_cancel_scheduled();
+        } else if (rec.op == HP_OP_PLAY) {
+            audio_command_t cmd = {
+                .cmd = HP_OP_PLAY,
+                .audio_id = rec.effect,
+                .intensity = rec.intensity,
+                .at_us = at_us,
+                .generation = i2s_cancel_generation(),
+                .trace_tag = tag,
+                .trace_index = (uint8_t)i,
+            };
+            // clips play back to back; without QUEUE the newest clip replaces
+            // the ones still waiting, unless they are scheduled for a time
+            if (!(rec.flags & HP_REC_FLAG_QUEUE) && !at_us) {
+                drop_unscheduled();
+            }
+            haptic_trace(HAPTIC_TRACE_ENQUEUE, tag, (uint8_t)i, rec.effect);
+            if (xQueueSend(xAudioCommandQueue, &cmd, 0) != pdTRUE) {
+                haptic_trace(HAPTIC_TRACE_DROP, tag, (uint8_t)i, rec.effect);
+                report->rejected++;
+                status = HP_STATUS_BUSY;
+                continue;
+            }
+        }
+        report->accepted++;
+    }
+    return status;
+}
+
+// Send TRACE packets until the trace rings are drained
+static void dump_trace(uint8_t seq, uint8_t *reply)
+{
+    size_t events;
+
+    do {
+        write_packet(reply, haptic_trace_dump(reply, seq, HP_MAX_PAYLOAD, &events));
+    } while (events);
+}
+
+// Reassemble and execute protocol packets from the serial byte stream. `tag`
+// traces the first packet completed by these bytes; later ones get their own.
+static void handle_stream(const uint8_t *data, int len, uint16_t tag)
+{
+    uint8_t reply[HP_MAX_PACKET];
+
+    for (int i = 0; i < len; i++) {
+        hp_packet_t pkt;
+        hp_status_t status;
+        hp_stream_result_t result = hp_stream_feed(&s_stream, data[i], &pkt, &status);
+
+        while (result != HP_STREAM_MORE) {
+            hp_status_report_t report = { .status = status };
+            bool answer = true;
+            uint8_t seq = 0;
+
+            if (!tag) {
+                tag = haptic_trace_tag();
+            }
+            haptic_trace(HAPTIC_TRACE_PARSE, tag, HAPTIC_TRACE_PACKET, status);
+
+            if (result == HP_STREAM_PACKET) {
+                seq = pkt.seq;
+                if (pkt.type == HP_PKT_CAPS_QUERY) {
+                    write_packet(reply, hp_build_caps(reply, seq, &s_caps));
+                    answer = false;
+                } else if (pkt.type == HP_PKT_TIME_QUERY) {
+                    hp_time_t now = { .device_us = (uint64_t)esp_timer_get_time() };
+                    i2s_schedule_stats(&now.scheduled, &now.late);
+                    write_packet(reply, hp_build_time(reply, seq, &now));
+                    answer = false;
+                } else if (pkt.type == HP_PKT_TRACE_QUERY) {
+                    dump_trace(seq, reply);
+                    answer = false;
+                } else if (pkt.type == HP_PKT_UPLOAD_BEGIN || pkt.type == HP_PKT_UPLOAD_DATA ||
+                           pkt.type == HP_PKT_UPLOAD_CHUNK) {
+                    // answered with UPLOAD_STATUS by the clip store
+                    clip_upload_packet(&pkt);
+                    answer = false;
+                } else if (pkt.type == HP_PKT_COMMANDS) {
+                    report.status = cmd_run_commands(&pkt, tag, &report);
+                    answer = (pkt.flags & HP_PKT_FLAG_ACK) || report.status != HP_STATUS_OK;
+                } else {
+                    report.status = HP_STATUS_BAD_TYPE;
+                }
+            }
+
+            if (answer) {
+                write_packet(reply, hp_build_status(reply, seq, &report));
+            }
+            tag = 0;
+            result = hp_stream_poll(&s_stream, &pkt, &status);
+        }
+    }
+}
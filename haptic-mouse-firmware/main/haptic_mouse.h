@@ -8,13 +8,123 @@
 #include "esp_log.h"
 #include "esp_check.h"
 #include "freertos/queue.h"
+#include "haptic_protocol.h"
+
+// Core layout: USB command handling and uploads on one core, audio output
+// on the other, so neither waits for the other's interrupts or flash writes
+#define HAPTIC_USB_CORE     0
+#define HAPTIC_OUTPUT_CORE  1
+
+#define UPLOAD_TASK_STACK_SIZE (4096)
 
 extern QueueHandle_t xAudioCommandQueue;
+extern TaskHandle_t xUploadTask;
 
 typedef struct {
     char cmd;
     char audio_id;
+    uint8_t intensity;  // 0 - 255, 255 = unscaled
+    int64_t at_us;      // esp_timer time the first sample plays at, 0 = as soon as possible
+    uint32_t generation; // i2s_cancel_generation() when queued, 0 = outlives cancels
+    uint16_t trace_tag; // haptic_trace.h tag of the packet, 0 = untraced
+    uint8_t trace_index;
 } audio_command_t;
 
+// audio_command_t.cmd of the entry that wakes the I2S task for a USB audio
+// stream; plays nothing
+#define AUDIO_CMD_STREAM    'S'
+
+// Sample format of a stored clip; always 16-bit PCM
+typedef struct {
+    uint32_t sample_rate;
+    uint8_t channels;   // 1 or 2
+} clip_format_t;
+
 void cmd_task(void *arg);
 void i2s_task(void *arg);
+
+// Abort the scheduled clip the I2S task is waiting for, if any, and the waits
+// of every clip stamped with an earlier generation
+void i2s_cancel_scheduled(void);
+// Generation to stamp a queued clip with
+uint32_t i2s_cancel_generation(void);
+// Scheduled clips played and how many of them missed their target (both wrap)
+void i2s_schedule_stats(uint16_t *scheduled, uint16_t *late);
+
+// Index the clips on LittleFS and start the upload writer; after the mount
+esp_err_t clip_store_init(void);
+// PCM data of clip `id` in the clip buffer, valid until the next load; NULL
+// if there is no such clip. I2S task only.
+uint8_t *clip_store_load(uint8_t id, size_t *size, clip_format_t *format);
+// Streaming conversion of a clip to the 16-bit stereo output format: a
+// windowed-sinc polyphase resampler in fixed point, mono clips duplicated to
+// both channels. The source must stay valid while the output is read.
+typedef struct {
+    const int16_t *samples;     // interleaved source frames
+    size_t frames;
+    uint8_t channels;
+    uint64_t step;              // source frames per output frame, 32.32 fixed point
+    uint64_t pos;               // source position of the next output frame, 32.32
+    size_t left;                // output frames still to produce
+} resampler_t;
+
+// Output frames `frames` source frames at `in_rate` turn into at `out_rate`
+size_t resampler_out_frames(size_t frames, uint32_t in_rate, uint32_t out_rate);
+void resampler_start(resampler_t *rs, const uint8_t *data, size_t size, const clip_format_t *format, uint32_t out_rate);
+// Fill `out` with up to `max_frames` stereo frames; returns the frames written, 0 at the end
+size_t resampler_read(resampler_t *rs, int16_t *out, size_t max_frames);
+// Streaming variant for mono input that arrives in pieces: add up to
+// `max_frames` output frames, times `gain` (Q15), to both channels of `out`,
+// as long as the taps stay within the `frames` source frames at `src`.
+// `pos` is the source position of the next output frame (32.32), starting at
+// RESAMPLER_WINDOW_START; returns the frames added. The taps reach from 3
+// frames before an output position to RESAMPLER_WINDOW_AFTER frames after it.
+#define RESAMPLER_WINDOW_START  (3ULL << 32)
+#define RESAMPLER_WINDOW_AFTER  4
+size_t resampler_mix_mono(const int16_t *src, size_t frames, uint64_t *pos, uint64_t step, int32_t gain,
+                          int16_t *out, size_t max_frames);
+
+// Handle an UPLOAD_BEGIN / UPLOAD_DATA / UPLOAD_CHUNK packet; command task only
+void clip_upload_packet(const hp_packet_t *pkt);
+
+// Queue the records of a COMMANDS packet for the I2S task; from the command
+// task or the TinyUSB task
+hp_status_t cmd_run_commands(const hp_packet_t *pkt, uint16_t tag, hp_status_report_t *report);
+// Write to the serial command channel (CDC port or USB Serial/JTAG); any task
+void cmd_serial_write(const void *buf, size_t len);
+
+// Install TinyUSB with the HID interface and the CDC port; `serial_task` is
+// notified whenever the CDC port received data. CONFIG_HAPTIC_USB_COMPOSITE.
+esp_err_t usb_composite_init(TaskHandle_t serial_task);
+
+#if CONFIG_HAPTIC_USB_AUDIO
+// Entities of the speaker function: usb_hid.c describes them, usb_audio.c
+// answers their requests
+#define UAC_ENTITY_INPUT_TERMINAL   0x01
+#define UAC_ENTITY_FEATURE_UNIT     0x02
+#define UAC_ENTITY_OUTPUT_TERMINAL  0x03
+#define UAC_ENTITY_CLOCK            0x04
+
+// Most output frames per usb_audio_mix call: one DMA descriptor
+#define USB_AUDIO_MAX_MIX_FRAMES    CONFIG_AUDIO_DMA_FRAME_NUM
+
+typedef struct {
+    uint32_t rate;          // stream sample rate set by the host
+    uint32_t buffered_us;   // stream audio in the jitter buffer and the resampler
+    uint32_t underruns;     // times the jitter buffer ran dry (wraps)
+} usb_audio_state_t;
+
+// The host has the streaming interface open; the I2S task keeps the output
+// fed while it is
+bool usb_audio_streaming(void);
+// Add the stream, resampled to `out_rate`, to `frames` 16-bit stereo frames
+// at `out`; nothing while the jitter buffer fills. I2S task only, at most
+// USB_AUDIO_MAX_MIX_FRAMES at a time.
+void usb_audio_mix(int16_t *out, size_t frames, uint32_t out_rate);
+void usb_audio_state(usb_audio_state_t *state);
+#else
+static inline bool usb_audio_streaming(void)
+{
+    return false;
+}
+#endif
@@ -1,13 +1,32 @@
 #include "haptic_mouse.h"
 
+#include <inttypes.h>
 #include "driver/gpio.h"
+#include "esp_heap_caps.h"
 
 // 定义队列，用于存储音频片段播放命令
 QueueHandle_t xAudioCommandQueue;
 
+#define AUDIO_COMMAND_QUEUE_LEN (10)
+
 #define CMD_TASK_STACK_SIZE (4096)
 #define BLINK_TASK_STACK_SIZE (4096)
-#define I2S_TASK_STACK_SIZE (4096*10)
+#define I2S_TASK_STACK_SIZE (8192)
+
+#define TAG "app_main"
+
+// Everything the tasks need is allocated here at build time; after boot
+// nothing on the command or output path touches the heap
+static StaticQueue_t s_audio_queue_buf;
+static uint8_t s_audio_queue_storage[AUDIO_COMMAND_QUEUE_LEN * sizeof(audio_command_t)];
+
+static TaskHandle_t s_cmd_task;
+static StaticTask_t s_cmd_tcb;
+static StackType_t s_cmd_stack[CMD_TASK_STACK_SIZE];
+
+static TaskHandle_t s_i2s_task;
+static StaticTask_t s_i2s_tcb;
+static StackType_t s_i2s_stack[I2S_TASK_STACK_SIZE];
 
 static void blink_task(void *arg)
 {
@@ -23,15 +42,51 @@ static void blink_task(void *arg)
     }
 }
 
-void app_main(void)
+static void report_stack(const char *name, TaskHandle_t task, uint32_t size)
 {
-    xAudioCommandQueue = xQueueCreate(10, sizeof(audio_command_t));
-    if (xAudioCommandQueue == NULL) {
-        ESP_LOGE("app_main", "Create xAudioCommandQueue failed");
+    if (task == NULL) {
         return;
     }
+    // stack depths are in bytes on ESP-IDF
+    uint32_t unused = uxTaskGetStackHighWaterMark(task);
+    ESP_LOGI(TAG, "  %-12s stack %5" PRIu32 " used %5" PRIu32 " free %5" PRIu32, name, size, size - unused, unused);
+}
+
+static void report_heap(const char *name, uint32_t caps)
+{
+    ESP_LOGI(TAG, "  %-12s free %7zu min %7zu largest %7zu", name, heap_caps_get_free_size(caps),
+             heap_caps_get_minimum_free_size(caps), heap_caps_get_largest_free_block(caps));
+}
 
-    xTaskCreate(cmd_task, "CMD_task", CMD_TASK_STACK_SIZE, NULL, 10, NULL);
-    xTaskCreate(i2s_task, "I2S_task", I2S_TASK_STACK_SIZE, NULL, 10, NULL);
+// Stack high-water marks of the tasks and the heap usage since boot
+static void memory_report(void)
+{
+    ESP_LOGI(TAG, "Memory footprint:");
+    report_stack("CMD_task", s_cmd_task, sizeof(s_cmd_stack));
+    report_stack("I2S_task", s_i2s_task, sizeof(s_i2s_stack));
+    report_stack("upload_task", xUploadTask, UPLOAD_TASK_STACK_SIZE);
+    report_stack("main", xTaskGetCurrentTaskHandle(), CONFIG_ESP_MAIN_TASK_STACK_SIZE);
+    report_heap("internal", MALLOC_CAP_INTERNAL);
+    report_heap("psram", MALLOC_CAP_SPIRAM);
+}
+
+void app_main(void)
+{
+    xAudioCommandQueue = xQueueCreateStatic(AUDIO_COMMAND_QUEUE_LEN, sizeof(audio_command_t),
+                                            s_audio_queue_storage, &s_audio_queue_buf);
+
+    // the USB serial interrupt is installed on the core cmd_task runs on,
+    // the I2S one on the core of i2s_task
+    s_cmd_task = xTaskCreateStaticPinnedToCore(cmd_task, "CMD_task", CMD_TASK_STACK_SIZE, NULL, 10,
+                                               s_cmd_stack, &s_cmd_tcb, HAPTIC_USB_CORE);
+    s_i2s_task = xTaskCreateStaticPinnedToCore(i2s_task, "I2S_task", I2S_TASK_STACK_SIZE, NULL, 10,
+                                               s_i2s_stack, &s_i2s_tcb, HAPTIC_OUTPUT_CORE);
     // xTaskCreate(blink_task, "blink_task", BLINK_TASK_STACK_SIZE, NULL, 10, NULL);
+
+#if CONFIG_MEMORY_REPORT_PERIOD_S
+    while (1) {
+        vTaskDelay(pdMS_TO_TICKS(CONFIG_MEMORY_REPORT_PERIOD_S * 1000));
+        memory_report();
+    }
+#endif
 }
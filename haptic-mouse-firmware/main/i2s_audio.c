@@ -1,5 +1,6 @@
 #include "haptic_mouse.h"
 
+#include <inttypes.h>
 #include <string.h>
 #include <sys/stat.h>
 #include <unistd.h>
@@ -7,18 +8,123 @@
 #include "esp_littlefs.h"
 #include "driver/i2s_std.h"
 #include "driver/gpio.h"
+#include "esp_timer.h"
+#include "haptic_alarm.h"
+#include "haptic_trace.h"
 
 #define EXAMPLE_BUFF_SIZE               4096
 
-#define CCCC(c1, c2, c3, c4)    ((c4 << 24) | (c3 << 16) | (c2 << 8) | c1)
+#define I2S_SAMPLE_RATE                 44100
+#define I2S_DMA_DESC_NUM                CONFIG_AUDIO_DMA_DESC_NUM
+#define I2S_DMA_FRAME_NUM               CONFIG_AUDIO_DMA_FRAME_NUM
+#define I2S_FRAME_BYTES                 4       // 16-bit stereo
+#define I2S_DESC_BYTES                  (I2S_DMA_FRAME_NUM * I2S_FRAME_BYTES)
+#define I2S_DESC_US                     ((int64_t)I2S_DMA_FRAME_NUM * 1000000 / I2S_SAMPLE_RATE)
+
+// Scheduled clips are written this long before their target time; the gap
+// up to the target is filled with silence, so the first sample plays on time
+#define I2S_SCHEDULE_LEAD_US            (2 * I2S_DESC_US)
+// Closer than this to a descriptor switch it is unclear which descriptor the
+// next write lands in
+#define I2S_BOUNDARY_GUARD_US           200
+
+#if CONFIG_MAX98357A_SD_GPIO >= 0
+#define AMP_WAKE_US                     CONFIG_MAX98357A_WAKE_US
+#else
+#define AMP_WAKE_US                     0
+#endif
+
+// Pre-armed mode: scheduled clips are preloaded this long before their
+// target, time enough for the copy into the DMA ring and the amplifier wake-up
+#define I2S_ARM_LEAD_US                 (AMP_WAKE_US + 1000)
+#if CONFIG_AUDIO_PREARMED
+#define I2S_IDLE_US                     ((int64_t)CONFIG_AUDIO_IDLE_MS * 1000)
+#define I2S_MODE_NAME                   "pre-armed"
+#else
+#define I2S_MODE_NAME                   "continuous"
+#endif
+
+// Clips per time-to-first-sample report
+#define FIRST_SAMPLE_REPORT_CLIPS       64
+
+#if CONFIG_HAPTIC_USB_AUDIO
+// While the host streams, writes stay this far ahead of the output at most,
+// so the stream leaves the jitter buffer at the pace it plays
+#define STREAM_AHEAD_US                 I2S_SCHEDULE_LEAD_US
+// Stream writes per latency report
+#define STREAM_REPORT_WRITES            1024
+#endif
+// A stop cut short the wait of a paced write
+#define I2S_ERR_CANCELLED               ESP_ERR_NOT_FINISHED
+
+// Clips in another format are converted this many frames at a time, between
+// the writes to the DMA ring
+#define CONVERT_FRAMES                  (2 * I2S_DMA_FRAME_NUM)
 
 static i2s_chan_handle_t                tx_chan;        // I2S tx channel handler
 
 static const char *TAG = "i2s_task";
 
+// Scheduled playback. Every clip is padded to whole DMA descriptors, so each
+// write starts on a fresh descriptor: right after the audio still queued, or
+// when the ring only plays silence, on the descriptor after the one playing.
+// on_sent marks the descriptor switches, which makes the play time of the
+// next write predictable to the sample.
+static haptic_alarm_t s_alarm;
+static volatile int64_t s_desc_start_us;   // when the descriptor now playing started
+static int64_t s_drained_us;               // when the audio written so far has played out
+static uint16_t s_scheduled;
+static uint16_t s_late;
+static const uint8_t s_silence[I2S_DESC_BYTES];
+// Play time of the next write: the frames written since s_write_start_us
+static int64_t s_write_start_us;
+static uint64_t s_write_frames;
+
+static int16_t s_convert_buf[CONVERT_FRAMES * 2];
+
+// A clip on its way to the DMA ring in the output format: either the loaded
+// clip itself or the output of the resampler, handed out piece by piece
+typedef struct {
+    const uint8_t *data;        // clip already in the output format, NULL when converted
+    resampler_t rs;
+    size_t size;                // output bytes
+    size_t done;                // output bytes handed to the driver
+    const uint8_t *piece;       // output not yet taken by the driver
+    size_t piece_len;
+} clip_out_t;
+
+static bool s_running;                     // TX channel enabled
+static int64_t s_amp_ready_us;             // when the amplifier is out of shutdown
+
+// Time from a loaded clip to its first sample on the wire, unscheduled clips only
+static struct {
+    uint32_t count;
+    uint32_t min_us;
+    uint32_t max_us;
+    uint64_t sum_us;
+} s_first_sample;
+
+#if CONFIG_HAPTIC_USB_AUDIO
+static int16_t s_mix_buf[I2S_DMA_FRAME_NUM * 2];
+
+// Time from the jitter buffer to the wire for stream audio arriving now:
+// the buffered stream plus the DMA ring ahead of the output
+static struct {
+    uint32_t count;
+    uint32_t min_us;
+    uint32_t max_us;
+    uint64_t sum_us;
+} s_stream_latency;
+
+static void stream_write_block(void);
+#endif
+
 static void i2s_example_init_std_simplex(void);
 static void i2s_example_write_task(void);
-void i2s_read_wav_file(const char* filename);
+static void amp_wake(void);
+static TickType_t idle_wait(void);
+static void i2s_stop(void);
+static void i2s_play_stored_clip(const audio_command_t *cmd);
 
 void i2s_task(void *arg)
 {
@@ -54,78 +160,440 @@ void i2s_task(void *arg)
     } else {
         ESP_LOGI(TAG, "Partition size: total: %d, used: %d", total, used);
     }
+    if (clip_store_init() != ESP_OK) {
+        ESP_LOGE(TAG, "Clip store unavailable, uploads disabled");
+    }
 
     // initialize I2S 
     ESP_LOGI(TAG, "Initializing I2S");
     i2s_example_init_std_simplex();
+#if CONFIG_MAX98357A_SD_GPIO >= 0
+    gpio_reset_pin(CONFIG_MAX98357A_SD_GPIO);
+    gpio_set_direction(CONFIG_MAX98357A_SD_GPIO, GPIO_MODE_OUTPUT);
+    gpio_set_level(CONFIG_MAX98357A_SD_GPIO, 0);
+#endif
+#if CONFIG_AUDIO_CONTINUOUS
+    // started once; clips are written behind the silence it plays
+    amp_wake();
     ESP_ERROR_CHECK(i2s_channel_enable(tx_chan));
+    s_desc_start_us = esp_timer_get_time();
+    s_running = true;
+#endif
+    ESP_ERROR_CHECK(haptic_alarm_init(&s_alarm));
 
     audio_command_t cmd;
     while (1) {
-        if (xQueueReceive(xAudioCommandQueue, &cmd, portMAX_DELAY)) {
-            ESP_LOGI(TAG, "Received command: %d, %d", cmd.cmd, cmd.audio_id);
-            char filename[20];
-            sprintf(filename, "/littlefs/%d.wav", cmd.audio_id);
-            i2s_read_wav_file(filename);
+        if (xQueueReceive(xAudioCommandQueue, &cmd, usb_audio_streaming() ? 0 : idle_wait())) {
+            if (cmd.cmd == AUDIO_CMD_STREAM) {
+                continue;
+            }
+            haptic_trace(HAPTIC_TRACE_DEQUEUE, cmd.trace_tag, cmd.trace_index, (uint8_t)cmd.audio_id);
+            // a stop since the clip was queued cancels its waits, even one
+            // that starts after the stop
+            haptic_alarm_expect(&s_alarm, cmd.generation);
+            i2s_play_stored_clip(&cmd);
+#if CONFIG_HAPTIC_USB_AUDIO
+        } else if (usb_audio_streaming()) {
+            haptic_alarm_expect(&s_alarm, 0);
+            stream_write_block();
+#endif
+        } else if (idle_wait() == 0) {
+            i2s_stop();
         }
     }
     // 关闭I2S
     // i2s_channel_disable(tx_chan);
 }
 
-void i2s_read_wav_file(const char* filename)
+static IRAM_ATTR bool i2s_on_sent(i2s_chan_handle_t handle, i2s_event_data_t *event, void *user_ctx)
+{
+    s_desc_start_us = esp_timer_get_time();
+    return false;
+}
+
+void i2s_cancel_scheduled(void)
+{
+    haptic_alarm_cancel(&s_alarm);
+}
+
+uint32_t i2s_cancel_generation(void)
+{
+    return haptic_alarm_generation(&s_alarm);
+}
+
+void i2s_schedule_stats(uint16_t *scheduled, uint16_t *late)
+{
+    *scheduled = s_scheduled;
+    *late = s_late;
+}
+
+// Time at which the next write starts playing
+static int64_t next_write_start(void)
+{
+    int64_t now = esp_timer_get_time();
+
+    if (s_drained_us - now > I2S_BOUNDARY_GUARD_US) {
+        return s_drained_us;
+    }
+
+    int64_t desc_start = s_desc_start_us;
+    if (desc_start + I2S_DESC_US - now < I2S_BOUNDARY_GUARD_US) {
+        // the DMA is about to move on; wait for its on_sent event
+        while (s_desc_start_us == desc_start && esp_timer_get_time() < desc_start + I2S_DESC_US + I2S_BOUNDARY_GUARD_US) {
+        }
+        desc_start = s_desc_start_us;
+    }
+    return desc_start + I2S_DESC_US;
+}
+
+static void amp_wake(void)
+{
+#if CONFIG_MAX98357A_SD_GPIO >= 0
+    gpio_set_level(CONFIG_MAX98357A_SD_GPIO, 1);
+#endif
+    s_amp_ready_us = esp_timer_get_time() + AMP_WAKE_US;
+}
+
+// Ticks until the output has been idle for long enough to stop it
+static TickType_t idle_wait(void)
+{
+#if CONFIG_AUDIO_PREARMED
+    if (s_running) {
+        int64_t left_us = s_drained_us + I2S_IDLE_US - esp_timer_get_time();
+        return left_us > 0 ? pdMS_TO_TICKS((left_us + 999) / 1000) + 1 : 0;
+    }
+#endif
+    return portMAX_DELAY;
+}
+
+// Stop the channel once the ring plays nothing but silence
+static void i2s_stop(void)
+{
+    ESP_ERROR_CHECK(i2s_channel_disable(tx_chan));
+#if CONFIG_MAX98357A_SD_GPIO >= 0
+    gpio_set_level(CONFIG_MAX98357A_SD_GPIO, 0);
+#endif
+    s_running = false;
+}
+
+static void clip_out_start(clip_out_t *clip, const uint8_t *data, size_t size, const clip_format_t *format)
+{
+    memset(clip, 0, sizeof(*clip));
+    if (format->sample_rate == I2S_SAMPLE_RATE && format->channels == 2) {
+        clip->data = data;
+        clip->size = size;
+    } else {
+        resampler_start(&clip->rs, data, size, format, I2S_SAMPLE_RATE);
+        clip->size = clip->rs.left * I2S_FRAME_BYTES;
+    }
+}
+
+// Next piece of output; false once all of it went to the driver
+static bool clip_out_next(clip_out_t *clip)
+{
+    if (clip->piece_len) {
+        return true;
+    }
+    if (clip->data) {
+        clip->piece = clip->data + clip->done;
+        clip->piece_len = clip->size - clip->done;
+    } else {
+        clip->piece = (const uint8_t *)s_convert_buf;
+        clip->piece_len = resampler_read(&clip->rs, s_convert_buf, CONVERT_FRAMES) * I2S_FRAME_BYTES;
+    }
+    return clip->piece_len > 0;
+}
+
+static void clip_out_taken(clip_out_t *clip, size_t bytes)
+{
+    clip->piece += bytes;
+    clip->piece_len -= bytes;
+    clip->done += bytes;
+}
+
+static int64_t write_end_us(void)
+{
+    return s_write_start_us + (int64_t)(s_write_frames * 1000000 / I2S_SAMPLE_RATE);
+}
+
+#if CONFIG_HAPTIC_USB_AUDIO
+static void stream_latency_record(void)
+{
+    usb_audio_state_t state;
+    int64_t ahead_us = write_end_us() - esp_timer_get_time();
+
+    usb_audio_state(&state);
+    uint32_t us = state.buffered_us + (ahead_us > 0 ? (uint32_t)ahead_us : 0);
+    if (s_stream_latency.count == 0 || us < s_stream_latency.min_us) {
+        s_stream_latency.min_us = us;
+    }
+    if (us > s_stream_latency.max_us) {
+        s_stream_latency.max_us = us;
+    }
+    s_stream_latency.sum_us += us;
+    if (++s_stream_latency.count == STREAM_REPORT_WRITES) {
+        ESP_LOGI(TAG, "USB audio latency: min %" PRIu32 " avg %" PRIu32 " max %" PRIu32 " us "
+                 "(%" PRIu32 " Hz, %d ms jitter buffer, %d x %d frames), %" PRIu32 " underruns",
+                 s_stream_latency.min_us, (uint32_t)(s_stream_latency.sum_us / s_stream_latency.count),
+                 s_stream_latency.max_us, state.rate, CONFIG_HAPTIC_USB_AUDIO_JITTER_MS,
+                 I2S_DMA_DESC_NUM, I2S_DMA_FRAME_NUM, state.underruns);
+        memset(&s_stream_latency, 0, sizeof(s_stream_latency));
+    }
+}
+#endif
+
+// Write to the DMA ring, blocking while it is full. While the host streams,
+// the stream is mixed in a descriptor at a time and each write waits until
+// the output is within STREAM_AHEAD_US of it; I2S_ERR_CANCELLED if a stop
+// cut that wait short.
+static esp_err_t ring_write(const uint8_t *data, size_t len, size_t *written)
+{
+    esp_err_t err = ESP_OK;
+    size_t n;
+
+    *written = 0;
+#if CONFIG_HAPTIC_USB_AUDIO
+    while (usb_audio_streaming() && *written < len) {
+        size_t chunk = len - *written < sizeof(s_mix_buf) ? len - *written : sizeof(s_mix_buf);
+
+        if (haptic_alarm_wait_until(&s_alarm, write_end_us() - STREAM_AHEAD_US) == HAPTIC_ALARM_CANCELLED) {
+            return I2S_ERR_CANCELLED;
+        }
+        memcpy(s_mix_buf, data + *written, chunk);
+        usb_audio_mix(s_mix_buf, chunk / I2S_FRAME_BYTES, I2S_SAMPLE_RATE);
+        n = 0;
+        err = i2s_channel_write(tx_chan, s_mix_buf, chunk, &n, portMAX_DELAY);
+        *written += n;
+        s_write_frames += n / I2S_FRAME_BYTES;
+        stream_latency_record();
+        if (err != ESP_OK) {
+            return err;
+        }
+    }
+#endif
+    if (*written < len) {
+        n = 0;
+        err = i2s_channel_write(tx_chan, data + *written, len - *written, &n, portMAX_DELAY);
+        *written += n;
+        s_write_frames += n / I2S_FRAME_BYTES;
+    }
+    return err;
+}
+
+// Load the start of a clip into the stopped channel's DMA ring and fill the
+// rest with silence, so the clip is the first thing sent once it is enabled
+static void i2s_preload(clip_out_t *clip)
+{
+    size_t n = 0;
+
+    while (clip_out_next(clip)) {
+        ESP_ERROR_CHECK(i2s_channel_preload_data(tx_chan, clip->piece, clip->piece_len, &n));
+        clip_out_taken(clip, n);
+        if (clip->piece_len) {
+            return;     // ring full
+        }
+    }
+    do {
+        ESP_ERROR_CHECK(i2s_channel_preload_data(tx_chan, s_silence, sizeof(s_silence), &n));
+    } while (n == sizeof(s_silence));
+}
+
+// Write what is left of a clip, blocking while the ring is full
+static void clip_out_write(clip_out_t *clip)
+{
+    size_t written;
+
+    while (clip_out_next(clip)) {
+        esp_err_t err = ring_write(clip->piece, clip->piece_len, &written);
+        clip_out_taken(clip, written);
+        if (err == I2S_ERR_CANCELLED) {
+            continue;   // a stop only drops clips still waiting for their time
+        }
+        if (err != ESP_OK) {
+            ESP_LOGE("AUDIO", "Write Task: i2s write failed");
+            return;
+        }
+    }
+}
+
+// Enable the preloaded channel at `go_us`; returns when its first sample went out
+static int64_t i2s_start(int64_t go_us)
 {
-    // 打开文件进行读取
-    FILE *f = fopen(filename, "rb");
-    // FILE *f = fopen("/littlefs/1.wav", "rb");
+    int64_t now;
 
-    if (f == NULL) 
-    {
-        ESP_LOGI("AUDIO", "Failed to open file for reading");
-    } 
-    else 
-    {
-        fseek(f, 12, SEEK_SET); // 重新将指针指向subchunkID
+    while (esp_timer_get_time() < go_us) {
+    }
+    ESP_ERROR_CHECK(i2s_channel_enable(tx_chan));
+    now = esp_timer_get_time();
+    s_desc_start_us = now;
+    s_running = true;
+    return now;
+}
+
+static void first_sample_record(int64_t delay_us)
+{
+    uint32_t us = delay_us > 0 ? (uint32_t)delay_us : 0;
 
-        uint32_t subChunkID = 0;
-        uint32_t subChunkSize = 0;
+    if (s_first_sample.count == 0 || us < s_first_sample.min_us) {
+        s_first_sample.min_us = us;
+    }
+    if (us > s_first_sample.max_us) {
+        s_first_sample.max_us = us;
+    }
+    s_first_sample.sum_us += us;
+    if (++s_first_sample.count == FIRST_SAMPLE_REPORT_CLIPS) {
+        ESP_LOGI(TAG, "Time to first sample: min %" PRIu32 " avg %" PRIu32 " max %" PRIu32 " us "
+                 "(%s, %d x %d frames)", s_first_sample.min_us,
+                 (uint32_t)(s_first_sample.sum_us / s_first_sample.count), s_first_sample.max_us,
+                 I2S_MODE_NAME, I2S_DMA_DESC_NUM, I2S_DMA_FRAME_NUM);
+        memset(&s_first_sample, 0, sizeof(s_first_sample));
+    }
+}
 
-        while(1){
-            fread(&subChunkID, sizeof(uint32_t), 1, f); // 读取subchunkID
-            fread(&subChunkSize, sizeof(uint32_t), 1, f); // 读取subchunkSize
+// Silence, or the stream alone while the host streams; false if a stop
+// cancelled the rest
+static bool write_silence(size_t bytes)
+{
+    size_t written;
 
-            // 将subchunkID转换为字符串
-            char subChunkIDStr[5];
-            memcpy(subChunkIDStr, &subChunkID, 4);
-            subChunkIDStr[4] = '\0';
-            ESP_LOGI("AUDIO", "subchunkID: %s, subchunkSize: %ld", subChunkIDStr, subChunkSize);
+    while (bytes) {
+        size_t chunk = bytes < sizeof(s_silence) ? bytes : sizeof(s_silence);
+        if (ring_write(s_silence, chunk, &written) == I2S_ERR_CANCELLED) {
+            return false;
+        }
+        bytes -= chunk;
+    }
+    return true;
+}
 
-            // 如果不是data块，则跳过
-            if (subChunkID != CCCC('d', 'a', 't', 'a')) {
-                fseek(f, subChunkSize, SEEK_CUR);
+#if CONFIG_HAPTIC_USB_AUDIO
+// One descriptor of the stream alone, while no clip plays. Pre-armed, the
+// channel runs for as long as the host streams.
+static void stream_write_block(void)
+{
+    size_t written = 0;
+    size_t n = 0;
+
+    if (!s_running) {
+        amp_wake();
+        do {
+            ESP_ERROR_CHECK(i2s_channel_preload_data(tx_chan, s_silence, sizeof(s_silence), &n));
+        } while (n == sizeof(s_silence));
+        s_drained_us = i2s_start(s_amp_ready_us) + I2S_DMA_DESC_NUM * I2S_DESC_US;
+    }
+    s_write_start_us = next_write_start();
+    s_write_frames = 0;
+    ring_write(s_silence, sizeof(s_silence), &written);
+    if (written) {
+        s_drained_us = write_end_us();
+    }
+}
+#endif
+
+// Play a loaded clip; with cmd->at_us set its first sample plays at that time
+static void play_clip(clip_out_t *clip, const audio_command_t *cmd)
+{
+    int64_t ready_us = esp_timer_get_time();
+    int64_t at_us = cmd->at_us;
+    int64_t start;
+    size_t pad = 0;
+    bool preloaded = false;
+
+    // while the host streams, the stream fills the wait: the gap up to the
+    // target is written as silence with the stream mixed in
+    if (at_us && !usb_audio_streaming() && haptic_alarm_wait_until(&s_alarm, at_us - (s_running ? I2S_SCHEDULE_LEAD_US : I2S_ARM_LEAD_US)) ==
+                 HAPTIC_ALARM_CANCELLED) {
+        haptic_trace(HAPTIC_TRACE_DROP, cmd->trace_tag, cmd->trace_index, (uint8_t)cmd->audio_id);
+        return;
+    }
+
+    if (s_running) {
+        start = next_write_start();
+        s_write_start_us = start;
+        s_write_frames = 0;
+        if (at_us) {
+            s_scheduled++;
+            if (at_us >= start) {
+                pad = (size_t)((at_us - start) * I2S_SAMPLE_RATE / 1000000) * I2S_FRAME_BYTES;
             } else {
-                break;
+                s_late++;
             }
         }
-        
-        // 读取wavData
-        size_t BytesWritten;
-        uint8_t *wavBuffer = (uint8_t *)malloc(subChunkSize);
-        fread(wavBuffer, sizeof(char), subChunkSize, f); // 读文件
-
-        // preloaded data
-        // ESP_ERROR_CHECK(i2s_channel_preload_data(tx_chan, wavBuffer, subChunkSize, &BytesWritten));
-        // ESP_ERROR_CHECK(i2s_channel_enable(tx_chan));
-
-        if (i2s_channel_write(tx_chan, wavBuffer, subChunkSize, &BytesWritten, portMAX_DELAY) == ESP_OK) {
-            ESP_LOGI("AUDIO", "Write Task: i2s write %d bytes", BytesWritten);
-        } else {
-            ESP_LOGE("AUDIO", "Write Task: i2s write failed");
+        if (!write_silence(pad)) {
+            haptic_trace(HAPTIC_TRACE_DROP, cmd->trace_tag, cmd->trace_index, (uint8_t)cmd->audio_id);
+            s_drained_us = write_end_us();
+            return;
         }
-        free(wavBuffer);
+    } else {
+        // the amplifier wakes while the ring is loaded
+        amp_wake();
+        i2s_preload(clip);
+        preloaded = clip->done == clip->size;
+        int64_t go_us = at_us > s_amp_ready_us ? at_us : s_amp_ready_us;
+        if (at_us) {
+            s_scheduled++;
+            if (go_us > at_us || esp_timer_get_time() > at_us) {
+                s_late++;
+            }
+        }
+        start = i2s_start(go_us);
+        s_write_start_us = start;
+        s_write_frames = clip->done / I2S_FRAME_BYTES;
+    }
+
+    // the clip is under way: from here a stop only cuts a pacing wait short,
+    // so the rest of the clip and its tail still go out
+    haptic_alarm_expect(&s_alarm, 0);
+    haptic_trace(HAPTIC_TRACE_OUTPUT, cmd->trace_tag, cmd->trace_index, clip->size);
+    clip_out_write(clip);
+    haptic_trace(HAPTIC_TRACE_DONE, cmd->trace_tag, cmd->trace_index, clip->done);
+
+    // complete the last descriptor so the next clip starts on a fresh one; a
+    // clip that fit the ring was already followed by silence up to its end
+    size_t total = pad + clip->done;
+    size_t tail = (I2S_DESC_BYTES - total % I2S_DESC_BYTES) % I2S_DESC_BYTES;
+    if (!preloaded) {
+        int64_t descs = (int64_t)((total + tail) / I2S_DESC_BYTES);
+        s_drained_us = write_silence(tail) ? start + descs * I2S_DESC_US : write_end_us();
+    } else {
+        s_drained_us = start + I2S_DMA_DESC_NUM * I2S_DESC_US;
+    }
+
+    if (!at_us) {
+        first_sample_record(start - ready_us);
     }
-    // 关闭文件
-    fclose(f);
+}
+
+// Scale 16-bit PCM samples in place by intensity / 255
+static void scale_samples(uint8_t *buf, size_t len, uint8_t intensity)
+{
+    int16_t *samples = (int16_t *)buf;
+    for (size_t i = 0; i < len / sizeof(int16_t); i++) {
+        samples[i] = (int16_t)((samples[i] * intensity) / 0xFF);
+    }
+}
+
+static void i2s_play_stored_clip(const audio_command_t *cmd)
+{
+    size_t size;
+    clip_format_t format;
+    clip_out_t clip;
+    uint8_t *data = clip_store_load((uint8_t)cmd->audio_id, &size, &format);
+
+    if (data == NULL) {
+        ESP_LOGI("AUDIO", "No clip %d", (uint8_t)cmd->audio_id);
+        haptic_trace(HAPTIC_TRACE_DROP, cmd->trace_tag, cmd->trace_index, (uint8_t)cmd->audio_id);
+        return;
+    }
+    haptic_trace(HAPTIC_TRACE_STORAGE, cmd->trace_tag, cmd->trace_index, size);
+    if (cmd->intensity < 0xFF) {
+        scale_samples(data, size, cmd->intensity);
+    }
+
+    // loaded before waiting, so file system latency does not delay a scheduled
+    // clip; a converted clip is resampled while it is written
+    clip_out_start(&clip, data, size, &format);
+    play_clip(&clip, cmd);
 }
 
 static void i2s_example_write_task(void)
@@ -178,8 +646,8 @@ static void i2s_example_init_std_simplex(void)
     i2s_chan_config_t tx_chan_cfg = {
         .id = I2S_NUM_AUTO,
         .role = I2S_ROLE_MASTER,
-        .dma_desc_num = 6,
-        .dma_frame_num = 240,
+        .dma_desc_num = I2S_DMA_DESC_NUM,
+        .dma_frame_num = I2S_DMA_FRAME_NUM,
         .auto_clear_after_cb = true,
         .auto_clear_before_cb = true,
         .intr_priority = 0,
@@ -191,7 +659,7 @@ static void i2s_example_init_std_simplex(void)
      * These two helper macros is defined in 'i2s_std.h' which can only be used in STD mode.
      * They can help to specify the slot and clock configurations for initialization or re-configuring */
     i2s_std_config_t tx_std_cfg = {
-        .clk_cfg  = I2S_STD_CLK_DEFAULT_CONFIG(44100),
+        .clk_cfg  = I2S_STD_CLK_DEFAULT_CONFIG(I2S_SAMPLE_RATE),
         .slot_cfg = I2S_STD_MSB_SLOT_DEFAULT_CONFIG(I2S_DATA_BIT_WIDTH_16BIT, I2S_SLOT_MODE_STEREO),
         .gpio_cfg = {
             .mclk = I2S_GPIO_UNUSED,    // some codecs may require mclk signal, this example doesn't need it
@@ -207,4 +675,10 @@ static void i2s_example_init_std_simplex(void)
         },
     };
     ESP_ERROR_CHECK(i2s_channel_init_std_mode(tx_chan, &tx_std_cfg));
+
+    /* Step 3: Track DMA descriptor switches for scheduled playback */
+    const i2s_event_callbacks_t cbs = {
+        .on_sent = i2s_on_sent,
+    };
+    ESP_ERROR_CHECK(i2s_channel_register_event_callback(tx_chan, &cbs, NULL));
 }
@@ -0,0 +1,147 @@
+#include "haptic_mouse.h"
+
+#include <math.h>
+#include <string.h>
+
+/*
+ * Polyphase resampler. Each output frame sits at a fractional source
+ * position; its integer part picks the source frames, the fraction picks
+ * one of RESAMPLER_PHASES sets of RESAMPLER_TAPS filter coefficients (a
+ * Blackman-windowed sinc sampled at that offset). The cutoff is the source
+ * Nyquist frequency, right for the upsampling this is mostly used for; from
+ * 48 kHz down to 44.1 kHz only content above 20 kHz aliases.
+ */
+#define RESAMPLER_TAPS          8
+#define RESAMPLER_PHASES        64
+#define RESAMPLER_PHASE_BITS    6
+#define RESAMPLER_COEF_BITS     14      // coefficients in Q14
+
+static int16_t s_coef[RESAMPLER_PHASES][RESAMPLER_TAPS];
+static bool s_coef_ready;
+
+static void resampler_build_table(void)
+{
+    for (int p = 0; p < RESAMPLER_PHASES; p++) {
+        float frac = (float)p / RESAMPLER_PHASES;
+        float h[RESAMPLER_TAPS];
+        float sum = 0;
+
+        // taps at source frames -3 .. 4 around the output position
+        for (int k = 0; k < RESAMPLER_TAPS; k++) {
+            float x = (float)(k - RESAMPLER_TAPS / 2 + 1) - frac;
+            float w = x / (RESAMPLER_TAPS / 2);
+            float sinc = fabsf(x) < 1e-6f ? 1.0f : sinf((float)M_PI * x) / ((float)M_PI * x);
+            float window = fabsf(w) >= 1.0f ? 0.0f :
+                           0.42f + 0.5f * cosf((float)M_PI * w) + 0.08f * cosf(2.0f * (float)M_PI * w);
+            h[k] = sinc * window;
+            sum += h[k];
+        }
+        // unity gain at every phase, so a constant signal stays constant
+        for (int k = 0; k < RESAMPLER_TAPS; k++) {
+            s_coef[p][k] = (int16_t)lrintf(h[k] / sum * (1 << RESAMPLER_COEF_BITS));
+        }
+    }
+    s_coef_ready = true;
+}
+
+size_t resampler_out_frames(size_t frames, uint32_t in_rate, uint32_t out_rate)
+{
+    return (size_t)((uint64_t)frames * out_rate / in_rate);
+}
+
+void resampler_start(resampler_t *rs, const uint8_t *data, size_t size, const clip_format_t *format, uint32_t out_rate)
+{
+    if (!s_coef_ready) {
+        resampler_build_table();
+    }
+    rs->samples = (const int16_t *)data;
+    rs->channels = format->channels;
+    rs->frames = size / (sizeof(int16_t) * format->channels);
+    rs->step = ((uint64_t)format->sample_rate << 32) / out_rate;
+    rs->pos = 0;
+    rs->left = resampler_out_frames(rs->frames, format->sample_rate, out_rate);
+}
+
+static inline int16_t resampler_clip16(int32_t acc)
+{
+    acc = (acc + (1 << (RESAMPLER_COEF_BITS - 1))) >> RESAMPLER_COEF_BITS;
+    return (int16_t)(acc > INT16_MAX ? INT16_MAX : acc < INT16_MIN ? INT16_MIN : acc);
+}
+
+size_t resampler_read(resampler_t *rs, int16_t *out, size_t max_frames)
+{
+    const int16_t *src = rs->samples;
+    const int ch = rs->channels;
+    const long last = (long)rs->frames - 1;
+    size_t n = max_frames < rs->left ? max_frames : rs->left;
+
+    for (size_t i = 0; i < n; i++) {
+        long base = (long)(rs->pos >> 32) - (RESAMPLER_TAPS / 2 - 1);
+        const int16_t *coef = s_coef[(uint32_t)rs->pos >> (32 - RESAMPLER_PHASE_BITS)];
+        int32_t acc_l = 0;
+        int32_t acc_r = 0;
+
+        if (base >= 0 && base + RESAMPLER_TAPS - 1 <= last) {
+            const int16_t *x = src + base * ch;
+            if (ch == 1) {
+                for (int k = 0; k < RESAMPLER_TAPS; k++) {
+                    acc_l += x[k] * coef[k];
+                }
+                acc_r = acc_l;
+            } else {
+                for (int k = 0; k < RESAMPLER_TAPS; k++) {
+                    acc_l += x[2 * k] * coef[k];
+                    acc_r += x[2 * k + 1] * coef[k];
+                }
+            }
+        } else {
+            // first and last frames: the clip is padded with silence
+            for (int k = 0; k < RESAMPLER_TAPS; k++) {
+                long j = base + k;
+                if (j < 0 || j > last) {
+                    continue;
+                }
+                acc_l += src[j * ch] * coef[k];
+                acc_r += src[j * ch + ch - 1] * coef[k];
+            }
+        }
+        out[2 * i] = resampler_clip16(acc_l);
+        out[2 * i + 1] = resampler_clip16(acc_r);
+        rs->pos += rs->step;
+    }
+    rs->left -= n;
+    return n;
+}
+
+static inline int16_t resampler_add16(int16_t a, int32_t b)
+{
+    int32_t sum = a + b;
+    return (int16_t)(sum > INT16_MAX ? INT16_MAX : sum < INT16_MIN ? INT16_MIN : sum);
+}
+
+size_t resampler_mix_mono(const int16_t *src, size_t frames, uint64_t *pos, uint64_t step, int32_t gain,
+                          int16_t *out, size_t max_frames)
+{
+    size_t i;
+
+    if (!s_coef_ready) {
+        resampler_build_table();
+    }
+    for (i = 0; i < max_frames; i++) {
+        long base = (long)(*pos >> 32) - (RESAMPLER_TAPS / 2 - 1);
+        const int16_t *coef = s_coef[(uint32_t)*pos >> (32 - RESAMPLER_PHASE_BITS)];
+        int32_t acc = 0;
+
+        if (base < 0 || base + RESAMPLER_TAPS > (long)frames) {
+            break;
+        }
+        for (int k = 0; k < RESAMPLER_TAPS; k++) {
+            acc += src[base + k] * coef[k];
+        }
+        int32_t s = ((int32_t)resampler_clip16(acc) * gain) >> 15;
+        out[2 * i] = resampler_add16(out[2 * i], s);
+        out[2 * i + 1] = resampler_add16(out[2 * i + 1], s);
+        *pos += step;
+    }
+    return i;
+}
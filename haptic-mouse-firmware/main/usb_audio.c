@@ -0,0 +1,270 @@
+#include "haptic_mouse.h"
+
+#if CONFIG_HAPTIC_USB_AUDIO
+
+#include <inttypes.h>
+#include <math.h>
+#include <string.h>
+#include "tinyusb.h"
+#include "class/audio/audio_device.h"
+
+#define TAG "usb_audio"
+
+/*
+ * USB Audio Class stream input. TinyUSB puts the isochronous packets into
+ * the OUT endpoint FIFO, which is the jitter buffer: the I2S task reads the
+ * stream from there straight into the resampler window and mixes it into
+ * the data it writes to the DMA ring, so a sample is copied once on its way
+ * from the packet to the ring. The feedback endpoint holds the FIFO at
+ * CONFIG_HAPTIC_USB_AUDIO_JITTER_MS by steering the host's rate, which also
+ * follows the drift between the USB SOF clock and the I2S clock.
+ */
+
+#define UAC_VOLUME_MIN          (-50 * 256)     // 1/256 dB
+#define UAC_VOLUME_STEP         256
+
+// A level off by one frame moves the feedback by a frame per this long
+#define FEEDBACK_SETTLE_MS      128
+
+static const uint32_t s_rates[] = { 8000, 16000, 32000, 44100, 48000 };
+#define RATE_COUNT              (sizeof(s_rates) / sizeof(s_rates[0]))
+
+// Set by the host, from the TinyUSB task
+static volatile uint32_t s_rate = 48000;
+static volatile bool s_open;
+static volatile uint32_t s_opens;
+static volatile bool s_mute;
+static volatile int16_t s_volume;               // 1/256 dB
+static volatile int32_t s_gain = 1 << 15;       // Q15
+
+// Read side, I2S task only. The window holds the source frames the taps of
+// the next output frame reach; s_pos is that frame's position in it.
+static int16_t s_window[2 * USB_AUDIO_MAX_MIX_FRAMES + 16];
+static size_t s_window_frames;
+static uint64_t s_pos;
+static uint32_t s_window_rate;
+static uint32_t s_seen_opens;
+static bool s_primed;
+static uint32_t s_underruns;
+
+static uint32_t jitter_frames(uint32_t rate)
+{
+    return rate * CONFIG_HAPTIC_USB_AUDIO_JITTER_MS / 1000;
+}
+
+// Samples per 1 ms frame the host should send, in 16.16
+static void feedback_update(uint32_t rate, size_t level_frames)
+{
+    int64_t nominal = ((int64_t)rate << 16) / 1000;
+    int64_t error = (int64_t)jitter_frames(rate) - (int64_t)level_frames;
+    int64_t fb = nominal + (error << 16) / FEEDBACK_SETTLE_MS;
+
+    // within 1 % of the nominal rate, well inside what hosts accept
+    if (fb > nominal + nominal / 100) {
+        fb = nominal + nominal / 100;
+    } else if (fb < nominal - nominal / 100) {
+        fb = nominal - nominal / 100;
+    }
+    tud_audio_fb_set((uint32_t)fb);
+}
+
+void usb_audio_mix(int16_t *out, size_t frames, uint32_t out_rate)
+{
+    uint32_t rate = s_rate;
+
+    if (frames == 0) {
+        return;
+    }
+    if (s_seen_opens != s_opens || s_window_rate != rate) {
+        // a new stream: start over with an empty window
+        s_seen_opens = s_opens;
+        s_window_rate = rate;
+        s_window_frames = 0;
+        s_pos = RESAMPLER_WINDOW_START;
+        s_primed = false;
+    }
+
+    // source frames up to the last tap of the last output frame
+    uint64_t step = ((uint64_t)rate << 32) / out_rate;
+    size_t need = (size_t)((s_pos + (uint64_t)(frames - 1) * step) >> 32) + RESAMPLER_WINDOW_AFTER + 1;
+    if (need > sizeof(s_window) / sizeof(s_window[0])) {
+        need = sizeof(s_window) / sizeof(s_window[0]);
+    }
+    size_t want = need > s_window_frames ? need - s_window_frames : 0;
+
+    // the jitter level is what stays buffered once this call took its share
+    size_t level = tud_audio_available() / sizeof(int16_t);
+    if (!s_primed && level < jitter_frames(rate) + want) {
+        feedback_update(rate, level);
+        return;
+    }
+    s_primed = true;
+
+    if (want) {
+        size_t got = tud_audio_read(s_window + s_window_frames, want * sizeof(int16_t)) / sizeof(int16_t);
+        if (got < want) {
+            // ran dry: play out what came with silence, then refill to the
+            // jitter level before going on
+            memset(s_window + s_window_frames + got, 0, (want - got) * sizeof(int16_t));
+            s_underruns++;
+            s_primed = false;
+        }
+        s_window_frames = need;
+    }
+
+    resampler_mix_mono(s_window, s_window_frames, &s_pos, step, s_mute ? 0 : s_gain, out, frames);
+
+    // drop the frames no tap reaches any more
+    size_t first = (size_t)((s_pos - RESAMPLER_WINDOW_START) >> 32);
+    if (first > s_window_frames) {
+        first = s_window_frames;
+    }
+    memmove(s_window, s_window + first, (s_window_frames - first) * sizeof(int16_t));
+    s_window_frames -= first;
+    s_pos -= (uint64_t)first << 32;
+
+    feedback_update(rate, tud_audio_available() / sizeof(int16_t));
+}
+
+void usb_audio_state(usb_audio_state_t *state)
+{
+    uint32_t rate = s_rate;
+    size_t window = s_window_frames > (s_pos >> 32) ? s_window_frames - (size_t)(s_pos >> 32) : 0;
+    size_t frames = tud_audio_available() / sizeof(int16_t) + window;
+
+    state->rate = rate;
+    state->buffered_us = (uint32_t)((uint64_t)frames * 1000000 / rate);
+    state->underruns = s_underruns;
+}
+
+bool usb_audio_streaming(void)
+{
+    return s_open;
+}
+
+/********* TinyUSB audio callbacks ***************/
+
+static bool clock_get_request(uint8_t rhport, tusb_control_request_t const *req, uint8_t ctrl)
+{
+    if (ctrl == AUDIO_CS_CTRL_SAM_FREQ && req->bRequest == AUDIO_CS_REQ_CUR) {
+        audio_control_cur_4_t cur = { .bCur = (int32_t)tu_htole32(s_rate) };
+        return tud_audio_buffer_and_schedule_control_xfer(rhport, req, &cur, sizeof(cur));
+    }
+    if (ctrl == AUDIO_CS_CTRL_SAM_FREQ && req->bRequest == AUDIO_CS_REQ_RANGE) {
+        audio_control_range_4_n_t(RATE_COUNT) range = { .wNumSubRanges = tu_htole16(RATE_COUNT) };
+        for (size_t i = 0; i < RATE_COUNT; i++) {
+            range.subrange[i].bMin = (int32_t)s_rates[i];
+            range.subrange[i].bMax = (int32_t)s_rates[i];
+            range.subrange[i].bRes = 0;
+        }
+        return tud_audio_buffer_and_schedule_control_xfer(rhport, req, &range, sizeof(range));
+    }
+    if (ctrl == AUDIO_CS_CTRL_CLK_VALID && req->bRequest == AUDIO_CS_REQ_CUR) {
+        audio_control_cur_1_t valid = { .bCur = 1 };
+        return tud_audio_buffer_and_schedule_control_xfer(rhport, req, &valid, sizeof(valid));
+    }
+    return false;
+}
+
+static bool feature_get_request(uint8_t rhport, tusb_control_request_t const *req, uint8_t ctrl)
+{
+    if (ctrl == AUDIO_FU_CTRL_MUTE && req->bRequest == AUDIO_CS_REQ_CUR) {
+        audio_control_cur_1_t mute = { .bCur = s_mute };
+        return tud_audio_buffer_and_schedule_control_xfer(rhport, req, &mute, sizeof(mute));
+    }
+    if (ctrl == AUDIO_FU_CTRL_VOLUME && req->bRequest == AUDIO_CS_REQ_CUR) {
+        audio_control_cur_2_t volume = { .bCur = (int16_t)tu_htole16(s_volume) };
+        return tud_audio_buffer_and_schedule_control_xfer(rhport, req, &volume, sizeof(volume));
+    }
+    if (ctrl == AUDIO_FU_CTRL_VOLUME && req->bRequest == AUDIO_CS_REQ_RANGE) {
+        audio_control_range_2_n_t(1) range = {
+            .wNumSubRanges = tu_htole16(1),
+            .subrange[0] = { .bMin = UAC_VOLUME_MIN, .bMax = 0, .bRes = UAC_VOLUME_STEP },
+        };
+        return tud_audio_buffer_and_schedule_control_xfer(rhport, req, &range, sizeof(range));
+    }
+    return false;
+}
+
+// Invoked for GET requests to an entity; returning false STALLs it
+bool tud_audio_get_req_entity_cb(uint8_t rhport, tusb_control_request_t const *p_request)
+{
+    uint8_t ctrl = TU_U16_HIGH(p_request->wValue);
+    uint8_t entity = TU_U16_HIGH(p_request->wIndex);
+
+    if (entity == UAC_ENTITY_CLOCK) {
+        return clock_get_request(rhport, p_request, ctrl);
+    }
+    if (entity == UAC_ENTITY_FEATURE_UNIT) {
+        return feature_get_request(rhport, p_request, ctrl);
+    }
+    return false;
+}
+
+// Invoked once the data stage of a SET request to an entity arrived
+bool tud_audio_set_req_entity_cb(uint8_t rhport, tusb_control_request_t const *p_request, uint8_t *buf)
+{
+    uint8_t ctrl = TU_U16_HIGH(p_request->wValue);
+    uint8_t entity = TU_U16_HIGH(p_request->wIndex);
+
+    if (p_request->bRequest != AUDIO_CS_REQ_CUR) {
+        return false;
+    }
+    if (entity == UAC_ENTITY_CLOCK && ctrl == AUDIO_CS_CTRL_SAM_FREQ &&
+        p_request->wLength == sizeof(audio_control_cur_4_t)) {
+        uint32_t rate = tu_le32toh((uint32_t)((audio_control_cur_4_t const *)buf)->bCur);
+        for (size_t i = 0; i < RATE_COUNT; i++) {
+            if (s_rates[i] == rate) {
+                s_rate = rate;
+                return true;
+            }
+        }
+        return false;
+    }
+    if (entity == UAC_ENTITY_FEATURE_UNIT && ctrl == AUDIO_FU_CTRL_MUTE &&
+        p_request->wLength == sizeof(audio_control_cur_1_t)) {
+        s_mute = ((audio_control_cur_1_t const *)buf)->bCur != 0;
+        return true;
+    }
+    if (entity == UAC_ENTITY_FEATURE_UNIT && ctrl == AUDIO_FU_CTRL_VOLUME &&
+        p_request->wLength == sizeof(audio_control_cur_2_t)) {
+        int16_t volume = (int16_t)tu_le16toh((uint16_t)((audio_control_cur_2_t const *)buf)->bCur);
+        if (volume < UAC_VOLUME_MIN) {
+            volume = UAC_VOLUME_MIN;
+        } else if (volume > 0) {
+            volume = 0;
+        }
+        s_volume = volume;
+        s_gain = (int32_t)lrintf((1 << 15) * powf(10.0f, volume / 256.0f / 20.0f));
+        return true;
+    }
+    return false;
+}
+
+// Invoked when the host selects an alternate setting; 1 starts the stream
+bool tud_audio_set_itf_cb(uint8_t rhport, tusb_control_request_t const *p_request)
+{
+    uint8_t alt = TU_U16_LOW(p_request->wValue);
+
+    if (alt == 0 || xAudioCommandQueue == NULL) {
+        return true;
+    }
+    s_opens++;
+    s_open = true;
+    tud_audio_fb_set((uint32_t)(((uint64_t)s_rate << 16) / 1000));
+
+    // the I2S task may be blocked on an empty queue; it streams from here on
+    audio_command_t wake = { .cmd = AUDIO_CMD_STREAM };
+    xQueueSend(xAudioCommandQueue, &wake, 0);
+    ESP_LOGI(TAG, "Stream open, %" PRIu32 " Hz", s_rate);
+    return true;
+}
+
+// Invoked when the host goes back to the zero-bandwidth setting
+bool tud_audio_set_itf_close_EP_cb(uint8_t rhport, tusb_control_request_t const *p_request)
+{
+    s_open = false;
+    return true;
+}
+
+#endif
@@ -0,0 +1,318 @@
+#include "haptic_mouse.h"
+
+#if CONFIG_HAPTIC_USB_COMPOSITE
+
+#include <string.h>
+#include "tinyusb.h"
+#include "tusb_cdc_acm.h"
+#include "class/hid/hid_device.h"
+#if CONFIG_HAPTIC_USB_AUDIO
+#include "class/audio/audio_device.h"
+#endif
+#include "esp_timer.h"
+#include "haptic_protocol.h"
+#include "haptic_trace.h"
+
+#define TAG "usb_hid"
+
+// Legacy single effect report of the browser plugin; the byte is a clip ID
+#define LEGACY_REPORT_ID        0x10
+
+// Report ID plus HP_HID_REPORT_SIZE; polled every frame, so a report waits
+// at most 1 ms for the bus
+#define HID_EP_SIZE             64
+#define HID_EP_INTERVAL_MS      1
+
+enum {
+    ITF_NUM_CDC = 0,
+    ITF_NUM_CDC_DATA,
+    ITF_NUM_HID,
+#if CONFIG_HAPTIC_USB_AUDIO
+    ITF_NUM_AUDIO_CONTROL,
+    ITF_NUM_AUDIO_STREAMING,
+#endif
+    ITF_NUM_TOTAL,
+};
+
+#define EPNUM_CDC_NOTIF         0x81
+#define EPNUM_CDC_OUT           0x02
+#define EPNUM_CDC_IN            0x82
+#define EPNUM_HID_OUT           0x03
+#define EPNUM_HID_IN            0x83
+// The OTG controller has six endpoints besides EP0, no more than four of
+// them IN; the audio function takes the last IN one for its feedback
+#define EPNUM_AUDIO_OUT         0x04
+#define EPNUM_AUDIO_FB          0x84
+
+/************* TinyUSB descriptors ****************/
+
+#if CONFIG_HAPTIC_USB_AUDIO
+// One 1 ms frame of 16-bit mono at 48 kHz, plus the extra sample the
+// feedback may ask for; CFG_TUD_AUDIO_FUNC_1_EP_OUT_SZ_MAX in CMakeLists.txt
+#define UAC_EP_SIZE             ((48 + 1) * 2)
+#define UAC_FB_EP_SIZE          3       // 10.14 at full speed
+
+/*
+ * Speaker function: the entities of TinyUSB's mono speaker with feedback
+ * (hence its TUD_AUDIO_SPEAKER_MONO_FB_DESC_LEN), with a programmable clock
+ * for the rates of usb_audio.c and mute and volume on the feature unit.
+ */
+#define UAC_SPEAKER_DESCRIPTOR(_itfnum, _stridx, _epout, _epfb) \
+    TUD_AUDIO_DESC_IAD(_itfnum, 0x02, 0x00), \
+    TUD_AUDIO_DESC_STD_AC(_itfnum, 0x00, _stridx), \
+    TUD_AUDIO_DESC_CS_AC(0x0200, AUDIO_FUNC_DESKTOP_SPEAKER, \
+                         TUD_AUDIO_DESC_CLK_SRC_LEN + TUD_AUDIO_DESC_INPUT_TERM_LEN + \
+                         TUD_AUDIO_DESC_OUTPUT_TERM_LEN + TUD_AUDIO_DESC_FEATURE_UNIT_ONE_CHANNEL_LEN, 0x00), \
+    TUD_AUDIO_DESC_CLK_SRC(UAC_ENTITY_CLOCK, AUDIO_CLOCK_SOURCE_ATT_INT_PRO_CLK, \
+                           (AUDIO_CTRL_RW << AUDIO_CLOCK_SOURCE_CTRL_CLK_FRQ_POS), UAC_ENTITY_INPUT_TERMINAL, 0x00), \
+    TUD_AUDIO_DESC_INPUT_TERM(UAC_ENTITY_INPUT_TERMINAL, AUDIO_TERM_TYPE_USB_STREAMING, 0x00, UAC_ENTITY_CLOCK, \
+                              0x01, AUDIO_CHANNEL_CONFIG_NON_PREDEFINED, 0x00, 0x0000, 0x00), \
+    TUD_AUDIO_DESC_OUTPUT_TERM(UAC_ENTITY_OUTPUT_TERMINAL, AUDIO_TERM_TYPE_OUT_DESKTOP_SPEAKER, 0x00, \
+                               UAC_ENTITY_FEATURE_UNIT, UAC_ENTITY_CLOCK, 0x0000, 0x00), \
+    TUD_AUDIO_DESC_FEATURE_UNIT_ONE_CHANNEL(UAC_ENTITY_FEATURE_UNIT, UAC_ENTITY_INPUT_TERMINAL, \
+        (AUDIO_CTRL_RW << AUDIO_FEATURE_UNIT_CTRL_MUTE_POS | AUDIO_CTRL_RW << AUDIO_FEATURE_UNIT_CTRL_VOLUME_POS), \
+        (AUDIO_CTRL_RW << AUDIO_FEATURE_UNIT_CTRL_MUTE_POS | AUDIO_CTRL_RW << AUDIO_FEATURE_UNIT_CTRL_VOLUME_POS), \
+        0x00), \
+    /* alternate 0: no bandwidth; alternate 1: the stream and its feedback */ \
+    TUD_AUDIO_DESC_STD_AS_INT((uint8_t)((_itfnum) + 1), 0x00, 0x00, 0x00), \
+    TUD_AUDIO_DESC_STD_AS_INT((uint8_t)((_itfnum) + 1), 0x01, 0x02, 0x00), \
+    TUD_AUDIO_DESC_CS_AS_INT(UAC_ENTITY_INPUT_TERMINAL, AUDIO_CTRL_NONE, AUDIO_FORMAT_TYPE_I, \
+                             AUDIO_DATA_FORMAT_TYPE_I_PCM, 0x01, AUDIO_CHANNEL_CONFIG_NON_PREDEFINED, 0x00), \
+    TUD_AUDIO_DESC_TYPE_I_FORMAT(2, 16), \
+    TUD_AUDIO_DESC_STD_AS_ISO_EP(_epout, \
+        (uint8_t)(TUSB_XFER_ISOCHRONOUS | TUSB_ISO_EP_ATT_ASYNCHRONOUS | TUSB_ISO_EP_ATT_DATA), UAC_EP_SIZE, 0x01), \
+    TUD_AUDIO_DESC_CS_AS_ISO_EP(AUDIO_CS_AS_ISO_DATA_EP_ATT_NON_MAX_PACKETS_OK, AUDIO_CTRL_NONE, \
+                                AUDIO_CS_AS_ISO_DATA_EP_LOCK_DELAY_UNIT_UNDEFINED, 0x0000), \
+    TUD_AUDIO_DESC_STD_AS_ISO_FB_EP(_epfb, UAC_FB_EP_SIZE, 0x01)
+
+#define UAC_DESC_LEN            TUD_AUDIO_SPEAKER_MONO_FB_DESC_LEN
+#else
+#define UAC_DESC_LEN            0
+#endif
+
+#define TUSB_DESC_TOTAL_LEN     (TUD_CONFIG_DESC_LEN + TUD_CDC_DESC_LEN + TUD_HID_INOUT_DESC_LEN + UAC_DESC_LEN)
+
+/**
+ * @brief HID report descriptor
+ *
+ * The vendor collection of the LRA firmware without its LRA-only reports
+ * (continuous patterns, effect catalog), so hosts drive both boards alike.
+ */
+static const uint8_t hid_report_descriptor[] = {
+    HID_USAGE_PAGE_N(0xFF00, 2), // Vendor page: legacy reports and the command protocol
+    HID_USAGE(0x01),
+    HID_COLLECTION(HID_COLLECTION_APPLICATION), // Application
+        HID_REPORT_ID(LEGACY_REPORT_ID) // Haptic report ID
+        HID_LOGICAL_MIN(0x00),
+        HID_LOGICAL_MAX(0xFF), // 8-bit (0-255)
+        HID_USAGE(0x01), // Just one actuator
+        HID_USAGE_MIN(0x01),
+        HID_USAGE_MAX(0x01),
+        HID_REPORT_SIZE(0x08),
+        HID_REPORT_COUNT(0x01),
+        HID_OUTPUT( HID_DATA | HID_VARIABLE | HID_ABSOLUTE ), // Output (Data,Var,Abs)
+        HID_REPORT_ID(HP_HID_REPORT_ID) // Command protocol packet (haptic_protocol.h)
+        HID_LOGICAL_MIN(0x00),
+        HID_LOGICAL_MAX(0xFF),
+        HID_USAGE(0x01),
+        HID_REPORT_SIZE(0x08),
+        HID_REPORT_COUNT(HP_HID_REPORT_SIZE),
+        HID_OUTPUT( HID_DATA | HID_VARIABLE | HID_ABSOLUTE ),
+        HID_REPORT_ID(HP_HID_CAPS_REPORT_ID) // Capabilities (CAPS packet)
+        HID_LOGICAL_MIN(0x00),
+        HID_LOGICAL_MAX(0xFF),
+        HID_USAGE(0x01),
+        HID_REPORT_SIZE(0x08),
+        HID_REPORT_COUNT(HP_HID_REPORT_SIZE),
+        HID_FEATURE( HID_DATA | HID_VARIABLE | HID_ABSOLUTE ),
+        HID_REPORT_ID(HP_HID_TIME_REPORT_ID) // Device clock (TIME packet)
+        HID_LOGICAL_MIN(0x00),
+        HID_LOGICAL_MAX(0xFF),
+        HID_USAGE(0x01),
+        HID_REPORT_SIZE(0x08),
+        HID_REPORT_COUNT(HP_HID_REPORT_SIZE),
+        HID_FEATURE( HID_DATA | HID_VARIABLE | HID_ABSOLUTE ),
+        HID_REPORT_ID(HP_HID_TRACE_REPORT_ID) // Trace dump (TRACE packet)
+        HID_LOGICAL_MIN(0x00),
+        HID_LOGICAL_MAX(0xFF),
+        HID_USAGE(0x01),
+        HID_REPORT_SIZE(0x08),
+        HID_REPORT_COUNT(HP_HID_REPORT_SIZE),
+        HID_FEATURE( HID_DATA | HID_VARIABLE | HID_ABSOLUTE ),
+    HID_COLLECTION_END,
+};
+
+/**
+ * @brief String descriptor
+ */
+static const char *hid_string_descriptor[7] = {
+    // array of pointer to string descriptors
+    (char[]){0x09, 0x04},  // 0: is supported language is English (0x0409)
+    "TinyUSB",             // 1: Manufacturer
+    "Haptic Mouse Speaker", // 2: Product
+    "123456",              // 3: Serials, should use chip ID
+    "Command serial",      // 4: CDC
+    "HID interface",       // 5: HID
+    "Haptic stream",       // 6: USB audio
+};
+
+/**
+ * @brief Configuration descriptor
+ *
+ * The CDC port carries the serial protocol (uploads, debugging); the HID
+ * interface takes reports on its own interrupt OUT endpoint rather than
+ * through control transfers. With CONFIG_HAPTIC_USB_AUDIO a speaker
+ * function follows, for waveforms streamed from the host.
+ */
+static const uint8_t hid_configuration_descriptor[] = {
+    // Configuration number, interface count, string index, total length, attribute, power in mA
+    TUD_CONFIG_DESCRIPTOR(1, ITF_NUM_TOTAL, 0, TUSB_DESC_TOTAL_LEN, TUSB_DESC_CONFIG_ATT_REMOTE_WAKEUP, 100),
+
+    // Interface number, string index, EP notification address and size, EP data address (out, in) and size
+    TUD_CDC_DESCRIPTOR(ITF_NUM_CDC, 4, EPNUM_CDC_NOTIF, 8, EPNUM_CDC_OUT, EPNUM_CDC_IN, 64),
+
+    // Interface number, string index, protocol, report descriptor len, EP Out & In address, size & polling interval
+    TUD_HID_INOUT_DESCRIPTOR(ITF_NUM_HID, 5, HID_ITF_PROTOCOL_NONE, sizeof(hid_report_descriptor),
+                             EPNUM_HID_OUT, 0x80 | EPNUM_HID_IN, HID_EP_SIZE, HID_EP_INTERVAL_MS),
+
+#if CONFIG_HAPTIC_USB_AUDIO
+    // Interface number, string index, EP Out & feedback EP In address
+    UAC_SPEAKER_DESCRIPTOR(ITF_NUM_AUDIO_CONTROL, 6, EPNUM_AUDIO_OUT, EPNUM_AUDIO_FB),
+#endif
+};
+
+// Capabilities reported over HID; uploads and acknowledgements need the CDC port
+static const hp_caps_t s_caps = {
+    .version_min = HP_VERSION,
+    .version_max = HP_VERSION,
+    .device_kind = HP_DEVICE_SPEAKER,
+    .actuator_count = 1,
+    .max_records = HP_HID_MAX_RECORDS,
+    .schedule_lead_ms = 25,     // clip load from LittleFS plus two DMA descriptors
+    .effect_count = 256,        // clip IDs, /littlefs/<id>.wav
+    .features = HP_CAP_INTENSITY | HP_CAP_QUEUE | HP_CAP_SCHEDULE,
+    .min_period_ms = 0,
+};
+
+static TaskHandle_t s_serial_task;
+
+/********* TinyUSB HID callbacks ***************/
+
+// Invoked when received GET HID REPORT DESCRIPTOR request
+uint8_t const *tud_hid_descriptor_report_cb(uint8_t instance)
+{
+    return hid_report_descriptor;
+}
+
+// Invoked when received GET_REPORT control request; returning 0 STALLs it
+uint16_t tud_hid_get_report_cb(uint8_t instance, uint8_t report_id, hid_report_type_t report_type, uint8_t *buffer,
+                               uint16_t reqlen)
+{
+    if (report_type != HID_REPORT_TYPE_FEATURE || reqlen < HP_HID_REPORT_SIZE) {
+        return 0;
+    }
+    memset(buffer, 0, HP_HID_REPORT_SIZE);
+    if (report_id == HP_HID_CAPS_REPORT_ID) {
+        hp_build_caps(buffer, 0, &s_caps);
+        return HP_HID_REPORT_SIZE;
+    }
+    if (report_id == HP_HID_TIME_REPORT_ID) {
+        // sampled as late as possible; the host takes the midpoint of its request
+        hp_time_t now = { .device_us = (uint64_t)esp_timer_get_time() };
+        i2s_schedule_stats(&now.scheduled, &now.late);
+        hp_build_time(buffer, 0, &now);
+        return HP_HID_REPORT_SIZE;
+    }
+    if (report_id == HP_HID_TRACE_REPORT_ID) {
+        // one chunk per request; the host reads until a chunk has no events
+        size_t events;
+        haptic_trace_dump(buffer, 0, HP_HID_REPORT_SIZE - HP_HEADER_SIZE - HP_CRC_SIZE, &events);
+        return HP_HID_REPORT_SIZE;
+    }
+    return 0;
+}
+
+// Run a COMMANDS packet straight from the USB task: the clips go into the
+// I2S task's queue, which wakes it, without a hop through the command task
+static void handle_protocol_packet(const uint8_t *buffer, uint16_t bufsize, uint16_t tag)
+{
+    hp_packet_t pkt;
+    hp_status_t status = hp_packet_parse(buffer, bufsize, &pkt);
+
+    if (status == HP_STATUS_OK && pkt.type != HP_PKT_COMMANDS) {
+        status = HP_STATUS_BAD_TYPE;
+    }
+    haptic_trace(HAPTIC_TRACE_PARSE, tag, HAPTIC_TRACE_PACKET, status);
+    if (status == HP_STATUS_OK) {
+        hp_status_report_t report = { 0 };
+        cmd_run_commands(&pkt, tag, &report);
+    }
+}
+
+// Invoked for SET_REPORT control requests and for data on the OUT endpoint
+void tud_hid_set_report_cb(uint8_t instance, uint8_t report_id, hid_report_type_t report_type, uint8_t const *buffer,
+                           uint16_t bufsize)
+{
+    // reports from the OUT endpoint come with report ID 0 and the ID still
+    // in front of the data
+    if (report_id == 0 && report_type != HID_REPORT_TYPE_FEATURE && bufsize > 0) {
+        report_id = buffer[0];
+        report_type = HID_REPORT_TYPE_OUTPUT;
+        buffer++;
+        bufsize--;
+    }
+    if (report_type != HID_REPORT_TYPE_OUTPUT || xAudioCommandQueue == NULL) {
+        return;
+    }
+
+    uint16_t tag = haptic_trace_tag();
+    haptic_trace(HAPTIC_TRACE_USB_RX, tag, HAPTIC_TRACE_PACKET, bufsize);
+
+    if (report_id == HP_HID_REPORT_ID) {
+        handle_protocol_packet(buffer, bufsize, tag);
+    } else if (report_id == LEGACY_REPORT_ID && bufsize >= 1) {
+        audio_command_t cmd = {
+            .cmd = HP_OP_PLAY,
+            .audio_id = (char)buffer[0],
+            .intensity = 0xFF,
+            .trace_tag = tag,
+        };
+        haptic_trace(HAPTIC_TRACE_PARSE, tag, HAPTIC_TRACE_PACKET, HP_STATUS_OK);
+        haptic_trace(HAPTIC_TRACE_ENQUEUE, tag, 0, buffer[0]);
+        if (xQueueSend(xAudioCommandQueue, &cmd, 0) != pdTRUE) {
+            haptic_trace(HAPTIC_TRACE_DROP, tag, 0, buffer[0]);
+        }
+    }
+}
+
+/********* CDC port ***************/
+
+// TinyUSB task: the command task sleeps until the port has data, instead of
+// polling it
+static void cdc_rx_cb(int itf, cdcacm_event_t *event)
+{
+    xTaskNotifyGive(s_serial_task);
+}
+
+esp_err_t usb_composite_init(TaskHandle_t serial_task)
+{
+    s_serial_task = serial_task;
+
+    const tinyusb_config_t tusb_cfg = {
+        .device_descriptor = NULL,
+        .string_descriptor = hid_string_descriptor,
+        .string_descriptor_count = sizeof(hid_string_descriptor) / sizeof(hid_string_descriptor[0]),
+        .external_phy = false,
+        .configuration_descriptor = hid_configuration_descriptor,
+    };
+    ESP_RETURN_ON_ERROR(tinyusb_driver_install(&tusb_cfg), TAG, "TinyUSB install failed");
+
+    const tinyusb_config_cdcacm_t acm_cfg = {
+        .usb_dev = TINYUSB_USBDEV_0,
+        .cdc_port = TINYUSB_CDC_ACM_0,
+        .callback_rx = cdc_rx_cb,
+    };
+    return tusb_cdc_acm_init(&acm_cfg);
+}
+
+#endif
@@ -1,3 +1,5 @@
+importScripts('protocol.js');
+
 // listens for messages from content.js
 chrome.runtime.onMessage.addListener((request, sender, sendResponse) => {
   if (request.action === 'updateIcon') {
@@ -8,4 +10,85 @@ chrome.runtime.onMessage.addListener((request, sender, sendResponse) => {
     };
     chrome.action.setIcon({ path: iconPath });
   }
-});
\ No newline at end of file
+});
+
+// hapticd link. The WebSocket lives here rather than in the content
+// scripts, so it carries the extension's origin, which hapticd accepts by
+// default, and pages never touch the local port. Content scripts without a
+// WebHID device connect a port named HM_DAEMON_PORT: they receive the
+// daemon's packets as { packet } messages and { closed } when it goes away,
+// and send their records as { records }.
+const HM_DAEMON_PORT = 'hapticd';
+const HM_DAEMON_URL = 'ws://127.0.0.1:8765/';
+const HM_DAEMON_RETRY = 5000;        // ms between connection attempts while a tab waits
+
+const daemonPorts = new Set();
+let daemonSocket = null;
+let daemonHello = [];                // CAPS and EFFECTS packets, replayed to late ports
+let daemonRetry = 0;
+
+function connectHapticDaemon() {
+  if (daemonSocket || !daemonPorts.size) {
+    return;
+  }
+  const ws = new WebSocket(HM_DAEMON_URL);
+  ws.binaryType = 'arraybuffer';
+  daemonSocket = ws;
+
+  ws.onmessage = (event) => {
+    const bytes = new Uint8Array(event.data);
+    const packet = hpDecodePacket(bytes);
+    if (packet.error !== undefined || ws !== daemonSocket) {
+      return;
+    }
+    if (packet.type === HP_PKT.CAPS) {
+      daemonHello = [];
+    }
+    const message = { packet: Array.from(bytes) };
+    daemonHello.push(message);
+    daemonPorts.forEach(port => port.postMessage(message));
+  };
+  ws.onclose = () => {
+    if (ws !== daemonSocket) {
+      return;
+    }
+    daemonSocket = null;
+    if (daemonHello.length) {
+      daemonPorts.forEach(port => port.postMessage({ closed: true }));
+    }
+    daemonHello = [];
+    clearTimeout(daemonRetry);
+    daemonRetry = setTimeout(connectHapticDaemon, HM_DAEMON_RETRY);
+  };
+}
+
+function closeHapticDaemon() {
+  clearTimeout(daemonRetry);
+  const ws = daemonSocket;
+  daemonSocket = null;
+  daemonHello = [];
+  if (ws) {
+    ws.close();
+  }
+}
+
+chrome.runtime.onConnect.addListener((port) => {
+  if (port.name !== HM_DAEMON_PORT) {
+    return;
+  }
+  daemonPorts.add(port);
+  daemonHello.forEach(message => port.postMessage(message));
+  connectHapticDaemon();
+
+  port.onMessage.addListener((message) => {
+    if (message.records && daemonSocket && daemonSocket.readyState === WebSocket.OPEN) {
+      daemonSocket.send(new Uint8Array(message.records));
+    }
+  });
+  port.onDisconnect.addListener(() => {
+    daemonPorts.delete(port);
+    if (!daemonPorts.size) {
+      closeHapticDaemon();
+    }
+  });
+});
@@ -0,0 +1,424 @@
+#!/usr/bin/env node
+// Headless benchmark harness for the content scripts
+//
+// Loads interaction_test.html in headless Chrome, injects a stub navigator.hid
+// (fake_hid.js) and the content scripts listed in manifest.json, then replays
+// the scripted input traces in traces/. For every trace it reports
+// event-to-report latency, reports (USB transactions) and commands per
+// second, main-thread time and dropped events (expected feedback that never
+// reached the device), plus how many packets were scheduled on the device
+// clock and how many of them arrived after their target time.
+//
+// Usage:
+//   node bench.js [--trace NAME]... [--runs 3] [--json FILE] [--legacy]
+//                 [--write-baseline FILE] [--baseline FILE] [--tolerance 0.25]
+//
+// --legacy makes the fake device fail the capability query, so the plugin
+// falls back to one legacy report per command.
+//
+// Every trace is replayed --runs times and the median of each metric is
+// reported. With --baseline the process exits with status 1 when a trace
+// regresses beyond the tolerance, so it can gate plugin changes.
+
+const fs = require('fs');
+const path = require('path');
+const puppeteer = require('puppeteer');
+const hp = require('../protocol.js');
+
+const PLUGIN_DIR = path.resolve(__dirname, '..');
+const TEST_PAGE = path.resolve(PLUGIN_DIR, '..', 'interaction_test.html');
+const TRACE_DIR = path.join(__dirname, 'traces');
+const EFFECT_LIST = path.resolve(PLUGIN_DIR, '..', 'haptic-mouse-firmware-lra', 'main', 'drv2605_effects.c');
+
+const EXPECT_WINDOW_MS = 150;   // expected feedback must arrive within this time after a step
+const SETTLE_MS = 300;          // time for the profile to load and the device to connect
+
+function parseArgs(argv) {
+  const args = { traces: [], runs: 3, tolerance: 0.25 };
+  for (let i = 0; i < argv.length; i++) {
+    switch (argv[i]) {
+      case '--trace': args.traces.push(argv[++i]); break;
+      case '--runs': args.runs = Number(argv[++i]); break;
+      case '--json': args.json = argv[++i]; break;
+      case '--baseline': args.baseline = argv[++i]; break;
+      case '--write-baseline': args.writeBaseline = argv[++i]; break;
+      case '--tolerance': args.tolerance = Number(argv[++i]); break;
+      case '--legacy': args.legacy = true; break;
+      default:
+        console.error(`Unknown argument: ${argv[i]}`);
+        process.exit(2);
+    }
+  }
+  return args;
+}
+
+const sleep = ms => new Promise(resolve => setTimeout(resolve, ms));
+
+// The LRA firmware's effect catalog, from the X(id, ms, peak, category, name)
+// list it is built from; the fake device reports it in EFFECTS packets
+function loadEffectCatalog() {
+  const effects = [null];
+  const entry = /X\(\s*(\d+),\s*(\d+),\s*(\d+),\s*(\w+),/g;
+  for (const [, id, durationMs, peak, category] of fs.readFileSync(EFFECT_LIST, 'utf8').matchAll(entry)) {
+    effects[Number(id)] = { durationMs: Number(durationMs), peak: Number(peak), category: hp.HP_EFFECT_CATEGORY[category] };
+  }
+  return effects;
+}
+
+function percentile(sorted, p) {
+  if (!sorted.length) {
+    return 0;
+  }
+  const idx = Math.min(sorted.length - 1, Math.ceil((p / 100) * sorted.length) - 1);
+  return sorted[Math.max(0, idx)];
+}
+
+// Command records carried by a recorded report
+function reportRecords(report) {
+  if (report.reportId !== hp.HP_HID_REPORT_ID) {
+    return null;
+  }
+  const packet = hp.hpDecodePacket(Uint8Array.from(report.data));
+  return packet.error === undefined ? hp.hpDecodeRecords(packet.payload) : [];
+}
+
+// Effect IDs carried by a recorded report
+function decodeReport(report) {
+  const records = reportRecords(report);
+  if (records) {
+    return records
+      .filter(r => r.op === hp.HP_OP.PLAY || r.op === hp.HP_OP.PATTERN_START)
+      .map(r => r.effect);
+  }
+  if (report.reportId === 0x10) {
+    return [report.data[0]];
+  }
+  if (report.reportId === 0x11 && report.data[0] === 0x01) {
+    return [report.data[1]];   // pattern start
+  }
+  return [];
+}
+
+// Index of the last element of sorted array `arr` whose t is <= t
+function lastAtOrBefore(arr, t) {
+  let lo = 0;
+  let hi = arr.length - 1;
+  let found = -1;
+  while (lo <= hi) {
+    const mid = (lo + hi) >> 1;
+    if (arr[mid].t <= t) {
+      found = mid;
+      lo = mid + 1;
+    } else {
+      hi = mid - 1;
+    }
+  }
+  return found;
+}
+
+class Player {
+  constructor(page) {
+    this.page = page;
+    this.mouse = { x: 0, y: 0 };
+  }
+
+  async box(selector) {
+    return this.page.$eval(selector, el => {
+      el.scrollIntoView({ block: 'center' });
+      const r = el.getBoundingClientRect();
+      return { left: r.left, top: r.top, width: r.width, height: r.height,
+        x: r.left + r.width / 2, y: r.top + r.height / 2 };
+    });
+  }
+
+  async moveMouse(x, y, steps = 1, interval = 0) {
+    const from = Object.assign({}, this.mouse);
+    for (let i = 1; i <= steps; i++) {
+      await this.page.mouse.move(from.x + (x - from.x) * i / steps, from.y + (y - from.y) * i / steps);
+      if (interval) {
+        await sleep(interval);
+      }
+    }
+    this.mouse = { x, y };
+  }
+
+  async run(step) {
+    const repeat = step.repeat || 1;
+    const interval = step.interval || 0;
+    const page = this.page;
+
+    switch (step.action) {
+      case 'move': {
+        const b = await this.box(step.to);
+        await this.moveMouse(b.x, b.y, step.steps || 5, step.interval || 10);
+        break;
+      }
+      case 'moveTo': {
+        const b = await this.box(step.to);
+        await this.moveMouse(b.x, b.y, step.steps || 10, interval);
+        break;
+      }
+      case 'down': {
+        const b = await this.box(step.on);
+        await this.moveMouse(b.x, b.y);
+        await page.mouse.down();
+        break;
+      }
+      case 'up':
+        await page.mouse.up();
+        break;
+      case 'click': {
+        const b = await this.box(step.on);
+        await this.moveMouse(b.x, b.y);
+        for (let i = 0; i < repeat; i++) {
+          await page.mouse.click(b.x, b.y);
+          await sleep(interval);
+        }
+        break;
+      }
+      case 'wheel': {
+        const b = await this.box(step.at);
+        await this.moveMouse(b.x, b.y);
+        for (let i = 0; i < repeat; i++) {
+          await page.mouse.wheel({ deltaX: step.dx || 0, deltaY: step.dy || 0 });
+          await sleep(interval);
+        }
+        break;
+      }
+      case 'select': {
+        const b = await this.box(step.on);
+        await this.moveMouse(b.left + 4, b.top + 10);
+        await page.mouse.down();
+        await this.moveMouse(b.left + b.width * 0.8, b.top + b.height * 0.6, step.steps || 10, interval);
+        await page.mouse.up();
+        break;
+      }
+      case 'wait':
+        await sleep(step.ms || 0);
+        break;
+      default:
+        throw new Error(`Unknown trace action: ${step.action}`);
+    }
+  }
+}
+
+async function openTestPage(browser, legacy) {
+  const manifest = JSON.parse(fs.readFileSync(path.join(PLUGIN_DIR, 'manifest.json'), 'utf8'));
+  const scripts = manifest.content_scripts[0].js;
+
+  const page = await browser.newPage();
+  await page.setViewport({ width: 1280, height: 1000 });
+  page.on('pageerror', err => console.error(`[page] ${err.message}`));
+  if (legacy) {
+    await page.evaluateOnNewDocument(() => { window.__hmBenchLegacy = true; });
+  }
+  await page.evaluateOnNewDocument(effects => { window.__hmBenchEffects = effects; }, loadEffectCatalog());
+  await page.evaluateOnNewDocument(fs.readFileSync(path.join(__dirname, 'fake_hid.js'), 'utf8'));
+  await page.goto(`file://${TEST_PAGE}`, { waitUntil: 'load' });
+
+  // Chrome injects content scripts at document_idle, after the load event
+  for (const script of scripts) {
+    await page.addScriptTag({ path: path.join(PLUGIN_DIR, script) });
+  }
+
+  // Connect the fake device through the floating button
+  await page.evaluate(() => {
+    const button = [...document.querySelectorAll('button')].find(b => b.textContent === 'Connect HID Device');
+    button.click();
+  });
+  await sleep(SETTLE_MS);
+  return page;
+}
+
+async function runTrace(browser, trace, legacy) {
+  const page = await openTestPage(browser, legacy);
+  const player = new Player(page);
+
+  const effectOf = await page.evaluate(() =>
+    Object.fromEntries(HM_TYPE_NAMES.map(name => [name, hapticTable.effect[HM_TYPE[name]]])));
+
+  await page.evaluate(() => window.__hmBench.reset());
+  const metricsBefore = await page.metrics();
+  const windows = [];
+
+  for (const step of trace.steps) {
+    const t0 = await page.evaluate(() => performance.now());
+    await player.run(step);
+    const t1 = await page.evaluate(() => performance.now());
+    windows.push({ step, t0, t1 });
+  }
+  await sleep(EXPECT_WINDOW_MS);
+
+  const metricsAfter = await page.metrics();
+  const { reports, inputs, tEnd, snap } = await page.evaluate(() => ({
+    reports: window.__hmBench.reports,
+    inputs: window.__hmBench.inputs,
+    tEnd: performance.now(),
+    snap: typeof snapStatsSummary === 'function' ? snapStatsSummary() : null
+  }));
+  await page.close();
+
+  // Event-to-report latency: each report is attributed to the most recent input
+  const latencies = [];
+  reports.forEach(r => {
+    const i = lastAtOrBefore(inputs, r.t);
+    if (i >= 0) {
+      latencies.push(r.t - inputs[i].t);
+    }
+  });
+  latencies.sort((a, b) => a - b);
+
+  // Dropped: expected feedback of a step that was never sent
+  let expected = 0;
+  let dropped = 0;
+  windows.forEach(({ step, t0, t1 }) => {
+    (step.expect || []).forEach(type => {
+      const effect = effectOf[type];
+      if (!effect) {
+        return;   // disabled in the active profile
+      }
+      expected++;
+      const hit = reports.some(r => r.t >= t0 && r.t <= t1 + EXPECT_WINDOW_MS && decodeReport(r).includes(effect));
+      if (!hit) {
+        dropped++;
+      }
+    });
+  });
+
+  // Commands: one per legacy report, one per record of a protocol packet
+  const commands = reports.reduce((n, r) => n + (reportRecords(r) || [r]).length, 0);
+  const scheduled = reports.filter(r => r.late !== null);
+
+  const duration = (tEnd - windows[0].t0) / 1000;
+  const mainThread = (metricsAfter.TaskDuration - metricsBefore.TaskDuration) * 1000;
+  const script = (metricsAfter.ScriptDuration - metricsBefore.ScriptDuration) * 1000;
+
+  return {
+    name: trace.name,
+    inputs: inputs.length,
+    reports: reports.length,
+    reportsPerSec: reports.length / duration,
+    commands,
+    scheduled: scheduled.length,
+    late: scheduled.filter(r => r.late).length,
+    latencyP50: percentile(latencies, 50),
+    latencyP95: percentile(latencies, 95),
+    latencyMax: latencies.length ? latencies[latencies.length - 1] : 0,
+    mainThreadMs: mainThread,
+    scriptMs: script,
+    expected,
+    dropped,
+    snapPredictions: snap ? snap.predictions : 0,
+    snapHitRate: snap ? snap.hitRate : 0,
+    snapSavedMs: snap ? snap.avgSavedMs : 0,
+    durationSec: duration
+  };
+}
+
+// Median of every numeric metric over several runs of the same trace
+function medianResult(runs) {
+  const out = { name: runs[0].name };
+  Object.keys(runs[0]).forEach(key => {
+    if (typeof runs[0][key] === 'number') {
+      const values = runs.map(r => r[key]).sort((a, b) => a - b);
+      out[key] = values[(values.length - 1) >> 1];
+    }
+  });
+  return out;
+}
+
+function printReport(results) {
+  const fmt = (v, d = 1) => v.toFixed(d).padStart(8);
+  console.log('trace        inputs  reports  rep/s     cmds   lat p50  lat p95  lat max  main ms  script ms  dropped');
+  results.forEach(r => {
+    console.log(
+      r.name.padEnd(12) +
+      String(r.inputs).padStart(7) +
+      String(r.reports).padStart(9) +
+      fmt(r.reportsPerSec) +
+      String(r.commands).padStart(9) +
+      fmt(r.latencyP50) + ' ' +
+      fmt(r.latencyP95) + ' ' +
+      fmt(r.latencyMax) + ' ' +
+      fmt(r.mainThreadMs) + '  ' +
+      fmt(r.scriptMs) + '  ' +
+      `${r.dropped}/${r.expected}`.padStart(7)
+    );
+  });
+  results.filter(r => r.scheduled).forEach(r => {
+    console.log(`${r.name}: ${r.scheduled} scheduled packets, ${r.late} late`);
+  });
+  results.filter(r => r.snapPredictions).forEach(r => {
+    console.log(`${r.name}: snap predictor ${r.snapPredictions} predictions, ` +
+      `hit rate ${(r.snapHitRate * 100).toFixed(0)}%, ${r.snapSavedMs.toFixed(1)} ms saved per hit`);
+  });
+}
+
+// Compare against a baseline; returns a list of regression messages
+function compareBaseline(results, baseline, tolerance) {
+  const failures = [];
+  const limit = (base, slack) => base * (1 + tolerance) + slack;
+  results.forEach(r => {
+    const b = baseline.find(x => x.name === r.name);
+    if (!b) {
+      return;
+    }
+    if (r.latencyP95 > limit(b.latencyP95, 2)) {
+      failures.push(`${r.name}: p95 latency ${r.latencyP95.toFixed(1)} ms > baseline ${b.latencyP95.toFixed(1)} ms`);
+    }
+    if (r.reportsPerSec > limit(b.reportsPerSec, 1)) {
+      failures.push(`${r.name}: ${r.reportsPerSec.toFixed(1)} reports/s > baseline ${b.reportsPerSec.toFixed(1)}`);
+    }
+    if (r.mainThreadMs > limit(b.mainThreadMs, 5)) {
+      failures.push(`${r.name}: main thread ${r.mainThreadMs.toFixed(1)} ms > baseline ${b.mainThreadMs.toFixed(1)} ms`);
+    }
+    if (r.dropped > b.dropped) {
+      failures.push(`${r.name}: ${r.dropped} dropped events > baseline ${b.dropped}`);
+    }
+  });
+  return failures;
+}
+
+async function main() {
+  const args = parseArgs(process.argv.slice(2));
+  const names = args.traces.length
+    ? args.traces
+    : fs.readdirSync(TRACE_DIR).filter(f => f.endsWith('.json')).map(f => f.replace(/\.json$/, '')).sort();
+
+  const browser = await puppeteer.launch({ headless: 'shell', args: ['--no-sandbox'] });
+  const results = [];
+  try {
+    for (const name of names) {
+      const trace = JSON.parse(fs.readFileSync(path.join(TRACE_DIR, `${name}.json`), 'utf8'));
+      const runs = [];
+      for (let i = 0; i < args.runs; i++) {
+        runs.push(await runTrace(browser, trace, args.legacy));
+      }
+      results.push(medianResult(runs));
+    }
+  } finally {
+    await browser.close();
+  }
+
+  printReport(results);
+
+  if (args.json) {
+    fs.writeFileSync(args.json, JSON.stringify(results, null, 2));
+  }
+  if (args.writeBaseline) {
+    fs.writeFileSync(args.writeBaseline, JSON.stringify(results, null, 2));
+  }
+  if (args.baseline) {
+    const baseline = JSON.parse(fs.readFileSync(args.baseline, 'utf8'));
+    const failures = compareBaseline(results, baseline, args.tolerance);
+    failures.forEach(f => console.error(`REGRESSION ${f}`));
+    if (failures.length) {
+      process.exit(1);
+    }
+  }
+}
+
+main().catch(err => {
+  console.error(err);
+  process.exit(2);
+});
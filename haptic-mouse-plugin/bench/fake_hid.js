@@ -0,0 +1,184 @@
+// Stubs for the extension and WebHID APIs used by the content scripts.
+// Injected into the test page before any other script runs. Every
+// sendReport() call and every user input event is recorded with its
+// performance.now() timestamp in window.__hmBench.
+//
+// The device answers the capability query and the effect catalog reads
+// (window.__hmBenchEffects, from bench.js) like the current LRA firmware, or
+// fails them like legacy firmware when window.__hmBenchLegacy is set.
+// sendReport() resolves after TRANSFER_MS, about one USB control transfer.
+// Its clock runs DRIFT fast and wraps the 32-bit µs range shortly after the
+// page loads; scheduled packets that arrive after their target count as late.
+(() => {
+  const reports = [];
+  const inputs = [];
+  const TRANSFER_MS = 2;
+  const CLOCK_OFFSET_US = 2 ** 32 - 2e6;
+  const DRIFT = 40e-6;
+  const schedule = { scheduled: 0, late: 0 };
+  let effectsNext = 1;
+
+  const deviceNow = () => Math.floor((performance.now() * 1000 + CLOCK_OFFSET_US) * (1 + DRIFT));
+
+  // Count scheduled packets and those that arrive after their target time
+  function trackSchedule(reportId, bytes, deviceUs) {
+    if (typeof hpDecodePacket !== 'function' || reportId !== HP_HID_REPORT_ID) {
+      return null;
+    }
+    const packet = hpDecodePacket(bytes);
+    if (packet.error !== undefined || packet.at === null) {
+      return null;
+    }
+    const late = ((packet.at - deviceUs) | 0) < 0;
+    schedule.scheduled++;
+    schedule.late += late ? 1 : 0;
+    return late;
+  }
+
+  // chrome.storage.local / chrome.runtime
+  const store = {};
+  const changeListeners = [];
+
+  function pick(keys) {
+    if (keys == null) {
+      return Object.assign({}, store);
+    }
+    const out = {};
+    [].concat(keys).forEach(k => {
+      if (k in store) {
+        out[k] = JSON.parse(JSON.stringify(store[k]));
+      }
+    });
+    return out;
+  }
+
+  function notify(changes) {
+    changeListeners.forEach(fn => setTimeout(() => fn(changes, 'local'), 0));
+  }
+
+  window.chrome = {
+    storage: {
+      local: {
+        get(keys, cb) { setTimeout(() => cb(pick(keys)), 0); },
+        set(items, cb) {
+          const changes = {};
+          Object.keys(items).forEach(k => {
+            changes[k] = { oldValue: store[k], newValue: items[k] };
+            store[k] = JSON.parse(JSON.stringify(items[k]));
+          });
+          notify(changes);
+          if (cb) setTimeout(cb, 0);
+        },
+        remove(keys, cb) {
+          const changes = {};
+          [].concat(keys).forEach(k => {
+            changes[k] = { oldValue: store[k] };
+            delete store[k];
+          });
+          notify(changes);
+          if (cb) setTimeout(cb, 0);
+        }
+      },
+      onChanged: { addListener(fn) { changeListeners.push(fn); } }
+    },
+    runtime: {
+      sendMessage() {},
+      onMessage: { addListener() {} },
+      // the background script's hapticd port; no daemon in the bench
+      connect(info) {
+        return {
+          name: info.name,
+          postMessage() {},
+          disconnect() {},
+          onMessage: { addListener() {} },
+          onDisconnect: { addListener() {} }
+        };
+      }
+    }
+  };
+
+  // navigator.hid with a single fake device
+  const device = {
+    opened: false,
+    productName: 'Haptic Mouse (bench)',
+    vendorId: 0x303a,
+    productId: 0x4004,
+    manufacturerName: 'TinyUSB',
+    collections: [],
+    async open() { this.opened = true; },
+    async close() { this.opened = false; },
+    sendReport(reportId, data) {
+      const bytes = new Uint8Array(data.buffer || data);
+      const late = trackSchedule(reportId, bytes, deviceNow());
+      reports.push({ t: performance.now(), reportId, data: Array.from(bytes), late });
+      return new Promise(resolve => setTimeout(resolve, TRANSFER_MS));
+    },
+    async sendFeatureReport() {},
+    async receiveFeatureReport(reportId) {
+      // protocol.js is loaded with the content scripts before this is called
+      const legacy = window.__hmBenchLegacy;
+      const catalog = window.__hmBenchEffects || [];
+      let packet = null;
+      if (!legacy && reportId === HP_HID_CAPS_REPORT_ID) {
+        const caps = hpEncodeCaps({
+          versionMin: 1, versionMax: 1, deviceKind: HP_DEVICE.LRA, actuatorCount: 1,
+          maxRecords: HP_HID_MAX_RECORDS, scheduleLeadMs: 3, effectCount: catalog.length,
+          features: HP_CAP.INTENSITY | HP_CAP.PATTERN | HP_CAP.QUEUE | HP_CAP.SCHEDULE, minPeriodMs: 10
+        });
+        packet = hpEncodePacket(HP_PKT.CAPS, 0, 0, caps, HP_HID_REPORT_SIZE);
+        effectsNext = 1;
+      } else if (!legacy && reportId === HP_HID_TIME_REPORT_ID) {
+        const time = hpEncodeTime({ deviceUs: deviceNow(), scheduled: schedule.scheduled, late: schedule.late });
+        packet = hpEncodePacket(HP_PKT.TIME, 0, 0, time, HP_HID_REPORT_SIZE);
+      } else if (!legacy && reportId === HP_HID_EFFECTS_REPORT_ID && catalog.length) {
+        // as the firmware: successive chunks, then an empty packet that
+        // rewinds to the first effect, as does a CAPS read
+        const chunk = catalog.slice(effectsNext, effectsNext + HP_HID_MAX_EFFECTS);
+        const effects = hpEncodeEffects(chunk.length ? effectsNext : 0, chunk);
+        effectsNext = chunk.length ? effectsNext + chunk.length : 1;
+        packet = hpEncodePacket(HP_PKT.EFFECTS, 0, 0, effects, HP_HID_REPORT_SIZE);
+      }
+      if (!packet) {
+        throw new DOMException('Failed to receive the feature report.', 'NotAllowedError');
+      }
+      const out = new Uint8Array(1 + packet.length);
+      out[0] = reportId;
+      out.set(packet, 1);
+      return new DataView(out.buffer);
+    },
+    addEventListener() {},
+    removeEventListener() {}
+  };
+
+  Object.defineProperty(navigator, 'hid', {
+    configurable: true,
+    value: {
+      async requestDevice() { return [device]; },
+      async getDevices() { return [device]; },
+      addEventListener() {},
+      removeEventListener() {}
+    }
+  });
+
+  // Record user input as seen by the page (capture phase, before any handler)
+  ['mousedown', 'mouseup', 'mousemove', 'click', 'wheel', 'keydown'].forEach(type => {
+    window.addEventListener(type, e => {
+      if (e.isTrusted) {
+        inputs.push({ t: e.timeStamp, type });
+      }
+    }, true);
+  });
+
+  window.__hmBench = {
+    reports,
+    inputs,
+    device,
+    storage: store,
+    reset() {
+      reports.length = 0;
+      inputs.length = 0;
+      schedule.scheduled = 0;
+      schedule.late = 0;
+    }
+  };
+})();
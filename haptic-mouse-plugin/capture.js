@@ -0,0 +1,116 @@
+// Interaction capture
+//
+// An optional ring of compact binary records, one per command the content
+// script issues, exported from the popup and replayed with
+// tools/haptic_replay.py. Capturing costs one 12-byte write per command and
+// nothing while it is off.
+//
+// Export format, little endian: a 16-byte header (magic "HMCT", version u8,
+// record size u8, reserved u16, record count u32, records overwritten by the
+// ring u32), then the records oldest first. A record is: time u32 (µs since
+// the first record, wraps), interaction type u8 (HM_TYPE, 0xFF none), op u8,
+// effect u8, intensity u8, arg u16, flags u8, result u8.
+
+const HM_CAPTURE_MAGIC = 0x54434D48;   // "HMCT"
+const HM_CAPTURE_VERSION = 1;
+const HM_CAPTURE_HEADER_SIZE = 16;
+const HM_CAPTURE_RECORD_SIZE = 12;
+const HM_CAPTURE_RECORDS = 8192;       // ring capacity, ~96 KB
+const HM_CAPTURE_NO_TYPE = 0xFF;
+
+const HM_CAPTURE_FLAG_SCHEDULED = 0x01;  // issued for scheduled (rhythmic) playback
+
+// What became of a captured command
+const HM_CAPTURE_RESULT = Object.freeze({
+  PENDING: 0,     // queued, not sent yet (or still in flight at export)
+  SENT: 1,        // handed to WebHID or the daemon
+  NO_DEVICE: 2,   // dropped at issue, no output was open
+  ERROR: 3,       // the transfer carrying it failed
+  DISCARDED: 4    // dropped from the queue when the device went away
+});
+
+const HM_CAPTURE_STORAGE_ENABLED = 'hmCaptureEnabled';
+
+class HapticCapture {
+  constructor(capacity = HM_CAPTURE_RECORDS) {
+    this.capacity = capacity;
+    this.bytes = new Uint8Array(capacity * HM_CAPTURE_RECORD_SIZE);
+    this.view = new DataView(this.bytes.buffer);
+    this.clear();
+  }
+
+  clear() {
+    this.count = 0;       // records ever added; record n is at slot n % capacity
+    this.origin = 0;      // performance.now() of the first record
+  }
+
+  get overwritten() {
+    return Math.max(0, this.count - this.capacity);
+  }
+
+  // Append a command record issued at `now` (ms); returns its ID for
+  // setResult() and update()
+  add(now, type, record, result) {
+    if (this.count === 0) {
+      this.origin = now;
+    }
+    const id = this.count++;
+    const o = (id % this.capacity) * HM_CAPTURE_RECORD_SIZE;
+    const v = this.view;
+    v.setUint32(o, Math.round((now - this.origin) * 1000) >>> 0, true);
+    v.setUint8(o + 4, type >= 0 ? type : HM_CAPTURE_NO_TYPE);
+    v.setUint8(o + 5, record.op);
+    v.setUint8(o + 6, record.effect || 0);
+    v.setUint8(o + 7, record.intensity === undefined ? 255 : record.intensity);
+    v.setUint16(o + 8, record.arg || 0, true);
+    v.setUint8(o + 10, record.scheduled ? HM_CAPTURE_FLAG_SCHEDULED : 0);
+    v.setUint8(o + 11, result);
+    return id;
+  }
+
+  // Offset of a record still in the ring, -1 once overwritten or cleared
+  offset(id) {
+    if (id >= this.count || id < this.count - this.capacity) {
+      return -1;
+    }
+    return (id % this.capacity) * HM_CAPTURE_RECORD_SIZE;
+  }
+
+  setResult(id, result) {
+    const o = this.offset(id);
+    if (o >= 0) {
+      this.bytes[o + 11] = result;
+    }
+  }
+
+  // A queued record changed before it went out (merged pattern update)
+  update(id, record) {
+    const o = this.offset(id);
+    if (o >= 0) {
+      this.bytes[o + 7] = record.intensity;
+      this.view.setUint16(o + 8, record.arg || 0, true);
+    }
+  }
+
+  // Header and records oldest first, times relative to the oldest record
+  export() {
+    const n = Math.min(this.count, this.capacity);
+    const first = this.count - n;
+    const out = new Uint8Array(HM_CAPTURE_HEADER_SIZE + n * HM_CAPTURE_RECORD_SIZE);
+    const header = new DataView(out.buffer);
+    header.setUint32(0, HM_CAPTURE_MAGIC, true);
+    header.setUint8(4, HM_CAPTURE_VERSION);
+    header.setUint8(5, HM_CAPTURE_RECORD_SIZE);
+    header.setUint32(8, n, true);
+    header.setUint32(12, this.overwritten, true);
+
+    const start = n ? this.view.getUint32((first % this.capacity) * HM_CAPTURE_RECORD_SIZE, true) : 0;
+    for (let i = 0; i < n; i++) {
+      const o = ((first + i) % this.capacity) * HM_CAPTURE_RECORD_SIZE;
+      const d = HM_CAPTURE_HEADER_SIZE + i * HM_CAPTURE_RECORD_SIZE;
+      out.set(this.bytes.subarray(o, o + HM_CAPTURE_RECORD_SIZE), d);
+      header.setUint32(d, (this.view.getUint32(o, true) - start) >>> 0, true);
+    }
+    return out;
+  }
+}
@@ -0,0 +1,191 @@
+// Element classification
+//
+// content.js listens once at the document root and resolves the target of
+// every event to an interaction role here. Buttons, links, range inputs,
+// scroll containers and destructive actions are recognized from the markup;
+// a data-hm-type attribute overrides the guess ("none" opts a subtree out).
+// Results are cached per element in a WeakMap, so repeated events on the same
+// element cost one lookup and removed elements are collected with the page.
+
+const HM_ROLE = Object.freeze({
+  NONE: 0,        // nothing to feel; events bubble on to the ancestors
+  BUTTON: 1,
+  LINK: 2,
+  WARNING: 3,     // destructive action
+  RANGE: 4,
+  SCROLL: 5,
+  DRAG: 6,
+  SNAP_AREA: 7,
+  TEXT: 8,
+  IGNORE: 9       // data-hm-type="none": this element and its subtree
+});
+
+// data-hm-type values (the attribute always wins over the automatic guess)
+const HM_ROLE_OVERRIDES = {
+  button: HM_ROLE.BUTTON,
+  link: HM_ROLE.LINK,
+  warningButton: HM_ROLE.WARNING,
+  range: HM_ROLE.RANGE,
+  scroll: HM_ROLE.SCROLL,
+  drag: HM_ROLE.DRAG,
+  snapArea: HM_ROLE.SNAP_AREA,
+  selectableText: HM_ROLE.TEXT,
+  none: HM_ROLE.IGNORE
+};
+
+// Roles that own the events of their descendants (a click on the icon inside
+// a button is a button click)
+const HM_OWNER_ROLES = new Set([
+  HM_ROLE.BUTTON, HM_ROLE.LINK, HM_ROLE.WARNING, HM_ROLE.RANGE, HM_ROLE.DRAG, HM_ROLE.IGNORE
+]);
+
+const HM_BUTTON_INPUT_TYPES = new Set(['button', 'submit', 'reset', 'image']);
+
+// Labels and class names of destructive actions
+const HM_DESTRUCTIVE_LABEL = /\b(delete|remove|discard|destroy|erase|revoke|uninstall|unsubscribe|deactivate|empty trash)\b|删除|移除|清空/i;
+const HM_DESTRUCTIVE_CLASS = /\b(danger|destructive|btn-delete|btn-remove)\b/i;
+const HM_LABEL_MAX = 64;
+
+// element -> { role, owner }: the element's own role and the nearest
+// ancestor-or-self whose role owns events (null if none)
+let hmClassCache = new WeakMap();
+
+function hmLabelOf(el) {
+  const label = el.getAttribute('aria-label') || el.getAttribute('title') ||
+    (el.tagName === 'INPUT' ? el.value : el.textContent) || '';
+  return label.slice(0, HM_LABEL_MAX);
+}
+
+function hmIsDestructive(el) {
+  return HM_DESTRUCTIVE_CLASS.test(el.getAttribute('class') || '') || HM_DESTRUCTIVE_LABEL.test(hmLabelOf(el));
+}
+
+function hmIsScrollContainer(el) {
+  if (el === document.scrollingElement) {
+    return true;
+  }
+  const overflow = getComputedStyle(el);
+  return /auto|scroll/.test(overflow.overflowY + overflow.overflowX);
+}
+
+// Guess the role of a single element from its markup
+function hmGuessRole(el) {
+  const override = el.dataset && el.dataset.hmType;
+  if (override !== undefined) {
+    return HM_ROLE_OVERRIDES[override] || HM_ROLE.NONE;
+  }
+
+  const tag = el.tagName;
+  const role = el.getAttribute('role');
+  let guess = HM_ROLE.NONE;
+  if (tag === 'BUTTON' || tag === 'SUMMARY' || role === 'button' || role === 'menuitem' ||
+    (tag === 'INPUT' && HM_BUTTON_INPUT_TYPES.has(el.type))) {
+    guess = HM_ROLE.BUTTON;
+  } else if ((tag === 'A' && el.hasAttribute('href')) || role === 'link') {
+    guess = HM_ROLE.LINK;
+  } else if (tag === 'INPUT' && el.type === 'range') {
+    return HM_ROLE.RANGE;
+  } else if (el.getAttribute('draggable') === 'true') {
+    return HM_ROLE.DRAG;
+  }
+
+  if (guess !== HM_ROLE.NONE) {
+    return hmIsDestructive(el) ? HM_ROLE.WARNING : guess;
+  }
+  return HM_ROLE.NONE;
+}
+
+// Classify an element (cached). Scroll containers are only recognized for
+// elements that actually fire scroll events, see hmScrollRole().
+function hmClassify(el) {
+  let entry = hmClassCache.get(el);
+  if (entry) {
+    return entry;
+  }
+
+  const role = hmGuessRole(el);
+  const inherited = el.parentElement ? hmClassify(el.parentElement).owner : null;
+  let owner = inherited;
+  if (HM_OWNER_ROLES.has(role) && !(inherited && hmRoleOf(inherited) === HM_ROLE.IGNORE)) {
+    owner = el;
+  }
+
+  entry = { role, owner };
+  hmClassCache.set(el, entry);
+  return entry;
+}
+
+function hmRoleOf(el) {
+  return hmClassify(el).role;
+}
+
+// True if the element lies in a subtree opted out with data-hm-type="none"
+function hmIsIgnored(el) {
+  const owner = hmClassify(el).owner;
+  return owner !== null && hmRoleOf(owner) === HM_ROLE.IGNORE;
+}
+
+// Nearest element owning the events of `target`, or null
+function hmOwnerOf(target) {
+  if (!(target instanceof Element)) {
+    return null;
+  }
+  const owner = hmClassify(target).owner;
+  return owner && hmRoleOf(owner) !== HM_ROLE.IGNORE ? owner : null;
+}
+
+// Role of an element that fired a scroll event: SCROLL unless it is opted
+// out, overridden to something else, or scrolled only by script (overflow
+// hidden, e.g. carousels)
+function hmScrollRole(el) {
+  if (hmIsIgnored(el)) {
+    return HM_ROLE.NONE;
+  }
+  const entry = hmClassify(el);
+  if (entry.role === HM_ROLE.NONE && hmIsScrollContainer(el)) {
+    entry.role = HM_ROLE.SCROLL;
+  }
+  return entry.role === HM_ROLE.SCROLL ? HM_ROLE.SCROLL : HM_ROLE.NONE;
+}
+
+// Attributes that only feed the destructive-action guess of the element
+// itself; a change re-guesses that element but keeps its owner chain intact
+const HM_LABEL_ATTRIBUTES = new Set(['class', 'title', 'aria-label']);
+
+// Keep the cache in step with the DOM. Structural attribute changes and moved
+// subtrees can change any descendant, so they drop the whole cache; label and
+// text changes only re-guess the element or the button/link containing them.
+// Entries are rebuilt lazily on the next event.
+function hmOnMutations(mutations) {
+  for (const m of mutations) {
+    if (m.type === 'attributes') {
+      if (!HM_LABEL_ATTRIBUTES.has(m.attributeName)) {
+        hmClassCache = new WeakMap();
+        return;
+      }
+      hmClassCache.delete(m.target);
+      continue;
+    }
+    for (const node of m.addedNodes) {
+      if (hmClassCache.has(node)) {
+        hmClassCache = new WeakMap();
+        return;
+      }
+    }
+    const entry = hmClassCache.get(m.target);
+    if (entry && entry.owner) {
+      hmClassCache.delete(entry.owner);
+    }
+  }
+}
+
+function hmWatchClassification(root) {
+  const observer = new MutationObserver(hmOnMutations);
+  observer.observe(root, {
+    childList: true,
+    subtree: true,
+    attributes: true,
+    attributeFilter: ['data-hm-type', 'class', 'role', 'type', 'href', 'draggable', 'aria-label', 'title']
+  });
+  return observer;
+}
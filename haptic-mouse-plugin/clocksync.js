@@ -0,0 +1,87 @@
+// Device clock synchronization
+//
+// Maps performance.now() to the device's esp_timer clock so commands can be
+// scheduled for a device time (HP_PKT_FLAG_AT, protocol.js). Each exchange
+// reads the device clock between two host timestamps; the device time is
+// paired with the midpoint. Exchanges with a slow round trip carry queuing
+// delay and are left out, and a line fitted through the rest gives the
+// offset and the drift of the crystal against the host clock.
+
+const HM_CLOCK_WINDOW = 30;          // exchanges kept for the fit
+const HM_CLOCK_MIN_SAMPLES = 4;      // exchanges before the estimate is used
+const HM_CLOCK_MIN_SPAN = 2000;      // ms of history before drift is estimated
+const HM_CLOCK_RTT_SLACK = 1;        // ms over the fastest round trip still trusted
+
+class DeviceClock {
+  constructor() {
+    this.reset();
+  }
+
+  reset() {
+    this.samples = [];
+    this.base = 0;       // host time (ms) of the fit's reference point
+    this.offset = 0;     // device time (µs) at `base`
+    this.rate = 1000;    // device µs per host ms
+    this.rtt = 0;        // fastest round trip in the window (ms)
+  }
+
+  // t0 / t1: performance.now() before and after the exchange,
+  // deviceUs: device clock read in between
+  addSample(t0, t1, deviceUs) {
+    this.samples.push({ host: (t0 + t1) / 2, device: deviceUs, rtt: t1 - t0 });
+    if (this.samples.length > HM_CLOCK_WINDOW) {
+      this.samples.shift();
+    }
+    this.fit();
+  }
+
+  fit() {
+    this.rtt = Math.min(...this.samples.map(s => s.rtt));
+    const good = this.samples.filter(s => s.rtt <= 2 * this.rtt + HM_CLOCK_RTT_SLACK);
+    const n = good.length;
+
+    // least squares around the mean, so the large device values stay exact
+    let mh = 0;
+    let md = 0;
+    good.forEach(s => { mh += s.host / n; md += s.device / n; });
+    let rate = 1000;
+    if (good[n - 1].host - good[0].host >= HM_CLOCK_MIN_SPAN) {
+      let sxy = 0;
+      let sxx = 0;
+      good.forEach(s => {
+        sxy += (s.host - mh) * (s.device - md);
+        sxx += (s.host - mh) * (s.host - mh);
+      });
+      rate = sxy / sxx;
+    }
+    this.base = mh;
+    this.offset = md;
+    this.rate = rate;
+  }
+
+  get synced() {
+    return this.samples.length >= HM_CLOCK_MIN_SAMPLES;
+  }
+
+  get driftPpm() {
+    return (this.rate / 1000 - 1) * 1e6;
+  }
+
+  // Device time (µs) at host time `hostMs`
+  toDevice(hostMs) {
+    return this.offset + this.rate * (hostMs - this.base);
+  }
+
+  summary() {
+    return {
+      samples: this.samples.length,
+      rttMs: this.rtt,
+      driftPpm: this.driftPpm
+    };
+  }
+}
+
+// Node (bench) loads this file as a module
+if (typeof module !== 'undefined') {
+  module.exports = { DeviceClock };
+}
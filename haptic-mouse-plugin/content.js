@@ -7,10 +7,12 @@ async function disconnectDevice() {
     await currentDevice.close();
   }
   currentDevice = null;
+  resetHapticOutput();
   chrome.storage.local.remove('connectedHIDDevices');
   updateExtensionIcon(false);
   floatingButton.textContent = 'Connect HID Device';
   floatingButton.style.backgroundColor = '#2196F3';
+  connectHapticDaemon();
 }
 
 // Update extension icon
@@ -24,6 +26,7 @@ function updateExtensionIcon(connected) {
 // Create floating button
 const floatingButton = document.createElement('button');
 floatingButton.textContent = 'Connect HID Device';
+floatingButton.dataset.hmType = 'none';
 floatingButton.style.cssText = `
   position: fixed;
   bottom: 20px;
@@ -58,7 +61,9 @@ floatingButton.addEventListener('click', async () => {
 
       // Try to open device connection
       await device.open();
+      closeHapticDaemon();
       currentDevice = device;
+      await configureHapticOutput(device);
 
       const deviceInfo = {
         productName: device.productName,
@@ -104,297 +109,804 @@ chrome.runtime.onMessage.addListener((request, sender, sendResponse) => {
     const div = document.createElement('div');
     div.innerHTML = request.content;
     document.body.appendChild(div);
+  } else if (request.action === 'getDynamicsStats') {
+    sendResponse(snapStatsSummary());
+  } else if (request.action === 'captureStatus') {
+    sendResponse({ enabled: hapticCaptureOn, records: Math.min(hapticCapture.count, hapticCapture.capacity),
+      overwritten: hapticCapture.overwritten });
+  } else if (request.action === 'exportCapture') {
+    // messages are JSON; the popup turns the array back into bytes
+    sendResponse({ bytes: Array.from(hapticCapture.export()) });
+  } else if (request.action === 'clearCapture') {
+    hapticCapture.clear();
+    sendResponse({});
   }
 });
 
-// Add hm-monitor functionality
-function initHMMonitor() {
-  // Haptic feedback intensity constants
-  const HAPTIC_FEEDBACK = {
-    BUTTON_CLICKED: 1,      // 普通按钮点击的反馈
+// Interaction capture (see capture.js), off unless enabled from the popup
+const hapticCapture = new HapticCapture();
+let hapticCaptureOn = false;
 
-    SCROLL_CONTINUOUS: 123,    // 持续滚动时的轻微反馈
-    SCROLL_BOUNDARY: 81,     // 滚动到顶部/底部的强反馈
+chrome.storage.local.get([HM_CAPTURE_STORAGE_ENABLED], (result) => {
+  hapticCaptureOn = !!result[HM_CAPTURE_STORAGE_ENABLED];
+});
+
+// Compiled dispatch table of the active haptic profile (see profiles.js)
+let hapticTable = compileProfile(HM_BUILTIN_PROFILES[HM_DEFAULT_PROFILE]);
 
-    DRAG_START_END: 24,      // 开始/结束拖拽时的反馈
-    DRAG_CONTINUOUS: 57,     // 拖拽过程中的反馈
-    SNAP_DETACH: 34,         // 从吸附区域脱离时的反馈
-    SNAP_ATTACHED: 77,      // 元素吸附到目标区域的反馈
+function applyHapticProfile() {
+  loadHapticProfiles((profiles, active) => {
+    // Cancel trailing reports scheduled by the previous table
+    hapticTable.pending.forEach(id => id && clearTimeout(id));
+    stopHapticPattern(activePattern.type);
+    hapticTable = compileProfile(profiles[active]);
+    console.log(`[hm-monitor] Haptic profile "${active}" loaded`);
+  });
+}
 
-    HOVER_WARNING: 16,       // 警告按钮悬停的反馈
-    WARNING_CLICKED: 14,    // 警告按钮点击的强反馈
+applyHapticProfile();
 
-    TEXT_SELECTED: 26        // 文本选择的轻微反馈
-  };
+// Profile edits from the popup take effect live in every tab
+chrome.storage.onChanged.addListener((changes, areaName) => {
+  if (areaName === 'local' && (changes[HM_STORAGE_PROFILES] || changes[HM_STORAGE_ACTIVE])) {
+    applyHapticProfile();
+  }
+  if (areaName === 'local' && changes[HM_CAPTURE_STORAGE_ENABLED]) {
+    hapticCaptureOn = !!changes[HM_CAPTURE_STORAGE_ENABLED].newValue;
+  }
+});
+
+// Emit the haptic feedback configured for an interaction type, honoring the
+// type's rate limit and coalescing policy. For continuous types, `speed`
+// (px/ms, see dynamics.js) picks a stronger effect and a denser rate.
+function emitHaptic(type, speed = -1) {
+  const table = hapticTable;
+  let effect = table.effect[type];
+  if (effect === 0) {
+    return;
+  }
 
-  const monitoredElements = document.querySelectorAll("[data-hm-type]");
+  let period = table.minInterval[type];
+  const refSpeed = HM_REF_SPEED[type];
+  if (speed >= 0 && refSpeed > 0) {
+    effect = speedToEffect(effect, speed, refSpeed);
+    period = speedToPeriod(period || PATTERN_DEFAULT_PERIOD, speed, refSpeed);
+  }
 
-  monitoredElements.forEach(el => {
-    // Check if element has already been initialized
-    if (el.dataset.hmInitialized === 'true') {
-      return;
+  const now = performance.now();
+  const rhythmic = refSpeed > 0;
+  if (table.coalesce[type] === HM_COALESCE.PATTERN) {
+    runHapticPattern(type, now, effect, period || PATTERN_DEFAULT_PERIOD, table.intensity[type]);
+    return;
+  }
+
+  const wait = table.lastSent[type] + period - now;
+  if (wait > 0) {
+    if (table.coalesce[type] === HM_COALESCE.TRAILING && !table.pending[type]) {
+      table.pending[type] = setTimeout(() => {
+        table.pending[type] = 0;
+        table.lastSent[type] = performance.now();
+        sendHapticFeedback(effect, table.intensity[type], rhythmic, type);
+      }, wait);
     }
+    return;
+  }
 
-    const type = el.dataset.hmType;
+  table.lastSent[type] = now;
+  sendHapticFeedback(effect, table.intensity[type], rhythmic, type);
+}
 
-    switch (type) {
-      case "button": {
-        el.addEventListener("click", () => {
-          console.log("[hm-monitor] Button clicked:", el.textContent);
-          sendHapticFeedback(HAPTIC_FEEDBACK.BUTTON_CLICKED);
-        });
-        // Mark element as initialized
-        el.dataset.hmInitialized = 'true';
-        break;
+// Device-side continuous patterns. While an interaction of a PATTERN type
+// keeps going, the device repeats the effect on its own timer; the host only
+// sends start, rate updates, keep-alives and stop.
+const PATTERN_DEFAULT_PERIOD = 50;   // ms, used when the profile has no rate limit
+const PATTERN_IDLE_STOP = 150;       // ms without activity before the pattern stops
+const PATTERN_KEEPALIVE = 1000;      // ms, must stay below the firmware timeout (2 s)
+const PATTERN_UPDATE_GAP = 100;      // ms, minimum spacing of rate/effect changes
+const PATTERN_UPDATE_RATIO = 0.15;   // relative period change worth an update
+
+const activePattern = { type: -1, effect: 0, period: 0, lastActivity: 0, lastUpdate: 0, timer: 0 };
+
+function runHapticPattern(type, now, effect, period, intensity) {
+  // a repetition arriving before the previous one has played out cuts off
+  // its brake; keep the period at least as long as an effect that has one
+  period = Math.max(period, hapticEffectMinPeriod(effect));
+  const sinceUpdate = now - activePattern.lastUpdate;
+  if (activePattern.type !== type || (sinceUpdate > PATTERN_UPDATE_GAP && activePattern.effect !== effect)) {
+    // START replaces whatever pattern the device is running
+    activePattern.type = type;
+    activePattern.effect = effect;
+    activePattern.period = period;
+    activePattern.lastUpdate = now;
+    sendPatternCommand(HP_OP.PATTERN_START, effect, period, intensity, HM_REF_SPEED[type] > 0, type);
+  } else if (sinceUpdate > PATTERN_KEEPALIVE ||
+    (sinceUpdate > PATTERN_UPDATE_GAP &&
+      Math.abs(period - activePattern.period) > PATTERN_UPDATE_RATIO * activePattern.period)) {
+    activePattern.period = period;
+    activePattern.lastUpdate = now;
+    sendPatternCommand(HP_OP.PATTERN_UPDATE, 0, period, intensity, false, type);
+  }
+  activePattern.lastActivity = now;
+
+  // One idle check timer per pattern instead of re-arming on every event
+  if (!activePattern.timer) {
+    activePattern.timer = setInterval(() => {
+      const idle = Math.max(PATTERN_IDLE_STOP, 2 * activePattern.period);
+      if (performance.now() - activePattern.lastActivity > idle) {
+        stopHapticPattern(activePattern.type);
       }
+    }, PATTERN_IDLE_STOP / 2);
+  }
+}
 
-      case "scroll": {
-        const scrollElement = el;
-        let lastScrollTop = scrollElement.scrollTop;
-        let lastEmitTime = 0;
-        let lastScrollPercentage = -1;
-        let atTopEmitted = true;
-        let atBottomEmitted = false;
-
-        const throttleGap = 50; // ms: controls minimum output interval for "scrolling"
-
-        setInterval(() => {
-          const currentScrollTop = scrollElement.scrollTop;
-          const scrollHeight = scrollElement.scrollHeight;
-          const clientHeight = scrollElement.clientHeight;
-          const scrollPercentage = Math.round((currentScrollTop / (scrollHeight - clientHeight)) * 100);
-
-          // Detect "scrolling" with throttling
-          if (Math.abs(currentScrollTop - lastScrollTop) > 1) {
-            const now = Date.now();
-            if (now - lastEmitTime > throttleGap) {
-              console.log(`[hm-monitor] Scrolling... Current position: ${currentScrollTop}px, ${scrollPercentage}%`);
-              sendHapticFeedback(HAPTIC_FEEDBACK.SCROLL_CONTINUOUS);
-              lastEmitTime = now;
-            }
-            lastScrollTop = currentScrollTop;
-          }
-
-          // Detect if reached top (one-time output)
-          if (scrollPercentage === 0 && !atTopEmitted) {
-            console.log("[hm-monitor] Scrolled to top");
-            sendHapticFeedback(HAPTIC_FEEDBACK.SCROLL_BOUNDARY);
-            atTopEmitted = true;
-          } else if (scrollPercentage > 0) {
-            atTopEmitted = false;
-          }
-
-          // Detect if reached bottom (one-time output)
-          if (scrollPercentage === 100 && !atBottomEmitted) {
-            console.log("[hm-monitor] Scrolled to bottom");
-            sendHapticFeedback(HAPTIC_FEEDBACK.SCROLL_BOUNDARY);
-            atBottomEmitted = true;
-          } else if (scrollPercentage < 100) {
-            atBottomEmitted = false;
-          }
-
-          lastScrollPercentage = scrollPercentage;
-        }, 50);
-
-        // Mark element as initialized
-        el.dataset.hmInitialized = 'true';
-        break;
-      }
+function stopHapticPattern(type) {
+  if (activePattern.type !== type || type < 0) {
+    return;
+  }
+  clearInterval(activePattern.timer);
+  activePattern.timer = 0;
+  activePattern.type = -1;
+  sendPatternCommand(HP_OP.PATTERN_STOP, 0, 0, 0, false, type);
+}
 
-      case "drag": {
-        const drag = el;
-        const snapAreas = document.querySelectorAll('[data-hm-type="snapArea"]');
-        const threshold = 20;
-        let lastSnapped = null;
-        let isDragging = false;
-        let isSnapping = false;
-
-        function getCenter(el) {
-          const rect = el.getBoundingClientRect();
-          return {
-            x: rect.left + rect.width / 2,
-            y: rect.top + rect.height / 2
-          };
-        }
+// hm-monitor: one set of listeners at the document root. Every event is
+// resolved to the element that owns it through the classification cache in
+// classify.js, so the listener count does not grow with the page.
 
-        function getDistance(p1, p2) {
-          const dx = p1.x - p2.x;
-          const dy = p1.y - p2.y;
-          return Math.sqrt(dx * dx + dy * dy);
-        }
+// Per scroll container state, created on its first scroll event
+const scrollStates = new WeakMap();
 
-        // Check snap areas
-        function checkSnapping() {
-          const dragCenter = getCenter(drag);
-          let snappedTo = null;
-
-          snapAreas.forEach(area => {
-            const areaCenter = getCenter(area);
-            const dist = getDistance(dragCenter, areaCenter);
-            if (dist < threshold) {
-              snappedTo = area.id || "Unnamed snap area";
-            }
-          });
-
-          if (snappedTo && snappedTo !== lastSnapped) {
-            isSnapping = true;
-            console.log(`[hm-monitor] Plugin detected: Snapped to ${snappedTo}`);
-            sendHapticFeedback(HAPTIC_FEEDBACK.SNAP_ATTACHED);
-            lastSnapped = snappedTo;
-          } else if (!snappedTo && lastSnapped !== null) {
-            isSnapping = false;
-            console.log(`[hm-monitor] Plugin detected: Detached from ${lastSnapped}`);
-            sendHapticFeedback(HAPTIC_FEEDBACK.SNAP_DETACH);
-            lastSnapped = null;
-          }
-        }
+function onScroll(e) {
+  // Autoscroll while dragging: the drag texture takes precedence
+  if (dragState.el) {
+    return;
+  }
+  const scrollElement = e.target === document ? document.scrollingElement : e.target;
+  if (!scrollElement || hmScrollRole(scrollElement) !== HM_ROLE.SCROLL) {
+    return;
+  }
 
-        // Don't interfere with dragging, only detect drag state
-        drag.addEventListener("mousedown", () => {
-          isDragging = true;
-          console.log("[hm-monitor] Plugin detected: Start dragging");
-          sendHapticFeedback(HAPTIC_FEEDBACK.DRAG_START_END);
-        });
-
-        document.addEventListener("mousemove", () => {
-          if (isDragging) {
-            checkSnapping();
-          }
-        });
-
-        document.addEventListener("mouseup", () => {
-          if (isDragging) {
-            isDragging = false;
-            console.log("[hm-monitor] Plugin detected: End dragging");
-            sendHapticFeedback(HAPTIC_FEEDBACK.DRAG_START_END);
-          }
-        });
-
-        // Check position change every 200ms
-        let lastPosition = null;
-
-        setInterval(() => {
-          if (!document.body.contains(drag)) return;
-
-          const currentPos = {
-            x: drag.offsetLeft,
-            y: drag.offsetTop
-          };
-
-          if (
-            lastPosition &&
-            (Math.abs(currentPos.x - lastPosition.x) > 0.5 ||
-              Math.abs(currentPos.y - lastPosition.y) > 0.5)
-          ) {
-            if (!isSnapping) {
-              sendHapticFeedback(HAPTIC_FEEDBACK.DRAG_CONTINUOUS);
-              console.log("[hm-monitor] Plugin detected: Element moving");
-            }
-          }
-
-          lastPosition = currentPos;
-        }, 100);
-
-        // Mark element as initialized
-        el.dataset.hmInitialized = 'true';
-        break;
-      }
+  let state = scrollStates.get(scrollElement);
+  if (!state) {
+    state = { velocity: new VelocityTracker(), lastPos: -1, atStartEmitted: true, atEndEmitted: false };
+    scrollStates.set(scrollElement, state);
+  }
 
-      case "warningButton": {
-        el.addEventListener("click", () => {
-          console.log("[hm-monitor] Warning button clicked");
-          sendHapticFeedback(HAPTIC_FEEDBACK.WARNING_CLICKED);
-        });
-        el.addEventListener("mouseenter", () => {
-          console.log("[hm-monitor] Hover on warning button");
-          sendHapticFeedback(HAPTIC_FEEDBACK.HOVER_WARNING);
-        });
-        el.addEventListener("mouseleave", () => {
-          console.log("[hm-monitor] Hover out from warning button");
-        });
-        // Mark element as initialized
-        el.dataset.hmInitialized = 'true';
-        break;
-      }
+  // Follow the axis the container scrolls along
+  const vertical = scrollElement.scrollHeight > scrollElement.clientHeight;
+  const currentPos = vertical ? scrollElement.scrollTop : scrollElement.scrollLeft;
+  const range = vertical ? scrollElement.scrollHeight - scrollElement.clientHeight
+    : scrollElement.scrollWidth - scrollElement.clientWidth;
+  const scrollPercentage = range > 0 ? Math.round((currentPos / range) * 100) : 0;
+  const speed = state.velocity.update(0, currentPos, e.timeStamp);
+
+  // Detect "scrolling"; speed drives texture strength and rate
+  if (Math.abs(currentPos - state.lastPos) > 1) {
+    emitHaptic(HM_TYPE.SCROLL_CONTINUOUS, speed);
+    state.lastPos = currentPos;
+  }
 
-      case "selectableText": {
-        let lastSelected = "";
-
-        const intervalId = setInterval(() => {
-          if (!document.body.contains(el)) {
-            // If element is removed, clear interval
-            clearInterval(intervalId);
-            return;
-          }
-          const selection = window.getSelection();
-          const selectedText = selection ? selection.toString().trim() : "";
-
-          // If text is not empty, and selection is within this element
-          if (
-            selectedText &&
-            selection &&
-            el.contains(selection.anchorNode) &&
-            selectedText !== lastSelected
-          ) {
-            console.log("[hm-monitor] Text selected");
-            sendHapticFeedback(HAPTIC_FEEDBACK.TEXT_SELECTED);
-            lastSelected = selectedText;
-          }
-
-          // If selection is cleared (empty string), reset selection
-          if (!selectedText && lastSelected !== "") {
-            lastSelected = "";
-          }
-        }, 20);
-
-        // Mark element as initialized
-        el.dataset.hmInitialized = 'true';
-        break;
+  // Detect if reached top (one-time output)
+  if (scrollPercentage === 0 && !state.atStartEmitted) {
+    console.log("[hm-monitor] Scrolled to top");
+    stopHapticPattern(HM_TYPE.SCROLL_CONTINUOUS);
+    emitHaptic(HM_TYPE.SCROLL_BOUNDARY);
+    state.atStartEmitted = true;
+  } else if (scrollPercentage > 0) {
+    state.atStartEmitted = false;
+  }
+
+  // Detect if reached bottom (one-time output)
+  if (scrollPercentage === 100 && !state.atEndEmitted) {
+    console.log("[hm-monitor] Scrolled to bottom");
+    stopHapticPattern(HM_TYPE.SCROLL_CONTINUOUS);
+    emitHaptic(HM_TYPE.SCROLL_BOUNDARY);
+    state.atEndEmitted = true;
+  } else if (scrollPercentage < 100) {
+    state.atEndEmitted = false;
+  }
+}
+
+// Drag state; only one element can be dragged at a time
+const SNAP_THRESHOLD = 20;
+const dragState = {
+  el: null,
+  snapAreas: [],
+  lastSnapped: null,
+  isSnapping: false,
+  velocity: new VelocityTracker(),
+  predictor: new SnapPredictor(SNAP_THRESHOLD)
+};
+
+function getCenter(el) {
+  const rect = el.getBoundingClientRect();
+  return {
+    x: rect.left + rect.width / 2,
+    y: rect.top + rect.height / 2
+  };
+}
+
+function getDistance(p1, p2) {
+  const dx = p1.x - p2.x;
+  const dy = p1.y - p2.y;
+  return Math.sqrt(dx * dx + dy * dy);
+}
+
+function snapTargets() {
+  return Array.from(dragState.snapAreas, area => ({
+    id: area.id || "Unnamed snap area",
+    center: getCenter(area)
+  }));
+}
+
+// Check snap areas
+function checkSnapping(now) {
+  const { predictor, velocity } = dragState;
+  const dragCenter = getCenter(dragState.el);
+  const targets = snapTargets();
+  let snappedTo = null;
+
+  targets.forEach(target => {
+    if (getDistance(dragCenter, target.center) < SNAP_THRESHOLD) {
+      snappedTo = target.id;
+    }
+  });
+
+  if (snappedTo && snappedTo !== dragState.lastSnapped) {
+    dragState.isSnapping = true;
+    stopHapticPattern(HM_TYPE.DRAG_CONTINUOUS);
+    console.log(`[hm-monitor] Plugin detected: Snapped to ${snappedTo}`);
+    // feedback may already have been sent by the predictor
+    if (!predictor.confirm(snappedTo, now)) {
+      emitHaptic(HM_TYPE.SNAP_ATTACHED);
+    }
+    dragState.lastSnapped = snappedTo;
+  } else if (!snappedTo && dragState.lastSnapped !== null) {
+    dragState.isSnapping = false;
+    console.log(`[hm-monitor] Plugin detected: Detached from ${dragState.lastSnapped}`);
+    emitHaptic(HM_TYPE.SNAP_DETACH);
+    dragState.lastSnapped = null;
+  } else if (!snappedTo) {
+    // Send the snap feedback early if the element will reach an area
+    // within the latency of the USB and actuator path
+    const predicted = predictor.predict(dragCenter, { x: velocity.vx, y: velocity.vy }, targets, now, dragState.lastSnapped);
+    if (predicted) {
+      stopHapticPattern(HM_TYPE.DRAG_CONTINUOUS);
+      emitHaptic(HM_TYPE.SNAP_ATTACHED);
+    }
+  }
+}
+
+// Don't interfere with dragging, only detect drag state
+function startDrag(el, e) {
+  dragState.el = el;
+  dragState.snapAreas = document.querySelectorAll('[data-hm-type="snapArea"]');
+  dragState.lastSnapped = null;
+  dragState.isSnapping = false;
+  dragState.velocity.reset();
+  dragState.velocity.update(e.clientX, e.clientY, e.timeStamp);
+  console.log("[hm-monitor] Plugin detected: Start dragging");
+  emitHaptic(HM_TYPE.DRAG_START_END);
+}
+
+function moveDrag(e) {
+  if (!dragState.el) {
+    return;
+  }
+  const speed = dragState.velocity.update(e.clientX, e.clientY, e.timeStamp);
+  checkSnapping(e.timeStamp);
+  if (!dragState.isSnapping && !dragState.predictor.pending && speed > 0) {
+    emitHaptic(HM_TYPE.DRAG_CONTINUOUS, speed);
+  }
+}
+
+function endDrag() {
+  if (dragState.el) {
+    dragState.el = null;
+    stopHapticPattern(HM_TYPE.DRAG_CONTINUOUS);
+    console.log("[hm-monitor] Plugin detected: End dragging");
+    console.log("[hm-monitor] Snap predictor:", snapStatsSummary());
+    emitHaptic(HM_TYPE.DRAG_START_END);
+  }
+}
+
+// Last reported text selection; compared by its end points, so large
+// selections are never converted to strings
+const lastSelection = { anchorNode: null, anchorOffset: 0, focusNode: null, focusOffset: 0 };
+
+function onSelectionChange() {
+  const selection = window.getSelection();
+  if (!selection || selection.isCollapsed) {
+    // If selection is cleared, reset selection
+    lastSelection.anchorNode = null;
+    lastSelection.focusNode = null;
+    return;
+  }
+
+  if (selection.anchorNode === lastSelection.anchorNode && selection.anchorOffset === lastSelection.anchorOffset &&
+    selection.focusNode === lastSelection.focusNode && selection.focusOffset === lastSelection.focusOffset) {
+    return;
+  }
+  lastSelection.anchorNode = selection.anchorNode;
+  lastSelection.anchorOffset = selection.anchorOffset;
+  lastSelection.focusNode = selection.focusNode;
+  lastSelection.focusOffset = selection.focusOffset;
+
+  const anchor = selection.anchorNode instanceof Element ? selection.anchorNode : selection.anchorNode.parentElement;
+  if (anchor && !hmIsIgnored(anchor)) {
+    console.log("[hm-monitor] Text selected");
+    emitHaptic(HM_TYPE.TEXT_SELECTED);
+  }
+}
+
+// Capture phase, so pages stopping propagation do not hide their events
+const HM_CAPTURE = { capture: true, passive: true };
+
+document.addEventListener("click", (e) => {
+  const owner = hmOwnerOf(e.target);
+  if (!owner) {
+    return;
+  }
+  const role = hmRoleOf(owner);
+  if (role === HM_ROLE.BUTTON || role === HM_ROLE.LINK) {
+    console.log("[hm-monitor] Button clicked:", owner.textContent);
+    emitHaptic(HM_TYPE.BUTTON_CLICKED);
+  } else if (role === HM_ROLE.WARNING) {
+    console.log("[hm-monitor] Warning button clicked");
+    emitHaptic(HM_TYPE.WARNING_CLICKED);
+  }
+}, HM_CAPTURE);
+
+document.addEventListener("mouseover", (e) => {
+  const owner = hmOwnerOf(e.target);
+  // mouseover bubbles from every child; react only when entering the owner
+  if (owner && hmRoleOf(owner) === HM_ROLE.WARNING && !owner.contains(e.relatedTarget)) {
+    console.log("[hm-monitor] Hover on warning button");
+    emitHaptic(HM_TYPE.HOVER_WARNING);
+  }
+}, HM_CAPTURE);
+
+document.addEventListener("input", (e) => {
+  if (e.target instanceof Element && hmRoleOf(e.target) === HM_ROLE.RANGE && !hmIsIgnored(e.target)) {
+    emitHaptic(HM_TYPE.SLIDER_STEP);
+  }
+}, HM_CAPTURE);
+
+document.addEventListener("mousedown", (e) => {
+  const owner = hmOwnerOf(e.target);
+  if (e.button === 0 && owner && hmRoleOf(owner) === HM_ROLE.DRAG) {
+    startDrag(owner, e);
+  }
+}, HM_CAPTURE);
+
+document.addEventListener("mousemove", moveDrag, HM_CAPTURE);
+document.addEventListener("mouseup", endDrag, HM_CAPTURE);
+
+// Native drag and drop (draggable="true") suppresses mouse events until the
+// drop; follow the drag events instead. The last drag event reports (0, 0).
+document.addEventListener("drag", (e) => {
+  if (e.clientX || e.clientY) {
+    moveDrag(e);
+  }
+}, HM_CAPTURE);
+document.addEventListener("dragend", endDrag, HM_CAPTURE);
+
+// scroll does not bubble, but it is visible in the capture phase
+document.addEventListener("scroll", onScroll, HM_CAPTURE);
+document.addEventListener("selectionchange", onSelectionChange);
+
+hmWatchClassification(document.documentElement);
+
+// Device output. Commands are queued as protocol records (protocol.js) and
+// sent in batches: everything queued in the same task, or while a transfer is
+// still in flight, goes out in the next packet, so a burst such as "stop
+// texture, snap, start texture" costs one USB transaction. Firmware without
+// the protocol gets one legacy report (0x10 / 0x11) per command.
+//
+// Rhythmic textures (velocity-dependent types) are scheduled on the device
+// clock: the packet carries the device time at which the command was issued
+// plus a fixed lead, so USB and timer jitter turn into one constant delay and
+// the spacing of the texture is kept. One-shot feedback goes out unscheduled.
+//
+// Without a WebHID device the records go to the hapticd daemon
+// (haptic-daemon/), when one is running, relayed by the background script
+// over its localhost WebSocket. The daemon owns the device, its clock and the
+// batching; it sends its CAPS and EFFECTS packets on connect and takes bare
+// records, rhythmic ones flagged HP_REC_FLAG_RHYTHMIC instead of carrying a
+// target time.
+const LEGACY_EFFECT_REPORT_ID = 0x10;
+const LEGACY_PATTERN_REPORT_ID = 0x11;
+const LEGACY_PATTERN_OP = { [HP_OP.PATTERN_STOP]: 0x00, [HP_OP.PATTERN_START]: 0x01, [HP_OP.PATTERN_UPDATE]: 0x02 };
+
+const HM_SCHEDULE_MARGIN = 10;       // ms of transport jitter absorbed on top of the device's own lead
+const HM_SCHEDULE_MAX_LEAD = 50;     // ms, upper bound when missed targets widen the lead
+const HM_SCHEDULE_GROUP = 1;         // ms, scheduled commands this close share a packet and a target
+const HM_CLOCK_BURST = 8;            // exchanges right after connecting
+const HM_CLOCK_SYNC_INTERVAL = 2000; // ms between exchanges afterwards
+const HM_DAEMON_PORT = 'hapticd';     // runtime port to background.js, which talks to hapticd
+const HM_DAEMON_RETRY = 5000;        // ms before reconnecting a dropped port
+
+const hapticOutput = {
+  caps: null,          // decoded CAPS packet, null for legacy firmware
+  effects: [],         // effect catalog by ID ({ durationMs, peak, category }), empty if not reported
+  maxRecords: 1,
+  queue: [],
+  flushPending: false,
+  inFlight: false,
+  seq: 0,
+  clock: new DeviceClock(),
+  lead: 0,             // ms from issue to device target time, 0 = not scheduling
+  late: -1,            // device's missed-target counter at the last exchange
+  syncTimer: 0,
+  daemon: null,        // port to hapticd, once it has sent its capabilities
+  transfers: 0,        // USB transactions (messages to the daemon)
+  commands: 0          // records sent
+};
+
+function resetHapticOutput() {
+  hapticOutput.daemon = null;
+  hapticOutput.caps = null;
+  hapticOutput.effects = [];
+  hapticOutput.maxRecords = 1;
+  hapticOutput.queue.length = 0;
+  clearInterval(hapticOutput.syncTimer);
+  hapticOutput.syncTimer = 0;
+  hapticOutput.clock.reset();
+  hapticOutput.lead = 0;
+  hapticOutput.late = -1;
+}
+
+// True when records can go out, over WebHID or through the daemon
+function hapticOutputReady() {
+  return (currentDevice && currentDevice.opened) || (hapticOutput.daemon !== null && hapticOutput.caps !== null);
+}
+
+let hapticDaemonPort = null;
+let hapticDaemonRetry = 0;
+
+// Reach hapticd through the background script, which owns the WebSocket
+// (see background.js), until a WebHID device is opened. The daemon refuses
+// connections while it has no device; the background script retries.
+function connectHapticDaemon() {
+  if (currentDevice || hapticDaemonPort) {
+    return;
+  }
+  const port = chrome.runtime.connect({ name: HM_DAEMON_PORT });
+  hapticDaemonPort = port;
+
+  port.onMessage.addListener((message) => {
+    if (port !== hapticDaemonPort) {
+      return;
+    }
+    if (message.closed) {
+      if (hapticOutput.daemon === port) {
+        resetHapticOutput();
+        updateExtensionIcon(false);
+      }
+      return;
+    }
+    const packet = hpDecodePacket(new Uint8Array(message.packet));
+    if (packet.error !== undefined) {
+      return;
+    }
+    if (packet.type === HP_PKT.CAPS) {
+      const caps = hpDecodeCaps(packet.payload);
+      resetHapticOutput();
+      if (caps && caps.versionMin <= HP_VERSION && HP_VERSION <= caps.versionMax) {
+        hapticOutput.caps = caps;
+        hapticOutput.maxRecords = Math.max(1, Math.min(caps.maxRecords, HP_HID_MAX_RECORDS));
+        hapticOutput.daemon = port;
+        updateExtensionIcon(true);
+        console.log('[hm-monitor] Connected to hapticd', caps);
       }
+    } else if (packet.type === HP_PKT.EFFECTS) {
+      const chunk = hpDecodeEffects(packet.payload);
+      (chunk ? chunk.effects : []).forEach(e => { hapticOutput.effects[e.id] = e; });
+    }
+  });
+  // the service worker was stopped or the extension reloaded
+  port.onDisconnect.addListener(() => {
+    if (port !== hapticDaemonPort) {
+      return;
+    }
+    hapticDaemonPort = null;
+    if (hapticOutput.daemon === port) {
+      resetHapticOutput();
+      updateExtensionIcon(false);
     }
+    hapticDaemonRetry = setTimeout(connectHapticDaemon, HM_DAEMON_RETRY);
   });
 }
 
-// Send haptic feedback to device
-async function sendHapticFeedback(intensity) {
+function closeHapticDaemon() {
+  clearTimeout(hapticDaemonRetry);
+  const port = hapticDaemonPort;
+  hapticDaemonPort = null;
+  if (port) {
+    port.disconnect();
+  }
+  if (hapticOutput.daemon) {
+    resetHapticOutput();
+  }
+}
+
+// Packet bytes of a feature report; the report ID may be included as the
+// first byte
+function featureReportBytes(view, reportId) {
+  const bytes = new Uint8Array(view.buffer, view.byteOffset, view.byteLength);
+  return bytes[0] === reportId && bytes[1] === HP_MAGIC ? bytes.subarray(1) : bytes;
+}
+
+// Ask the device for its capabilities; legacy firmware has no caps report
+async function configureHapticOutput(device) {
+  resetHapticOutput();
   try {
-    if (!currentDevice || !currentDevice.opened) {
-      console.log("[hm-monitor] No device connected, cannot send haptic feedback");
-      return;
+    const view = await device.receiveFeatureReport(HP_HID_CAPS_REPORT_ID);
+    const packet = hpDecodePacket(featureReportBytes(view, HP_HID_CAPS_REPORT_ID));
+    const caps = packet.error === undefined && packet.type === HP_PKT.CAPS ? hpDecodeCaps(packet.payload) : null;
+    if (caps && caps.versionMin <= HP_VERSION && HP_VERSION <= caps.versionMax) {
+      hapticOutput.caps = caps;
+      hapticOutput.maxRecords = Math.max(1, Math.min(caps.maxRecords, HP_HID_MAX_RECORDS));
     }
+  } catch (error) {
+    // no feature report: legacy firmware
+  }
+  console.log(`[hm-monitor] Device protocol: ${hapticOutput.caps ? `v${HP_VERSION}` : 'legacy'}`, hapticOutput.caps);
 
-    // Ensure intensity value is within valid range
-    intensity = Math.max(0, Math.min(255, intensity));
+  if (hapticOutput.caps) {
+    await readEffectCatalog(device);
+  }
 
-    // Create report data
-    const reportId = 0x10; // Report ID
-    const data = new Uint8Array([intensity]);
+  if (hapticOutput.caps && (hapticOutput.caps.features & HP_CAP.SCHEDULE)) {
+    await startClockSync(device);
+  }
+}
 
-    console.log(`[hm-monitor] Sending haptic feedback: intensity=${intensity}`);
-    await currentDevice.sendReport(reportId, data);
+// Read the effect catalog, one EFFECTS packet per feature report; firmware
+// without the report leaves the catalog empty. Reading CAPS rewound it, but
+// another reader (hapticd) may move the device's cursor meanwhile: read on
+// past the empty packet that starts it over until every effect came by, for
+// at most two rounds.
+async function readEffectCatalog(device) {
+  const effects = [];
+  const count = hapticOutput.caps.effectCount;
+  const round = Math.ceil(count / HP_HID_MAX_EFFECTS) + 1;
+  let missing = Math.max(0, count - 1);
+  try {
+    for (let i = 0; i < 2 * round && missing > 0; i++) {
+      const view = await device.receiveFeatureReport(HP_HID_EFFECTS_REPORT_ID);
+      const packet = hpDecodePacket(featureReportBytes(view, HP_HID_EFFECTS_REPORT_ID));
+      const chunk = packet.error === undefined && packet.type === HP_PKT.EFFECTS ? hpDecodeEffects(packet.payload) : null;
+      if (!chunk) {
+        break;
+      }
+      chunk.effects.forEach(e => {
+        if (e.id > 0 && e.id < count && !effects[e.id]) {
+          effects[e.id] = e;
+          missing--;
+        }
+      });
+    }
   } catch (error) {
-    console.error("[hm-monitor] Failed to send haptic feedback:", error);
+    // no catalog report: older firmware
+  }
+  if (device === currentDevice) {
+    hapticOutput.effects = effects;
+    console.log(`[hm-monitor] Effect catalog: ${effects.filter(Boolean).length} effects`);
   }
 }
 
-// Initialize monitoring after page load
-document.addEventListener('DOMContentLoaded', () => {
-  // Delay a bit to ensure all page elements are loaded
-  setTimeout(initHMMonitor, 1000);
-});
+// Shortest repetition period in ms that lets an effect play out to the end
+// of its brake. Hums and buzzes have no brake worth keeping and may be
+// retriggered at any rate; 0 as well when the device has no catalog.
+function hapticEffectMinPeriod(effect) {
+  const info = hapticOutput.effects[effect];
+  if (!info || info.category === HP_EFFECT_CATEGORY.HUM || info.category === HP_EFFECT_CATEGORY.BUZZ) {
+    return 0;
+  }
+  return info.durationMs;
+}
+
+// One clock exchange: read the device clock between two host timestamps
+async function syncDeviceClock(device) {
+  const out = hapticOutput;
+  const t0 = performance.now();
+  const view = await device.receiveFeatureReport(HP_HID_TIME_REPORT_ID);
+  const t1 = performance.now();
+  const packet = hpDecodePacket(featureReportBytes(view, HP_HID_TIME_REPORT_ID));
+  const time = packet.error === undefined && packet.type === HP_PKT.TIME ? hpDecodeTime(packet.payload) : null;
+  if (!time || device !== currentDevice) {
+    return;
+  }
+  out.clock.addSample(t0, t1, time.deviceUs);
+
+  // targets were missed since the last exchange: this host needs more lead
+  if (out.late >= 0 && out.late !== time.late && out.lead) {
+    out.lead = Math.min(HM_SCHEDULE_MAX_LEAD, out.lead + 2);
+  }
+  out.late = time.late;
+}
 
-// Add MutationObserver to handle dynamically loaded elements
-const observer = new MutationObserver((mutations) => {
-  mutations.forEach((mutation) => {
-    if (mutation.addedNodes.length) {
-      // Check for new elements with data-hm-type attribute
-      setTimeout(initHMMonitor, 500);
+async function startClockSync(device) {
+  const out = hapticOutput;
+  try {
+    for (let i = 0; i < HM_CLOCK_BURST; i++) {
+      await syncDeviceClock(device);
     }
-  });
-});
+  } catch (error) {
+    console.warn('[hm-monitor] Device clock sync failed, sending unscheduled:', error);
+    return;
+  }
+  if (device !== currentDevice) {
+    return;
+  }
+  out.lead = out.caps.scheduleLeadMs + HM_SCHEDULE_MARGIN;
+  out.syncTimer = setInterval(() => {
+    syncDeviceClock(device).catch(() => {});
+  }, HM_CLOCK_SYNC_INTERVAL);
+  console.log(`[hm-monitor] Device clock synced, lead ${out.lead} ms`, out.clock.summary());
+}
+
+// Capture a command issued by an interaction, see capture.js
+function captureHapticCommand(record, type, result) {
+  if (hapticCaptureOn) {
+    record.capture = hapticCapture.add(performance.now(), type, record, result);
+  }
+}
+
+// Set the outcome of captured records once their transfer is done
+function captureHapticResult(records, result) {
+  for (const record of records) {
+    if (record.capture !== undefined) {
+      hapticCapture.setResult(record.capture, result);
+    }
+  }
+}
+
+function queueHapticCommand(record, type) {
+  const queue = hapticOutput.queue;
+  // A rate update only changes the pending start/update of the same pattern
+  if (record.op === HP_OP.PATTERN_UPDATE) {
+    const last = queue[queue.length - 1];
+    if (last && (last.op === HP_OP.PATTERN_START || last.op === HP_OP.PATTERN_UPDATE)) {
+      last.arg = record.arg || last.arg;
+      last.intensity = record.intensity;
+      if (last.capture !== undefined) {
+        hapticCapture.update(last.capture, last);
+      }
+      return;
+    }
+  }
+  captureHapticCommand(record, type, HM_CAPTURE_RESULT.PENDING);
+  if (record.scheduled) {
+    record.t = performance.now();
+  }
+  queue.push(record);
+  if (!hapticOutput.flushPending && !hapticOutput.inFlight) {
+    hapticOutput.flushPending = true;
+    queueMicrotask(flushHapticCommands);
+  }
+}
+
+// Take the records of the next packet from the queue. Timed records (PLAY,
+// PATTERN_START) either all carry one target time or none: a scheduled
+// record is not sent with an immediate one, nor with one issued more than
+// HM_SCHEDULE_GROUP ms apart. Untimed records go with either kind.
+function takeHapticBatch(out) {
+  const queue = out.queue;
+  const scheduling = out.lead > 0 && out.clock.synced;
+  let first = null;
+  let n = 0;
+  for (; n < queue.length && n < out.maxRecords; n++) {
+    const record = queue[n];
+    if (record.op !== HP_OP.PLAY && record.op !== HP_OP.PATTERN_START) {
+      continue;
+    }
+    const timed = scheduling && record.scheduled;
+    if (!first) {
+      first = record;
+    } else if (timed !== (scheduling && first.scheduled) || (timed && record.t - first.t > HM_SCHEDULE_GROUP)) {
+      break;
+    }
+  }
+  const at = first && scheduling && first.scheduled ? Math.round(out.clock.toDevice(first.t + out.lead)) : null;
+  return { records: queue.splice(0, n), at };
+}
+
+async function flushHapticCommands() {
+  const out = hapticOutput;
+  out.flushPending = false;
+  if (out.inFlight) {
+    return;
+  }
+  out.inFlight = true;
+  let batch = [];
+  try {
+    if (out.daemon && !currentDevice) {
+      // the daemon batches and schedules; everything queued goes in one message
+      batch = out.queue.splice(0).map(record => ({
+        ...record,
+        flags: (record.flags || 0) | (record.scheduled ? HP_REC_FLAG_RHYTHMIC : 0)
+      }));
+      out.transfers++;
+      out.commands += batch.length;
+      out.daemon.postMessage({ records: Array.from(hpEncodeRecords(batch)) });
+      captureHapticResult(batch, HM_CAPTURE_RESULT.SENT);
+    }
+    while (out.queue.length) {
+      if (!currentDevice || !currentDevice.opened) {
+        captureHapticResult(out.queue, HM_CAPTURE_RESULT.DISCARDED);
+        out.queue.length = 0;
+        break;
+      }
+      const taken = takeHapticBatch(out);
+      const at = taken.at;
+      batch = taken.records;
+      out.transfers += out.caps ? 1 : batch.length;
+      out.commands += batch.length;
+      if (out.caps) {
+        const flags = at === null ? 0 : HP_PKT_FLAG_AT;
+        const packet = hpEncodePacket(HP_PKT.COMMANDS, out.seq, flags, hpEncodeRecords(batch, at), HP_HID_REPORT_SIZE);
+        out.seq = (out.seq + 1) & 0xFF;
+        await currentDevice.sendReport(HP_HID_REPORT_ID, packet);
+      } else {
+        for (const record of batch) {
+          await sendLegacyReport(record);
+        }
+      }
+      captureHapticResult(batch, HM_CAPTURE_RESULT.SENT);
+    }
+  } catch (error) {
+    console.error("[hm-monitor] Failed to send haptic commands:", error);
+    captureHapticResult(batch, HM_CAPTURE_RESULT.ERROR);
+    captureHapticResult(out.queue, HM_CAPTURE_RESULT.DISCARDED);
+    out.queue.length = 0;
+  } finally {
+    out.inFlight = false;
+  }
+}
+
+function sendLegacyReport(record) {
+  if (record.op === HP_OP.PLAY) {
+    return currentDevice.sendReport(LEGACY_EFFECT_REPORT_ID, new Uint8Array([record.effect]));
+  }
+  if (record.op in LEGACY_PATTERN_OP) {
+    const period = record.arg;
+    return currentDevice.sendReport(LEGACY_PATTERN_REPORT_ID,
+      new Uint8Array([LEGACY_PATTERN_OP[record.op], record.effect, period & 0xFF, period >> 8, record.intensity]));
+  }
+  return Promise.resolve();
+}
+
+// Send haptic feedback to device; `scheduled` plays it at a constant delay
+// on the device clock when the device supports it. `type` is the
+// interaction it answers, for the capture.
+function sendHapticFeedback(effect, intensity = 255, scheduled = false, type = -1) {
+  // Ensure effect value is within valid range
+  effect = Math.max(0, Math.min(255, effect));
+  const record = { op: HP_OP.PLAY, effect, intensity, scheduled };
+  if (!hapticOutputReady()) {
+    console.log("[hm-monitor] No device connected, cannot send haptic feedback");
+    captureHapticCommand(record, type, HM_CAPTURE_RESULT.NO_DEVICE);
+    return;
+  }
+
+  console.log(`[hm-monitor] Sending haptic feedback: effect=${effect} intensity=${intensity}`);
+  queueHapticCommand(record, type);
+}
+
+// Send a continuous pattern command to device
+function sendPatternCommand(op, effect, period, intensity, scheduled = false, type = -1) {
+  period = Math.max(0, Math.min(0xFFFF, Math.round(period)));
+  const record = { op, effect, intensity, arg: period, scheduled };
+  if (!hapticOutputReady()) {
+    captureHapticCommand(record, type, HM_CAPTURE_RESULT.NO_DEVICE);
+    return;
+  }
+
+  console.log(`[hm-monitor] Sending pattern: op=${op} effect=${effect} period=${period}ms`);
+  queueHapticCommand(record, type);
+}
 
-// Start observing DOM changes
-observer.observe(document.body, {
-  childList: true,
-  subtree: true
-});
\ No newline at end of file
+// Use the daemon until a WebHID device is connected
+connectHapticDaemon();
@@ -0,0 +1,209 @@
+// Input dynamics
+//
+// Smoothed scroll/pointer velocity computed from event timestamps, the
+// mapping from velocity to effect and repetition period for continuous
+// textures, and a predictor that fires snap feedback slightly before a
+// dragged element reaches a snap area to hide USB and actuator latency.
+
+// Time constant of the velocity low-pass filter (ms)
+const HM_VELOCITY_TAU = 40;
+
+// Velocity (px/ms) at which a continuous texture plays at its profile rate,
+// indexed by HM_TYPE. Zero means the type is not velocity dependent.
+const HM_REF_SPEED = new Float32Array(HM_TYPE_COUNT);
+HM_REF_SPEED[HM_TYPE.SCROLL_CONTINUOUS] = 1.0;
+HM_REF_SPEED[HM_TYPE.DRAG_CONTINUOUS] = 0.5;
+
+// Period scale limits: fast motion plays up to 2.5x denser, slow motion up
+// to 2x sparser than the profile rate
+const HM_PERIOD_MIN_SCALE = 0.4;
+const HM_PERIOD_MAX_SCALE = 2.0;
+const HM_PERIOD_MIN = 15;   // ms, leaves headroom over the firmware minimum
+
+// Library effects that are intensity variants of one waveform, weakest first.
+// Faster motion steps up through the family of the profile's effect.
+const HM_EFFECT_FAMILIES = [
+  [123, 122, 121, 120, 119],  // Smooth Hum 5 … 1
+  [3, 2, 1],                  // Strong Click 30/60/100%
+  [6, 5, 4],                  // Sharp Click 30/60/100%
+  [9, 8, 7],                  // Soft Bump 30/60/100%
+  [26, 25, 24],               // Sharp Tick 3 … 1
+  [20, 19, 18, 17],           // Strong Click 4 … 1
+  [23, 22, 21],               // Medium Click 3 … 1
+  [51, 50, 49, 48, 47],       // Buzz 5 … 1
+  [57, 56],                   // Pulsing Sharp 2, 1
+  [63, 62, 61, 60, 59, 58],   // Transition Click 6 … 1
+  [69, 68, 67, 66, 65, 64]    // Transition Hum 6 … 1
+];
+
+// effect → [family, position] lookup, built once
+const HM_EFFECT_FAMILY_OF = new Int16Array(256).fill(-1);
+const HM_EFFECT_POSITION_OF = new Int16Array(256);
+HM_EFFECT_FAMILIES.forEach((family, f) => family.forEach((effect, i) => {
+  HM_EFFECT_FAMILY_OF[effect] = f;
+  HM_EFFECT_POSITION_OF[effect] = i;
+}));
+
+// Exponentially smoothed 2-D velocity in px/ms
+class VelocityTracker {
+  constructor(tau = HM_VELOCITY_TAU) {
+    this.tau = tau;
+    this.reset();
+  }
+
+  reset() {
+    this.x = 0;
+    this.y = 0;
+    this.t = -1;
+    this.vx = 0;
+    this.vy = 0;
+    this.primed = false;
+  }
+
+  // Feed a position sample taken at event time t (ms); returns the speed
+  update(x, y, t) {
+    if (this.t < 0 || t - this.t > 10 * this.tau) {
+      // first sample or long pause: restart from rest
+      this.vx = 0;
+      this.vy = 0;
+      this.primed = false;
+    } else if (t > this.t) {
+      const dt = t - this.t;
+      // the first interval seeds the filter instead of ramping up from rest
+      const alpha = this.primed ? 1 - Math.exp(-dt / this.tau) : 1;
+      this.vx += alpha * ((x - this.x) / dt - this.vx);
+      this.vy += alpha * ((y - this.y) / dt - this.vy);
+      this.primed = true;
+    }
+    this.x = x;
+    this.y = y;
+    this.t = t;
+    return this.speed;
+  }
+
+  get speed() {
+    return Math.hypot(this.vx, this.vy);
+  }
+}
+
+// Repetition period for a continuous texture: denser when moving faster
+function speedToPeriod(basePeriod, speed, refSpeed) {
+  const ratio = speed > 0 ? refSpeed / speed : HM_PERIOD_MAX_SCALE;
+  const scale = Math.max(HM_PERIOD_MIN_SCALE, Math.min(HM_PERIOD_MAX_SCALE, ratio));
+  return Math.max(HM_PERIOD_MIN, Math.round(basePeriod * scale));
+}
+
+// Effect for a continuous texture: one step stronger within the effect's
+// family for every doubling of speed above the reference speed
+function speedToEffect(effect, speed, refSpeed) {
+  const f = HM_EFFECT_FAMILY_OF[effect];
+  if (f < 0 || speed <= refSpeed) {
+    return effect;
+  }
+  const family = HM_EFFECT_FAMILIES[f];
+  const steps = Math.floor(Math.log2(speed / refSpeed)) + 1;
+  return family[Math.min(family.length - 1, HM_EFFECT_POSITION_OF[effect] + steps)];
+}
+
+// Snap predictor instrumentation
+const hmSnapStats = {
+  predictions: 0,   // early snap feedback sent
+  hits: 0,          // ... followed by the real snap to the same area
+  misses: 0,        // ... not followed by a snap in time (spurious feedback)
+  unpredicted: 0,   // real snaps that were not predicted
+  savedMs: 0        // total time between early feedback and the real snap
+};
+
+// Latency to hide: USB polling interval plus actuator start-up (ms)
+const HM_SNAP_LEAD = 15;
+// A prediction not confirmed within this time counts as a miss (ms)
+const HM_SNAP_EXPIRE = 4 * HM_SNAP_LEAD;
+
+// Predicts when a moving point will enter a circle of `radius` around one
+// of the snap targets
+class SnapPredictor {
+  constructor(radius, lead = HM_SNAP_LEAD) {
+    this.radius = radius;
+    this.lead = lead;
+    this.predicted = null;
+    this.predictedAt = 0;
+  }
+
+  // Time (ms) until point p moving at v enters the circle around c, or -1
+  static timeToEnter(p, v, c, radius) {
+    const dx = c.x - p.x;
+    const dy = c.y - p.y;
+    const vv = v.x * v.x + v.y * v.y;
+    const dv = dx * v.x + dy * v.y;
+    const dd = dx * dx + dy * dy - radius * radius;
+    if (dd <= 0) {
+      return 0;
+    }
+    if (vv === 0 || dv <= 0) {
+      return -1;
+    }
+    const disc = dv * dv - vv * dd;
+    if (disc < 0) {
+      return -1;
+    }
+    return (dv - Math.sqrt(disc)) / vv;
+  }
+
+  // Returns the target predicted to be entered within the lead time, once
+  // per approach, or null. `targets` holds { id, center } objects.
+  predict(p, v, targets, now, current) {
+    this.expire(now);
+    if (this.predicted !== null) {
+      return null;
+    }
+    for (const target of targets) {
+      if (target.id === current) {
+        continue;
+      }
+      const t = SnapPredictor.timeToEnter(p, v, target.center, this.radius);
+      if (t > 0 && t <= this.lead) {
+        this.predicted = target.id;
+        this.predictedAt = now;
+        hmSnapStats.predictions++;
+        return target.id;
+      }
+    }
+    return null;
+  }
+
+  get pending() {
+    return this.predicted !== null;
+  }
+
+  // Called on a real snap; returns true if its feedback was already sent
+  confirm(id, now) {
+    this.expire(now);
+    if (this.predicted === id) {
+      hmSnapStats.hits++;
+      hmSnapStats.savedMs += now - this.predictedAt;
+      this.predicted = null;
+      return true;
+    }
+    hmSnapStats.unpredicted++;
+    return false;
+  }
+
+  expire(now) {
+    if (this.predicted !== null && now - this.predictedAt > HM_SNAP_EXPIRE) {
+      hmSnapStats.misses++;
+      this.predicted = null;
+    }
+  }
+}
+
+function snapStatsSummary() {
+  const s = hmSnapStats;
+  return {
+    predictions: s.predictions,
+    hits: s.hits,
+    misses: s.misses,
+    unpredicted: s.unpredicted,
+    hitRate: s.predictions ? s.hits / s.predictions : 0,
+    avgSavedMs: s.hits ? s.savedMs / s.hits : 0
+  };
+}
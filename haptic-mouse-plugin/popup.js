@@ -23,4 +23,170 @@ function updateDeviceList() {
 document.addEventListener('DOMContentLoaded', updateDeviceList);
 
 // Update device list every second
-setInterval(updateDeviceList, 1000);
\ No newline at end of file
+setInterval(updateDeviceList, 1000);
+
+// Haptic profile editor
+let editorProfiles = {};
+
+function renderProfileSelect(active) {
+  const select = document.getElementById('profileSelect');
+  // profile names are user text: options, not markup
+  select.replaceChildren(...Object.keys(editorProfiles).map(name => new Option(name, name)));
+  select.value = active;
+}
+
+function renderProfileTable(name) {
+  const profile = normalizeProfile(editorProfiles[name]);
+  const tbody = document.querySelector('#profileTable tbody');
+  tbody.innerHTML = HM_TYPE_NAMES.map(type => {
+    const entry = profile[type];
+    const options = HM_COALESCE_NAMES
+      .map(c => `<option value="${c}"${c === entry.coalesce ? ' selected' : ''}>${c.toLowerCase()}</option>`)
+      .join('');
+    return `
+      <tr data-type="${type}">
+        <td>${type.toLowerCase().replace(/_/g, ' ')}</td>
+        <td><input type="number" min="0" max="255" data-field="effect" value="${entry.effect}"></td>
+        <td><input type="number" min="0" max="255" data-field="intensity" value="${entry.intensity}"></td>
+        <td><input type="number" min="0" max="10000" data-field="minInterval" value="${entry.minInterval}"></td>
+        <td><select data-field="coalesce">${options}</select></td>
+      </tr>
+    `;
+  }).join('');
+}
+
+function readProfileTable() {
+  const profile = {};
+  document.querySelectorAll('#profileTable tbody tr').forEach(row => {
+    const entry = {};
+    row.querySelectorAll('[data-field]').forEach(input => {
+      entry[input.dataset.field] = input.tagName === 'SELECT' ? input.value : Number(input.value);
+    });
+    profile[row.dataset.type] = entry;
+  });
+  return normalizeProfile(profile);
+}
+
+function setProfileStatus(text) {
+  document.getElementById('profileStatus').textContent = text;
+}
+
+// Only user-defined and user-modified profiles are persisted; built-in ones
+// come from profiles.js
+function saveUserProfiles(userProfiles, active) {
+  chrome.storage.local.set({
+    [HM_STORAGE_PROFILES]: userProfiles,
+    [HM_STORAGE_ACTIVE]: active
+  }, () => setProfileStatus(`Profile "${active}" active in all tabs`));
+}
+
+function initProfileEditor() {
+  loadHapticProfiles((profiles, active) => {
+    editorProfiles = profiles;
+    renderProfileSelect(active);
+    renderProfileTable(active);
+  });
+
+  document.getElementById('profileSelect').addEventListener('change', (e) => {
+    renderProfileTable(e.target.value);
+    setProfileStatus('');
+  });
+
+  document.getElementById('profileSave').addEventListener('click', () => {
+    const name = document.getElementById('profileSelect').value;
+    editorProfiles[name] = readProfileTable();
+    chrome.storage.local.get([HM_STORAGE_PROFILES], (result) => {
+      const userProfiles = result[HM_STORAGE_PROFILES] || {};
+      userProfiles[name] = editorProfiles[name];
+      saveUserProfiles(userProfiles, name);
+    });
+  });
+
+  document.getElementById('profileNew').addEventListener('click', () => {
+    const name = document.getElementById('profileName').value.trim();
+    if (!name || editorProfiles[name]) {
+      return;
+    }
+    editorProfiles[name] = readProfileTable();
+    renderProfileSelect(name);
+    document.getElementById('profileName').value = '';
+    setProfileStatus(`Profile "${name}" created, save to activate`);
+  });
+
+  document.getElementById('profileDelete').addEventListener('click', () => {
+    const name = document.getElementById('profileSelect').value;
+    chrome.storage.local.get([HM_STORAGE_PROFILES], (result) => {
+      const userProfiles = result[HM_STORAGE_PROFILES] || {};
+      delete userProfiles[name];
+      // Deleting a modified built-in profile restores its defaults
+      editorProfiles = Object.assign({}, HM_BUILTIN_PROFILES, userProfiles);
+      const active = editorProfiles[name] ? name : HM_DEFAULT_PROFILE;
+      renderProfileSelect(active);
+      renderProfileTable(active);
+      saveUserProfiles(userProfiles, active);
+    });
+  });
+}
+
+document.addEventListener('DOMContentLoaded', initProfileEditor);
+
+// Interaction capture: enabled for every tab through storage, exported from
+// the active tab's ring (see capture.js)
+function sendToActiveTab(message, callback) {
+  chrome.tabs.query({ active: true, currentWindow: true }, (tabs) => {
+    if (!tabs.length) {
+      callback(undefined);
+      return;
+    }
+    chrome.tabs.sendMessage(tabs[0].id, message, (response) => {
+      // no content script in this tab (chrome:// pages, store)
+      callback(chrome.runtime.lastError ? undefined : response);
+    });
+  });
+}
+
+function updateCaptureStatus() {
+  sendToActiveTab({ action: 'captureStatus' }, (status) => {
+    const text = document.getElementById('captureStatus');
+    if (!status) {
+      text.textContent = 'No capture in this tab';
+    } else {
+      text.textContent = `${status.records} records in this tab` +
+        (status.overwritten ? `, ${status.overwritten} overwritten` : '');
+    }
+  });
+}
+
+function initCapturePanel() {
+  const enabled = document.getElementById('captureEnabled');
+  chrome.storage.local.get([HM_CAPTURE_STORAGE_ENABLED], (result) => {
+    enabled.checked = !!result[HM_CAPTURE_STORAGE_ENABLED];
+  });
+  enabled.addEventListener('change', () => {
+    chrome.storage.local.set({ [HM_CAPTURE_STORAGE_ENABLED]: enabled.checked });
+  });
+
+  document.getElementById('captureExport').addEventListener('click', () => {
+    sendToActiveTab({ action: 'exportCapture' }, (response) => {
+      if (!response) {
+        return;
+      }
+      const blob = new Blob([new Uint8Array(response.bytes)], { type: 'application/octet-stream' });
+      const url = URL.createObjectURL(blob);
+      const link = document.createElement('a');
+      link.href = url;
+      link.download = `haptic-capture-${new Date().toISOString().replace(/[:.]/g, '-')}.hmct`;
+      link.click();
+      setTimeout(() => URL.revokeObjectURL(url), 0);
+    });
+  });
+
+  document.getElementById('captureClear').addEventListener('click', () => {
+    sendToActiveTab({ action: 'clearCapture' }, updateCaptureStatus);
+  });
+
+  updateCaptureStatus();
+  setInterval(updateCaptureStatus, 1000);
+}
+
+document.addEventListener('DOMContentLoaded', initCapturePanel);
@@ -0,0 +1,130 @@
+// Haptic profiles
+//
+// A profile maps every interaction type to an effect ID, an intensity, a rate
+// limit and a coalescing policy. Profiles are stored in chrome.storage.local
+// and edited from the popup. Before use a profile is compiled into flat typed
+// arrays indexed by HM_TYPE, so the dispatch path in content.js is a single
+// indexed lookup without any string handling.
+
+// Interaction types (indices into the compiled dispatch table)
+const HM_TYPE = Object.freeze({
+  BUTTON_CLICKED: 0,      // 普通按钮点击的反馈
+  SCROLL_CONTINUOUS: 1,   // 持续滚动时的轻微反馈
+  SCROLL_BOUNDARY: 2,     // 滚动到顶部/底部的强反馈
+  DRAG_START_END: 3,      // 开始/结束拖拽时的反馈
+  DRAG_CONTINUOUS: 4,     // 拖拽过程中的反馈
+  SNAP_DETACH: 5,         // 从吸附区域脱离时的反馈
+  SNAP_ATTACHED: 6,       // 元素吸附到目标区域的反馈
+  HOVER_WARNING: 7,       // 警告按钮悬停的反馈
+  WARNING_CLICKED: 8,     // 警告按钮点击的强反馈
+  TEXT_SELECTED: 9,       // 文本选择的轻微反馈
+  SLIDER_STEP: 10         // 滑块数值变化时的刻度反馈
+});
+
+const HM_TYPE_NAMES = Object.keys(HM_TYPE);
+const HM_TYPE_COUNT = HM_TYPE_NAMES.length;
+
+// What to do with an event that arrives inside the rate limit window
+const HM_COALESCE = Object.freeze({
+  DROP: 0,      // discard it
+  TRAILING: 1,  // send one trailing report when the window closes
+  PATTERN: 2    // device repeats the effect every minInterval ms while active
+});
+
+const HM_COALESCE_NAMES = Object.keys(HM_COALESCE);
+
+const HM_STORAGE_PROFILES = 'hapticProfiles';
+const HM_STORAGE_ACTIVE = 'activeHapticProfile';
+const HM_DEFAULT_PROFILE = 'default';
+
+// Built-in profiles. "default" keeps the original effects and rates, with the
+// continuous scroll and drag textures generated on the device.
+const HM_BUILTIN_PROFILES = {
+  default: {
+    BUTTON_CLICKED:    { effect: 1,   intensity: 255, minInterval: 0,   coalesce: 'DROP' },
+    SCROLL_CONTINUOUS: { effect: 123, intensity: 255, minInterval: 50,  coalesce: 'PATTERN' },
+    SCROLL_BOUNDARY:   { effect: 81,  intensity: 255, minInterval: 0,   coalesce: 'DROP' },
+    DRAG_START_END:    { effect: 24,  intensity: 255, minInterval: 0,   coalesce: 'DROP' },
+    DRAG_CONTINUOUS:   { effect: 57,  intensity: 255, minInterval: 100, coalesce: 'PATTERN' },
+    SNAP_DETACH:       { effect: 34,  intensity: 255, minInterval: 0,   coalesce: 'DROP' },
+    SNAP_ATTACHED:     { effect: 77,  intensity: 255, minInterval: 0,   coalesce: 'DROP' },
+    HOVER_WARNING:     { effect: 16,  intensity: 255, minInterval: 0,   coalesce: 'DROP' },
+    WARNING_CLICKED:   { effect: 14,  intensity: 255, minInterval: 0,   coalesce: 'DROP' },
+    TEXT_SELECTED:     { effect: 26,  intensity: 255, minInterval: 20,  coalesce: 'TRAILING' },
+    SLIDER_STEP:       { effect: 25,  intensity: 255, minInterval: 15,  coalesce: 'TRAILING' }
+  },
+  subtle: {
+    BUTTON_CLICKED:    { effect: 3,   intensity: 160, minInterval: 0,   coalesce: 'DROP' },
+    SCROLL_CONTINUOUS: { effect: 123, intensity: 96,  minInterval: 120, coalesce: 'PATTERN' },
+    SCROLL_BOUNDARY:   { effect: 8,   intensity: 160, minInterval: 0,   coalesce: 'DROP' },
+    DRAG_START_END:    { effect: 26,  intensity: 160, minInterval: 0,   coalesce: 'DROP' },
+    DRAG_CONTINUOUS:   { effect: 0,   intensity: 0,   minInterval: 0,   coalesce: 'DROP' },
+    SNAP_DETACH:       { effect: 0,   intensity: 0,   minInterval: 0,   coalesce: 'DROP' },
+    SNAP_ATTACHED:     { effect: 9,   intensity: 160, minInterval: 0,   coalesce: 'DROP' },
+    HOVER_WARNING:     { effect: 0,   intensity: 0,   minInterval: 0,   coalesce: 'DROP' },
+    WARNING_CLICKED:   { effect: 12,  intensity: 200, minInterval: 0,   coalesce: 'DROP' },
+    TEXT_SELECTED:     { effect: 0,   intensity: 0,   minInterval: 0,   coalesce: 'DROP' },
+    SLIDER_STEP:       { effect: 26,  intensity: 120, minInterval: 40,  coalesce: 'DROP' }
+  }
+};
+
+function clampInt(value, min, max, fallback) {
+  const n = Math.round(Number(value));
+  if (!Number.isFinite(n)) {
+    return fallback;
+  }
+  return Math.max(min, Math.min(max, n));
+}
+
+// Fill in missing types and clamp every field to its valid range
+function normalizeProfile(profile) {
+  const base = HM_BUILTIN_PROFILES[HM_DEFAULT_PROFILE];
+  const out = {};
+  HM_TYPE_NAMES.forEach(name => {
+    const src = (profile && profile[name]) || base[name];
+    out[name] = {
+      effect: clampInt(src.effect, 0, 255, base[name].effect),
+      intensity: clampInt(src.intensity, 0, 255, base[name].intensity),
+      minInterval: clampInt(src.minInterval, 0, 10000, base[name].minInterval),
+      coalesce: HM_COALESCE_NAMES.includes(src.coalesce) ? src.coalesce : 'DROP'
+    };
+  });
+  return out;
+}
+
+// Compile a profile into a flat dispatch table. lastSent and pending hold the
+// per-type rate limit state and are reset on every compile.
+function compileProfile(profile) {
+  const normalized = normalizeProfile(profile);
+  const table = {
+    effect: new Uint8Array(HM_TYPE_COUNT),
+    intensity: new Uint8Array(HM_TYPE_COUNT),
+    minInterval: new Uint16Array(HM_TYPE_COUNT),
+    coalesce: new Uint8Array(HM_TYPE_COUNT),
+    lastSent: new Float64Array(HM_TYPE_COUNT).fill(-Infinity),
+    pending: new Array(HM_TYPE_COUNT).fill(0)
+  };
+
+  HM_TYPE_NAMES.forEach((name, type) => {
+    const entry = normalized[name];
+    table.effect[type] = entry.effect;
+    table.intensity[type] = entry.intensity;
+    table.minInterval[type] = entry.minInterval;
+    table.coalesce[type] = HM_COALESCE[entry.coalesce];
+  });
+
+  return table;
+}
+
+// Read all profiles (built-in ones merged with user-defined ones) and the name
+// of the active profile from storage.
+function loadHapticProfiles(callback) {
+  chrome.storage.local.get([HM_STORAGE_PROFILES, HM_STORAGE_ACTIVE], function (result) {
+    const profiles = Object.assign({}, HM_BUILTIN_PROFILES, result[HM_STORAGE_PROFILES] || {});
+    let active = result[HM_STORAGE_ACTIVE] || HM_DEFAULT_PROFILE;
+    if (!profiles[active]) {
+      active = HM_DEFAULT_PROFILE;
+    }
+    callback(profiles, active);
+  });
+}
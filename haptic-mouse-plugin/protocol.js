@@ -0,0 +1,278 @@
+// Haptic command protocol, version 1
+//
+// JavaScript codec for the packet format defined in
+// haptic-common/include/haptic_protocol.h; keep both in sync. A packet is a
+// 6-byte header (magic, version, type, seq, payload length, flags), the
+// payload and a CRC-16/CCITT-FALSE, little endian. COMMANDS packets carry a
+// batch of 8-byte records (op, flags, effect, intensity, actuator, reserved,
+// arg u16); with HP_PKT_FLAG_AT the records are preceded by a u32 target
+// time on the device clock (µs).
+
+const HP_MAGIC = 0xA5;
+const HP_VERSION = 1;
+
+const HP_HEADER_SIZE = 6;
+const HP_RECORD_SIZE = 8;
+const HP_CRC_SIZE = 2;
+const HP_MAX_PAYLOAD = 248;
+
+const HP_HID_REPORT_ID = 0x20;       // output report carrying one packet
+const HP_HID_CAPS_REPORT_ID = 0x21;  // feature report returning a CAPS packet
+const HP_HID_TIME_REPORT_ID = 0x22;  // feature report returning a TIME packet
+const HP_HID_TRACE_REPORT_ID = 0x23; // feature report returning a TRACE packet (tools/haptic_trace.py)
+const HP_HID_EFFECTS_REPORT_ID = 0x24; // feature report returning the next EFFECTS packet
+const HP_HID_REPORT_SIZE = 63;
+const HP_HID_MAX_RECORDS = Math.floor((HP_HID_REPORT_SIZE - HP_HEADER_SIZE - HP_CRC_SIZE) / HP_RECORD_SIZE);
+
+const HP_PKT = Object.freeze({ COMMANDS: 0x01, CAPS_QUERY: 0x02, CAPS: 0x03, STATUS: 0x04, TIME_QUERY: 0x05, TIME: 0x06,
+  TRACE_QUERY: 0x07, TRACE: 0x08, UPLOAD_BEGIN: 0x09, UPLOAD_DATA: 0x0A, UPLOAD_CHUNK: 0x0B, UPLOAD_STATUS: 0x0C,
+  EFFECTS: 0x0D });
+const HP_PKT_FLAG_ACK = 0x01;
+const HP_PKT_FLAG_AT = 0x02;
+const HP_AT_SIZE = 4;
+
+const HP_OP = Object.freeze({
+  NOP: 0x00,
+  PLAY: 0x01,
+  STOP: 0x02,
+  PATTERN_START: 0x03,
+  PATTERN_UPDATE: 0x04,
+  PATTERN_STOP: 0x05
+});
+
+const HP_REC_FLAG_QUEUE = 0x01;
+const HP_REC_FLAG_RHYTHMIC = 0x80;   // hapticd link only: scheduled at a constant lead by the daemon
+const HP_ACTUATOR_ALL = 0xFF;
+
+const HP_STATUS = Object.freeze({
+  OK: 0x00, BAD_CRC: 0x01, BAD_VERSION: 0x02, BAD_LENGTH: 0x03,
+  BAD_TYPE: 0x04, UNSUPPORTED: 0x05, BUSY: 0x06, STORAGE: 0x07, BAD_CLIP: 0x08
+});
+
+const HP_DEVICE = Object.freeze({ SPEAKER: 0x01, LRA: 0x02 });
+
+const HP_CAP = Object.freeze({ INTENSITY: 0x0001, PATTERN: 0x0002, QUEUE: 0x0004, ACK: 0x0008, SCHEDULE: 0x0010,
+  UPLOAD: 0x0020 });
+
+const HP_EFFECT_CATEGORY = Object.freeze({ CLICK: 0x00, TICK: 0x01, BUMP: 0x02, MULTI_CLICK: 0x03, BUZZ: 0x04,
+  ALERT: 0x05, PULSE: 0x06, HUM: 0x07, RAMP_UP: 0x08, RAMP_DOWN: 0x09 });
+const HP_EFFECTS_HEADER_SIZE = 2;
+const HP_EFFECT_INFO_SIZE = 4;
+const HP_HID_MAX_EFFECTS = Math.floor(
+  (HP_HID_REPORT_SIZE - HP_HEADER_SIZE - HP_CRC_SIZE - HP_EFFECTS_HEADER_SIZE) / HP_EFFECT_INFO_SIZE);
+
+const HP_CRC_TABLE = new Uint16Array([
+  0x0000, 0x1021, 0x2042, 0x3063, 0x4084, 0x50A5, 0x60C6, 0x70E7,
+  0x8108, 0x9129, 0xA14A, 0xB16B, 0xC18C, 0xD1AD, 0xE1CE, 0xF1EF
+]);
+
+// CRC-16/CCITT-FALSE (poly 0x1021, init 0xFFFF)
+function hpCrc16(bytes, length = bytes.length) {
+  let crc = 0xFFFF;
+  for (let i = 0; i < length; i++) {
+    const b = bytes[i];
+    crc = ((crc << 4) ^ HP_CRC_TABLE[(crc >> 12) ^ (b >> 4)]) & 0xFFFF;
+    crc = ((crc << 4) ^ HP_CRC_TABLE[(crc >> 12) ^ (b & 0x0F)]) & 0xFFFF;
+  }
+  return crc;
+}
+
+// Encode a packet. `payload` is a Uint8Array; `size` pads the result to a
+// fixed report size (HID) and defaults to the exact packet length.
+function hpEncodePacket(type, seq, flags, payload, size = 0) {
+  const length = HP_HEADER_SIZE + payload.length + HP_CRC_SIZE;
+  if (payload.length > HP_MAX_PAYLOAD || (size && length > size)) {
+    throw new RangeError(`haptic packet too large: ${length} bytes`);
+  }
+  const out = new Uint8Array(Math.max(size, length));
+  out[0] = HP_MAGIC;
+  out[1] = HP_VERSION;
+  out[2] = type;
+  out[3] = seq & 0xFF;
+  out[4] = payload.length;
+  out[5] = flags;
+  out.set(payload, HP_HEADER_SIZE);
+  const crc = hpCrc16(out, HP_HEADER_SIZE + payload.length);
+  out[length - 2] = crc & 0xFF;
+  out[length - 1] = crc >> 8;
+  return out;
+}
+
+// Encode command records ({ op, flags, effect, intensity, actuator, arg })
+// into a COMMANDS payload. With `at` (device µs, wrapped to 32 bits) the
+// payload starts with the target time; send it with HP_PKT_FLAG_AT.
+function hpEncodeRecords(records, at = null) {
+  const base = at === null ? 0 : HP_AT_SIZE;
+  const out = new Uint8Array(base + records.length * HP_RECORD_SIZE);
+  if (at !== null) {
+    new DataView(out.buffer).setUint32(0, at >>> 0, true);
+  }
+  records.forEach((r, i) => {
+    const o = base + i * HP_RECORD_SIZE;
+    const arg = r.arg || 0;
+    out[o] = r.op;
+    out[o + 1] = r.flags || 0;
+    out[o + 2] = r.effect || 0;
+    out[o + 3] = r.intensity === undefined ? 0xFF : r.intensity;
+    out[o + 4] = r.actuator === undefined ? HP_ACTUATOR_ALL : r.actuator;
+    out[o + 6] = arg & 0xFF;
+    out[o + 7] = (arg >> 8) & 0xFF;
+  });
+  return out;
+}
+
+// Validate a packet at offset 0 of `bytes` (trailing padding is ignored).
+// Returns { type, seq, flags, at, payload } or { error: HP_STATUS.* }. For a
+// scheduled packet `at` is the target time and `payload` holds the records
+// only; otherwise `at` is null.
+function hpDecodePacket(bytes) {
+  if (bytes.length < HP_HEADER_SIZE + HP_CRC_SIZE || bytes[0] !== HP_MAGIC) {
+    return { error: HP_STATUS.BAD_LENGTH };
+  }
+  const payloadLength = bytes[4];
+  const body = HP_HEADER_SIZE + payloadLength;
+  if (payloadLength > HP_MAX_PAYLOAD || bytes.length < body + HP_CRC_SIZE) {
+    return { error: HP_STATUS.BAD_LENGTH };
+  }
+  if ((bytes[body] | (bytes[body + 1] << 8)) !== hpCrc16(bytes, body)) {
+    return { error: HP_STATUS.BAD_CRC };
+  }
+  if (bytes[1] !== HP_VERSION) {
+    return { error: HP_STATUS.BAD_VERSION };
+  }
+  const flags = bytes[5];
+  const scheduled = (flags & HP_PKT_FLAG_AT) !== 0 && payloadLength >= HP_AT_SIZE;
+  const at = scheduled
+    ? (bytes[6] | (bytes[7] << 8) | (bytes[8] << 16) | (bytes[9] << 24)) >>> 0
+    : null;
+  return {
+    type: bytes[2],
+    seq: bytes[3],
+    flags,
+    at,
+    payload: bytes.subarray(HP_HEADER_SIZE + (scheduled ? HP_AT_SIZE : 0), body)
+  };
+}
+
+function hpDecodeRecords(payload) {
+  const records = [];
+  for (let o = 0; o + HP_RECORD_SIZE <= payload.length; o += HP_RECORD_SIZE) {
+    records.push({
+      op: payload[o],
+      flags: payload[o + 1],
+      effect: payload[o + 2],
+      intensity: payload[o + 3],
+      actuator: payload[o + 4],
+      arg: payload[o + 6] | (payload[o + 7] << 8)
+    });
+  }
+  return records;
+}
+
+function hpEncodeCaps(caps) {
+  const p = new Uint8Array(12);
+  p[0] = caps.versionMin;
+  p[1] = caps.versionMax;
+  p[2] = caps.deviceKind;
+  p[3] = caps.actuatorCount;
+  p[4] = caps.maxRecords;
+  p[5] = caps.scheduleLeadMs || 0;
+  p[6] = caps.effectCount & 0xFF;
+  p[7] = caps.effectCount >> 8;
+  p[8] = caps.features & 0xFF;
+  p[9] = caps.features >> 8;
+  p[10] = caps.minPeriodMs & 0xFF;
+  p[11] = caps.minPeriodMs >> 8;
+  return p;
+}
+
+function hpDecodeCaps(payload) {
+  if (payload.length < 12) {
+    return null;
+  }
+  return {
+    versionMin: payload[0],
+    versionMax: payload[1],
+    deviceKind: payload[2],
+    actuatorCount: payload[3],
+    maxRecords: payload[4],
+    scheduleLeadMs: payload[5],
+    effectCount: payload[6] | (payload[7] << 8),
+    features: payload[8] | (payload[9] << 8),
+    minPeriodMs: payload[10] | (payload[11] << 8)
+  };
+}
+
+// TIME payload: device clock in µs (u64) and the scheduled / late counters
+function hpEncodeTime(time) {
+  const p = new Uint8Array(12);
+  const view = new DataView(p.buffer);
+  view.setUint32(0, time.deviceUs % 0x100000000, true);
+  view.setUint32(4, Math.floor(time.deviceUs / 0x100000000), true);
+  view.setUint16(8, time.scheduled & 0xFFFF, true);
+  view.setUint16(10, time.late & 0xFFFF, true);
+  return p;
+}
+
+function hpDecodeTime(payload) {
+  if (payload.length < 12) {
+    return null;
+  }
+  const view = new DataView(payload.buffer, payload.byteOffset, payload.byteLength);
+  return {
+    deviceUs: view.getUint32(4, true) * 0x100000000 + view.getUint32(0, true),
+    scheduled: view.getUint16(8, true),
+    late: view.getUint16(10, true)
+  };
+}
+
+// EFFECTS payload: first effect ID, entry count, then per effect the nominal
+// duration (ms, u16), peak strength (%) and category; an empty list ends the
+// catalog
+function hpEncodeEffects(first, effects) {
+  const p = new Uint8Array(HP_EFFECTS_HEADER_SIZE + effects.length * HP_EFFECT_INFO_SIZE);
+  p[0] = first;
+  p[1] = effects.length;
+  effects.forEach((effect, i) => {
+    const o = HP_EFFECTS_HEADER_SIZE + i * HP_EFFECT_INFO_SIZE;
+    p[o] = effect.durationMs & 0xFF;
+    p[o + 1] = effect.durationMs >> 8;
+    p[o + 2] = effect.peak;
+    p[o + 3] = effect.category;
+  });
+  return p;
+}
+
+// Returns { first, effects: [{ id, durationMs, peak, category }] }
+function hpDecodeEffects(payload) {
+  if (payload.length < HP_EFFECTS_HEADER_SIZE) {
+    return null;
+  }
+  const first = payload[0];
+  const count = Math.min(payload[1], Math.floor((payload.length - HP_EFFECTS_HEADER_SIZE) / HP_EFFECT_INFO_SIZE));
+  const effects = [];
+  for (let i = 0; i < count; i++) {
+    const o = HP_EFFECTS_HEADER_SIZE + i * HP_EFFECT_INFO_SIZE;
+    effects.push({
+      id: first + i,
+      durationMs: payload[o] | (payload[o + 1] << 8),
+      peak: payload[o + 2],
+      category: payload[o + 3]
+    });
+  }
+  return { first, effects };
+}
+
+// Node (bench and host tools) loads this file as a module
+if (typeof module !== 'undefined') {
+  module.exports = {
+    HP_MAGIC, HP_VERSION, HP_HEADER_SIZE, HP_RECORD_SIZE, HP_CRC_SIZE, HP_MAX_PAYLOAD,
+    HP_HID_REPORT_ID, HP_HID_CAPS_REPORT_ID, HP_HID_TIME_REPORT_ID, HP_HID_TRACE_REPORT_ID, HP_HID_EFFECTS_REPORT_ID,
+    HP_HID_REPORT_SIZE, HP_HID_MAX_RECORDS, HP_HID_MAX_EFFECTS,
+    HP_PKT, HP_PKT_FLAG_ACK, HP_PKT_FLAG_AT, HP_AT_SIZE, HP_OP, HP_REC_FLAG_QUEUE, HP_REC_FLAG_RHYTHMIC,
+    HP_ACTUATOR_ALL,
+    HP_STATUS, HP_DEVICE, HP_CAP, HP_EFFECT_CATEGORY,
+    hpCrc16, hpEncodePacket, hpEncodeRecords, hpDecodePacket, hpDecodeRecords, hpEncodeCaps, hpDecodeCaps,
+    hpEncodeTime, hpDecodeTime, hpEncodeEffects, hpDecodeEffects
+  };
+}
@@ -0,0 +1,104 @@
+#!/usr/bin/env python3
+"""Drive the standard HID Haptics collection of the LRA firmware over hidraw.
+
+Talks only to the Simple Haptic Controller (hid_haptics.h), the way an OS
+haptic stack would: `info` reads the waveform and duration lists, `play`
+fires a waveform through the manual trigger, `stop` ends it. Works the same
+against the device and against the haptic_uhid.py stand-in. Without a
+device path the first hidraw node with a Simple Haptic Controller is used.
+
+Examples:
+  haptic_hid.py info
+  haptic_hid.py play click --repeat 2 --period 150
+  haptic_hid.py --hidraw /dev/hidraw3 play buzz_continuous --intensity 40
+  haptic_hid.py stop
+"""
+
+import argparse
+import fcntl
+import glob
+import os
+import sys
+import time
+
+import hid_haptics as hh
+
+# bytes a report descriptor starts a Simple Haptic Controller collection with
+CONTROLLER_COLLECTION = bytes([0x05, hh.USAGE_PAGE_HAPTICS, 0x09, hh.SIMPLE_HAPTIC_CONTROLLER, 0xA1, 0x01])
+
+
+def hidiocgfeature(length):
+    # _IOC(_IOC_WRITE | _IOC_READ, 'H', 0x07, length)
+    return (3 << 30) | (length << 16) | (ord('H') << 8) | 0x07
+
+
+def find_hidraw():
+    """First hidraw node whose report descriptor has a Simple Haptic Controller."""
+    for node in sorted(glob.glob('/sys/class/hidraw/hidraw*')):
+        try:
+            with open(os.path.join(node, 'device', 'report_descriptor'), 'rb') as f:
+                if CONTROLLER_COLLECTION in f.read():
+                    return '/dev/' + os.path.basename(node)
+        except OSError:
+            continue
+    return None
+
+
+def read_feature(fd):
+    buf = bytearray(1 + hh.FEATURE_SIZE)
+    buf[0] = hh.FEATURE_REPORT_ID
+    fcntl.ioctl(fd, hidiocgfeature(len(buf)), buf)
+    return hh.parse_feature(buf[1:])
+
+
+def cmd_info(fd, args):
+    waveforms, auto_trigger, cutoff_ms = read_feature(fd)
+    print(f'{"ordinal":>7}  {"waveform":<20} {"duration":>8}')
+    for ordinal, usage, duration_ms in waveforms:
+        duration = 'cont.' if duration_ms == 0 else f'{duration_ms} ms'
+        print(f'{ordinal:>7}  {hh.waveform_name(usage):<20} {duration:>8}')
+    print(f'auto trigger {auto_trigger}, waveform cutoff {cutoff_ms} ms')
+
+
+def cmd_play(fd, args):
+    try:
+        trigger = hh.ordinal_of(args.waveform)
+    except ValueError:
+        sys.exit(f'unknown waveform {args.waveform!r}')
+    report = bytes([hh.OUTPUT_REPORT_ID]) + hh.build_output(trigger, args.intensity, args.repeat, args.period)
+    start = time.perf_counter()
+    os.write(fd, report)
+    print(f'sent {report.hex()} in {(time.perf_counter() - start) * 1e6:.0f} µs')
+
+
+def cmd_stop(fd, args):
+    os.write(fd, bytes([hh.OUTPUT_REPORT_ID]) + hh.build_output(hh.ORDINAL_STOP, 0))
+
+
+def main():
+    parser = argparse.ArgumentParser(description=__doc__, formatter_class=argparse.RawDescriptionHelpFormatter)
+    parser.add_argument('--hidraw', metavar='PATH', help='hidraw node (default: find the haptic controller)')
+    sub = parser.add_subparsers(dest='command', required=True)
+    sub.add_parser('info', help='list the waveforms').set_defaults(func=cmd_info)
+    play = sub.add_parser('play', help='fire a waveform')
+    play.add_argument('waveform', help='name, ordinal or waveform usage: ' +
+                      ', '.join(w[1] for w in hh.WAVEFORMS))
+    play.add_argument('--intensity', type=int, default=100, choices=range(0, 101), metavar='PERCENT')
+    play.add_argument('--repeat', type=int, default=0, choices=range(0, 256), metavar='N')
+    play.add_argument('--period', type=int, default=0, metavar='MS', help='retrigger period')
+    play.set_defaults(func=cmd_play)
+    sub.add_parser('stop', help='stop the running waveform').set_defaults(func=cmd_stop)
+    args = parser.parse_args()
+
+    path = args.hidraw or find_hidraw()
+    if path is None:
+        sys.exit('no hidraw device with a Simple Haptic Controller')
+    fd = os.open(path, os.O_RDWR)
+    try:
+        args.func(fd, args)
+    finally:
+        os.close(fd)
+
+
+if __name__ == '__main__':
+    main()
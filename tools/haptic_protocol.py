@@ -0,0 +1,94 @@
+"""Host side of the haptic command protocol (haptic_protocol.h).
+
+Packet framing and the constants the tools in this directory share; the
+firmware header is the reference for the wire format.
+"""
+
+import struct
+
+HP_MAGIC = 0xA5
+HP_VERSION = 1
+HP_HEADER_SIZE = 6
+HP_RECORD_SIZE = 8
+HP_CRC_SIZE = 2
+HP_MAX_PAYLOAD = 248
+
+# hp_packet_type_t
+HP_PKT_COMMANDS = 0x01
+HP_PKT_STATUS = 0x04
+HP_PKT_TRACE_QUERY = 0x07
+HP_PKT_TRACE = 0x08
+HP_PKT_UPLOAD_BEGIN = 0x09
+HP_PKT_UPLOAD_DATA = 0x0A
+HP_PKT_UPLOAD_CHUNK = 0x0B
+HP_PKT_UPLOAD_STATUS = 0x0C
+
+# hp_status_t
+STATUS_NAMES = ['ok', 'bad_crc', 'bad_version', 'bad_length', 'bad_type',
+                'unsupported', 'busy', 'storage', 'bad_clip']
+HP_STATUS_OK = 0
+HP_STATUS_BAD_CRC = 1
+HP_STATUS_BAD_LENGTH = 3
+
+# hp_op_t
+OP_NAMES = ['nop', 'play', 'stop', 'pattern_start', 'pattern_update', 'pattern_stop']
+HP_OP_PLAY = 0x01
+HP_OP_PATTERN_START = 0x03
+HP_REC_FLAG_RHYTHMIC = 0x80     # hapticd link only
+HP_ACTUATOR_ALL = 0xFF
+
+HP_HID_REPORT_ID = 0x20
+HP_HID_TRACE_REPORT_ID = 0x23
+HP_HID_REPORT_SIZE = 63
+HP_HID_MAX_RECORDS = (HP_HID_REPORT_SIZE - HP_HEADER_SIZE - HP_CRC_SIZE) // HP_RECORD_SIZE
+HP_TRACE_HEADER_SIZE = 8
+HP_TRACE_EVENT_SIZE = 12
+
+HP_UPLOAD_CHUNK_SIZE = 4096
+HP_UPLOAD_DATA_MAX = HP_MAX_PAYLOAD - 4
+HP_UPLOAD_WINDOW = 2
+# hp_upload_phase_t
+UPLOAD_BEGUN, UPLOAD_STORED, UPLOAD_COMMITTED = range(3)
+
+
+def crc16(data):
+    """CRC-16/CCITT-FALSE, as hp_crc16()."""
+    crc = 0xFFFF
+    for b in data:
+        crc ^= b << 8
+        for _ in range(8):
+            crc = ((crc << 1) ^ 0x1021) if crc & 0x8000 else crc << 1
+            crc &= 0xFFFF
+    return crc
+
+
+def build_packet(ptype, seq=0, payload=b''):
+    body = bytes([HP_MAGIC, HP_VERSION, ptype, seq & 0xFF, len(payload), 0]) + payload
+    return body + struct.pack('<H', crc16(body))
+
+
+def pack_record(op, effect=0, intensity=255, arg=0, flags=0, actuator=HP_ACTUATOR_ALL):
+    """One 8-byte command record, as hp_packet_add_record() writes it."""
+    return struct.pack('<BBBBBxH', op, flags, effect, intensity, actuator, arg)
+
+
+def parse_packets(data):
+    """Yield (type, payload) of every valid packet in a byte stream."""
+    for ptype, payload, _ in scan_packets(data):
+        yield ptype, payload
+
+
+def scan_packets(data):
+    """Like parse_packets(), also yielding the offset just past each packet."""
+    i = 0
+    while i + HP_HEADER_SIZE + HP_CRC_SIZE <= len(data):
+        if data[i] != HP_MAGIC:
+            i += 1
+            continue
+        end = i + HP_HEADER_SIZE + data[i + 4] + HP_CRC_SIZE
+        if end <= len(data) and data[i + 1] == HP_VERSION and \
+                struct.unpack_from('<H', data, end - 2)[0] == crc16(data[i:end - 2]):
+            yield data[i + 2], bytes(data[i + HP_HEADER_SIZE:end - 2]), end
+            i = end
+        else:
+            i += 1
@@ -0,0 +1,276 @@
+#!/usr/bin/env python3
+"""Replay an interaction capture exported from the plugin popup.
+
+The content script can record every command it issues into a ring of
+12-byte records (haptic-mouse-plugin/capture.js); the popup exports it as a
+.hmct file. This tool feeds the commands back at their original spacing,
+or --speed times faster, into the firmware command path or into a host-side
+stand-in, so transport and scheduler changes can be measured against a real
+workload. Records issued within --group ms of each other share a COMMANDS
+packet, as the plugin batches them. Packets and their sequence numbers only
+depend on the capture and the options, so two runs send the same bytes.
+
+Sinks:
+  --serial PORT    speaker firmware, COMMANDS packets on the USB serial port
+  --hidraw PATH    LRA firmware or hapticd-fake, output report 0x20
+  --socket [PATH]  hapticd, bare records; scheduled records keep their
+                   rhythmic flag, so the daemon schedules them as it does
+                   for the plugin
+  --mock           no device: log every packet on the host clock
+
+Over serial and hidraw every record plays on arrival; the plugin's target
+times come from a clock sync with the device that a replay does not repeat.
+
+Examples:
+  haptic_replay.py capture.hmct --mock --speed 0
+  haptic_replay.py capture.hmct --hidraw /dev/hidraw3
+  haptic_replay.py capture.hmct --socket --speed 2
+"""
+
+import argparse
+import os
+import socket
+import struct
+import sys
+import time
+
+from haptic_protocol import (HP_HID_MAX_RECORDS, HP_HID_REPORT_ID, HP_HID_REPORT_SIZE, HP_OP_PATTERN_START,
+                             HP_OP_PLAY, HP_PKT_COMMANDS, HP_PKT_STATUS, HP_REC_FLAG_RHYTHMIC, HP_RECORD_SIZE,
+                             OP_NAMES, STATUS_NAMES, build_packet, parse_packets, scan_packets, pack_record)
+
+# capture.js
+CAPTURE_MAGIC = b'HMCT'
+CAPTURE_VERSION = 1
+CAPTURE_HEADER_SIZE = 16
+CAPTURE_RECORD_SIZE = 12
+CAPTURE_NO_TYPE = 0xFF
+CAPTURE_FLAG_SCHEDULED = 0x01
+RESULT_NAMES = ['pending', 'sent', 'no_device', 'error', 'discarded']
+RESULT_SENT = 1
+
+# HM_TYPE in profiles.js
+TYPE_NAMES = ['button_clicked', 'scroll_continuous', 'scroll_boundary', 'drag_start_end', 'drag_continuous',
+              'snap_detach', 'snap_attached', 'hover_warning', 'warning_clicked', 'text_selected', 'slider_step']
+
+SPIN_S = 0.002      # the last stretch before a deadline is busy-waited
+
+
+def read_capture(path):
+    """Return (records, overwritten); record times unwrapped to µs."""
+    with open(path, 'rb') as f:
+        data = f.read()
+    if len(data) < CAPTURE_HEADER_SIZE or data[:4] != CAPTURE_MAGIC:
+        sys.exit(f'{path}: not an interaction capture')
+    version, size, _, count, overwritten = struct.unpack_from('<BBHII', data, 4)
+    if version != CAPTURE_VERSION or size < CAPTURE_RECORD_SIZE:
+        sys.exit(f'{path}: capture version {version} is not supported')
+    count = min(count, (len(data) - CAPTURE_HEADER_SIZE) // size)
+
+    records = []
+    t = last = 0
+    for n in range(count):
+        low, ctype, op, effect, intensity, arg, flags, result = \
+            struct.unpack_from('<IBBBBHBB', data, CAPTURE_HEADER_SIZE + n * size)
+        t += (low - last) % 2**32
+        last = low
+        records.append({'t': t, 'type': ctype, 'op': op, 'effect': effect, 'intensity': intensity,
+                        'arg': arg, 'scheduled': bool(flags & CAPTURE_FLAG_SCHEDULED), 'result': result})
+    return records, overwritten
+
+
+def group_records(records, group_us, max_records):
+    """Split the records into batches: (time of the first record, records)."""
+    batches = []
+    for rec in records:
+        if batches and rec['t'] - batches[-1][0] <= group_us and len(batches[-1][1]) < max_records:
+            batches[-1][1].append(rec)
+        else:
+            batches.append((rec['t'], [rec]))
+    return batches
+
+
+def encode_records(batch, rhythmic):
+    return b''.join(pack_record(r['op'], r['effect'], r['intensity'], r['arg'],
+                                HP_REC_FLAG_RHYTHMIC if rhythmic and r['scheduled'] else 0)
+                    for r in batch)
+
+
+def describe(rec):
+    op = OP_NAMES[rec['op']] if rec['op'] < len(OP_NAMES) else f'op{rec["op"]}'
+    text = op
+    if rec['op'] in (HP_OP_PLAY, HP_OP_PATTERN_START):
+        text += f' effect {rec["effect"]}'
+    if rec['op'] != HP_OP_PLAY and rec['arg']:
+        text += f' period {rec["arg"]} ms'
+    if rec['type'] != CAPTURE_NO_TYPE:
+        text += f' ({TYPE_NAMES[rec["type"]] if rec["type"] < len(TYPE_NAMES) else rec["type"]})'
+    return text + (' [scheduled]' if rec['scheduled'] else '')
+
+
+class SerialSink:
+    """Speaker firmware: COMMANDS packets, non-OK STATUS replies counted."""
+
+    def __init__(self, port):
+        import serial  # pyserial, only needed for this transport
+
+        self.ser = serial.Serial(port, 115200, timeout=0)
+        self.ser.reset_input_buffer()
+        self.rx = bytearray()
+        self.statuses = {}
+
+    def send(self, seq, batch):
+        self.ser.write(build_packet(HP_PKT_COMMANDS, seq, encode_records(batch, False)))
+        self.drain()
+
+    def drain(self):
+        self.rx += self.ser.read(self.ser.in_waiting or 0)
+        end = 0
+        for ptype, payload, end in scan_packets(self.rx):
+            if ptype == HP_PKT_STATUS and payload:
+                name = STATUS_NAMES[payload[0]] if payload[0] < len(STATUS_NAMES) else str(payload[0])
+                self.statuses[name] = self.statuses.get(name, 0) + 1
+        del self.rx[:end]
+
+    def close(self):
+        time.sleep(0.1)
+        self.drain()
+        self.ser.close()
+        if self.statuses:
+            print('device rejected packets: ' + ', '.join(f'{n} {s}' for s, n in sorted(self.statuses.items())))
+
+
+class HidrawSink:
+    """LRA firmware or hapticd-fake: one packet per output report."""
+
+    def __init__(self, path):
+        self.fd = os.open(path, os.O_RDWR)
+
+    def send(self, seq, batch):
+        packet = build_packet(HP_PKT_COMMANDS, seq, encode_records(batch, False))
+        os.write(self.fd, bytes([HP_HID_REPORT_ID]) + packet.ljust(HP_HID_REPORT_SIZE, b'\0'))
+
+    def close(self):
+        os.close(self.fd)
+
+
+class SocketSink:
+    """hapticd: one datagram of bare records per batch."""
+
+    def __init__(self, path):
+        self.sock = socket.socket(socket.AF_UNIX, socket.SOCK_SEQPACKET)
+        try:
+            self.sock.connect(path)
+            # the daemon greets with its device's CAPS packet
+            self.sock.settimeout(1.0)
+            greeting = list(parse_packets(self.sock.recv(4096)))
+        except OSError as e:
+            sys.exit(f'{path}: {e}')
+        if not greeting:
+            sys.exit(f'{path}: no CAPS packet from hapticd')
+
+    def send(self, seq, batch):
+        self.sock.send(encode_records(batch, True))
+
+    def close(self):
+        self.sock.close()
+
+
+class MockSink:
+    """No device: log every packet with its send time."""
+
+    def __init__(self):
+        self.start = None
+
+    def send(self, seq, batch):
+        now = time.monotonic()
+        self.start = now if self.start is None else self.start
+        print(f'{(now - self.start) * 1000:10.3f} ms  #{seq:<3} ' + '; '.join(describe(r) for r in batch))
+
+    def close(self):
+        pass
+
+
+def percentile(sorted_values, p):
+    return sorted_values[min(len(sorted_values) - 1, int(p / 100 * len(sorted_values)))]
+
+
+def replay(batches, sink, speed):
+    """Send every batch at its deadline; returns (lateness, write time) in µs per batch."""
+    lateness = []
+    writes = []
+    start = time.monotonic()
+    for seq, (t_us, batch) in enumerate(batches):
+        if speed > 0:
+            deadline = start + t_us / 1e6 / speed
+            wait = deadline - time.monotonic()
+            if wait > SPIN_S:
+                time.sleep(wait - SPIN_S)
+            while time.monotonic() < deadline:
+                pass
+        else:
+            deadline = time.monotonic()
+        sent = time.monotonic()
+        sink.send(seq & 0xFF, batch)
+        done = time.monotonic()
+        lateness.append((sent - deadline) * 1e6)
+        writes.append((done - sent) * 1e6)
+    return lateness, writes
+
+
+def main():
+    parser = argparse.ArgumentParser(description=__doc__, formatter_class=argparse.RawDescriptionHelpFormatter)
+    parser.add_argument('capture', help='.hmct file exported from the plugin popup')
+    sink = parser.add_mutually_exclusive_group(required=True)
+    sink.add_argument('--serial', metavar='PORT', help='speaker firmware USB serial port')
+    sink.add_argument('--hidraw', metavar='PATH', help='LRA firmware or hapticd-fake hidraw node')
+    sink.add_argument('--socket', metavar='PATH', nargs='?',
+                      const=os.path.join(os.environ.get('XDG_RUNTIME_DIR') or '/tmp', 'hapticd.sock'),
+                      help='hapticd Unix socket (default $XDG_RUNTIME_DIR/hapticd.sock)')
+    sink.add_argument('--mock', action='store_true', help='log the packets, no device')
+    parser.add_argument('--speed', type=float, default=1.0,
+                        help='replay speed factor, 0 = back to back (default 1)')
+    parser.add_argument('--group', type=float, default=1.0,
+                        help='records this many ms apart share a packet (default 1)')
+    parser.add_argument('--all', action='store_true',
+                        help='also replay records the plugin did not send (no device, failed transfers)')
+    args = parser.parse_args()
+
+    records, overwritten = read_capture(args.capture)
+    results = {}
+    for rec in records:
+        name = RESULT_NAMES[rec['result']] if rec['result'] < len(RESULT_NAMES) else str(rec['result'])
+        results[name] = results.get(name, 0) + 1
+    print(f'{len(records)} records over {records[-1]["t"] / 1e6 if records else 0:.1f} s, '
+          f'{overwritten} overwritten before the export; ' +
+          ', '.join(f'{n} {name}' for name, n in sorted(results.items())))
+    if not args.all:
+        records = [r for r in records if r['result'] == RESULT_SENT]
+    if not records:
+        sys.exit('nothing to replay' + ('' if args.all else ' (no sent records, try --all)'))
+
+    batches = group_records(records, args.group * 1000, HP_HID_MAX_RECORDS)
+    if args.serial:
+        out = SerialSink(args.serial)
+    elif args.hidraw:
+        out = HidrawSink(args.hidraw)
+    elif args.socket:
+        out = SocketSink(args.socket)
+    else:
+        out = MockSink()
+    try:
+        lateness, writes = replay(batches, out, args.speed)
+    finally:
+        out.close()
+
+    print(f'\n{len(records)} records in {len(batches)} packets '
+          f'({len(records) * HP_RECORD_SIZE} record bytes)')
+    print(f'{"":<12}{"min":>9}{"p50":>9}{"p90":>9}{"p99":>9}{"max":>9}   (µs)')
+    for label, values in (('late', lateness), ('write', writes)):
+        values.sort()
+        print(f'{label:<12}' + ''.join(f'{v:>9.1f}' for v in (values[0], percentile(values, 50),
+                                                             percentile(values, 90), percentile(values, 99),
+                                                             values[-1])))
+
+
+if __name__ == '__main__':
+    main()
@@ -0,0 +1,265 @@
+#!/usr/bin/env python3
+"""Drain and decode the firmware stage-timestamp trace (haptic_trace.h).
+
+The firmware records a binary event each time a command passes a stage
+(USB receive, parse, queue, storage read, output, completion) and returns
+them as TRACE packets of the haptic command protocol (haptic_protocol.h).
+This tool reads the packets from a device or a saved dump, places every
+event on the esp_timer clock and prints per-stage latency histograms;
+--timeline writes a Chrome trace for chrome://tracing or ui.perfetto.dev.
+
+Examples:
+  haptic_trace.py --serial /dev/ttyACM0            # speaker firmware
+  haptic_trace.py --hidraw /dev/hidraw3 --save lra.bin
+  haptic_trace.py lra.bin --timeline lra.json
+"""
+
+import argparse
+import fcntl
+import json
+import os
+import struct
+import sys
+import time
+
+from haptic_protocol import (HP_HID_REPORT_SIZE, HP_HID_TRACE_REPORT_ID, HP_PKT_TRACE,
+                             HP_PKT_TRACE_QUERY, HP_TRACE_EVENT_SIZE, HP_TRACE_HEADER_SIZE,
+                             build_packet, parse_packets)
+
+# haptic_trace_stage_t, in pipeline order
+SYNC, USB_RX, PARSE, ENQUEUE, DEQUEUE, STORAGE, OUTPUT, DONE, DROP = range(9)
+STAGE_NAMES = ['sync', 'usb_rx', 'parse', 'enqueue', 'dequeue', 'storage', 'output', 'done', 'drop']
+TRACE_PACKET = 0xFF
+
+
+def trace_events(payload):
+    """Return (core, lost, mhz, [(cycles, arg, tag, index, stage)]) of a TRACE payload."""
+    core, count, lost, mhz = struct.unpack_from('<BBHH', payload)
+    events = [struct.unpack_from('<IIHBB', payload, HP_TRACE_HEADER_SIZE + n * HP_TRACE_EVENT_SIZE)
+              for n in range(count)
+              if HP_TRACE_HEADER_SIZE + (n + 1) * HP_TRACE_EVENT_SIZE <= len(payload)]
+    return core, lost, mhz, events
+
+
+def read_serial(port, timeout):
+    """Drain the speaker firmware: TRACE_QUERY, then TRACE packets up to the empty one."""
+    import serial  # pyserial, only needed for this transport
+
+    raw = bytearray()
+    with serial.Serial(port, 115200, timeout=0.1) as ser:
+        ser.reset_input_buffer()
+        ser.write(build_packet(HP_PKT_TRACE_QUERY))
+        deadline = time.monotonic() + timeout
+        while time.monotonic() < deadline:
+            raw += ser.read(4096)
+            traces = [p for t, p in parse_packets(raw) if t == HP_PKT_TRACE]
+            if traces and traces[-1][1] == 0:
+                break
+    return bytes(raw)
+
+
+def hidiocgfeature(length):
+    # _IOC(_IOC_WRITE | _IOC_READ, 'H', 0x07, length)
+    return (3 << 30) | (length << 16) | (ord('H') << 8) | 0x07
+
+
+def read_hidraw(path, timeout):
+    """Drain the LRA firmware: one TRACE packet per feature report read."""
+    raw = bytearray()
+    fd = os.open(path, os.O_RDWR)
+    try:
+        deadline = time.monotonic() + timeout
+        while time.monotonic() < deadline:
+            buf = bytearray(1 + HP_HID_REPORT_SIZE)
+            buf[0] = HP_HID_TRACE_REPORT_ID
+            fcntl.ioctl(fd, hidiocgfeature(len(buf)), buf)
+            packets = list(parse_packets(buf[1:]))
+            if not packets or packets[0][0] != HP_PKT_TRACE:
+                sys.exit(f'{path}: no TRACE packet in report 0x{HP_HID_TRACE_REPORT_ID:02x}')
+            raw += buf[1:]
+            if packets[0][1][1] == 0:
+                break
+    finally:
+        os.close(fd)
+    return bytes(raw)
+
+
+def decode(raw):
+    """Place all events on the esp_timer clock.
+
+    Returns (events, lost): events as dicts sorted by time in µs. Each core
+    converts cycles relative to its latest SYNC; events dumped before the
+    first SYNC of their core use the next one.
+    """
+    cores = {}
+    timeline = []
+    lost = 0
+    last_us = None
+
+    def unwrap(low):
+        nonlocal last_us
+        if last_us is None:
+            last_us = low
+        else:
+            last_us += ((low - last_us + 2**31) % 2**32) - 2**31
+        return last_us
+
+    def place(ev, core, sync, mhz):
+        cycles, arg, tag, index, stage = ev
+        delta = ((cycles - sync[0] + 2**31) % 2**32) - 2**31
+        timeline.append({'t': sync[1] + delta / mhz, 'core': core, 'stage': stage,
+                         'tag': tag, 'index': index, 'arg': arg})
+
+    for ptype, payload in parse_packets(raw):
+        if ptype != HP_PKT_TRACE or len(payload) < HP_TRACE_HEADER_SIZE:
+            continue
+        core, dropped, mhz, events = trace_events(payload)
+        lost += dropped
+        state = cores.setdefault(core, {'sync': None, 'pending': []})
+        for ev in events:
+            if ev[4] == SYNC:
+                state['sync'] = (ev[0], unwrap(ev[1]))
+                for early in state['pending']:
+                    place(early, core, state['sync'], mhz)
+                state['pending'] = []
+            elif state['sync'] is None:
+                state['pending'].append(ev)
+            else:
+                place(ev, core, state['sync'], mhz)
+
+    unplaced = sum(len(s['pending']) for s in cores.values())
+    if unplaced:
+        print(f'warning: {unplaced} events without a SYNC were skipped', file=sys.stderr)
+    timeline.sort(key=lambda e: e['t'])
+    return timeline, lost
+
+
+def build_chains(timeline):
+    """Group tagged events into one chain (stage -> time) per command.
+
+    Packet-level stages (USB_RX, PARSE) are shared by every record of their
+    packet. A tag seen again at the same or an earlier stage starts a new
+    chain, since tags wrap.
+    """
+    packets = {}
+    open_chains = {}
+    chains = []
+
+    for ev in timeline:
+        tag, stage = ev['tag'], ev['stage']
+        if tag == 0 or stage == SYNC:
+            continue
+        if ev['index'] == TRACE_PACKET:
+            if stage == USB_RX or tag not in packets:
+                packets[tag] = {}
+            packets[tag][stage] = ev['t']
+            continue
+        key = (tag, ev['index'])
+        chain = open_chains.get(key)
+        if chain is None or stage <= max(s for s in chain['stages'] if s > PARSE):
+            if chain is not None:
+                chains.append(chain)
+            chain = {'tag': tag, 'index': ev['index'], 'effect': ev['arg'] if stage == ENQUEUE else None,
+                     'stages': dict(packets.get(tag, {}))}
+            open_chains[key] = chain
+        chain['stages'][stage] = ev['t']
+        if stage in (DONE, DROP):
+            chains.append(chain)
+            del open_chains[key]
+
+    chains.extend(open_chains.values())
+    chains.sort(key=lambda c: min(c['stages'].values()))
+    return chains
+
+
+def percentile(sorted_values, p):
+    return sorted_values[min(len(sorted_values) - 1, int(p / 100 * len(sorted_values)))]
+
+
+def print_histograms(chains, out):
+    """Latency of each pair of consecutive stages, plus end to end."""
+    spans = {}
+    for chain in chains:
+        stages = sorted(s for s in chain['stages'] if s != DROP)
+        for a, b in zip(stages, stages[1:]):
+            spans.setdefault((a, b), []).append(chain['stages'][b] - chain['stages'][a])
+        if USB_RX in chain['stages'] and OUTPUT in chain['stages']:
+            spans.setdefault((USB_RX, OUTPUT), []).append(chain['stages'][OUTPUT] - chain['stages'][USB_RX])
+
+    print(f'{"stage":<22}{"n":>6}{"min":>9}{"p50":>9}{"p90":>9}{"p99":>9}{"max":>9}   (µs)', file=out)
+    for (a, b), values in sorted(spans.items(), key=lambda kv: (kv[0][1] - kv[0][0] > 1, kv[0])):
+        values.sort()
+        label = f'{STAGE_NAMES[a]} -> {STAGE_NAMES[b]}'
+        print(f'{label:<22}{len(values):>6}' +
+              ''.join(f'{v:>9.1f}' for v in (values[0], percentile(values, 50), percentile(values, 90),
+                                              percentile(values, 99), values[-1])), file=out)
+
+    for (a, b), values in sorted(spans.items()):
+        print(f'\n{STAGE_NAMES[a]} -> {STAGE_NAMES[b]}', file=out)
+        buckets = {}
+        for v in values:
+            edge = 1
+            while edge < v:
+                edge *= 2
+            buckets[edge] = buckets.get(edge, 0) + 1
+        peak = max(buckets.values())
+        for edge in sorted(buckets):
+            bar = '#' * max(1, round(40 * buckets[edge] / peak))
+            print(f'  <= {edge:>7} µs {bar} {buckets[edge]}', file=out)
+
+
+def write_timeline(timeline, chains, path):
+    """Chrome trace: one track per stage with a span per command, plus raw events per core."""
+    events = []
+    for chain in chains:
+        stages = sorted(chain['stages'])
+        name = f'#{chain["tag"]}.{chain["index"]}'
+        for a, b in zip(stages, stages[1:]):
+            events.append({'name': name, 'ph': 'X', 'pid': 1, 'tid': f'{STAGE_NAMES[a]} -> {STAGE_NAMES[b]}',
+                           'ts': chain['stages'][a], 'dur': chain['stages'][b] - chain['stages'][a],
+                           'args': {'effect': chain['effect']}})
+    for ev in timeline:
+        if ev['stage'] != SYNC:
+            events.append({'name': STAGE_NAMES[ev['stage']], 'ph': 'i', 's': 't', 'pid': 2,
+                           'tid': f'core {ev["core"]}', 'ts': ev['t'],
+                           'args': {'tag': ev['tag'], 'index': ev['index'], 'arg': ev['arg']}})
+    events.append({'name': 'process_name', 'ph': 'M', 'pid': 1, 'args': {'name': 'commands'}})
+    events.append({'name': 'process_name', 'ph': 'M', 'pid': 2, 'args': {'name': 'cores'}})
+    with open(path, 'w') as f:
+        json.dump({'traceEvents': events, 'displayTimeUnit': 'ms'}, f)
+
+
+def main():
+    parser = argparse.ArgumentParser(description=__doc__, formatter_class=argparse.RawDescriptionHelpFormatter)
+    source = parser.add_mutually_exclusive_group(required=True)
+    source.add_argument('dump', nargs='?', help='raw TRACE packets saved with --save')
+    source.add_argument('--serial', metavar='PORT', help='speaker firmware USB serial port')
+    source.add_argument('--hidraw', metavar='PATH', help='LRA firmware hidraw node')
+    parser.add_argument('--save', metavar='FILE', help='append the raw packets to FILE')
+    parser.add_argument('--timeline', metavar='FILE', help='write a Chrome trace JSON')
+    parser.add_argument('--timeout', type=float, default=5.0, help='device read timeout in s')
+    args = parser.parse_args()
+
+    if args.serial:
+        raw = read_serial(args.serial, args.timeout)
+    elif args.hidraw:
+        raw = read_hidraw(args.hidraw, args.timeout)
+    else:
+        with open(args.dump, 'rb') as f:
+            raw = f.read()
+    if args.save:
+        with open(args.save, 'ab') as f:
+            f.write(raw)
+
+    timeline, lost = decode(raw)
+    chains = build_chains(timeline)
+    drops = sum(1 for c in chains if DROP in c['stages'])
+    print(f'{len(timeline)} events, {len(chains)} commands, {drops} dropped, {lost} events lost to overrun\n')
+    if chains:
+        print_histograms(chains, sys.stdout)
+    if args.timeline:
+        write_timeline(timeline, chains, args.timeline)
+
+
+if __name__ == '__main__':
+    main()
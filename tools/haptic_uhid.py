@@ -0,0 +1,153 @@
+#!/usr/bin/env python3
+"""uhid stand-in for the LRA firmware's standard HID Haptics collection.
+
+Creates a virtual HID device through /dev/uhid with the Simple Haptic
+Controller report descriptor of hid_haptics.h, answers the waveform-list
+feature report and decodes every manual trigger the way the firmware does,
+logging the DRV2605 effects it would play. Lets haptic_hid.py and OS haptic
+clients be checked on Linux without hardware. Needs access to /dev/uhid
+(root, or a udev rule).
+
+Example:
+  sudo haptic_uhid.py &
+  haptic_hid.py play success
+"""
+
+import argparse
+import errno
+import glob
+import os
+import struct
+import sys
+import time
+
+import hid_haptics as hh
+
+# linux/uhid.h
+UHID_DESTROY = 1
+UHID_START = 2
+UHID_OUTPUT = 6
+UHID_GET_REPORT = 9
+UHID_GET_REPORT_REPLY = 10
+UHID_CREATE2 = 11
+UHID_SET_REPORT = 13
+UHID_SET_REPORT_REPLY = 14
+UHID_FEATURE_REPORT = 0
+UHID_DATA_MAX = 4096
+UHID_EVENT_SIZE = 4 + 128 + 64 + 64 + 2 + 2 + 4 * 4 + UHID_DATA_MAX    # sizeof(struct uhid_event)
+BUS_USB = 0x03
+
+NAME = 'Haptic Mouse uhid stand-in'
+ACTIONS = ['nothing', 'stop', 'play', 'continuous']
+
+
+class StandIn:
+    """Device side state: the auto trigger and a log of decoded triggers."""
+
+    def __init__(self, out):
+        self.auto_trigger = hh.ORDINAL_NONE
+        self.out = out
+        self.start = time.monotonic()
+
+    def log(self, text):
+        print(f'{(time.monotonic() - self.start) * 1e3:10.1f} ms  {text}', file=self.out, flush=True)
+
+    def get_feature(self, rnum):
+        if rnum != hh.FEATURE_REPORT_ID:
+            return None
+        return bytes([rnum]) + hh.build_feature(self.auto_trigger)
+
+    def set_feature(self, data):
+        """Return an errno for the reply."""
+        if len(data) < 1 + hh.FEATURE_SIZE or data[0] != hh.FEATURE_REPORT_ID:
+            return errno.EIO
+        auto_trigger = struct.unpack_from('<H', data, 1 + 4 * hh.WAVEFORM_COUNT)[0]
+        if not hh.ORDINAL_NONE <= auto_trigger <= hh.ORDINAL_MAX:
+            return errno.EINVAL
+        self.auto_trigger = auto_trigger
+        self.log(f'auto trigger {auto_trigger}')
+        return 0
+
+    def output(self, data):
+        if not data or data[0] != hh.OUTPUT_REPORT_ID:
+            self.log(f'ignored output report {data[:1].hex()}')
+            return
+        try:
+            action, effect, intensity, repeat, period_ms = hh.decode_output(data[1:])
+        except ValueError as e:
+            self.log(f'rejected {data.hex()}: {e}')
+            return
+        text = f'{ACTIONS[action]:<10}'
+        if action in (hh.PLAY, hh.CONTINUOUS):
+            text += f' effect {effect:3} intensity {intensity:3}'
+        if action == hh.PLAY and repeat:
+            text += f' x{1 + repeat}' + (f' every {period_ms} ms' if period_ms else ' back to back')
+        if action == hh.CONTINUOUS:
+            text += f' every {period_ms} ms, cut off after {hh.CUTOFF_MS} ms without a new trigger'
+        self.log(text.rstrip())
+
+
+def event(etype, payload=b''):
+    return (struct.pack('<I', etype) + payload).ljust(UHID_EVENT_SIZE, b'\0')
+
+
+def create2(descriptor, vendor, product):
+    return event(UHID_CREATE2, struct.pack('<128s64s64sHHIIII', NAME.encode(), b'', b'', len(descriptor),
+                                           BUS_USB, vendor, product, 0, 0) + descriptor)
+
+
+def find_hidraw():
+    for uevent in glob.glob('/sys/class/hidraw/hidraw*/device/uevent'):
+        with open(uevent) as f:
+            if f'HID_NAME={NAME}\n' in f.read():
+                return '/dev/' + uevent.split('/')[4]
+    return None
+
+
+def serve(fd, device):
+    while True:
+        ev = os.read(fd, UHID_EVENT_SIZE)
+        etype = struct.unpack_from('<I', ev)[0]
+        if etype == UHID_START:
+            # the hidraw node appears once the HID core has bound the device
+            time.sleep(0.1)
+            device.log(f'started as {find_hidraw() or "(no hidraw node)"}')
+        elif etype == UHID_OUTPUT:
+            size, _rtype = struct.unpack_from('<HB', ev, 4 + UHID_DATA_MAX)
+            device.output(ev[4:4 + size])
+        elif etype == UHID_GET_REPORT:
+            req, rnum, rtype = struct.unpack_from('<IBB', ev, 4)
+            data = device.get_feature(rnum) if rtype == UHID_FEATURE_REPORT else None
+            err = 0 if data else errno.EIO
+            os.write(fd, event(UHID_GET_REPORT_REPLY, struct.pack('<IHH', req, err, len(data or b'')) + (data or b'')))
+        elif etype == UHID_SET_REPORT:
+            req, rnum, rtype, size = struct.unpack_from('<IBBH', ev, 4)
+            data = ev[12:12 + size]
+            err = device.set_feature(data) if rtype == UHID_FEATURE_REPORT else errno.EIO
+            os.write(fd, event(UHID_SET_REPORT_REPLY, struct.pack('<IH', req, err)))
+
+
+def main():
+    parser = argparse.ArgumentParser(description=__doc__, formatter_class=argparse.RawDescriptionHelpFormatter)
+    parser.add_argument('--uhid', default='/dev/uhid', help='uhid character device')
+    parser.add_argument('--vid', type=lambda s: int(s, 0), default=0x303A, help='vendor ID (default Espressif)')
+    parser.add_argument('--pid', type=lambda s: int(s, 0), default=0x4004, help='product ID')
+    args = parser.parse_args()
+
+    try:
+        fd = os.open(args.uhid, os.O_RDWR)
+    except OSError as e:
+        sys.exit(f'{args.uhid}: {e.strerror}')
+    device = StandIn(sys.stdout)
+    os.write(fd, create2(hh.report_descriptor(), args.vid, args.pid))
+    try:
+        serve(fd, device)
+    except KeyboardInterrupt:
+        pass
+    finally:
+        os.write(fd, event(UHID_DESTROY))
+        os.close(fd)
+
+
+if __name__ == '__main__':
+    main()
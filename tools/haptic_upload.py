@@ -0,0 +1,186 @@
+#!/usr/bin/env python3
+"""Upload clips to the speaker firmware over USB serial, without reflashing.
+
+Each file is streamed as CRC-checked chunks (UPLOAD_* packets of
+haptic_protocol.h) with up to HP_UPLOAD_WINDOW chunks in flight, so the
+device writes one chunk to flash while the next arrives. A rejected chunk is
+resent from the offset the device reports. The device swaps the clip in only
+once the whole file is on flash and checks out; the clip plays with the new
+sound on the next command. Prints the throughput per clip and in total.
+
+Examples:
+  haptic_upload.py --serial /dev/ttyACM0 3 click.wav 7 thud.wav
+  haptic_upload.py --serial /dev/ttyACM0 --dir haptic-mouse-firmware/flash_data
+"""
+
+import argparse
+import os
+import re
+import struct
+import sys
+import time
+import zlib
+
+from haptic_protocol import (HP_PKT_UPLOAD_BEGIN, HP_PKT_UPLOAD_CHUNK, HP_PKT_UPLOAD_DATA,
+                             HP_PKT_UPLOAD_STATUS, HP_STATUS_BAD_CRC, HP_STATUS_BAD_LENGTH,
+                             HP_STATUS_OK, HP_UPLOAD_CHUNK_SIZE, HP_UPLOAD_DATA_MAX,
+                             HP_UPLOAD_WINDOW, STATUS_NAMES, UPLOAD_BEGUN, UPLOAD_COMMITTED,
+                             build_packet, scan_packets)
+
+RETRIES = 5
+
+
+class UploadError(Exception):
+    pass
+
+
+class Link:
+    """Serial port plus the UPLOAD_STATUS packets received on it."""
+
+    def __init__(self, port):
+        import serial  # pyserial, only needed for this transport
+
+        self.ser = serial.Serial(port, 115200, timeout=0.01)
+        self.ser.reset_input_buffer()
+        self.rx = bytearray()
+        self.seq = 0
+
+    def send(self, ptype, payload):
+        self.seq = (self.seq + 1) & 0xFF
+        self.ser.write(build_packet(ptype, self.seq, payload))
+
+    def status(self, timeout):
+        """Next UPLOAD_STATUS as (status, phase, clip, offset, elapsed_us, flash_us), or None."""
+        deadline = time.monotonic() + timeout
+        while True:
+            found = next(scan_packets(self.rx), None)
+            if found:
+                ptype, payload, end = found
+                del self.rx[:end]
+                if ptype == HP_PKT_UPLOAD_STATUS and len(payload) >= 16:
+                    return struct.unpack_from('<BBBxIII', payload)
+                continue
+            if len(self.rx) > 512:
+                # no packet in there; keep what may be the start of one
+                del self.rx[:-256]
+            if time.monotonic() >= deadline:
+                return None
+            self.rx += self.ser.read(4096)
+
+
+def send_chunk(link, data, start):
+    chunk = data[start:start + HP_UPLOAD_CHUNK_SIZE]
+    for i in range(0, len(chunk), HP_UPLOAD_DATA_MAX):
+        link.send(HP_PKT_UPLOAD_DATA, struct.pack('<I', start + i) + chunk[i:i + HP_UPLOAD_DATA_MAX])
+    link.send(HP_PKT_UPLOAD_CHUNK, struct.pack('<II', start, zlib.crc32(chunk)))
+    return start + len(chunk)
+
+
+def upload(link, clip, data, timeout):
+    """Upload one clip; returns (elapsed_us, flash_us) as measured by the device."""
+    begin = struct.pack('<B3xII', clip, len(data), zlib.crc32(data))
+    for _ in range(RETRIES):
+        # a repeated BEGIN restarts the session, so it is safe to resend
+        link.send(HP_PKT_UPLOAD_BEGIN, begin)
+        st = link.status(timeout)
+        while st is not None and (st[1] != UPLOAD_BEGUN or st[2] != clip):
+            st = link.status(timeout)    # left over from an earlier session
+        if st is not None:
+            break
+    else:
+        raise UploadError('no answer to UPLOAD_BEGIN')
+    if st[0] != HP_STATUS_OK:
+        raise UploadError(f'device refused the upload: {STATUS_NAMES[st[0]]}')
+
+    acked = 0
+    sent = 0
+    retries = 0
+    while True:
+        while sent < len(data) and sent - acked < HP_UPLOAD_WINDOW * HP_UPLOAD_CHUNK_SIZE:
+            sent = send_chunk(link, data, sent)
+
+        st = link.status(timeout)
+        if st is None:
+            # a chunk or its acknowledgement got lost; resend what is unacknowledged
+            retries += 1
+            if retries > RETRIES:
+                raise UploadError(f'no progress after {acked} bytes')
+            sent = acked
+            continue
+        status, phase, st_clip, offset, elapsed_us, flash_us = st
+        if st_clip != clip or phase == UPLOAD_BEGUN:
+            continue    # left over from an earlier session
+        if status in (HP_STATUS_BAD_CRC, HP_STATUS_BAD_LENGTH):
+            retries += 1
+            if retries > RETRIES:
+                raise UploadError(f'chunk at {offset} rejected {RETRIES} times ({STATUS_NAMES[status]})')
+            acked = sent = offset
+            continue
+        if status != HP_STATUS_OK:
+            raise UploadError(f'upload failed at {offset}: {STATUS_NAMES[status]}')
+        if offset > acked:
+            acked = offset
+            retries = 0
+        if phase == UPLOAD_COMMITTED:
+            return elapsed_us, flash_us
+
+
+def clip_files(args):
+    """[(clip, path)] from ID FILE pairs or the <id>.wav files of --dir."""
+    if args.dir:
+        names = [n for n in os.listdir(args.dir) if re.fullmatch(r'\d+\.wav', n)]
+        pairs = [(int(n[:-4]), os.path.join(args.dir, n)) for n in names]
+    else:
+        if len(args.clips) % 2:
+            sys.exit('clips are given as ID FILE pairs')
+        pairs = [(int(args.clips[i], 0), args.clips[i + 1]) for i in range(0, len(args.clips), 2)]
+    for clip, path in pairs:
+        if not 0 <= clip <= 255:
+            sys.exit(f'{path}: clip ID {clip} out of range')
+    return sorted(pairs)
+
+
+def main():
+    parser = argparse.ArgumentParser(description=__doc__, formatter_class=argparse.RawDescriptionHelpFormatter)
+    parser.add_argument('--serial', required=True, metavar='PORT', help='speaker firmware serial port')
+    parser.add_argument('--dir', help='upload every <id>.wav in this directory')
+    parser.add_argument('--timeout', type=float, default=2.0, help='seconds to wait for an acknowledgement')
+    parser.add_argument('clips', nargs='*', metavar='ID FILE', help='clip ID and WAV file, repeated')
+    args = parser.parse_args()
+
+    pairs = clip_files(args)
+    if not pairs:
+        sys.exit('nothing to upload')
+
+    link = Link(args.serial)
+    total_bytes = 0
+    total_s = 0.0
+    failed = 0
+    print(f'{"clip":>4}  {"bytes":>8}  {"time":>7}  {"KB/s":>6}  {"flash":>6}')
+    for clip, path in pairs:
+        with open(path, 'rb') as f:
+            data = f.read()
+        if data[:4] != b'RIFF' or data[8:12] != b'WAVE':
+            print(f'{clip:4}  {path}: not a WAV file', file=sys.stderr)
+            failed += 1
+            continue
+        start = time.monotonic()
+        try:
+            elapsed_us, flash_us = upload(link, clip, data, args.timeout)
+        except UploadError as e:
+            print(f'{clip:4}  {path}: {e}', file=sys.stderr)
+            failed += 1
+            continue
+        seconds = time.monotonic() - start
+        total_bytes += len(data)
+        total_s += seconds
+        # flash: share of the device-side upload time spent writing flash
+        print(f'{clip:4}  {len(data):8}  {seconds:6.2f}s  {len(data) / 1024 / seconds:6.1f}  '
+              f'{100 * flash_us / max(elapsed_us, 1):5.1f}%')
+    if total_s:
+        print(f'total {total_bytes} bytes in {total_s:.2f}s, {total_bytes / 1024 / total_s:.1f} KB/s')
+    sys.exit(1 if failed else 0)
+
+
+if __name__ == '__main__':
+    main()
@@ -0,0 +1,173 @@
+"""Host side of the standard HID Haptics collection (hid_haptics.h).
+
+Report IDs, the waveform list and the report layouts of the Simple Haptic
+Controller the LRA firmware exposes next to the command protocol; the
+firmware header is the reference for the descriptor and the wire format.
+"""
+
+import struct
+
+FEATURE_REPORT_ID = 0x30
+OUTPUT_REPORT_ID = 0x31
+
+# Haptics page usages (HUTRR63)
+USAGE_PAGE_HAPTICS = 0x0E
+USAGE_PAGE_ORDINAL = 0x0A
+SIMPLE_HAPTIC_CONTROLLER = 0x01
+WAVEFORM_LIST = 0x10
+DURATION_LIST = 0x11
+AUTO_TRIGGER = 0x20
+MANUAL_TRIGGER = 0x21
+AUTO_TRIGGER_CONTROL = 0x22
+INTENSITY = 0x23
+REPEAT_COUNT = 0x24
+RETRIGGER_PERIOD = 0x25
+WAVEFORM_CUTOFF_TIME = 0x28
+
+WAVEFORM_NONE = 0x1001
+WAVEFORM_STOP = 0x1002
+ORDINAL_NONE = 1
+ORDINAL_STOP = 2
+ORDINAL_FIRST = 3
+
+# Waveform list in ordinal order: (usage, name, DRV2605 effect, catalog
+# duration in ms, continuous), as s_waveforms in hid_haptics.c
+WAVEFORMS = [
+    (0x1003, 'click', 1, 60, False),
+    (0x1004, 'buzz_continuous', 47, 400, True),
+    (0x1005, 'rumble_continuous', 119, 400, True),
+    (0x1006, 'press', 4, 45, False),
+    (0x1007, 'release', 5, 45, False),
+    (0x1008, 'hover', 26, 30, False),
+    (0x1009, 'success', 27, 130, False),
+    (0x100A, 'error', 14, 250, False),
+]
+WAVEFORM_COUNT = len(WAVEFORMS)
+ORDINAL_MAX = ORDINAL_FIRST + WAVEFORM_COUNT - 1
+CUTOFF_MS = 2000    # HAPTIC_PATTERN_TIMEOUT_MS
+
+FEATURE_SIZE = 4 * WAVEFORM_COUNT + 8
+OUTPUT_SIZE = 6
+
+# Actions of a decoded manual trigger (hid_haptics_action_t)
+NOTHING, STOP, PLAY, CONTINUOUS = range(4)
+
+
+def _item(prefix, value=None, size=1):
+    """Short item: prefix is tag | type, size 0, 1, 2 or 3 (4 bytes) as the TinyUSB *_N macros."""
+    if value is None:
+        return bytes([prefix])
+    length = (0, 1, 2, 4)[size]
+    return bytes([prefix | size]) + (value & (2 ** (8 * length) - 1)).to_bytes(length, 'little')
+
+
+def report_descriptor():
+    """HID_HAPTICS_REPORT_DESCRIPTOR, byte for byte."""
+    page, usage, usage_min, usage_max = 0x04, 0x08, 0x18, 0x28
+    logical_min, logical_max, unit, unit_exp = 0x14, 0x24, 0x64, 0x54
+    report_size, report_count, report_id = 0x74, 0x94, 0x84
+    collection, end, output, feature = 0xA0, 0xC0, 0x90, 0xB0
+    application, logical = 1, 2
+    data_var_abs, const_var_abs = 0x02, 0x03
+    ms = [_item(unit, 0x1001, 2), _item(unit_exp, 0x0D)]
+
+    def ordinal_list(list_usage, lmin, lmax, extra):
+        return [_item(usage, list_usage), _item(collection, logical),
+                _item(page, USAGE_PAGE_ORDINAL), _item(usage_min, ORDINAL_FIRST), _item(usage_max, ORDINAL_MAX),
+                lmin, lmax, *extra, _item(report_size, 16), _item(report_count, WAVEFORM_COUNT),
+                _item(feature, data_var_abs), _item(end)]
+
+    items = [
+        _item(page, USAGE_PAGE_HAPTICS), _item(usage, SIMPLE_HAPTIC_CONTROLLER), _item(collection, application),
+        _item(report_id, FEATURE_REPORT_ID),
+        *ordinal_list(WAVEFORM_LIST, _item(logical_min, WAVEFORM_NONE, 2), _item(logical_max, 0x2FFF, 2), []),
+        _item(page, USAGE_PAGE_HAPTICS),
+        *ordinal_list(DURATION_LIST, _item(logical_min, 0), _item(logical_max, 0x7FFF, 2), ms),
+        _item(page, USAGE_PAGE_HAPTICS),
+        _item(usage, AUTO_TRIGGER), _item(logical_min, ORDINAL_NONE), _item(logical_max, ORDINAL_MAX),
+        _item(unit, 0), _item(unit_exp, 0), _item(report_size, 16), _item(report_count, 1),
+        _item(feature, data_var_abs),
+        _item(usage, AUTO_TRIGGER_CONTROL), _item(logical_min, 0), _item(logical_max, 0x7FFFFFFF, 3),
+        _item(report_size, 32), _item(feature, const_var_abs),
+        _item(usage, WAVEFORM_CUTOFF_TIME), _item(logical_max, 0x7FFF, 2), *ms, _item(report_size, 16),
+        _item(feature, const_var_abs),
+        _item(report_id, OUTPUT_REPORT_ID),
+        _item(usage, MANUAL_TRIGGER), _item(logical_min, ORDINAL_NONE), _item(logical_max, ORDINAL_MAX),
+        _item(unit, 0), _item(unit_exp, 0), _item(report_size, 16), _item(output, data_var_abs),
+        _item(usage, INTENSITY), _item(logical_min, 0), _item(logical_max, 100), _item(report_size, 8),
+        _item(output, data_var_abs),
+        _item(usage, REPEAT_COUNT), _item(logical_max, 0xFF, 2), _item(output, data_var_abs),
+        _item(usage, RETRIGGER_PERIOD), _item(logical_max, 0x7FFF, 2), *ms, _item(report_size, 16),
+        _item(output, data_var_abs),
+        _item(end),
+    ]
+    return b''.join(items)
+
+
+def waveform_name(usage):
+    names = {WAVEFORM_NONE: 'none', WAVEFORM_STOP: 'stop'}
+    names.update((w[0], w[1]) for w in WAVEFORMS)
+    return names.get(usage, f'0x{usage:04x}')
+
+
+def build_feature(auto_trigger=ORDINAL_NONE):
+    """Feature report payload (without report ID), as hid_haptics_get_feature()."""
+    usages = [w[0] for w in WAVEFORMS]
+    durations = [0 if w[4] else w[3] for w in WAVEFORMS]
+    return struct.pack(f'<{WAVEFORM_COUNT}H{WAVEFORM_COUNT}HHIH', *usages, *durations, auto_trigger, 0, CUTOFF_MS)
+
+
+def parse_feature(data):
+    """Return ([(ordinal, usage, duration_ms)], auto_trigger, cutoff_ms) of a feature report payload."""
+    if len(data) < FEATURE_SIZE:
+        raise ValueError(f'feature report is {len(data)} bytes, expected {FEATURE_SIZE}')
+    fields = struct.unpack_from(f'<{WAVEFORM_COUNT}H{WAVEFORM_COUNT}HHIH', data)
+    usages, durations = fields[:WAVEFORM_COUNT], fields[WAVEFORM_COUNT:2 * WAVEFORM_COUNT]
+    auto_trigger, _control, cutoff_ms = fields[2 * WAVEFORM_COUNT:]
+    waveforms = [(ORDINAL_FIRST + i, u, d) for i, (u, d) in enumerate(zip(usages, durations))]
+    return waveforms, auto_trigger, cutoff_ms
+
+
+def ordinal_of(name):
+    """Manual trigger value for a waveform name, ordinal or usage (0x1001 and up)."""
+    if name == 'none':
+        return ORDINAL_NONE
+    if name == 'stop':
+        return ORDINAL_STOP
+    for i, w in enumerate(WAVEFORMS):
+        if w[1] == name:
+            return ORDINAL_FIRST + i
+    return int(name, 0)
+
+
+def build_output(trigger, intensity=100, repeat=0, period_ms=0):
+    """Output report payload (without report ID)."""
+    return struct.pack('<HBBH', trigger, intensity, repeat, period_ms)
+
+
+def decode_output(data):
+    """Decode a manual trigger as hid_haptics_decode_output().
+
+    Returns (action, effect, intensity 0-255, repeat, period_ms); raises
+    ValueError where the firmware returns an error.
+    """
+    if len(data) < OUTPUT_SIZE:
+        raise ValueError(f'output report is {len(data)} bytes, expected {OUTPUT_SIZE}')
+    trigger, percent, repeat, period_ms = struct.unpack_from('<HBBH', data)
+    percent = min(percent, 100)
+    if trigger >= WAVEFORM_NONE:
+        usages = [WAVEFORM_NONE, WAVEFORM_STOP] + [w[0] for w in WAVEFORMS]
+        trigger = usages.index(trigger) + 1 if trigger in usages else 0
+    if trigger == ORDINAL_STOP:
+        return STOP, 0, 0, 0, 0
+    if trigger == ORDINAL_NONE:
+        return NOTHING, 0, 0, 0, 0
+    if not ORDINAL_FIRST <= trigger <= ORDINAL_MAX:
+        raise ValueError(f'waveform {trigger} is not in the waveform list')
+    if percent == 0:
+        return NOTHING, 0, 0, 0, 0
+    _usage, _name, effect, duration_ms, continuous = WAVEFORMS[trigger - ORDINAL_FIRST]
+    intensity = (percent * 0xFF + 50) // 100
+    if continuous:
+        return CONTINUOUS, effect, intensity, 0, period_ms or duration_ms
+    return PLAY, effect, intensity, repeat, period_ms